@@ -0,0 +1,166 @@
+/*
+* "Copyright (c) 2006 University of Southern California.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software and its
+* documentation for any purpose, without fee, and without written
+* agreement is hereby granted, provided that the above copyright
+* notice, the following two paragraphs and the author appear in all
+* copies of this software.
+*
+* IN NO EVENT SHALL THE UNIVERSITY OF SOUTHERN CALIFORNIA BE LIABLE TO
+* ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+* DAMAGES ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS
+* DOCUMENTATION, EVEN IF THE UNIVERSITY OF SOUTHERN CALIFORNIA HAS BEEN
+* ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+* THE UNIVERSITY OF SOUTHERN CALIFORNIA SPECIFICALLY DISCLAIMS ANY
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  THE SOFTWARE
+* PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND THE UNIVERSITY OF
+* SOUTHERN CALIFORNIA HAS NO OBLIGATION TO PROVIDE MAINTENANCE,
+* SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
+*
+*/
+
+/**
+ * Packet rings in memory shared by the Tenet router and a transport
+ * running on the same host.
+ *
+ * The router creates a shm_channel in a memfd for every transport that
+ * connects to its unix socket (SHM_CHANNEL_PATH), and passes the memfd
+ * and one eventfd per direction to it with SCM_RIGHTS. Each ring has
+ * one producer and one consumer. A consumer that runs out of packets
+ * sets 'sleeping' and waits on the eventfd of its ring; the producer
+ * rings the eventfd only then, so a busy consumer costs no syscalls.
+ *
+ * Both sides keep the unix socket open; it breaking tells the other
+ * side that the channel is gone.
+ **/
+
+#ifndef _SHMRING_H_
+#define _SHMRING_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __linux__
+#define USE_SHM_CHANNEL
+#include <sys/eventfd.h>
+#endif
+
+#define SHM_RING_SIZE       (256 * 1024)    /* data bytes in each direction, a power of 2 */
+#define SHM_CHANNEL_MAGIC   0x54534d43      /* "TSMC" */
+#define SHM_CHANNEL_VERSION 1
+#define SHM_CHANNEL_PATH    "/tmp/tenet_router.%d"  /* by the router port for transports */
+
+enum {
+    SHM_FD_MEMORY = 0,
+    SHM_FD_TO_TRANSPORT,    /* rung by the router */
+    SHM_FD_TO_ROUTER,       /* rung by the transport */
+    SHM_FD_COUNT
+};
+
+/* counters run freely and wrap; each record is a 16-bit length and the
+   packet, and may wrap around the end of 'data' */
+typedef struct shm_ring {
+    volatile uint32_t head __attribute__((aligned(64)));     /* written by the consumer */
+    volatile uint32_t tail __attribute__((aligned(64)));     /* written by the producer */
+    volatile uint32_t sleeping __attribute__((aligned(64))); /* consumer waits on the eventfd */
+    uint8_t data[SHM_RING_SIZE] __attribute__((aligned(64)));
+} shm_ring;
+
+typedef struct shm_channel {
+    uint32_t magic;
+    uint32_t version;
+    shm_ring to_transport;
+    shm_ring to_router;
+} shm_channel;
+
+static inline void shm_ring_init(shm_ring *r) {
+    r->head = 0;
+    r->tail = 0;
+    r->sleeping = 1;    /* nothing was read yet, so the consumer waits */
+}
+
+static inline void shm_ring_copy(shm_ring *r, uint32_t pos, void *buf, int len, int to_ring) {
+    uint32_t offset = pos & (SHM_RING_SIZE - 1);
+    uint32_t first = SHM_RING_SIZE - offset;
+
+    if (first > (uint32_t)len)
+        first = len;
+
+    if (to_ring) {
+        memcpy(r->data + offset, buf, first);
+        memcpy(r->data, (uint8_t *)buf + first, len - first);
+    } else {
+        memcpy(buf, r->data + offset, first);
+        memcpy((uint8_t *)buf + first, r->data, len - first);
+    }
+}
+
+/* producer: returns 0, or -1 if the ring has no room for the packet */
+static inline int shm_ring_write(shm_ring *r, const void *packet, int len) {
+    uint32_t tail = r->tail;
+    uint16_t l = len;
+
+    if (SHM_RING_SIZE - (tail - r->head) < sizeof(l) + len)
+        return -1;
+
+    shm_ring_copy(r, tail, &l, sizeof(l), 1);
+    shm_ring_copy(r, tail + sizeof(l), (void *)packet, len, 1);
+
+    /* publish the record before the new tail */
+    __sync_synchronize();
+    r->tail = tail + sizeof(l) + len;
+
+    return 0;
+}
+
+/* consumer: returns the length of the packet read into 'buf', or 0 if
+   the ring is empty. Longer packets are cut to 'max'. */
+static inline int shm_ring_read(shm_ring *r, void *buf, int max) {
+    uint32_t head = r->head;
+    uint16_t l;
+
+    if (head == r->tail)
+        return 0;
+
+    /* read the record only after seeing the tail */
+    __sync_synchronize();
+
+    shm_ring_copy(r, head, &l, sizeof(l), 0);
+    shm_ring_copy(r, head + sizeof(l), buf, l < max ? l : max, 0);
+
+    /* done with the record before the producer may reuse it */
+    __sync_synchronize();
+    r->head = head + sizeof(l) + l;
+
+    return l < max ? l : max;
+}
+
+#ifdef USE_SHM_CHANNEL
+/* producer: wakes the consumer up if it waits; call after writing */
+static inline void shm_ring_notify(shm_ring *r, int efd) {
+    __sync_synchronize();
+
+    if (r->sleeping && __sync_bool_compare_and_swap(&r->sleeping, 1, 0))
+        eventfd_write(efd, 1);
+}
+
+/* consumer: returns 1 if it may wait on the eventfd now, or 0 if a
+   packet came in meanwhile and it has to read again */
+static inline int shm_ring_sleep(shm_ring *r) {
+    r->sleeping = 1;
+    __sync_synchronize();
+
+    if (r->head != r->tail) {
+        r->sleeping = 0;
+        return 0;
+    }
+
+    return 1;
+}
+#endif
+
+#endif
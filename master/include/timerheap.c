@@ -0,0 +1,161 @@
+/*
+* "Copyright (c) 2006 University of Southern California.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software and its
+* documentation for any purpose, without fee, and without written
+* agreement is hereby granted, provided that the above copyright
+* notice, the following two paragraphs and the author appear in all
+* copies of this software.
+*
+* IN NO EVENT SHALL THE UNIVERSITY OF SOUTHERN CALIFORNIA BE LIABLE TO
+* ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+* DAMAGES ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS
+* DOCUMENTATION, EVEN IF THE UNIVERSITY OF SOUTHERN CALIFORNIA HAS BEEN
+* ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+* THE UNIVERSITY OF SOUTHERN CALIFORNIA SPECIFICALLY DISCLAIMS ANY
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  THE SOFTWARE
+* PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND THE UNIVERSITY OF
+* SOUTHERN CALIFORNIA HAS NO OBLIGATION TO PROVIDE MAINTENANCE,
+* SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
+*
+*/
+
+/**
+ * File for a min-heap of timers.
+ **/
+
+#include "timerheap.h"
+#include "timeval.h"
+#include <stdlib.h>
+#include <stdio.h>
+
+struct timer_heap main_timers = {NULL, 0, 0};
+
+static void swap_timers(struct timer_heap *h, int i, int j) {
+    struct timer_event *t = h->timers[i];
+    h->timers[i] = h->timers[j];
+    h->timers[j] = t;
+    h->timers[i]->index = i;
+    h->timers[j]->index = j;
+}
+
+static void sift_up(struct timer_heap *h, int i) {
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (compare_timeval(&h->timers[parent]->alarm_time, &h->timers[i]->alarm_time) <= 0)
+            break;
+        swap_timers(h, i, parent);
+        i = parent;
+    }
+}
+
+static void sift_down(struct timer_heap *h, int i) {
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= h->num_timers)
+            break;
+        if ((child + 1 < h->num_timers) &&
+                (compare_timeval(&h->timers[child + 1]->alarm_time, &h->timers[child]->alarm_time) < 0))
+            child++;
+        if (compare_timeval(&h->timers[i]->alarm_time, &h->timers[child]->alarm_time) <= 0)
+            break;
+        swap_timers(h, i, child);
+        i = child;
+    }
+}
+
+/* takes the timer at 'i' out of the heap */
+static void remove_timer(struct timer_heap *h, int i) {
+    struct timer_event *t = h->timers[i];
+    int last = --h->num_timers;
+
+    if (i != last) {
+        h->timers[i] = h->timers[last];
+        h->timers[i]->index = i;
+        sift_down(h, i);
+        sift_up(h, i);
+    }
+    t->index = -1;
+}
+
+void timer_heap_init(struct timer_heap *h) {
+    h->timers = NULL;
+    h->num_timers = 0;
+    h->max_timers = 0;
+}
+
+int timer_heap_next_ms(struct timer_heap *h) {
+    struct timeval curr, left;
+
+    if (h->num_timers == 0)
+        return -1;
+    gettimeofday(&curr, NULL);
+    if (subtract_timeval(&h->timers[0]->alarm_time, &curr, &left) < 0)
+        return 0;
+    return left.tv_sec * 1000 + (left.tv_usec + 999) / 1000;
+}
+
+int timer_heap_fire(struct timer_heap *h) {
+    struct timeval curr;
+    int limit = h->num_timers;  // a timer re-armed for 'now' waits for the next round
+    int fired = 0;
+
+    gettimeofday(&curr, NULL);
+
+    while ((fired < limit) && (h->num_timers > 0) &&
+            (compare_timeval(&h->timers[0]->alarm_time, &curr) <= 0)) {
+        struct timer_event *t = h->timers[0];
+        remove_timer(h, 0);
+        fired++;
+        t->fired(t->arg);
+    }
+    return fired;
+}
+
+void timer_init(struct timer_event *t, struct timer_heap *h, void (*fired)(void *arg), void *arg) {
+    clear_timeval(&t->alarm_time);
+    t->fired = fired;
+    t->arg = arg;
+    t->heap = h;
+    t->index = -1;
+}
+
+void timer_start(struct timer_event *t, unsigned long interval_ms) {
+    struct timer_heap *h = t->heap;
+    struct timeval curr;
+
+    gettimeofday(&curr, NULL);
+    add_ms_to_timeval(&curr, interval_ms, &t->alarm_time);
+
+    if (t->index >= 0) {    // already running, move it
+        sift_down(h, t->index);
+        sift_up(h, t->index);
+        return;
+    }
+
+    if (h->num_timers == h->max_timers) {
+        int max = h->max_timers ? 2 * h->max_timers : 64;
+        struct timer_event **timers = realloc(h->timers, max * sizeof(*timers));
+        if (!timers) {
+            fprintf(stderr, "out of memory\n");
+            exit(2);
+        }
+        h->timers = timers;
+        h->max_timers = max;
+    }
+    t->index = h->num_timers++;
+    h->timers[t->index] = t;
+    sift_up(h, t->index);
+}
+
+void timer_stop(struct timer_event *t) {
+    if (t->index >= 0)
+        remove_timer(t->heap, t->index);
+}
+
+int timer_is_running(struct timer_event *t) {
+    return (t->index >= 0);
+}
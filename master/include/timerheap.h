@@ -0,0 +1,77 @@
+/*
+* "Copyright (c) 2006 University of Southern California.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software and its
+* documentation for any purpose, without fee, and without written
+* agreement is hereby granted, provided that the above copyright
+* notice, the following two paragraphs and the author appear in all
+* copies of this software.
+*
+* IN NO EVENT SHALL THE UNIVERSITY OF SOUTHERN CALIFORNIA BE LIABLE TO
+* ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+* DAMAGES ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS
+* DOCUMENTATION, EVEN IF THE UNIVERSITY OF SOUTHERN CALIFORNIA HAS BEEN
+* ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+* THE UNIVERSITY OF SOUTHERN CALIFORNIA SPECIFICALLY DISCLAIMS ANY
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  THE SOFTWARE
+* PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND THE UNIVERSITY OF
+* SOUTHERN CALIFORNIA HAS NO OBLIGATION TO PROVIDE MAINTENANCE,
+* SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
+*
+*/
+
+/**
+ * Header file for a min-heap of timers.
+ *
+ * A timer is armed for an interval from now and, once it is due, fired
+ * by whoever runs the heap (timer_heap_fire), usually a main loop that
+ * sleeps for timer_heap_next_ms() at most. Arming, re-arming and
+ * stopping a timer are O(log n); firing takes every due timer at once.
+ * A heap belongs to one thread.
+ **/
+
+#ifndef _TIMERHEAP_H_
+#define _TIMERHEAP_H_
+
+#include <sys/time.h>
+
+struct timer_event;
+
+struct timer_heap {
+    struct timer_event **timers;
+    int num_timers;
+    int max_timers;
+};
+
+struct timer_event {
+    struct timeval alarm_time;
+    void (*fired)(void *arg);
+    void *arg;
+    struct timer_heap *heap;
+    int index;              // in heap->timers, -1 if not running
+};
+
+/* the heap of the program's main loop, which the protocol modules use */
+extern struct timer_heap main_timers;
+
+void timer_heap_init(struct timer_heap *h);
+
+/* milli-seconds until the next timer is due, 0 if one is, -1 if none is running */
+int timer_heap_next_ms(struct timer_heap *h);
+
+/* fires the timers that are due; returns how many */
+int timer_heap_fire(struct timer_heap *h);
+
+void timer_init(struct timer_event *t, struct timer_heap *h, void (*fired)(void *arg), void *arg);
+
+/* (re)starts the timer to fire once, 'interval_ms' from now */
+void timer_start(struct timer_event *t, unsigned long interval_ms);
+
+void timer_stop(struct timer_event *t);
+
+int timer_is_running(struct timer_event *t);
+
+#endif
@@ -41,6 +41,13 @@
 #include "sfsource.h"
 #include "tosmsg.h"
 
+static int writer_fd = -1;
+static int (*writer)(int fd, const void *packet, int len) = NULL;
+
+void set_TOS_Msg_writer(int fd, int (*w)(int fd, const void *packet, int len)) {
+    writer_fd = fd;
+    writer = w;
+}
 
 void fdump_packet(FILE *fptr, unsigned char *packet, int len) {
     int i;
@@ -68,7 +75,10 @@ void send_TOS_Msg(int fd, const void *data, int len, uint8_t type, uint16_t addr
     msg->type = type;
     memcpy(msg->data, data, len);
 
-    ok = write_sf_packet(fd, packet, length);
+    if (writer && fd == writer_fd)
+        ok = writer(fd, packet, length);
+    else
+        ok = write_sf_packet(fd, packet, length);
     if (ok < 0) {
         fprintf(stderr, "Note: send to socket error in tosmsg.c\n");
         exit(2);
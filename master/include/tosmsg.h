@@ -94,5 +94,11 @@ void fdump_packet(FILE *fptr, unsigned char *packet, int len);
 void send_TOS_Msg(int fd, const void *msg, int len, uint8_t type, 
                   uint16_t addr, uint8_t group);
 
+/* set_TOS_Msg_writer :
+    - makes send_TOS_Msg hand the packets for "fd" to "writer"
+      (which returns like write_sf_packet) instead of writing them
+      to the socket. */
+void set_TOS_Msg_writer(int fd, int (*writer)(int fd, const void *packet, int len));
+
 #endif
 
@@ -0,0 +1,231 @@
+/*
+* "Copyright (c) 2006 University of Southern California.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software and its
+* documentation for any purpose, without fee, and without written
+* agreement is hereby granted, provided that the above copyright
+* notice, the following two paragraphs and the author appear in all
+* copies of this software.
+*
+* IN NO EVENT SHALL THE UNIVERSITY OF SOUTHERN CALIFORNIA BE LIABLE TO
+* ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+* DAMAGES ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS
+* DOCUMENTATION, EVEN IF THE UNIVERSITY OF SOUTHERN CALIFORNIA HAS BEEN
+* ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+* THE UNIVERSITY OF SOUTHERN CALIFORNIA SPECIFICALLY DISCLAIMS ANY
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  THE SOFTWARE
+* PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND THE UNIVERSITY OF
+* SOUTHERN CALIFORNIA HAS NO OBLIGATION TO PROVIDE MAINTENANCE,
+* SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
+*
+*/
+
+/*
+* beacontest: starts a router on loopback and plays a neighbor master
+* (127.0.0.2) that sends it beacons. After each step it reads the router's
+* MRT with the debugger's "mrt" command and checks which motes are routed
+* through the neighbor: learning a whole set, deltas, a replayed beacon, a
+* whole set with a gap, a complete whole set, a new epoch, and the silence
+* that makes the router forget the neighbor.
+* Exits 1 if any step failed. The debugger port (19999) must be free.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "TenetRouter.h"
+#include "RouteBeacon.h"
+
+#define BEACON_TEST_NEIGHBOR	"127.0.0.2"
+#define BEACON_TEST_DEBUGGER	"127.0.0.3"		// the router ignores its own IP
+#define BEACON_TEST_INTERVAL	1		// sec, the router's -bi
+
+static int	s_fdNeighbor;
+static int	s_fdDebugger;
+static struct	sockaddr_in	s_addrRouter;
+
+// a beacon of the neighbor, nAdded motes then nWithdrawn motes
+static void SendBeacon(uint32_t nEpoch, uint32_t nSeq, uint8_t nFlags,
+	const uint16_t* pAdded, int nAdded, const uint16_t* pWithdrawn, int nWithdrawn)
+{
+	TR_Packet	packet;
+	TR_Beacon*	pBeacon = (TR_Beacon*) packet.pData;
+	int			i;
+
+	memset(&packet.header, 0, sizeof(packet.header));
+	packet.header.type = TR_PACKET_TYPE_BEACON;
+	packet.header.lMasterIP = inet_addr(BEACON_TEST_NEIGHBOR);
+	packet.header.nDataLength = BEACON_HEADER_LENGTH + ( nAdded + nWithdrawn ) * sizeof(uint16_t);
+
+	pBeacon->nEpoch = htonl(nEpoch);
+	pBeacon->nSeq = htonl(nSeq);
+	pBeacon->nFlags = nFlags;
+	pBeacon->nAdded = htons(nAdded);
+	pBeacon->nWithdrawn = htons(nWithdrawn);
+
+	for( i = 0 ; i < nAdded ; i++ )
+		pBeacon->pMotes[i] = htons(pAdded[i]);
+
+	for( i = 0 ; i < nWithdrawn ; i++ )
+		pBeacon->pMotes[nAdded + i] = htons(pWithdrawn[i]);
+
+	sendto(s_fdNeighbor, &packet, packet.GetTotalPacketLength(), 0,
+		(struct sockaddr*) &s_addrRouter, sizeof(s_addrRouter));
+
+	// the route thread applies it
+	usleep(100000);
+}
+
+// the motes the router routes through the neighbor, in order: "42 44"
+static void GetLearned(char* pStr)
+{
+	TR_Packet	packet;
+	MRT_Packet*	pMRT_Packet = (MRT_Packet*) packet.pData;
+	int			i;
+
+	memset(&packet.header, 0, sizeof(packet.header));
+	strcpy(packet.pData, "mrt");
+	packet.header.type = TR_PACKET_TYPE_CTRL_REQ;
+	packet.header.lMasterIP = inet_addr(BEACON_TEST_DEBUGGER);
+	packet.header.nDataLength = strlen(packet.pData) + 1;
+
+	sendto(s_fdDebugger, &packet, packet.GetTotalPacketLength(), 0,
+		(struct sockaddr*) &s_addrRouter, sizeof(s_addrRouter));
+
+	pStr[0] = '\0';
+
+	if( recv(s_fdDebugger, &packet, sizeof(packet), 0) < (int) sizeof(TR_PacketHeader) + 1 )
+	{
+		strcpy(pStr, "(no answer)");
+		return;
+	}
+
+	for( i = 0 ; i < pMRT_Packet->nEntries ; i++ )
+	{
+		if( pMRT_Packet->pEntries[i].masterIP == inet_addr(BEACON_TEST_NEIGHBOR) )
+			sprintf(pStr + strlen(pStr), "%s%d", pStr[0] ? " " : "", pMRT_Packet->pEntries[i].moteID);
+	}
+}
+
+static bool Check(const char* pName, const char* pExpected)
+{
+	char	pLearned[1024];
+	bool	bPassed;
+
+	GetLearned(pLearned);
+	bPassed = ( 0 == strcmp(pLearned, pExpected) );
+
+	MSG("%-32s %s  learned {%s}, expected {%s}\n", pName, bPassed ? "ok  " : "FAIL", pLearned, pExpected);
+
+	return bPassed;
+}
+
+int main(int argc, char** argv)
+{
+	const char*	pRouter = argc > 1 ? argv[1] : "./router";
+	char	pTransportPort[16], pRouterPort[16], pInterval[16];
+	int		nTransportPort, nRouterPort;
+	int		nFailed = 0;
+	pid_t	pid;
+	struct	sockaddr_in	addr;
+	struct	timeval	tv = { 1, 0 };
+	uint16_t	pSet[] = { 42, 43 };
+	uint16_t	p43[] = { 43 }, p44[] = { 44 }, p50[] = { 50 }, p51[] = { 51 };
+	uint16_t	p60[] = { 60 }, p61[] = { 61 };
+
+	if( argc > 2 || ( argc > 1 && '-' == argv[1][0] ) )
+	{
+		MSG("   - Usage: %s [router binary (default ./router)]\n", argv[0]);
+		exit(1);
+	}
+
+	srand(getpid());
+	nTransportPort = 20000 + rand() % 10000;
+	nRouterPort = nTransportPort + 1;
+	sprintf(pTransportPort, "%d", nTransportPort);
+	sprintf(pRouterPort, "%d", nRouterPort);
+	sprintf(pInterval, "%d", BEACON_TEST_INTERVAL);
+
+	if( 0 == ( pid = fork() ) )
+	{
+		int fdNull = open("/dev/null", O_WRONLY);
+
+		dup2(fdNull, 1);
+		dup2(fdNull, 2);
+		execl(pRouter, pRouter, "-s", "-i", "-n", "lo", "-a", "1", "-sm", "0",
+			"-bi", pInterval, "-tp", pTransportPort, "-rp", pRouterPort, (char*) NULL);
+		_exit(1);
+	}
+
+	s_addrRouter.sin_family = AF_INET;
+	s_addrRouter.sin_port = htons(nRouterPort);
+	s_addrRouter.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	bzero(&(s_addrRouter.sin_zero), 8);
+
+	addr = s_addrRouter;
+	addr.sin_port = 0;
+	addr.sin_addr.s_addr = inet_addr(BEACON_TEST_NEIGHBOR);
+	s_fdNeighbor = socket(AF_INET, SOCK_DGRAM, 0);
+
+	if( bind(s_fdNeighbor, (struct sockaddr*) &addr, sizeof(addr)) == -1 )
+	{
+		TR_ERROR("bind() failed\n");
+		exit(1);
+	}
+
+	addr.sin_port = htons(TENET_ROUTER_PORT_FOR_DEBUGGER);
+	addr.sin_addr.s_addr = inet_addr(BEACON_TEST_DEBUGGER);
+	s_fdDebugger = socket(AF_INET, SOCK_DGRAM, 0);
+
+	if( bind(s_fdDebugger, (struct sockaddr*) &addr, sizeof(addr)) == -1 )
+	{
+		TR_ERROR("bind() failed, is a debugger running?\n");
+		exit(1);
+	}
+
+	setsockopt(s_fdDebugger, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+	usleep(500000);
+
+	SendBeacon(1000, 1, BEACON_FLAG_FULL | BEACON_FLAG_FIRST | BEACON_FLAG_LAST, pSet, 2, NULL, 0);
+	nFailed += !Check("whole set", "42 43");
+
+	SendBeacon(1000, 2, 0, p44, 1, p43, 1);
+	nFailed += !Check("delta", "42 44");
+
+	SendBeacon(1000, 2, 0, p43, 1, NULL, 0);
+	nFailed += !Check("replayed beacon ignored", "42 44");
+
+	// seq 6 is lost, so the set is incomplete and must withdraw nothing
+	SendBeacon(1000, 5, BEACON_FLAG_FULL | BEACON_FLAG_FIRST, p60, 1, NULL, 0);
+	SendBeacon(1000, 7, BEACON_FLAG_FULL | BEACON_FLAG_LAST, p61, 1, NULL, 0);
+	nFailed += !Check("whole set with a gap", "42 44 60 61");
+
+	SendBeacon(1000, 8, BEACON_FLAG_FULL | BEACON_FLAG_FIRST | BEACON_FLAG_LAST, p50, 1, NULL, 0);
+	nFailed += !Check("complete whole set", "50");
+
+	// the neighbor restarted; its old routes stay until its next whole set
+	SendBeacon(2000, 1, 0, p51, 1, NULL, 0);
+	nFailed += !Check("new epoch", "50 51");
+
+	sleep(( BEACON_NEIGHBOR_LOSS + 2 ) * BEACON_TEST_INTERVAL);
+	nFailed += !Check("silent neighbor forgotten", "");
+
+	// -sm 0, so there is no channel socket to clean up
+	kill(pid, SIGKILL);
+	waitpid(pid, NULL, 0);
+
+	return nFailed ? 1 : 0;
+}
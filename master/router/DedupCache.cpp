@@ -0,0 +1,121 @@
+/*
+* "Copyright (c) 2006 University of Southern California.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software and its
+* documentation for any purpose, without fee, and without written
+* agreement is hereby granted, provided that the above copyright
+* notice, the following two paragraphs and the author appear in all
+* copies of this software.
+*
+* IN NO EVENT SHALL THE UNIVERSITY OF SOUTHERN CALIFORNIA BE LIABLE TO
+* ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+* DAMAGES ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS
+* DOCUMENTATION, EVEN IF THE UNIVERSITY OF SOUTHERN CALIFORNIA HAS BEEN
+* ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+* THE UNIVERSITY OF SOUTHERN CALIFORNIA SPECIFICALLY DISCLAIMS ANY
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  THE SOFTWARE
+* PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND THE UNIVERSITY OF
+* SOUTHERN CALIFORNIA HAS NO OBLIGATION TO PROVIDE MAINTENANCE,
+* SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
+*
+*/
+
+
+/*
+* Duplicate suppression for packets flooded between masters
+*/
+
+#include "DedupCache.h"
+#include "TenetRouter.h"
+#include "routinglayer.h"
+#include "trd.h"
+
+#include <string.h>
+#include <stddef.h>
+#include <arpa/inet.h>
+
+CDedupCache::CDedupCache(unsigned int nWindow)
+{
+	m_lWindow = nWindow * 1000UL;
+
+	memset(m_pEntries, 0, sizeof(m_pEntries));
+}
+
+CDedupCache::~CDedupCache(void)
+{
+}
+
+// origin in the top 16 bits, the AM type in the next 8, then the
+// sequence number or the payload hash; false if pMsg is not cached
+bool CDedupCache::GetKey(TOS_Msg* pMsg, uint64_t& lKey)
+{
+	uint64_t	lOrigin;
+	uint32_t	nId;
+
+	switch( pMsg->type )
+	{
+		case AM_COL_DATA:
+			lOrigin = ntohs(( (collection_header_t*) pMsg->data )->originaddr);
+			nId = (uint16_t) ntohs(( (collection_header_t*) pMsg->data )->originseqno);
+			break;
+
+		case AM_TRD_MSG:
+			lOrigin = ntohs(( (TRD_Msg*) pMsg->data )->metadata.origin);
+			nId = ntohs(( (TRD_Msg*) pMsg->data )->metadata.seqno);
+			break;
+
+		default:
+			if( 0xFFFF != ntohs(pMsg->addr) )
+				return false;
+
+			// FNV-1a
+			lOrigin = 0;
+			nId = 2166136261u;
+
+			for( int i = 0 ; i < pMsg->length && i < TOSH_DATA_LENGTH ; i++ )
+				nId = ( nId ^ pMsg->data[i] ) * 16777619u;
+
+			nId = ( nId ^ pMsg->length ) * 16777619u;
+			break;
+	}
+
+	lKey = lOrigin << 48 | (uint64_t) pMsg->type << 40 | nId;
+
+	return true;
+}
+
+bool CDedupCache::IsDuplicate(TOS_Msg* pMsg, unsigned long lNow)
+{
+	DedupEntry*	pVictim = NULL;
+	uint64_t	lKey;
+	uint32_t	nSlot;
+
+	if( !GetKey(pMsg, lKey) )
+		return false;
+
+	// spreads the keys that only differ in their sequence numbers
+	nSlot = (uint32_t) ( ( lKey * 0x9E3779B97F4A7C15ULL ) >> 32 );
+
+	for( int i = 0 ; i < DEDUP_PROBES ; i++ )
+	{
+		DedupEntry* pEntry = &m_pEntries[ ( nSlot + i ) & ( DEDUP_CACHE_SIZE - 1 ) ];
+		bool bLive = 0 != pEntry->lSeen && lNow - pEntry->lSeen < m_lWindow;
+
+		if( bLive && pEntry->lKey == lKey )
+			return true;
+
+		// the first free slot, or the oldest if there is none
+		if( NULL == pVictim
+			|| ( 0 != pVictim->lSeen && lNow - pVictim->lSeen < m_lWindow
+				&& ( !bLive || pEntry->lSeen < pVictim->lSeen ) ) )
+			pVictim = pEntry;
+	}
+
+	pVictim->lKey = lKey;
+	pVictim->lSeen = lNow;
+
+	return false;
+}
@@ -0,0 +1,73 @@
+/*
+* "Copyright (c) 2006 University of Southern California.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software and its
+* documentation for any purpose, without fee, and without written
+* agreement is hereby granted, provided that the above copyright
+* notice, the following two paragraphs and the author appear in all
+* copies of this software.
+*
+* IN NO EVENT SHALL THE UNIVERSITY OF SOUTHERN CALIFORNIA BE LIABLE TO
+* ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+* DAMAGES ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS
+* DOCUMENTATION, EVEN IF THE UNIVERSITY OF SOUTHERN CALIFORNIA HAS BEEN
+* ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+* THE UNIVERSITY OF SOUTHERN CALIFORNIA SPECIFICALLY DISCLAIMS ANY
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  THE SOFTWARE
+* PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND THE UNIVERSITY OF
+* SOUTHERN CALIFORNIA HAS NO OBLIGATION TO PROVIDE MAINTENANCE,
+* SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
+*
+*/
+
+
+/*
+* Remembers the packets routed recently, so that a packet reaching this
+* master again (flooded by several neighbors, or heard by several base
+* stations) is routed only once. A packet is known by its origin mote,
+* its AM type and its sequence number. Broadcasts of types without one
+* are known by a hash of their payload instead; unicasts of such types
+* are never taken for duplicates.
+*
+* Entries older than the window count as free, and a full run of probed
+* slots gives up its oldest entry, so the memory stays fixed whatever the
+* packet rate. Used by the route thread only.
+*/
+
+#ifndef _DEDUP_CACHE_H_
+#define _DEDUP_CACHE_H_
+
+#include <stdint.h>
+
+#include "tosmsg.h"
+
+#define DEDUP_CACHE_SIZE	8192	// slots, must be a power of 2
+#define DEDUP_PROBES		8		// slots a key may be in
+
+struct DedupEntry
+{
+	uint64_t		lKey;
+	unsigned long	lSeen;		// CMetrics::Now() when first routed, 0 for never
+};
+
+class CDedupCache
+{
+public:
+	CDedupCache(unsigned int nWindow);	// msec
+	~CDedupCache(void);
+
+	// true if pMsg was routed less than the window before lNow;
+	// remembers it otherwise
+	bool	IsDuplicate(TOS_Msg* pMsg, unsigned long lNow);
+
+private:
+	unsigned long	m_lWindow;	// usec
+	DedupEntry		m_pEntries[DEDUP_CACHE_SIZE];
+
+	static bool		GetKey(TOS_Msg* pMsg, uint64_t& lKey);
+};
+
+#endif
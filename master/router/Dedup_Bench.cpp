@@ -0,0 +1,136 @@
+/*
+* "Copyright (c) 2006 University of Southern California.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software and its
+* documentation for any purpose, without fee, and without written
+* agreement is hereby granted, provided that the above copyright
+* notice, the following two paragraphs and the author appear in all
+* copies of this software.
+*
+* IN NO EVENT SHALL THE UNIVERSITY OF SOUTHERN CALIFORNIA BE LIABLE TO
+* ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+* DAMAGES ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS
+* DOCUMENTATION, EVEN IF THE UNIVERSITY OF SOUTHERN CALIFORNIA HAS BEEN
+* ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+* THE UNIVERSITY OF SOUTHERN CALIFORNIA SPECIFICALLY DISCLAIMS ANY
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  THE SOFTWARE
+* PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND THE UNIVERSITY OF
+* SOUTHERN CALIFORNIA HAS NO OBLIGATION TO PROVIDE MAINTENANCE,
+* SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
+*
+*/
+
+/*
+* dedupbench: the cost of CDedupCache::IsDuplicate() and whether it finds
+* the copies of a flood. Every packet arrives DEDUP_BENCH_COPIES times, as
+* if relayed by that many neighbors, one microsecond apart:
+*   col       : COL data of DEDUP_BENCH_ORIGINS motes, keyed on origin/seqno
+*   broadcast : broadcasts without a sequence number, keyed on a payload hash
+*   unicast   : unicasts without a sequence number, never duplicates
+* Exits 1 if a case found a different number of duplicates than it should.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <arpa/inet.h>
+
+#include "DedupCache.h"
+#include "TR_Common.h"
+#include "routinglayer.h"
+
+#define DEDUP_BENCH_PACKETS	2000000		// distinct packets per case
+#define DEDUP_BENCH_COPIES	3
+#define DEDUP_BENCH_ORIGINS	200
+#define DEDUP_BENCH_WINDOW	1000		// msec, the router's default
+
+enum
+{
+	DEDUP_BENCH_COL,
+	DEDUP_BENCH_BROADCAST,
+	DEDUP_BENCH_UNICAST
+};
+
+static double Now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static bool Run(const char* pName, int nCase, long nExpected)
+{
+	CDedupCache*	pDedup = new CDedupCache(DEDUP_BENCH_WINDOW);
+	TOS_Msg			msg;
+	collection_header_t*	pHeader = (collection_header_t*) msg.data;
+	unsigned long	lNow = 1;
+	long			nDuplicates = 0;
+	double			dStart, dTime;
+	int				i, j;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.length = 20;
+
+	switch( nCase )
+	{
+		case DEDUP_BENCH_COL:
+			msg.type = AM_COL_DATA;
+			msg.addr = htons(1);
+			break;
+
+		case DEDUP_BENCH_BROADCAST:
+			msg.type = 5;
+			msg.addr = htons(0xFFFF);
+			break;
+
+		case DEDUP_BENCH_UNICAST:
+			msg.type = 5;
+			msg.addr = htons(1);
+			break;
+	}
+
+	dStart = Now();
+
+	for( i = 0 ; i < DEDUP_BENCH_PACKETS ; i++ )
+	{
+		if( DEDUP_BENCH_COL == nCase )
+		{
+			pHeader->originaddr = htons(i % DEDUP_BENCH_ORIGINS);
+			pHeader->originseqno = htons(i / DEDUP_BENCH_ORIGINS);
+		}
+		else
+		{
+			memcpy(msg.data, &i, sizeof(i));
+		}
+
+		for( j = 0 ; j < DEDUP_BENCH_COPIES ; j++ )
+			nDuplicates += pDedup->IsDuplicate(&msg, lNow++);
+	}
+
+	dTime = Now() - dStart;
+
+	MSG("%-10s %.1f ns per lookup, %ld duplicates of %d (expected %ld)\n",
+		pName, dTime * 1e9 / ( DEDUP_BENCH_PACKETS * DEDUP_BENCH_COPIES ),
+		nDuplicates, DEDUP_BENCH_PACKETS * DEDUP_BENCH_COPIES, nExpected);
+
+	delete pDedup;
+
+	return nDuplicates == nExpected;
+}
+
+int main(int argc, char** argv)
+{
+	long	nCopies = (long) DEDUP_BENCH_PACKETS * ( DEDUP_BENCH_COPIES - 1 );
+	int		nFailed = 0;
+
+	nFailed += !Run("col", DEDUP_BENCH_COL, nCopies);
+	nFailed += !Run("broadcast", DEDUP_BENCH_BROADCAST, nCopies);
+	nFailed += !Run("unicast", DEDUP_BENCH_UNICAST, 0);
+
+	return nFailed ? 1 : 0;
+}
@@ -0,0 +1,335 @@
+/*
+* "Copyright (c) 2006 University of Southern California.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software and its
+* documentation for any purpose, without fee, and without written
+* agreement is hereby granted, provided that the above copyright
+* notice, the following two paragraphs and the author appear in all
+* copies of this software.
+*
+* IN NO EVENT SHALL THE UNIVERSITY OF SOUTHERN CALIFORNIA BE LIABLE TO
+* ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+* DAMAGES ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS
+* DOCUMENTATION, EVEN IF THE UNIVERSITY OF SOUTHERN CALIFORNIA HAS BEEN
+* ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+* THE UNIVERSITY OF SOUTHERN CALIFORNIA SPECIFICALLY DISCLAIMS ANY
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  THE SOFTWARE
+* PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND THE UNIVERSITY OF
+* SOUTHERN CALIFORNIA HAS NO OBLIGATION TO PROVIDE MAINTENANCE,
+* SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
+*
+*/
+
+/*
+* Per next hop egress queues of the Tenet router
+*/
+
+#include "TenetRouter.h"
+#include "EgressShaper.h"
+#include "TR_Common.h"
+#include "Metrics.h"
+
+#include "routinglayer.h"
+#include "trd.h"
+
+#include <stddef.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#define EGRESS_TOKEN	1000000ULL		// one packet worth of tokens
+
+CEgressShaper::CEgressShaper(unsigned int nMoteRate, unsigned int nMoteBurst,
+	unsigned int nNeighborRate, unsigned int nNeighborBurst)
+{
+	m_nMoteRate = nMoteRate;
+	m_nMoteBurst = nMoteBurst > 0 ? nMoteBurst : 1;
+	m_nNeighborRate = nNeighborRate;
+	m_nNeighborBurst = nNeighborBurst > 0 ? nNeighborBurst : 1;
+
+	memset(m_pHops, 0, sizeof(m_pHops));
+	m_nNextHop = 0;
+	m_nBacklog = 0;
+	m_nDrops = 0;
+
+	if( NULL == ( m_pPool = (TR_EgressJob*) malloc(EGRESS_POOL_SIZE * sizeof(TR_EgressJob)) ) )
+	{
+		TR_ERROR("malloc() failed\n");
+		exit(1);
+	}
+
+	for( m_nFree = 0 ; m_nFree < EGRESS_POOL_SIZE ; m_nFree++ )
+		m_pFree[m_nFree] = &m_pPool[m_nFree];
+}
+
+CEgressShaper::~CEgressShaper(void)
+{
+	free(m_pPool);
+}
+
+int CEgressShaper::Classify(TR_EgressJob* pJob)
+{
+	TOS_Msg* pMsg = (TOS_Msg*) pJob->pData;
+
+	// only a TOSMSG frame to a neighbor carries a TOS_Msg
+	if( EGRESS_TO_NEIGHBOR == pJob->nType )
+	{
+		switch( pJob->header.type )
+		{
+			case TR_PACKET_TYPE_TOSMSG:
+				pMsg = (TOS_Msg*) pJob->pMsg;
+				break;
+
+			case TR_PACKET_TYPE_BEACON:
+				return EGRESS_CLASS_CONTROL;
+
+			default:
+				return EGRESS_CLASS_TASK;
+		}
+	}
+
+	switch( pMsg->type )
+	{
+		case AM_TRD_CONTROL:
+			return EGRESS_CLASS_CONTROL;
+
+		case AM_COL_DATA:
+			if( ( ( (collection_header_t*) pMsg->data )->protocol & PROTOCOL_MASK ) == PROTOCOL_RCR_TRANSPORT )
+				return EGRESS_CLASS_BULK;
+			break;
+	}
+
+	return EGRESS_CLASS_TASK;
+}
+
+unsigned long long CEgressShaper::GetBurst(EgressHop* pHop)
+{
+	return ( EGRESS_IS_MOTE_HOP(pHop->nIP) ? m_nMoteBurst : m_nNeighborBurst ) * EGRESS_TOKEN;
+}
+
+// an idle hop is recycled when the table is full
+EgressHop* CEgressShaper::GetHop(uint32_t nHop)
+{
+	EgressHop* pFree = NULL;
+	EgressHop* pIdle = NULL;
+
+	for( int i = 0 ; i < MAX_EGRESS_HOPS ; i++ )
+	{
+		EgressHop* pHop = &m_pHops[i];
+
+		if( !pHop->bUsed )
+		{
+			if( NULL == pFree )
+				pFree = pHop;
+		}
+		else if( pHop->nIP == nHop )
+		{
+			return pHop;
+		}
+		else if( NULL == pIdle && 0 == pHop->GetDepth() )
+		{
+			pIdle = pHop;
+		}
+	}
+
+	if( NULL == pFree && NULL == ( pFree = pIdle ) )
+		return NULL;
+
+	memset(pFree, 0, sizeof(EgressHop));
+	pFree->bUsed = true;
+	pFree->nIP = nHop;
+	pFree->lTokens = GetBurst(pFree);
+	clock_gettime(CLOCK_MONOTONIC, &pFree->timeFilled);
+
+	return pFree;
+}
+
+void CEgressShaper::Fill(EgressHop* pHop, struct timespec* pNow)
+{
+	unsigned int nRate = EGRESS_IS_MOTE_HOP(pHop->nIP) ? m_nMoteRate : m_nNeighborRate;
+	long long lElapsed = ( pNow->tv_sec - pHop->timeFilled.tv_sec ) * 1000000LL
+		+ ( pNow->tv_nsec - pHop->timeFilled.tv_nsec ) / 1000;
+
+	if( lElapsed <= 0 )
+		return;
+
+	pHop->timeFilled = *pNow;
+
+	if( 0 == nRate || ( pHop->lTokens += lElapsed * nRate ) > GetBurst(pHop) )
+		pHop->lTokens = GetBurst(pHop);
+}
+
+bool CEgressShaper::Enqueue(uint32_t nHop, TR_EgressJob* pJob)
+{
+	EgressHop* pHop;
+	TR_EgressJob* pCopy;
+	char* pMsg = EGRESS_TO_NEIGHBOR == pJob->nType ? pJob->pMsg : pJob->pData;
+	int nClass = Classify(pJob);
+
+	if( NULL == ( pHop = GetHop(nHop) ) || 0 == m_nFree )
+	{
+		m_nDrops++;
+		CMetrics::Count(METRIC_DROP_NEXT_HOP_FULL);
+		return false;
+	}
+
+	if( pHop->GetDepth(nClass) >= EGRESS_HOP_QUEUE_LEN )
+	{
+		pHop->pDrops[nClass]++;
+		CMetrics::Count(METRIC_DROP_NEXT_HOP_FULL);
+		return false;
+	}
+
+	pCopy = m_pFree[--m_nFree];
+
+	memcpy(pCopy, pJob, offsetof(TR_EgressJob, pData));
+	memcpy(pCopy->pData, pMsg, pJob->nLen);
+	pCopy->pMsg = pCopy->pData;
+
+	pHop->pQueue[nClass][ pHop->pTail[nClass]++ & (EGRESS_HOP_QUEUE_LEN - 1) ] = pCopy;
+	m_nBacklog++;
+	CMetrics::Add(METRIC_QUEUE_SHAPED, 1);
+
+	return true;
+}
+
+TR_EgressJob* CEgressShaper::Dequeue(void)
+{
+	struct timespec timeNow;
+
+	if( 0 == m_nBacklog )
+		return NULL;
+
+	clock_gettime(CLOCK_MONOTONIC, &timeNow);
+
+	for( int i = 0 ; i < MAX_EGRESS_HOPS ; i++ )
+	{
+		EgressHop* pHop = &m_pHops[ ( m_nNextHop + i ) % MAX_EGRESS_HOPS ];
+
+		if( !pHop->bUsed || 0 == pHop->GetDepth() )
+			continue;
+
+		Fill(pHop, &timeNow);
+
+		if( pHop->lTokens < EGRESS_TOKEN )
+			continue;
+
+		for( int nClass = 0 ; nClass < EGRESS_CLASSES ; nClass++ )
+		{
+			if( 0 == pHop->GetDepth(nClass) )
+				continue;
+
+			pHop->lTokens -= EGRESS_TOKEN;
+			pHop->nSent++;
+			m_nBacklog--;
+			CMetrics::Add(METRIC_QUEUE_SHAPED, -1);
+
+			// the next call starts with the following hop
+			m_nNextHop = ( m_nNextHop + i + 1 ) % MAX_EGRESS_HOPS;
+
+			return pHop->pQueue[nClass][ pHop->pHead[nClass]++ & (EGRESS_HOP_QUEUE_LEN - 1) ];
+		}
+	}
+
+	return NULL;
+}
+
+void CEgressShaper::Release(TR_EgressJob* pJob)
+{
+	m_pFree[m_nFree++] = pJob;
+}
+
+long CEgressShaper::GetDelay(void)
+{
+	struct timespec timeNow;
+	long lDelay = -1;
+
+	if( 0 == m_nBacklog )
+		return -1;
+
+	clock_gettime(CLOCK_MONOTONIC, &timeNow);
+
+	for( int i = 0 ; i < MAX_EGRESS_HOPS ; i++ )
+	{
+		EgressHop* pHop = &m_pHops[i];
+		unsigned int nRate = EGRESS_IS_MOTE_HOP(pHop->nIP) ? m_nMoteRate : m_nNeighborRate;
+		long lHop = 0;
+
+		if( !pHop->bUsed || 0 == pHop->GetDepth() )
+			continue;
+
+		Fill(pHop, &timeNow);
+
+		if( pHop->lTokens < EGRESS_TOKEN && nRate > 0 )
+			lHop = (long) ( ( EGRESS_TOKEN - pHop->lTokens + nRate - 1 ) / nRate );
+
+		if( lDelay < 0 || lHop < lDelay )
+			lDelay = lHop;
+	}
+
+	return lDelay;
+}
+
+// called by the egress thread, for the debugger's "egress" command
+int CEgressShaper::MakeEGRESS_Packet(EGRESS_Packet* pPacket)
+{
+	pPacket->nDrops = m_nDrops;
+	pPacket->nHops = 0;
+
+	for( int i = 0 ; i < MAX_EGRESS_HOPS ; i++ )
+	{
+		EgressHop* pHop = &m_pHops[i];
+		EGRESS_HopEntry* pEntry;
+
+		if( !pHop->bUsed )
+			continue;
+
+		pEntry = &pPacket->pHops[ pPacket->nHops++ ];
+		pEntry->nIP = pHop->nIP;
+		pEntry->nSent = pHop->nSent;
+
+		for( int nClass = 0 ; nClass < EGRESS_CLASSES ; nClass++ )
+		{
+			pEntry->pDepth[nClass] = pHop->GetDepth(nClass);
+			pEntry->pDrops[nClass] = pHop->pDrops[nClass];
+		}
+	}
+
+	return pPacket->GetEGRESS_PacketLength();
+}
+
+void CEgressShaper::Show(EGRESS_Packet* pPacket)
+{
+	MSG ("         NextHop    Depth(c/t/b)           Drops(c/t/b)       Sent\n");
+	MSG ("--------------------------------------------------\n");
+
+	for( int i = 0 ; i < pPacket->nHops ; i++ )
+	{
+		EGRESS_HopEntry* pEntry = &pPacket->pHops[i];
+		struct in_addr in;
+
+		in.s_addr = pEntry->nIP;
+
+		if( EGRESS_IS_MOTE_HOP(pEntry->nIP) )
+		{
+			MSG("           mote %u", pEntry->nIP);
+		}
+		else
+		{
+			MSG(" %16s", inet_ntoa( in ));
+		}
+
+		MSG("  %4u/%4u/%4u  %6u/%6u/%6u %10u \n",
+			pEntry->pDepth[EGRESS_CLASS_CONTROL], pEntry->pDepth[EGRESS_CLASS_TASK], pEntry->pDepth[EGRESS_CLASS_BULK],
+			pEntry->pDrops[EGRESS_CLASS_CONTROL], pEntry->pDrops[EGRESS_CLASS_TASK], pEntry->pDrops[EGRESS_CLASS_BULK],
+			pEntry->nSent
+			);
+	}
+
+	MSG ("--------------------------------------------------\n");
+	MSG (" egress queue depth %u, %u drops \n", pPacket->nQueueDepth, pPacket->nQueueDrops );
+	MSG (" %u drops without a free hop or job \n", pPacket->nDrops );
+	MSG ("--------------------------------------------------\n");
+}
@@ -0,0 +1,165 @@
+/*
+* "Copyright (c) 2006 University of Southern California.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software and its
+* documentation for any purpose, without fee, and without written
+* agreement is hereby granted, provided that the above copyright
+* notice, the following two paragraphs and the author appear in all
+* copies of this software.
+*
+* IN NO EVENT SHALL THE UNIVERSITY OF SOUTHERN CALIFORNIA BE LIABLE TO
+* ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+* DAMAGES ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS
+* DOCUMENTATION, EVEN IF THE UNIVERSITY OF SOUTHERN CALIFORNIA HAS BEEN
+* ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+* THE UNIVERSITY OF SOUTHERN CALIFORNIA SPECIFICALLY DISCLAIMS ANY
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  THE SOFTWARE
+* PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND THE UNIVERSITY OF
+* SOUTHERN CALIFORNIA HAS NO OBLIGATION TO PROVIDE MAINTENANCE,
+* SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
+*
+*/
+
+/*
+* Per next hop egress queues of the Tenet router
+*
+* A packet for a shaped link (the base station mote, or the neighbors
+* when a rate is configured for them) is not sent right away but queued
+* on its next hop, in one of three priority classes. Each hop drains its
+* highest class first, as fast as its token bucket allows; a full class
+* drops the new packet. Everything here runs on the egress thread, even
+* the snapshot for the debugger (MakeEGRESS_Packet); drops and the
+* backlog are also counted into the egress thread's CMetrics shard.
+*/
+
+#ifndef _EGRESS_SHAPER_H_
+#define _EGRESS_SHAPER_H_
+
+#include <stdint.h>
+#include "TR_Common.h"
+#include <time.h>
+
+#define MAX_EGRESS_HOPS			32
+#define EGRESS_HOP_QUEUE_LEN	32		// per class, must be a power of 2
+#define EGRESS_POOL_SIZE		512
+
+// hops 0 .. MAX_BASE_STATIONS-1 are the base station motes, by their index
+// in the router; never a neighbor's IP
+#define EGRESS_IS_MOTE_HOP(nHop)	( (nHop) < MAX_BASE_STATIONS )
+
+enum
+{
+	EGRESS_CLASS_CONTROL = 0,	// TRD control and route beacons
+	EGRESS_CLASS_TASK = 1,		// tasks and everything else
+	EGRESS_CLASS_BULK = 2,		// RCRT data
+	EGRESS_CLASSES = 3
+};
+
+struct TR_EgressJob;
+
+struct EgressHop
+{
+	uint32_t		nIP;				// the base station for a mote hop
+	bool			bUsed;
+
+	// token bucket, in millionths of a packet
+	unsigned long long	lTokens;
+	struct timespec	timeFilled;
+
+	TR_EgressJob*	pQueue[EGRESS_CLASSES][EGRESS_HOP_QUEUE_LEN];
+	unsigned int	pHead[EGRESS_CLASSES];
+	unsigned int	pTail[EGRESS_CLASSES];
+
+	unsigned long	nSent;
+	unsigned long	pDrops[EGRESS_CLASSES];
+
+	unsigned int	GetDepth(int nClass)
+	{
+		return pTail[nClass] - pHead[nClass];
+	}
+
+	unsigned int	GetDepth(void)
+	{
+		return GetDepth(EGRESS_CLASS_CONTROL) + GetDepth(EGRESS_CLASS_TASK) + GetDepth(EGRESS_CLASS_BULK);
+	}
+};
+
+struct EGRESS_HopEntry
+{
+	uint32_t	nIP;
+	uint16_t	pDepth[EGRESS_CLASSES];
+	uint32_t	pDrops[EGRESS_CLASSES];
+	uint32_t	nSent;
+}__attribute__((packed));
+
+struct EGRESS_Packet
+{
+	uint32_t	nQueueDepth;	// egress queue between the route and egress threads
+	uint32_t	nQueueDrops;
+	uint32_t	nDrops;			// no free hop or job
+	unsigned char	nHops;
+	struct EGRESS_HopEntry	pHops[MAX_EGRESS_HOPS];
+
+	int GetEGRESS_PacketLength()
+	{
+		return nHops * sizeof(EGRESS_HopEntry) + 3 * sizeof(uint32_t) + sizeof(unsigned char);
+	}
+}__attribute__((packed));// just for debugging purpose
+
+class CEgressShaper
+{
+public:
+	// nRate in packets per second, 0 leaves the link unshaped
+	CEgressShaper(unsigned int nMoteRate, unsigned int nMoteBurst,
+		unsigned int nNeighborRate, unsigned int nNeighborBurst);
+	~CEgressShaper(void);
+
+	bool	IsShaped(uint32_t nHop)
+	{
+		return 0 != ( EGRESS_IS_MOTE_HOP(nHop) ? m_nMoteRate : m_nNeighborRate );
+	}
+
+	bool	IsEmpty(void)
+	{
+		return 0 == m_nBacklog;
+	}
+
+	// copies pJob onto the queue of nHop; false if it was dropped
+	bool	Enqueue(uint32_t nHop, TR_EgressJob* pJob);
+
+	// the next job allowed to leave, NULL if none is; give it back with Release()
+	TR_EgressJob*	Dequeue(void);
+	void	Release(TR_EgressJob* pJob);
+
+	// microseconds until Dequeue() can return a job again
+	long	GetDelay(void);
+
+	int		MakeEGRESS_Packet(EGRESS_Packet* pPacket);
+	static void	Show(EGRESS_Packet* pPacket);
+
+	static int	Classify(TR_EgressJob* pJob);
+
+private:
+	unsigned int	m_nMoteRate;
+	unsigned int	m_nMoteBurst;
+	unsigned int	m_nNeighborRate;
+	unsigned int	m_nNeighborBurst;
+
+	EgressHop		m_pHops[MAX_EGRESS_HOPS];
+	int				m_nNextHop;		// round robin over the hops
+	unsigned int	m_nBacklog;
+	unsigned long	m_nDrops;			// no free hop or job
+
+	TR_EgressJob*	m_pPool;
+	TR_EgressJob*	m_pFree[EGRESS_POOL_SIZE];
+	int				m_nFree;
+
+	EgressHop*	GetHop(uint32_t nHop);
+	void		Fill(EgressHop* pHop, struct timespec* pNow);
+	unsigned long long	GetBurst(EgressHop* pHop);
+};
+
+#endif
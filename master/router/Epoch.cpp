@@ -0,0 +1,135 @@
+/*
+* "Copyright (c) 2006 University of Southern California.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software and its
+* documentation for any purpose, without fee, and without written
+* agreement is hereby granted, provided that the above copyright
+* notice, the following two paragraphs and the author appear in all
+* copies of this software.
+*
+* IN NO EVENT SHALL THE UNIVERSITY OF SOUTHERN CALIFORNIA BE LIABLE TO
+* ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+* DAMAGES ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS
+* DOCUMENTATION, EVEN IF THE UNIVERSITY OF SOUTHERN CALIFORNIA HAS BEEN
+* ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+* THE UNIVERSITY OF SOUTHERN CALIFORNIA SPECIFICALLY DISCLAIMS ANY
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  THE SOFTWARE
+* PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND THE UNIVERSITY OF
+* SOUTHERN CALIFORNIA HAS NO OBLIGATION TO PROVIDE MAINTENANCE,
+* SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
+*
+*/
+
+/*
+* Epoch based reclamation for the read-mostly routing tables
+*/
+
+#include <stdlib.h>
+#include "Epoch.h"
+#include "TR_Common.h"
+
+volatile unsigned long CEpoch::s_pReaders[MAX_EPOCH_THREADS];
+volatile unsigned long CEpoch::s_nEpoch = 1;
+int CEpoch::s_nSlots;
+
+__thread int CEpoch::t_nSlot = -1;
+__thread int CEpoch::t_nDepth;
+
+EpochRetiredList CEpoch::s_listRetired;
+pthread_mutex_t CEpoch::s_lockRetired = PTHREAD_MUTEX_INITIALIZER;
+
+int CEpoch::GetSlot(void)
+{
+	if( t_nSlot < 0 )
+	{
+		t_nSlot = __sync_fetch_and_add(&s_nSlots, 1);
+
+		if( t_nSlot >= MAX_EPOCH_THREADS )
+		{
+			TR_ERROR("too many reader threads\n");
+			exit(1);
+		}
+	}
+
+	return t_nSlot;
+}
+
+void CEpoch::Enter(void)
+{
+	if( t_nDepth++ )
+		return;
+
+	s_pReaders[GetSlot()] = s_nEpoch;
+
+	// the announcement has to be visible before we load any table pointer
+	__sync_synchronize();
+}
+
+void CEpoch::Leave(void)
+{
+	if( --t_nDepth )
+		return;
+
+	__sync_synchronize();
+
+	s_pReaders[t_nSlot] = 0;
+}
+
+void CEpoch::Retire(void* pData)
+{
+	EpochRetired retired;
+
+	// the caller has already swapped the pointer, so readers entering from
+	// here on cannot reach pData
+	__sync_synchronize();
+
+	pthread_mutex_lock(&s_lockRetired);
+
+	retired.pData = pData;
+	retired.nEpoch = __sync_fetch_and_add(&s_nEpoch, 1);
+
+	s_listRetired.push_back(retired);
+
+	pthread_mutex_unlock(&s_lockRetired);
+
+	Reclaim();
+}
+
+void CEpoch::Reclaim(void)
+{
+	unsigned long nOldest = (unsigned long) -1;
+	int nSlots = s_nSlots < MAX_EPOCH_THREADS ? s_nSlots : MAX_EPOCH_THREADS;
+
+	__sync_synchronize();
+
+	for( int i = 0 ; i < nSlots ; i++ )
+	{
+		unsigned long nEpoch = s_pReaders[i];
+
+		if( nEpoch && nEpoch < nOldest )
+			nOldest = nEpoch;
+	}
+
+	pthread_mutex_lock(&s_lockRetired);
+
+	// anything retired before the oldest reader entered is unreachable
+	EpochRetiredList::iterator iter = s_listRetired.begin();
+
+	while( iter != s_listRetired.end() )
+	{
+		if( iter->nEpoch < nOldest )
+		{
+			free(iter->pData);
+			iter = s_listRetired.erase(iter);
+		}
+		else
+		{
+			iter++;
+		}
+	}
+
+	pthread_mutex_unlock(&s_lockRetired);
+}
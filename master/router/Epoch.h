@@ -0,0 +1,85 @@
+/*
+* "Copyright (c) 2006 University of Southern California.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software and its
+* documentation for any purpose, without fee, and without written
+* agreement is hereby granted, provided that the above copyright
+* notice, the following two paragraphs and the author appear in all
+* copies of this software.
+*
+* IN NO EVENT SHALL THE UNIVERSITY OF SOUTHERN CALIFORNIA BE LIABLE TO
+* ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+* DAMAGES ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS
+* DOCUMENTATION, EVEN IF THE UNIVERSITY OF SOUTHERN CALIFORNIA HAS BEEN
+* ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+* THE UNIVERSITY OF SOUTHERN CALIFORNIA SPECIFICALLY DISCLAIMS ANY
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  THE SOFTWARE
+* PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND THE UNIVERSITY OF
+* SOUTHERN CALIFORNIA HAS NO OBLIGATION TO PROVIDE MAINTENANCE,
+* SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
+*
+*/
+
+/*
+* Epoch based reclamation for the read-mostly routing tables
+*
+* Readers bracket their accesses with Enter()/Leave() (or a CEpochGuard)
+* and never take a lock. A writer publishes a new version of a table and
+* hands the old one to Retire(). It is freed once every reader that could
+* still see it has left.
+*/
+
+#ifndef _EPOCH_H_
+#define _EPOCH_H_
+
+#include <pthread.h>
+#include <list>
+using namespace std;
+
+#define MAX_EPOCH_THREADS	16
+
+struct EpochRetired
+{
+	void*			pData;
+	unsigned long	nEpoch;
+};
+
+typedef list<EpochRetired> EpochRetiredList;
+
+class CEpoch
+{
+public:
+	static void	Enter(void);
+	static void	Leave(void);
+
+	// pData must have been malloc()ed and no longer be reachable from a
+	// published version
+	static void	Retire(void* pData);
+	static void	Reclaim(void);
+
+private:
+	static int	GetSlot(void);
+
+	// epoch each thread entered at, 0 when it is outside
+	static volatile unsigned long	s_pReaders[MAX_EPOCH_THREADS];
+	static volatile unsigned long	s_nEpoch;
+	static int	s_nSlots;
+
+	static __thread int	t_nSlot;
+	static __thread int	t_nDepth;
+
+	static EpochRetiredList	s_listRetired;
+	static pthread_mutex_t	s_lockRetired;
+};
+
+class CEpochGuard
+{
+public:
+	CEpochGuard(void)	{ CEpoch::Enter(); }
+	~CEpochGuard(void)	{ CEpoch::Leave(); }
+};
+
+#endif
@@ -36,10 +36,20 @@
 #include "File.h"
 #include "Network.h"
 #include "TR_Common.h"
+#include "Epoch.h"
+#include <stdlib.h>
+#include <string.h>
 
 #define MAX_STRING_SIZE			256
-
-IPRT CIPRT_Manager::s_IPRT;  // IP routing table
+#define IPRT_GROW				16		// spare entries in a pending version
+#define IPRT_VERSION_SIZE(n)	( sizeof(IPRT_Version) + ( (n) - 1 ) * sizeof(IPRT_Slot) )
+
+IPRT_Version* volatile CIPRT_Manager::s_pIPRT;  // IP routing table
+IPRT_Version* CIPRT_Manager::s_pPending;
+bool CIPRT_Manager::s_bChanged;
+bool CIPRT_Manager::s_bMonitored;
+int CIPRT_Manager::s_nUpdateDepth;
+pthread_mutex_t CIPRT_Manager::s_lockUpdate;
 int CIPRT_Manager::s_nTimer;
 
 extern struct Debug TR_Debug;
@@ -54,92 +64,259 @@ CIPRT_Manager::~CIPRT_Manager(void)
 
 void CIPRT_Manager::Initialize(void)
 {
+	pthread_mutexattr_t attr;
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&s_lockUpdate, &attr);
+	pthread_mutexattr_destroy(&attr);
+
+	s_pIPRT = (IPRT_Version*) calloc(1, IPRT_VERSION_SIZE(1));
+	s_pIPRT->nCapacity = 1;
 }
 
 void CIPRT_Manager::Finalize(void)
 {
 }
 
-AddrMaster CIPRT_Manager::LookUpNextHop(AddrMaster destIP)
+void CIPRT_Manager::BeginUpdate(void)
 {
-	IPRTiter iter;
+	pthread_mutex_lock(&s_lockUpdate);
 
-	iter = CIPRT_Manager::s_IPRT.find(destIP);
-
-	if (iter == s_IPRT.end())
-		return 0;
+	if( 0 == s_nUpdateDepth++ )
+	{
+		IPRT_Version* pVersion = s_pIPRT;
+		int nCapacity = pVersion->nEntries + IPRT_GROW;
 
-	IPRT_Entry* pIPRT_Entry = (IPRT_Entry*) iter->second;
-	pIPRT_Entry->bUsed = true;
+		s_pPending = (IPRT_Version*) malloc(IPRT_VERSION_SIZE(nCapacity));
+		s_pPending->nEntries = pVersion->nEntries;
+		s_pPending->nCapacity = nCapacity;
+		memcpy(s_pPending->pSlots, pVersion->pSlots, pVersion->nEntries * sizeof(IPRT_Slot));
 
-	return pIPRT_Entry->nextHopIP;
+		s_bChanged = false;
+	}
 }
 
-IPRT_Entry* CIPRT_Manager::LookUpEntry(AddrMaster destIP)
+void CIPRT_Manager::EndUpdate(void)
 {
-	IPRTiter iter;
-	IPRT_Entry* pIPRT_Entry;
+	if( 0 == --s_nUpdateDepth )
+	{
+		if( s_bChanged )
+		{
+			IPRT_Version* pOld = s_pIPRT;
 
-	iter = CIPRT_Manager::s_IPRT.find(destIP);
+			__sync_synchronize();
+			s_pIPRT = s_pPending;
 
-	if (iter == s_IPRT.end())
-		return NULL;
+			CEpoch::Retire(pOld);
+		}
+		else
+		{
+			free(s_pPending);
+		}
 
-	pIPRT_Entry = (IPRT_Entry*) iter->second;
-	pIPRT_Entry->bUsed = true;
+		s_pPending = NULL;
+	}
 
-	return pIPRT_Entry;
+	pthread_mutex_unlock(&s_lockUpdate);
 }
 
-void CIPRT_Manager::Update(AddrMaster destIP, AddrMaster nextHopIP)
+// returns the index of the first entry whose destIP is not below destIP
+int CIPRT_Manager::Find(IPRT_Version* pVersion, AddrMaster destIP)
 {
-	IPRT_Entry* pIPRT_Entry = CIPRT_Manager::LookUpEntry(destIP);
+	int nLow = 0;
+	int nHigh = pVersion->nEntries;
 
-	if(NULL == pIPRT_Entry)
+	while( nLow < nHigh )
 	{
-		CIPRT_Manager::Insert(destIP, nextHopIP);
+		int nMid = ( nLow + nHigh ) / 2;
+
+		if( pVersion->pSlots[nMid].entry.destIP < destIP )
+			nLow = nMid + 1;
+		else
+			nHigh = nMid;
 	}
-	else
+
+	return nLow;
+}
+
+AddrMaster CIPRT_Manager::LookUpNextHop(AddrMaster destIP)
+{
+	CEpochGuard guard;
+	IPRT_Entry* pIPRT_Entry = CIPRT_Manager::LookUpEntry(destIP);
+
+	if( NULL == pIPRT_Entry )
+		return 0;
+
+	return pIPRT_Entry->nextHopIP;
+}
+
+IPRT_Entry* CIPRT_Manager::LookUpEntry(AddrMaster destIP)
+{
+	IPRT_Version* pVersion = s_pIPRT;
+	int i = Find(pVersion, destIP);
+
+	if( i == pVersion->nEntries || pVersion->pSlots[i].entry.destIP != destIP )
+		return NULL;
+
+	// bUsed is only a hint for Refresh(), so it is set in place
+	pVersion->pSlots[i].entry.bUsed = true;
+
+	return &pVersion->pSlots[i].entry;
+}
+
+void CIPRT_Manager::Update(AddrMaster destIP, AddrMaster nextHopIP, bool bKernel)
+{
 	{
-		pIPRT_Entry->nextHopIP = nextHopIP;
-		pIPRT_Entry->bUsed = true;
+		CEpochGuard guard;
+		IPRT_Version* pVersion = s_pIPRT;
+		int i = Find(pVersion, destIP);
+		IPRT_Slot* pSlot = &pVersion->pSlots[i];
+
+		if( i < pVersion->nEntries && pSlot->entry.destIP == destIP
+			&& pSlot->entry.nextHopIP == nextHopIP && ( pSlot->bKernel || !bKernel ) )
+		{
+			pSlot->entry.bUsed = true;
+			return;
+		}
 	}
+
+	CIPRT_Manager::BeginUpdate();
+	CIPRT_Manager::Store(destIP, nextHopIP, bKernel);
+	CIPRT_Manager::EndUpdate();
 }
 
 
 void CIPRT_Manager::Insert(AddrMaster destIP, AddrMaster nextHopIP)
 {
-	typedef pair <AddrMaster, IPRT_Entry*> IPRT_Entry_Pair;
+	CIPRT_Manager::BeginUpdate();
+
+	int i = Find(s_pPending, destIP);
+
+	if( i == s_pPending->nEntries || s_pPending->pSlots[i].entry.destIP != destIP )
+		CIPRT_Manager::Store(destIP, nextHopIP, false);
+
+	CIPRT_Manager::EndUpdate();
+}
+
+// called inside an update
+void CIPRT_Manager::Store(AddrMaster destIP, AddrMaster nextHopIP, bool bKernel)
+{
+	int i = Find(s_pPending, destIP);
+	IPRT_Slot* pSlot = &s_pPending->pSlots[i];
+	IPRT_Entry* pIPRT_Entry = &pSlot->entry;
 
-	IPRT_Entry* pIPRT_Entry = new IPRT_Entry;
+	s_bChanged = true;
+
+	if( i < s_pPending->nEntries && pIPRT_Entry->destIP == destIP )
+	{
+		pIPRT_Entry->nextHopIP = nextHopIP;
+		pIPRT_Entry->bUsed = true;
+		pSlot->bKernel = pSlot->bKernel || bKernel;
+		return;
+	}
+
+	if( s_pPending->nEntries == s_pPending->nCapacity )
+	{
+		s_pPending->nCapacity *= 2;
+		s_pPending = (IPRT_Version*) realloc(s_pPending, IPRT_VERSION_SIZE(s_pPending->nCapacity));
+		pSlot = &s_pPending->pSlots[i];
+		pIPRT_Entry = &pSlot->entry;
+	}
+
+	memmove(pSlot + 1, pSlot, ( s_pPending->nEntries - i ) * sizeof(IPRT_Slot));
+	s_pPending->nEntries++;
 
 	pIPRT_Entry->destIP = destIP;
 	pIPRT_Entry->nextHopIP = nextHopIP;
 	pIPRT_Entry->bUsed = true;
+	pSlot->bKernel = bKernel;
 
 	CONDITIONAL_DEBUG( TR_Debug.bTraceIPRT, "DestIP(%s) : NextHopIP(%s) is added to IPRT \n",
 		inet_ntoa((in_addr&)pIPRT_Entry->destIP),
 		inet_ntoa((in_addr&)pIPRT_Entry->nextHopIP)
 		);
-
-	CIPRT_Manager::s_IPRT.insert(IPRT_Entry_Pair(destIP, pIPRT_Entry));
 }
 
 void CIPRT_Manager::Erase(AddrMaster destIP)
 {
-	IPRTiter iter;
+	CIPRT_Manager::BeginUpdate();
 
-	iter = CIPRT_Manager::s_IPRT.find(destIP);
+	int i = Find(s_pPending, destIP);
 
-	if (iter == s_IPRT.end())
-		return;
+	if( i < s_pPending->nEntries && s_pPending->pSlots[i].entry.destIP == destIP )
+	{
+		CONDITIONAL_DEBUG(TR_Debug.bTraceIPRT, "destIP(%d) is deleted from IPRT \n", destIP);
 
-	CONDITIONAL_DEBUG(TR_Debug.bTraceIPRT, "destIP(%d) is deleted from IPRT \n", destIP);
+		memmove(&s_pPending->pSlots[i], &s_pPending->pSlots[i + 1],
+			( s_pPending->nEntries - i - 1 ) * sizeof(IPRT_Slot));
+		s_pPending->nEntries--;
+		s_bChanged = true;
+	}
 
-	CIPRT_Manager::s_IPRT.erase(iter);
+	CIPRT_Manager::EndUpdate();
 }
 
 int CIPRT_Manager::Refresh(int nType)
+{
+	int nKept = 0;
+
+	// the whole refresh goes out as a single new version
+	CIPRT_Manager::BeginUpdate();
+
+	for( int i = 0 ; i < s_pPending->nEntries ; i++ )
+	{
+		IPRT_Slot* pSlot = &s_pPending->pSlots[i];
+
+		// with route events, kernel routes stay until the kernel drops them
+		if ( pSlot->entry.bUsed || ( s_bMonitored && pSlot->bKernel ) )
+		{
+			pSlot->entry.bUsed = false;
+			s_pPending->pSlots[nKept++] = *pSlot;
+		}
+	}
+
+	s_pPending->nEntries = nKept;
+	s_bChanged = true;
+
+	if( !s_bMonitored )
+		CIPRT_Manager::LoadRouteFile();
+
+	CIPRT_Manager::EndUpdate();
+
+	return 0;
+}
+
+// replaces all kernel routes with the current routing table; used when
+// route events may have been missed
+void CIPRT_Manager::Resync(void)
+{
+	int nKept = 0;
+
+	CIPRT_Manager::BeginUpdate();
+
+	for( int i = 0 ; i < s_pPending->nEntries ; i++ )
+	{
+		if ( !s_pPending->pSlots[i].bKernel )
+			s_pPending->pSlots[nKept++] = s_pPending->pSlots[i];
+	}
+
+	s_pPending->nEntries = nKept;
+	s_bChanged = true;
+
+	CIPRT_Manager::LoadRouteFile();
+
+	CIPRT_Manager::EndUpdate();
+}
+
+// set while a route monitor delivers the kernel's route events
+void CIPRT_Manager::SetMonitored(bool bMonitored)
+{
+	s_bMonitored = bMonitored;
+}
+
+// called inside an update
+void CIPRT_Manager::LoadRouteFile(void)
 {
 	char pStr[MAX_STRING_SIZE];
 	char pStrToken[MAX_STRING_SIZE];
@@ -157,30 +334,8 @@ int CIPRT_Manager::Refresh(int nType)
 #endif
 	CFile file(ROUTE_FILE);
 
-	IPRTiter iter;
-	IPRTiter iterTemp;
-
-	iter = CIPRT_Manager::s_IPRT.begin();
-
-	while( iter != CIPRT_Manager::s_IPRT.end() )
-	{
-		IPRT_Entry* pIPRT_Entry = (IPRT_Entry*) iter->second;
-
-		iterTemp=iter;
-		iter++;
-
-		if ( pIPRT_Entry->bUsed )
-		{
-			pIPRT_Entry->bUsed = false;
-		}
-		else
-		{
-			CIPRT_Manager::s_IPRT.erase(iterTemp);
-		}
-	}
-
 	if(NULL == file.ReadLine(pStr))
-		return 0;
+		return;
 
 #ifdef __CYGWIN__
 	while(NULL != file.ReadLine(pStr))
@@ -214,7 +369,7 @@ int CIPRT_Manager::Refresh(int nType)
 
 		if( maskIP == 0xFFFFFFFF )
 		{
-			CIPRT_Manager::Update(destIP, gatewayIP);
+			CIPRT_Manager::Store(destIP, gatewayIP, true);
 		}
 	}
 #else
@@ -280,7 +435,7 @@ int CIPRT_Manager::Refresh(int nType)
 	   if ( IsInTheSameMachine( gatewayIP ) )
 		continue;
 
-  	   CIPRT_Manager::Update(destIP, gatewayIP);
+  	   CIPRT_Manager::Store(destIP, gatewayIP, true);
 
 SKIP:
             continue;
@@ -315,17 +470,17 @@ SKIP:
 
 		if( maskIP == 0xFFFFFFFF )
 		{
-			CIPRT_Manager::Update(destIP, gatewayIP);
+			CIPRT_Manager::Store(destIP, gatewayIP, true);
 		}
 	}
 #endif
 #endif
-	return 0;
 }
 
 void CIPRT_Manager::Show(void)
 {
-	IPRTiter iter;
+	CEpochGuard guard;
+	IPRT_Version* pVersion = s_pIPRT;
 	IPRT_Entry*	pEntry;
 	struct in_addr in;
 	in.s_addr = GetMyIP();
@@ -336,29 +491,21 @@ void CIPRT_Manager::Show(void)
 	MSG ("            Dest          NextHop\n");
 	MSG ("--------------------------------------------------\n");
 
-	if( CIPRT_Manager::s_IPRT.size() !=  0 )
+	for( int i = 0 ; i < pVersion->nEntries ; i++ )
 	{
-		iter = CIPRT_Manager::s_IPRT.begin();
-
-		while(iter != CIPRT_Manager::s_IPRT.end())
-		{
-			pEntry = (IPRT_Entry*) iter->second;
-
-			MSG(" %16s",
-				inet_ntoa((in_addr&)pEntry->destIP)
-				);
+		pEntry = &pVersion->pSlots[i].entry;
 
-			MSG(" %16s \n",
-				inet_ntoa((in_addr&)pEntry->nextHopIP)
-				);
-
-			iter++;
-		}
+		MSG(" %16s",
+			inet_ntoa((in_addr&)pEntry->destIP)
+			);
 
+		MSG(" %16s \n",
+			inet_ntoa((in_addr&)pEntry->nextHopIP)
+			);
 	}
 
 	MSG ("--------------------------------------------------\n");
-	MSG (" %d entries in IPRT \n", CIPRT_Manager::s_IPRT.size() );
+	MSG (" %d entries in IPRT \n", pVersion->nEntries );
 	MSG ("--------------------------------------------------\n");
 
 }
@@ -392,19 +539,15 @@ void CIPRT_Manager::Show(IPRT_Packet* pPacket)
 // just for debugging purpose
 int CIPRT_Manager::MakeIPRT_Packet(IPRT_Packet* pPacket)
 {
-	IPRTiter iter;
+	CEpochGuard guard;
+	IPRT_Version* pVersion = s_pIPRT;
 
 	pPacket->nEntries = 0;
 
-	if( CIPRT_Manager::s_IPRT.size() !=  0 )
+	// the debug packet only has room for MAX_IPRT_ENTRIES
+	for( int i = 0 ; i < pVersion->nEntries && pPacket->nEntries < MAX_IPRT_ENTRIES ; i++ )
 	{
-		iter = CIPRT_Manager::s_IPRT.begin();
-
-		while(iter != CIPRT_Manager::s_IPRT.end())
-		{
-			memcpy( &pPacket->pEntries[ pPacket->nEntries++ ], ((IPRT_Entry*) iter->second), sizeof(IPRT_Entry)); 
-			iter++;
-		}
+		memcpy( &pPacket->pEntries[ pPacket->nEntries++ ], &pVersion->pSlots[i].entry, sizeof(IPRT_Entry)); 
 	}
 
 	return pPacket->GetIPRT_PacketLength();
@@ -36,8 +36,7 @@
 #define _IPRT_MGR_H_
 
 #include "tosmsg.h"
-#include <map>
-using namespace std;
+#include <pthread.h>
 
 #define AddrMote	uint16_t
 #define AddrMaster	uint32_t
@@ -78,8 +77,19 @@ struct IPRT_Packet
 	}
 }__attribute__((packed));// just for debugging purpose
 
-typedef map <AddrMaster, IPRT_Entry*> IPRT;
-typedef map <AddrMaster, IPRT_Entry*> :: iterator IPRTiter;
+struct IPRT_Slot
+{
+	IPRT_Entry	entry;
+	bool		bKernel;	// a route of the kernel; only a route event removes it
+};
+
+// One published version of the table, sorted by destIP
+struct IPRT_Version
+{
+	int			nEntries;
+	int			nCapacity;
+	IPRT_Slot	pSlots[1];
+};
 
 // IP Routing table is accessed through this class
 class CIPRT_Manager
@@ -89,18 +99,33 @@ public:
 	~CIPRT_Manager(void);
 
 private:
-	static IPRT s_IPRT;
+	// Published and updated the same way as the MRT (see MRT_Manager.h).
+	// The table is small, so a writer copies all of it.
+	static IPRT_Version* volatile	s_pIPRT;
+	static IPRT_Version*	s_pPending;
+	static bool				s_bChanged;
+	static bool				s_bMonitored;	// kernel route events keep the table current
+	static int				s_nUpdateDepth;
+	static pthread_mutex_t	s_lockUpdate;
 	static int	s_nTimer;
 
+	static void			BeginUpdate(void);
+	static void			EndUpdate(void);
+	static int			Find(IPRT_Version* pVersion, AddrMaster destIP);
+	static void			Store(AddrMaster destIP, AddrMaster nextHopIP, bool bKernel);
+	static void			LoadRouteFile(void);
+
 public:
 	static void			Initialize(void);
 	static void			Finalize(void);
-	static void			Update(AddrMaster DestIP, AddrMaster nextHopIP);
+	static void			Update(AddrMaster DestIP, AddrMaster nextHopIP, bool bKernel = false);
 	static void			Insert(AddrMaster DestIP, AddrMaster nextHopIP);
 	static void			Erase(AddrMaster DestIP);
 	static AddrMaster	LookUpNextHop(AddrMaster DestIP);
-	static IPRT_Entry*	LookUpEntry(AddrMaster DestIP);
+	static IPRT_Entry*	LookUpEntry(AddrMaster DestIP);	// valid inside a CEpochGuard
 	static int			Refresh(int nType);
+	static void			Resync(void);
+	static void			SetMonitored(bool bMonitored);
 	static void			Show(void);
 	static void			Show(IPRT_Packet* pPacket);
 	static int			MakeIPRT_Packet(IPRT_Packet* pPacket);
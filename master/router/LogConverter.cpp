@@ -0,0 +1,120 @@
+/*
+* "Copyright (c) 2006 University of Southern California.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software and its
+* documentation for any purpose, without fee, and without written
+* agreement is hereby granted, provided that the above copyright
+* notice, the following two paragraphs and the author appear in all
+* copies of this software.
+*
+* IN NO EVENT SHALL THE UNIVERSITY OF SOUTHERN CALIFORNIA BE LIABLE TO
+* ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+* DAMAGES ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS
+* DOCUMENTATION, EVEN IF THE UNIVERSITY OF SOUTHERN CALIFORNIA HAS BEEN
+* ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+* THE UNIVERSITY OF SOUTHERN CALIFORNIA SPECIFICALLY DISCLAIMS ANY
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  THE SOFTWARE
+* PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND THE UNIVERSITY OF
+* SOUTHERN CALIFORNIA HAS NO OBLIGATION TO PROVIDE MAINTENANCE,
+* SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
+*
+*/
+
+/*
+* logconv: converts a binary packet log of the Tenet router (-l) to the
+* text format it used to write, one packet per line:
+*   <01 if the packet came from my transport, 00 otherwise> <hex bytes>
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "PacketLog.h"
+#include "TR_Common.h"
+
+#define PACKET_FROM_MY_TRANSPORT	0x02
+
+void ShowUsage(char* argv)
+{
+	MSG("   - Usage: %s [options] <binary log> [text log]\n", argv);
+	MSG("   - [options] \n");
+	MSG("       -h            : print this message\n");
+	MSG("       -t            : start every line with the time of the packet\n");
+
+	exit(1);
+}
+
+int main(int argc, char** argv)
+{
+	FILE*	pIn;
+	FILE*	pOut = stdout;
+	bool	bTime = false;
+	int		i = 1;
+	PacketLogHeader	header;
+	PacketLogRecord	record;
+	unsigned char	pData[65536];
+
+	if( i < argc && 0 == strcmp( "-t", argv[i] ) )
+	{
+		bTime = true;
+		i++;
+	}
+
+	if( i >= argc || 0 == strcmp( "-h", argv[i] ) )
+		ShowUsage( argv[0] );
+
+	if( NULL == ( pIn = fopen( argv[i], "rb" ) ) )
+	{
+		TR_ERROR("File open error : [%s]\n", argv[i]);
+		exit(1);
+	}
+
+	if( i + 1 < argc && NULL == ( pOut = fopen( argv[i + 1], "w" ) ) )
+	{
+		TR_ERROR("File open error : [%s]\n", argv[i + 1]);
+		exit(1);
+	}
+
+	if( 1 != fread( &header, sizeof(header), 1, pIn )
+		|| PACKET_LOG_MAGIC != header.nMagic
+		|| header.nVersion < 1 || header.nVersion > PACKET_LOG_VERSION )
+	{
+		TR_ERROR("Not a packet log : [%s]\n", argv[i]);
+		exit(1);
+	}
+
+	while( 1 == fread( &record, 1 == header.nVersion ? PACKET_LOG_RECORD_V1_SIZE : sizeof(record), 1, pIn ) )
+	{
+		// a log cut short while the router was writing it
+		if( record.nLen != fread( pData, 1, record.nLen, pIn ) )
+			break;
+
+		if( bTime )
+		{
+			time_t	timeRecord = record.nSec;
+			char	pStrTime[MAX_STRING_SIZE];
+
+			strftime( pStrTime, sizeof(pStrTime), "%Y-%m-%d %H:%M:%S", localtime( &timeRecord ) );
+			fprintf( pOut, "%s.%06u ", pStrTime, record.nUsec );
+		}
+
+		fprintf( pOut, "%02d ", ( record.nFrom == PACKET_FROM_MY_TRANSPORT ? 1:0 ) );
+
+		for( int j = 0 ; j < record.nLen ; j++ )
+			fprintf( pOut, "%02x ", pData[j] );
+
+		fprintf( pOut, "\n" );
+	}
+
+	fclose( pIn );
+
+	if( pOut != stdout )
+		fclose( pOut );
+
+	return 0;
+}
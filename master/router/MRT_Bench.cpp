@@ -0,0 +1,220 @@
+/*
+* "Copyright (c) 2006 University of Southern California.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software and its
+* documentation for any purpose, without fee, and without written
+* agreement is hereby granted, provided that the above copyright
+* notice, the following two paragraphs and the author appear in all
+* copies of this software.
+*
+* IN NO EVENT SHALL THE UNIVERSITY OF SOUTHERN CALIFORNIA BE LIABLE TO
+* ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+* DAMAGES ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS
+* DOCUMENTATION, EVEN IF THE UNIVERSITY OF SOUTHERN CALIFORNIA HAS BEEN
+* ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+* THE UNIVERSITY OF SOUTHERN CALIFORNIA SPECIFICALLY DISCLAIMS ANY
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  THE SOFTWARE
+* PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND THE UNIVERSITY OF
+* SOUTHERN CALIFORNIA HAS NO OBLIGATION TO PROVIDE MAINTENANCE,
+* SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
+*
+*/
+
+/*
+* mrtbench: compares the mote routing table (CMRT_Manager) with the
+* std::map<AddrMote, MRT_Entry*> it replaced, at 100, 1K and 10K motes.
+* Prints lookups and updates per second for both.
+*   lookup  : LookUpNextHopMaster() of a known mote
+*   refresh : Update() of a known mote on the same route
+*   reroute : Update() of a known mote to a new next hop
+* The results go to stderr; the table itself prints every insert to stdout.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <map>
+using namespace std;
+
+#include "MRT_Manager.h"
+#include "IPRT_Manager.h"
+#include "TenetRouter.h"
+#include "Epoch.h"
+
+#define MRT_BENCH_LOOKUPS	4000000
+#define MRT_BENCH_UPDATES	1000000
+#define MRT_BENCH_MASTER	0x0A010203
+#define MRT_BENCH_MY_IP		0x0A010001
+
+// what Main.cpp provides to the rest of the router
+CTenetRouter* g_pTR;
+bool	g_bInteractive = false;
+
+void ShowHelp()
+{
+}
+
+typedef map <AddrMote, MRT_Entry*> MRT;
+typedef map <AddrMote, MRT_Entry*> :: iterator MRTiter;
+
+// the table as it was before CMRT_Manager indexed it by moteID
+static MRT s_MRT;
+
+static AddrMaster MapLookUpNextHopMaster(AddrMote moteID)
+{
+	MRTiter iter = s_MRT.find(moteID);
+
+	if (iter == s_MRT.end())
+		return 0;
+
+	MRT_Entry* pMRT_Entry = iter->second;
+	uint32_t addrNextHopMaster = CIPRT_Manager::LookUpNextHop(pMRT_Entry->masterIP);
+
+	if ( GetMyIP() == pMRT_Entry->masterIP || !addrNextHopMaster )
+		return pMRT_Entry->masterIP;
+	else
+		return addrNextHopMaster;
+}
+
+static void MapUpdate(AddrMote moteID, AddrMote nextHopMoteID, AddrMaster masterIP)
+{
+	MRTiter iter = s_MRT.find(moteID);
+
+	if (iter == s_MRT.end())
+	{
+		MRT_Entry* pMRT_Entry = new MRT_Entry;
+
+		pMRT_Entry->moteID = moteID;
+		pMRT_Entry->masterIP = masterIP;
+		pMRT_Entry->nextMoteID = nextHopMoteID;
+		pMRT_Entry->bUsed = true;
+
+		s_MRT.insert(pair <AddrMote, MRT_Entry*> (moteID, pMRT_Entry));
+		return;
+	}
+
+	if( nextHopMoteID )
+	{
+		iter->second->masterIP = masterIP;
+		iter->second->nextMoteID = nextHopMoteID;
+	}
+
+	iter->second->bUsed = true;
+}
+
+static void MapClear(void)
+{
+	for( MRTiter iter = s_MRT.begin() ; iter != s_MRT.end() ; iter++ )
+		delete iter->second;
+
+	s_MRT.clear();
+}
+
+static double Now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void Report(const char* pName, int nMotes, int nOps, double dMap, double dMRT)
+{
+	fprintf(stderr, "%-8s %6d motes : map %10.0f/s   mrt %10.0f/s   x%.2f\n",
+		pName, nMotes, nOps / dMap, nOps / dMRT, dMap / dMRT);
+}
+
+static void Run(int nMotes)
+{
+	AddrMote*	pMotes = (AddrMote*) malloc(nMotes * sizeof(AddrMote));
+	AddrMote*	pOrder = (AddrMote*) malloc(MRT_BENCH_LOOKUPS * sizeof(AddrMote));
+	uint32_t	nSum = 0;
+	double		dStart, dMap, dMRT;
+	int			i;
+
+	// spread the motes over the whole address space, as a deployment would
+	for( i = 0 ; i < nMotes ; i++ )
+		pMotes[i] = (AddrMote) ( 1 + i * ( 65000 / nMotes ) );
+
+	for( i = 0 ; i < MRT_BENCH_LOOKUPS ; i++ )
+		pOrder[i] = pMotes[rand() % nMotes];
+
+	for( i = 0 ; i < nMotes ; i++ )
+	{
+		MapUpdate(pMotes[i], 1, MRT_BENCH_MASTER);
+		CMRT_Manager::Update(pMotes[i], 1, MRT_BENCH_MASTER);
+	}
+
+	dStart = Now();
+	for( i = 0 ; i < MRT_BENCH_LOOKUPS ; i++ )
+		nSum += MapLookUpNextHopMaster(pOrder[i]);
+	dMap = Now() - dStart;
+
+	dStart = Now();
+	for( i = 0 ; i < MRT_BENCH_LOOKUPS ; i++ )
+		nSum += CMRT_Manager::LookUpNextHopMaster(pOrder[i]);
+	dMRT = Now() - dStart;
+
+	Report("lookup", nMotes, MRT_BENCH_LOOKUPS, dMap, dMRT);
+
+	dStart = Now();
+	for( i = 0 ; i < MRT_BENCH_UPDATES ; i++ )
+		MapUpdate(pOrder[i], 1, MRT_BENCH_MASTER);
+	dMap = Now() - dStart;
+
+	dStart = Now();
+	for( i = 0 ; i < MRT_BENCH_UPDATES ; i++ )
+		CMRT_Manager::Update(pOrder[i], 1, MRT_BENCH_MASTER);
+	dMRT = Now() - dStart;
+
+	Report("refresh", nMotes, MRT_BENCH_UPDATES, dMap, dMRT);
+
+	dStart = Now();
+	for( i = 0 ; i < MRT_BENCH_UPDATES ; i++ )
+		MapUpdate(pOrder[i], 2 + ( i & 1 ), MRT_BENCH_MASTER);
+	dMap = Now() - dStart;
+
+	dStart = Now();
+	for( i = 0 ; i < MRT_BENCH_UPDATES ; i++ )
+	{
+		CMRT_Manager::Update(pOrder[i], 2 + ( i & 1 ), MRT_BENCH_MASTER);
+
+		// the router reclaims from its timer; do it here so retired
+		// versions do not pile up
+		if( 0 == ( i & 1023 ) )
+			CEpoch::Reclaim();
+	}
+	dMRT = Now() - dStart;
+
+	Report("reroute", nMotes, MRT_BENCH_UPDATES, dMap, dMRT);
+
+	for( i = 0 ; i < nMotes ; i++ )
+		CMRT_Manager::Erase(pMotes[i]);
+	CEpoch::Reclaim();
+	MapClear();
+
+	if( 0 == nSum )
+		fprintf(stderr, "no route was found\n");
+
+	free(pOrder);
+	free(pMotes);
+}
+
+int main(int argc, char** argv)
+{
+	// a fixed address, so lookups do not ask the interface every time
+	SetMyAddrSource("", MRT_BENCH_MY_IP, MRT_BENCH_MY_IP | 0xFFFF);
+
+	CIPRT_Manager::Initialize();
+	CMRT_Manager::Initialize();
+
+	Run(100);
+	Run(1000);
+	Run(10000);
+
+	return 0;
+}
@@ -36,8 +36,14 @@
 #include "Network.h"
 #include "TR_Common.h"
 #include "TenetRouter.h"
-
-MRT CMRT_Manager::s_MRT;  // Mote routing table
+#include "Epoch.h"
+
+MRT_Version* volatile CMRT_Manager::s_pMRT;  // Mote routing table
+MRT_Version* CMRT_Manager::s_pPending;
+uint32_t CMRT_Manager::s_pCopied[MRT_PAGES / 32];
+bool CMRT_Manager::s_bChanged;
+int CMRT_Manager::s_nUpdateDepth;
+pthread_mutex_t CMRT_Manager::s_lockUpdate;
 int CMRT_Manager::s_nTimer;
 
 extern struct Debug TR_Debug;
@@ -53,30 +59,159 @@ CMRT_Manager::~CMRT_Manager(void)
 
 void CMRT_Manager::Initialize(void)
 {
+	pthread_mutexattr_t attr;
+
+	// Refresh() erases entries from inside its own update
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&s_lockUpdate, &attr);
+	pthread_mutexattr_destroy(&attr);
+
+	s_pMRT = (MRT_Version*) calloc(1, sizeof(MRT_Version));
 }
 
 void CMRT_Manager::Finalize(void)
 {
 }
 
+void CMRT_Manager::BeginUpdate(void)
+{
+	pthread_mutex_lock(&s_lockUpdate);
+
+	if( 0 == s_nUpdateDepth++ )
+	{
+		s_pPending = (MRT_Version*) malloc(sizeof(MRT_Version));
+		memcpy(s_pPending, s_pMRT, sizeof(MRT_Version));
+		memset(s_pCopied, 0, sizeof(s_pCopied));
+		s_bChanged = false;
+	}
+}
+
+void CMRT_Manager::EndUpdate(void)
+{
+	if( 0 == --s_nUpdateDepth )
+	{
+		if( s_bChanged )
+		{
+			MRT_Version* pOld = s_pMRT;
+
+			for( int i = 0 ; i < MRT_PAGES ; i++ )
+			{
+				if( ( s_pCopied[i >> 5] & ( 1u << ( i & 31 ) ) )
+					&& 0 == s_pPending->pPages[i]->nEntries )
+				{
+					free(s_pPending->pPages[i]);
+					s_pPending->pPages[i] = NULL;
+				}
+			}
+
+			// the new version has to be complete before readers can see it
+			__sync_synchronize();
+			s_pMRT = s_pPending;
+
+			for( int i = 0 ; i < MRT_PAGES ; i++ )
+			{
+				if( ( s_pCopied[i >> 5] & ( 1u << ( i & 31 ) ) ) && pOld->pPages[i] )
+					CEpoch::Retire(pOld->pPages[i]);
+			}
+
+			CEpoch::Retire(pOld);
+		}
+		else
+		{
+			free(s_pPending);
+		}
+
+		s_pPending = NULL;
+	}
+
+	pthread_mutex_unlock(&s_lockUpdate);
+}
+
+// returns the page of s_pPending holding moteID, copying it first if it is
+// still shared with the published version
+MRT_Page* CMRT_Manager::GetPrivatePage(AddrMote moteID)
+{
+	int nPage = moteID / MRT_PAGE_SIZE;
+	MRT_Page* pPage = s_pPending->pPages[nPage];
+
+	if( s_pCopied[nPage >> 5] & ( 1u << ( nPage & 31 ) ) )
+		return pPage;
+
+	MRT_Page* pCopy = (MRT_Page*) malloc(sizeof(MRT_Page));
+
+	if( pPage )
+		memcpy(pCopy, pPage, sizeof(MRT_Page));
+	else
+		memset(pCopy, 0, sizeof(MRT_Page));
+
+	s_pPending->pPages[nPage] = pCopy;
+	s_pCopied[nPage >> 5] |= 1u << ( nPage & 31 );
+	s_bChanged = true;
+
+	return pCopy;
+}
+
+MRT_Entry* CMRT_Manager::Find(MRT_Version* pVersion, AddrMote moteID)
+{
+	MRT_Page* pPage = pVersion->pPages[moteID / MRT_PAGE_SIZE];
+	int nSlot = moteID % MRT_PAGE_SIZE;
+
+	if( NULL == pPage || 0 == ( pPage->pValid[nSlot >> 5] & ( 1u << ( nSlot & 31 ) ) ) )
+		return NULL;
+
+	return &pPage->pEntries[nSlot];
+}
+
+// returns the first entry at or after nIndex and moves nIndex to it,
+// NULL if there is none
+MRT_Entry* CMRT_Manager::Next(MRT_Version* pVersion, int& nIndex)
+{
+	while( nIndex < MRT_SIZE )
+	{
+		MRT_Page* pPage = pVersion->pPages[nIndex / MRT_PAGE_SIZE];
+
+		if( NULL == pPage )
+		{
+			nIndex = ( nIndex / MRT_PAGE_SIZE + 1 ) * MRT_PAGE_SIZE;
+			continue;
+		}
+
+		int			nSlot = nIndex % MRT_PAGE_SIZE;
+		uint32_t	bits = pPage->pValid[nSlot >> 5] & ( 0xFFFFFFFFu << ( nSlot & 31 ) );
+
+		if( bits )
+		{
+			nIndex = ( nIndex & ~31 ) | __builtin_ctz(bits);
+			return &pPage->pEntries[nIndex % MRT_PAGE_SIZE];
+		}
+
+		nIndex = ( nIndex | 31 ) + 1;
+	}
+
+	return NULL;
+}
+
 // this info is used for Refresh()
 void CMRT_Manager::SetUsed(AddrMote moteID, bool bUsed)
 {
+	CEpochGuard guard;
 	MRT_Entry* pMRT_Entry = CMRT_Manager::LookUpEntry(moteID);
 
+	// bUsed is only a hint for Refresh(), so it is set in place rather than
+	// publishing a new version. A mark racing with an update may be lost.
 	if(pMRT_Entry)
 		pMRT_Entry->bUsed = bUsed;
 }
 
 AddrMaster CMRT_Manager::LookUpNextHopMaster(AddrMote moteID)
 {
-	MRTiter iter;
-	iter = CMRT_Manager::s_MRT.find(moteID);
+	CEpochGuard guard;
+	MRT_Entry* pMRT_Entry = Find(s_pMRT, moteID);
 
-	if (iter == s_MRT.end())
+	if( NULL == pMRT_Entry )
 		return 0;
 
-	MRT_Entry* pMRT_Entry = (MRT_Entry*) iter->second;
 	uint32_t addrNextHopMaster = CIPRT_Manager::LookUpNextHop(pMRT_Entry->masterIP);
 
 	if ( GetMyIP() == pMRT_Entry->masterIP || !addrNextHopMaster )
@@ -87,57 +222,86 @@ AddrMaster CMRT_Manager::LookUpNextHopMaster(AddrMote moteID)
 
 AddrMote CMRT_Manager::LookUpNextHopMote(AddrMote moteID)
 {
-	MRTiter iter;
+	CEpochGuard guard;
+	MRT_Entry* pMRT_Entry = Find(s_pMRT, moteID);
 
-	iter = CMRT_Manager::s_MRT.find(moteID);
-
-	if (iter == s_MRT.end())
+	if( NULL == pMRT_Entry )
 		return 0;
 
-	MRT_Entry* pMRT_Entry = (MRT_Entry*) iter->second;
-
 	if ( GetMyIP() == pMRT_Entry->masterIP )
 		return pMRT_Entry->nextMoteID;
 	else
 		return CIPRT_Manager::LookUpNextHop(pMRT_Entry->masterIP);
 }
 
-MRT_Entry* CMRT_Manager::LookUpEntry(AddrMote moteID)
+// the base station to reach a mote of mine through, 0 if it is not known
+unsigned char CMRT_Manager::LookUpBaseStation(AddrMote moteID)
 {
-	MRTiter iter;
-
-	iter = CMRT_Manager::s_MRT.find(moteID);
+	CEpochGuard guard;
+	MRT_Version* pVersion = s_pMRT;
 
-	if (iter == s_MRT.end())
-		return NULL;
+	if( NULL == Find(pVersion, moteID) )
+		return 0;
 
-	MRT_Entry* pMRT_Entry = (MRT_Entry*) iter->second;
+	return pVersion->pPages[moteID / MRT_PAGE_SIZE]->pBase[moteID % MRT_PAGE_SIZE];
+}
 
-	return pMRT_Entry;
+MRT_Entry* CMRT_Manager::LookUpEntry(AddrMote moteID)
+{
+	return Find(s_pMRT, moteID);
 }
 
-void CMRT_Manager::Update(AddrMote moteID, AddrMote nextHopMoteID, AddrMaster masterIP)
+void CMRT_Manager::Update(AddrMote moteID, AddrMote nextHopMoteID, AddrMaster masterIP, unsigned char nBase)
 {
-	MRT_Entry* pMRT_Entry = CMRT_Manager::LookUpEntry(moteID);
+	MRT_Entry* pMRT_Entry;
+
+	{
+		CEpochGuard guard;
+		MRT_Version* pVersion = s_pMRT;
+
+		// a known mote on an unchanged route does not need a new version
+		pMRT_Entry = Find(pVersion, moteID);
+
+		if( pMRT_Entry &&
+			( !nextHopMoteID ||
+			( pMRT_Entry->nextMoteID == nextHopMoteID && pMRT_Entry->masterIP == masterIP
+			&& pVersion->pPages[moteID / MRT_PAGE_SIZE]->pBase[moteID % MRT_PAGE_SIZE] == nBase ) ) )
+		{
+			pMRT_Entry->bUsed = true;
+			return;
+		}
+	}
+
+	CMRT_Manager::BeginUpdate();
+
+	pMRT_Entry = Find(s_pPending, moteID);
 
 	if(NULL == pMRT_Entry)
 	{
-		CMRT_Manager::Insert(moteID, nextHopMoteID, masterIP);
+		CMRT_Manager::Insert(moteID, nextHopMoteID, masterIP, nBase);
 	}
-	else
+	else if( nextHopMoteID )
 	{
-		if( nextHopMoteID )
-		{
-			pMRT_Entry->masterIP = masterIP;
-			pMRT_Entry->nextMoteID = nextHopMoteID;
-		}
+		MRT_Page* pPage = GetPrivatePage(moteID);
+
+		pMRT_Entry = &pPage->pEntries[moteID % MRT_PAGE_SIZE];
 
+		pMRT_Entry->masterIP = masterIP;
+		pMRT_Entry->nextMoteID = nextHopMoteID;
 		pMRT_Entry->bUsed = true;
+		pPage->pBase[moteID % MRT_PAGE_SIZE] = nBase;
 	}
+	else
+	{
+		pMRT_Entry->bUsed = true;
+	}
+
+	CMRT_Manager::EndUpdate();
 }
 
 
-void CMRT_Manager::Insert(AddrMote moteID, AddrMote nextHopMoteID, AddrMaster masterIP)
+// called inside an update
+void CMRT_Manager::Insert(AddrMote moteID, AddrMote nextHopMoteID, AddrMaster masterIP, unsigned char nBase)
 {
 /*
 	if( moteID == 
@@ -149,16 +313,19 @@ void CMRT_Manager::Insert(AddrMote moteID, AddrMote nextHopMoteID, AddrMaster ma
     if( moteID == CTenetRouter::GetTenetLocalAddr() )
         return;
 
-	typedef pair <AddrMote, MRT_Entry*> MRT_Entry_Pair;
-
-	MRT_Entry* pMRT_Entry = new MRT_Entry;
+	MRT_Page* pPage = GetPrivatePage(moteID);
+	int nSlot = moteID % MRT_PAGE_SIZE;
+	MRT_Entry* pMRT_Entry = &pPage->pEntries[nSlot];
 
 	pMRT_Entry->moteID = moteID;
 	pMRT_Entry->masterIP = masterIP;
 	pMRT_Entry->nextMoteID = nextHopMoteID;
 	pMRT_Entry->bUsed = true;
+	pPage->pBase[nSlot] = nBase;
 
-	CMRT_Manager::s_MRT.insert(MRT_Entry_Pair(moteID, pMRT_Entry));
+	pPage->pValid[nSlot >> 5] |= 1u << ( nSlot & 31 );
+	pPage->nEntries++;
+	s_pPending->nEntries++;
 
 	printf("Inside insert call %d, %d, %d\n", moteID, nextHopMoteID, masterIP);
 
@@ -170,32 +337,114 @@ void CMRT_Manager::Insert(AddrMote moteID, AddrMote nextHopMoteID, AddrMaster ma
 
 void CMRT_Manager::Erase(AddrMote moteID)
 {
-	MRTiter iter;
+	CMRT_Manager::BeginUpdate();
 
-	iter = CMRT_Manager::s_MRT.find(moteID);
+	if( Find(s_pPending, moteID) )
+	{
+		CONDITIONAL_DEBUG( TR_Debug.bTraceMRT, "CMRT_Manager::Erase()// MoteID(%d) is deleted from MRT \n", moteID);
 
-	if (iter == s_MRT.end())
-		return;
+		MRT_Page* pPage = GetPrivatePage(moteID);
+		int nSlot = moteID % MRT_PAGE_SIZE;
 
-	CONDITIONAL_DEBUG( TR_Debug.bTraceMRT, "CMRT_Manager::Erase()// MoteID(%d) is deleted from MRT \n", moteID);
+		pPage->pValid[nSlot >> 5] &= ~( 1u << ( nSlot & 31 ) );
+		pPage->nEntries--;
+		s_pPending->nEntries--;
+	}
 
-	CMRT_Manager::s_MRT.erase(iter);
+	CMRT_Manager::EndUpdate();
 }
 
-int CMRT_Manager::Refresh(int nType)
+// the motes another master advertised (see RouteBeacon.h), applied as one
+// new version; only that master can withdraw its routes, and a mote of
+// mine stays mine
+void CMRT_Manager::Learn(AddrMaster masterIP, AddrMote* pAdded, int nAdded, AddrMote* pWithdrawn, int nWithdrawn)
+{
+	MRT_Entry* pMRT_Entry;
+
+	CMRT_Manager::BeginUpdate();
+
+	for( int i = 0 ; i < nWithdrawn ; i++ )
+	{
+		pMRT_Entry = Find(s_pPending, pWithdrawn[i]);
+
+		if( pMRT_Entry && pMRT_Entry->masterIP == masterIP )
+			CMRT_Manager::Erase(pWithdrawn[i]);
+	}
+
+	for( int i = 0 ; i < nAdded ; i++ )
+	{
+		AddrMote moteID = pAdded[i];
+
+		pMRT_Entry = Find(s_pPending, moteID);
+
+		if( NULL == pMRT_Entry )
+		{
+			CMRT_Manager::Insert(moteID, moteID, masterIP, 0);
+		}
+		else if( pMRT_Entry->masterIP == masterIP && pMRT_Entry->nextMoteID == moteID )
+		{
+			// unchanged; bUsed is a hint and set in place as in SetUsed()
+			pMRT_Entry->bUsed = true;
+		}
+		else if( pMRT_Entry->masterIP != GetMyIP() )
+		{
+			MRT_Page* pPage = GetPrivatePage(moteID);
+
+			pMRT_Entry = &pPage->pEntries[moteID % MRT_PAGE_SIZE];
+
+			pMRT_Entry->masterIP = masterIP;
+			pMRT_Entry->nextMoteID = moteID;
+			pMRT_Entry->bUsed = true;
+			pPage->pBase[moteID % MRT_PAGE_SIZE] = 0;
+		}
+	}
+
+	CMRT_Manager::EndUpdate();
+}
+
+// erases the routes to masterIP, except for the motes set in pKeep (NULL
+// keeps none)
+void CMRT_Manager::EraseMaster(AddrMaster masterIP, uint32_t* pKeep)
+{
+	MRT_Entry* pMRT_Entry;
+
+	CMRT_Manager::BeginUpdate();
+
+	for( int i = 0 ; NULL != ( pMRT_Entry = Next(s_pPending, i) ) ; i++ )
+	{
+		if( pMRT_Entry->masterIP == masterIP
+			&& ( NULL == pKeep || 0 == ( pKeep[i >> 5] & ( 1u << ( i & 31 ) ) ) ) )
+			CMRT_Manager::Erase(pMRT_Entry->moteID);
+	}
+
+	CMRT_Manager::EndUpdate();
+}
+
+// sets the bit of every mote masterIP is the master of in pSet (MRT_SIZE bits)
+void CMRT_Manager::MakeMoteSet(AddrMaster masterIP, uint32_t* pSet)
 {
-	MRTiter iter;
-	MRTiter iterTemp;
+	CEpochGuard guard;
+	MRT_Version* pVersion = s_pMRT;
+	MRT_Entry* pMRT_Entry;
 
-	iter = CMRT_Manager::s_MRT.begin();
+	memset(pSet, 0, MRT_SIZE / 8);
 
-	while( iter != CMRT_Manager::s_MRT.end() )
+	for( int i = 0 ; NULL != ( pMRT_Entry = Next(pVersion, i) ) ; i++ )
 	{
-		MRT_Entry* pMRT_Entry = (MRT_Entry*) iter->second;
+		if( pMRT_Entry->masterIP == masterIP )
+			pSet[i >> 5] |= 1u << ( i & 31 );
+	}
+}
+
+int CMRT_Manager::Refresh(int nType)
+{
+	MRT_Entry* pMRT_Entry;
 
-		iterTemp=iter;
-		iter++;
+	// all erases of one refresh go out as a single new version
+	CMRT_Manager::BeginUpdate();
 
+	for( int i = 0 ; NULL != ( pMRT_Entry = Next(s_pPending, i) ) ; i++ )
+	{
 		if ( pMRT_Entry->bUsed )
 		{
 			pMRT_Entry->bUsed = false;
@@ -214,16 +463,19 @@ int CMRT_Manager::Refresh(int nType)
 		}
 		else
 		{
-			CMRT_Manager::s_MRT.erase(iterTemp);
+			CMRT_Manager::Erase(pMRT_Entry->moteID);
 		}
 	}
 
+	CMRT_Manager::EndUpdate();
+
 	return 0;
 }
 
 void CMRT_Manager::Show(void)
 {
-	MRTiter iter;
+	CEpochGuard guard;
+	MRT_Version* pVersion = s_pMRT;
 	MRT_Entry*	pEntry;
 	struct in_addr in;
 	in.s_addr = GetMyIP();
@@ -234,27 +486,18 @@ void CMRT_Manager::Show(void)
 	MSG (" Mote ID               NextHopMoteID masterIP Used             \n");
 	MSG ("--------------------------------------------------\n");
 
-	if( CMRT_Manager::s_MRT.size() !=  0 )
+	for( int i = 0 ; NULL != ( pEntry = Next(pVersion, i) ) ; i++ )
 	{
-		iter = CMRT_Manager::s_MRT.begin();
-
-		while(iter != CMRT_Manager::s_MRT.end())
-		{
-			pEntry = (MRT_Entry*) iter->second;
-
-			MSG(" %4d(%3d.%3d) %14d %16s %s\n", 
-				pEntry->moteID,
-				((0xFF00) & pEntry->moteID) >> 8,
-				((0x00FF) & pEntry->moteID),
-				pEntry->nextMoteID,
-				inet_ntoa((in_addr&)pEntry->masterIP),
-				pEntry->bUsed == true ? "TRUE" : "FALSE");
-
-			iter++;
-		}
+		MSG(" %4d(%3d.%3d) %14d %16s %s\n", 
+			pEntry->moteID,
+			((0xFF00) & pEntry->moteID) >> 8,
+			((0x00FF) & pEntry->moteID),
+			pEntry->nextMoteID,
+			inet_ntoa((in_addr&)pEntry->masterIP),
+			pEntry->bUsed == true ? "TRUE" : "FALSE");
 	}
 	MSG ("--------------------------------------------------\n");
-	MSG (" %d entries in MRT \n", CMRT_Manager::s_MRT.size() );
+	MSG (" %d entries in MRT \n", pVersion->nEntries );
 	MSG ("--------------------------------------------------\n");
 }
 
@@ -285,19 +528,16 @@ void CMRT_Manager::Show(MRT_Packet* pPacket)
 
 int CMRT_Manager::MakeMRT_Packet(MRT_Packet* pPacket)
 {
-	MRTiter iter;
+	CEpochGuard guard;
+	MRT_Version* pVersion = s_pMRT;
+	MRT_Entry* pEntry;
 
 	pPacket->nEntries = 0;
 
-	if( CMRT_Manager::s_MRT.size() !=  0 )
+	// the debug packet only has room for MAX_MRT_ENTRIES
+	for( int i = 0 ; pPacket->nEntries < MAX_MRT_ENTRIES && NULL != ( pEntry = Next(pVersion, i) ) ; i++ )
 	{
-		iter = CMRT_Manager::s_MRT.begin();
-
-		while(iter != CMRT_Manager::s_MRT.end())
-		{
-			memcpy( &pPacket->pEntries[ pPacket->nEntries++ ], ((MRT_Entry*) iter->second), sizeof(MRT_Entry)); 
-			iter++;
-		}
+		memcpy( &pPacket->pEntries[ pPacket->nEntries++ ], pEntry, sizeof(MRT_Entry)); 
 	}
 
 	return pPacket->GetMRT_PacketLength();
@@ -35,8 +35,7 @@
 #define _MRT_MGR_H_
 
 #include "tosmsg.h"
-#include <map>
-using namespace std;
+#include <pthread.h>
 
 #define AddrMote	uint16_t
 #define AddrMaster	uint32_t
@@ -45,6 +44,9 @@ using namespace std;
 #define MRT_REFRESH_TIMER_ID	10001
 #define MRT_REFRESH_TIMEOUT		120		// sec
 #define MAX_MRT_ENTRIES			110
+#define MRT_SIZE				65536	// one slot per AddrMote
+#define MRT_PAGE_SIZE			256
+#define MRT_PAGES				( MRT_SIZE / MRT_PAGE_SIZE )
 
 // Mote routing table entry
 struct MRT_Entry
@@ -66,8 +68,22 @@ struct MRT_Packet
 	}
 }__attribute__((packed)); // just for debugging purpose
 
-typedef map <AddrMote, MRT_Entry*> MRT;
-typedef map <AddrMote, MRT_Entry*> :: iterator MRTiter;
+// MRT_PAGE_SIZE consecutive slots of the table, indexed by moteID.
+// A page is shared by all versions until a writer changes it.
+struct MRT_Page
+{
+	uint32_t	pValid[MRT_PAGE_SIZE / 32];
+	int			nEntries;
+	MRT_Entry	pEntries[MRT_PAGE_SIZE];
+	unsigned char	pBase[MRT_PAGE_SIZE];	// base station a mote of mine was heard through
+};
+
+// One published version of the table; empty pages are NULL
+struct MRT_Version
+{
+	int			nEntries;
+	MRT_Page*	pPages[MRT_PAGES];
+};
 
 // Mote routing table manager
 class CMRT_Manager
@@ -77,19 +93,38 @@ public:
 	~CMRT_Manager(void);
 
 private:
-	static MRT s_MRT;
+	// Readers use the published version s_pMRT without a lock, inside a
+	// CEpochGuard. Writers serialize on s_lockUpdate and change s_pPending,
+	// copying each page the first time they touch it. The outermost
+	// EndUpdate() publishes s_pPending and retires what it replaced.
+	static MRT_Version* volatile	s_pMRT;
+	static MRT_Version*	s_pPending;
+	static uint32_t		s_pCopied[MRT_PAGES / 32];	// pages private to s_pPending
+	static bool			s_bChanged;
+	static int			s_nUpdateDepth;
+	static pthread_mutex_t	s_lockUpdate;
 	static int	s_nTimer;
-	static void			Insert(AddrMote moteID, AddrMote nextHopMoteID, AddrMaster masterIP);
+
+	static void			BeginUpdate(void);
+	static void			EndUpdate(void);
+	static MRT_Page*	GetPrivatePage(AddrMote moteID);
+	static MRT_Entry*	Find(MRT_Version* pVersion, AddrMote moteID);
+	static MRT_Entry*	Next(MRT_Version* pVersion, int& nIndex);
+	static void			Insert(AddrMote moteID, AddrMote nextHopMoteID, AddrMaster masterIP, unsigned char nBase);
 
 public:
 	static void			Initialize(void);
 	static void			Finalize(void);
 	static void			SetUsed(AddrMote moteID, bool bUsed);
-	static void			Update(AddrMote moteID, AddrMote nextHopMoteID, AddrMaster masterIP);
+	static void			Update(AddrMote moteID, AddrMote nextHopMoteID, AddrMaster masterIP, unsigned char nBase = 0);
 	static void			Erase(AddrMote moteID);
 	static AddrMaster	LookUpNextHopMaster(AddrMote moteID);
+	static void			Learn(AddrMaster masterIP, AddrMote* pAdded, int nAdded, AddrMote* pWithdrawn, int nWithdrawn);
+	static void			EraseMaster(AddrMaster masterIP, uint32_t* pKeep);
+	static void			MakeMoteSet(AddrMaster masterIP, uint32_t* pSet);
 	static AddrMote		LookUpNextHopMote(AddrMote moteID);
-	static MRT_Entry*	LookUpEntry(AddrMote moteID);
+	static unsigned char	LookUpBaseStation(AddrMote moteID);
+	static MRT_Entry*	LookUpEntry(AddrMote moteID);	// valid inside a CEpochGuard
 	static int			Refresh(int nType);
 	static void			Show(void);
 	static void			Show(MRT_Packet* pPacket);
@@ -38,7 +38,11 @@
 #include "TR_Common.h"
 #include "TenetRouter.h"
 #include "File.h"
+#include "PacketLog.h"
 #include "Network.h"
+#include "TCP_Socket.h"
+#include "RouterConfig.h"
+#include "TraceReplay.h"
 
 extern struct Debug TR_Debug;
 
@@ -53,18 +57,36 @@ void ShowUsage(char* argv)
 	MSG("   - Usage: %s [options]\n",argv);
 	MSG("   - [options] \n");
 	MSG("       -h            : print this message\n");
+	MSG("       -c <file>     : read TENET_* = value settings from this file; the\n");
+	MSG("                       environment and these options override them\n");
 	MSG("       -s            : standalone mode (without BaseStation)\n");
 	MSG("       -a            : set local address (16bit)\n");
 	MSG("       -i            : Interactive Mode\n");
-	MSG("       -l [Path]     : specify log path\n");
+	MSG("       -l [Path]     : specify log path (binary, see logconv)\n");
+	MSG("       -ls <kbytes>  : start a new log file at this size\n");
+	MSG("       -lt <sec>     : start a new log file after this time\n");
 	MSG("       -n [Inf]      : name of network interface\n");
 	
 	GetAddress("", ALL_INFO);
 
 	MSG("       -tp <port>    : set the port for transport\n");
 	MSG("       -rp <port>    : set the port for other routers\n");
-	MSG("       -sp <sf port> : set the serial forwarder port\n");
-	MSG("       -sh <sf host> : set the serial forwarder host\n");
+	MSG("       -mp <port>    : serve metrics on this port of localhost\n");
+	MSG("       -sm <0|1>     : serve transports on this host over shared memory (default: %s)\n", _TENET_ROUTER_SHM);
+	MSG("       -dw <msec>    : drop packets routed again within this time, 0 for never (default: %s)\n", _TENET_DEDUP_WINDOW);
+	MSG("       -bi <sec>     : advertise my motes to other routers this often, 0 for never (default: %s)\n", _TENET_BEACON_INTERVAL);
+	MSG("       -sp <sf port> : set the serial forwarder port, a comma separated list\n");
+	MSG("                       for several base stations (up to %d)\n", MAX_BASE_STATIONS);
+	MSG("       -sh <sf host> : set the serial forwarder host, or one per port\n");
+	MSG("       -mr <pkts/s>  : shape packets to the mote (default: unshaped)\n");
+	MSG("       -mb <pkts>    : burst allowed to the mote (default: %s)\n", _TENET_EGRESS_MOTE_BURST);
+	MSG("       -nr <pkts/s>  : shape packets to each neighbor (default: unshaped)\n");
+	MSG("       -nb <pkts>    : burst allowed to each neighbor (default: %s)\n", _TENET_EGRESS_NEIGHBOR_BURST);
+	MSG("       -ob <kbytes>  : output a TCP client may have waiting (default: %s)\n", _TENET_TCP_OUTPUT_BUDGET);
+	MSG("       -op <policy>  : when it is exceeded, oldest, newest or disconnect (default: %s)\n", _TENET_TCP_OVERFLOW_POLICY);
+	MSG("       -rr <log>     : route the packets of a log (-l) instead of the network, and exit\n");
+	MSG("       -rt <0|1>     : keep the time between the packets of the log (default: 0)\n");
+	MSG("       -rd <file>    : write where each packet of the log was sent to this file\n");
 
 	exit(1);
 }
@@ -79,6 +101,7 @@ void ShowHelp()
 	MSG("  trace(t) iprt(i)       : enable/disable to trace iprt \n");  
 	MSG("  mrt(m)                 : show mote routing table\n");
 	MSG("  iprt(i)                : show ip routing table\n");
+	MSG("  egress(e)              : show egress queues\n");
 	MSG("  q                      : quit\n");
 	MSG("------------------------------------------------------------\n");
 }
@@ -94,43 +117,59 @@ void EnableInteractiveMode(int n)
 	TR_Arg.bInteractive = true;
 }
 
-void ParseArgv(int argc, char **argv)
+// the options that only set a configuration value
+static const char* s_pOptions[][2] =
 {
-	char pStr[MAX_STRING_SIZE];
-
-	if( ! getenv("TENET_ROUTER_PORT_FOR_TRANSPORT"))
-		setenv("TENET_ROUTER_PORT_FOR_TRANSPORT", _TENET_ROUTER_PORT_FOR_TRANSPORT, 1);
-
-	if( ! getenv("TENET_ROUTER_PORT_FOR_OTHER_ROUTER"))
-		setenv("TENET_ROUTER_PORT_FOR_OTHER_ROUTER", _TENET_ROUTER_PORT_FOR_OTHER_ROUTER, 1);
-
-	if( ! getenv("TENET_SF_HOST"))
-		setenv("TENET_SF_HOST", _TENET_SF_HOST, 1);
-
-	if( ! getenv("TENET_SF_PORT"))
-		setenv("TENET_SF_PORT", _TENET_SF_PORT, 1);
-
-	if( ! getenv("TENET_ROUTER_INTERFACE"))
+	{ "-a",  "TENET_LOCAL_ADDRESS" },
+	{ "-l",  "TENET_LOG_PATH" },
+	{ "-ls", "TENET_LOG_MAX_SIZE" },
+	{ "-lt", "TENET_LOG_MAX_AGE" },
+	{ "-tp", "TENET_ROUTER_PORT_FOR_TRANSPORT" },
+	{ "-rp", "TENET_ROUTER_PORT_FOR_OTHER_ROUTER" },
+	{ "-n",  "TENET_ROUTER_INTERFACE" },
+	{ "-mp", "TENET_ROUTER_PORT_FOR_METRICS" },
+	{ "-sm", "TENET_ROUTER_SHM" },
+	{ "-dw", "TENET_DEDUP_WINDOW" },
+	{ "-bi", "TENET_BEACON_INTERVAL" },
+	{ "-sh", "TENET_SF_HOST" },
+	{ "-sp", "TENET_SF_PORT" },
+	{ "-mr", "TENET_EGRESS_MOTE_RATE" },
+	{ "-mb", "TENET_EGRESS_MOTE_BURST" },
+	{ "-nr", "TENET_EGRESS_NEIGHBOR_RATE" },
+	{ "-nb", "TENET_EGRESS_NEIGHBOR_BURST" },
+	{ "-ob", "TENET_TCP_OUTPUT_BUDGET" },
+	{ "-op", "TENET_TCP_OVERFLOW_POLICY" },
+	{ "-rr", "TENET_REPLAY_PATH" },
+	{ "-rt", "TENET_REPLAY_TIMING" },
+	{ "-rd", "TENET_REPLAY_DECISIONS" },
+	{ NULL, NULL }
+};
+
+// defaults, then the config file, the environment and the command line
+void ParseArgv(int argc, char **argv, CRouterConfig* pConfig)
+{
+	for( int i=1 ; i < argc - 1 ; i++ )
 	{
-		if ( !GetDefaultNetworkInterface( pStr ) )
-			TR_ERROR ( "No network interface found\n" );
-
-		setenv("TENET_ROUTER_INTERFACE", pStr, 1);
+		if( 0 == strcmp( "-c",  argv[i] ) && ! pConfig->LoadFile( argv[i + 1] ) )
+			ShowUsage( argv[0] );
 	}
 
-	setenv("TENET_ROUTER_STANDALONE_MODE", "FALSE", 1);
+	if( ! pConfig->LoadEnvironment() )
+		ShowUsage( argv[0] );
 
 	for( int i=1 ; i < argc ; i++ )
 	{
-		if( 0 == strcmp( "-a",  argv[i] ))
+		int j;
+
+		if( 0 == strcmp( "-c",  argv[i] ))
 		{
-			setenv("TENET_LOCAL_ADDRESS", argv[++i], 1);
+			i++;
 			continue;
 		}
 
 		if( 0 == strcmp( "-s",  argv[i] ))
 		{
-			setenv("TENET_ROUTER_STANDALONE_MODE", "TRUE", 1);
+			pConfig->Set( "TENET_ROUTER_STANDALONE_MODE", "TRUE" );
 			continue;
 		}
 
@@ -140,80 +179,59 @@ void ParseArgv(int argc, char **argv)
 			continue;
 		}
 
-		if( 0 == strcmp( "-l",  argv[i] ))
+		for( j = 0 ; s_pOptions[j][0] ; j++ )
 		{
-			struct tm *t;
-			char	pStrLog[MAX_STRING_SIZE];
-			time_t  timeCur = time(NULL);
-			t =localtime(&timeCur);
-
-			sprintf( pStrLog, "%s/%d-%d-%d-%d-%d",
-					argv[++i],
-					t->tm_mon+1,
-					t->tm_mday,
-					t->tm_hour,
-					t->tm_min,
-					t->tm_sec);
-
-			TR_Arg.pLogFile = new CFile( pStrLog, false );
-			continue;
+			if( 0 == strcmp( s_pOptions[j][0], argv[i] ))
+				break;
 		}
 
-		if( 0 == strcmp( "-tp",  argv[i] ))
-		{
-			setenv("TENET_ROUTER_PORT_FOR_TRANSPORT", argv[++i], 1);
-			continue;
-		}
+		if( NULL == s_pOptions[j][0] || i + 1 == argc || ! pConfig->Set( s_pOptions[j][1], argv[++i] ) )
+			ShowUsage(argv[0]);
+	}
 
-		if( 0 == strcmp( "-rp",  argv[i] ))
-		{
-			setenv("TENET_ROUTER_PORT_FOR_OTHER_ROUTER", argv[++i], 1);
-			continue;
-		}
+	if( ! pConfig->Finish() )
+		ShowUsage( argv[0] );
 
-                if( 0 == strcmp( "-n",  argv[i] ))
-                {
-                        setenv("TENET_ROUTER_INTERFACE", argv[++i], 1);
-                        continue;
-                }
+	CTCP_Client::SetOutputPolicy( pConfig->nOutputBudget * 1024, (char*) pConfig->pOverflowPolicy );
 
-		if( 0 == strcmp( "-sh",  argv[i] ))
-		{
-			setenv("TENET_SF_HOST", argv[++i], 1);
-			continue;
-		}
+	if( pConfig->pLogFilePath[0] )
+		TR_Arg.pLog = new CPacketLog( pConfig->pLogFilePath, pConfig->nLogMaxSize, pConfig->nLogMaxAge );
+}
 
-		if( 0 == strcmp( "-sp",  argv[i] ))
-		{
-			setenv("TENET_SF_PORT", argv[++i], 1);
-			continue;
-		}
+// routes a packet log instead of the network; nothing is connected
+int Replay(const CRouterConfig& config)
+{
+	CTraceReplay	replay( config.bReplayTiming, config.pReplayDecisions );
 
-		ShowUsage(argv[0]);
-	}
-	
+	g_pTR->SetReplay( &replay );
 
-	if ( 0 == GetMyIP() )
-	{
-		TR_ERROR("Please specify network interface\n");
-		ShowUsage( argv[0] );
-	}
+	if( ! replay.Run( config.pReplayPath ) )
+		return 1;
 
-	sprintf( pStr, "%d", (unsigned int)( ( 0xFF000000 & GetMyIP() ) >> 24 | ( 0x00FF0000 & GetMyIP() ) >> 8 ) );
+	replay.Report();
 
-        if( ! getenv("TENET_LOCAL_ADDRESS"))
-                setenv("TENET_LOCAL_ADDRESS", pStr, 1);
+	g_pTR->SetReplay( NULL );
 
-	struct in_addr in;
-	in.s_addr = GetMyBroadcastAddr();
+	return 0;
+}
+
+// set by SIGTERM/SIGINT; the main loop ends and calls EndTR(). Nothing
+// more is done in the handler, which may run while the socket loop holds
+// a lock the egress thread waits for
+static volatile sig_atomic_t	s_bEndTR = 0;
 
-	setenv("TENET_BROADCAST_ADDRESS", inet_ntoa( in ), 1);
+void OnEndSignal(int n)
+{
+	s_bEndTR = 1;
 }
 
-void EndTR(int n)
+// called by the main thread once its loop ended
+void EndTR(void)
 {
 	g_pTR->Terminate();
 
+	CMetrics::Finalize();
+
 	CMRT_Manager::Finalize();
 	CIPRT_Manager::Finalize();
 
@@ -221,6 +239,10 @@ void EndTR(int n)
 
 	delete g_pTR;
 
+	// after the pipeline stopped, so that nothing is logged anymore
+	if( TR_Arg.pLog )
+		delete TR_Arg.pLog;
+
 	exit(0);
 }
 
@@ -228,6 +250,7 @@ void EndTR(int n)
 int main(int argc, char** argv)
 {
 	TR_Packet	packet;
+	CRouterConfig	config;
 	int		pid = 0;
 
 	TR_Debug.bInteractive = false;
@@ -237,7 +260,7 @@ int main(int argc, char** argv)
 	TR_Debug.bTraceIPRT = false;
 
 	TR_Arg.bInteractive = false;
-	TR_Arg.pLogFile = NULL;
+	TR_Arg.pLog = NULL;
 
 	//packet.header.lMasterIP = GetMyIP();
 
@@ -245,7 +268,9 @@ int main(int argc, char** argv)
 	MSG(" Tenet Router\n");
 	MSG("------------------------------------------------------------\n");
 
-	ParseArgv( argc, argv );
+	ParseArgv( argc, argv, &config );
+
+	config.Show();
 
 	packet.header.lMasterIP = GetMyIP();
 
@@ -266,7 +291,19 @@ int main(int argc, char** argv)
 	CIPRT_Manager::Initialize();
 	CIPRT_Manager::Refresh(0);
 
-	g_pTR = new CTenetRouter();
+	g_pTR = new CTenetRouter( config );
+
+	if( config.pReplayPath[0] )
+	{
+		int nResult = Replay( config );
+
+		// the log of a replay (-l) was never started, deleting it writes it out
+		if( TR_Arg.pLog )
+			delete TR_Arg.pLog;
+
+		exit( nResult );
+	}
+
 	g_pTR->StartServer();
 
 
@@ -285,20 +322,31 @@ int main(int argc, char** argv)
 			exit(0);
 		}
 
-                if( signal(SIGTERM, EndTR) == SIG_ERR)
+                if( signal(SIGTERM, OnEndSignal) == SIG_ERR)
                 {
                         TR_ERROR("singal() error\n");
                         exit(0);
                 }
 
-                if( signal(SIGINT, EndTR) == SIG_ERR)
+                if( signal(SIGINT, OnEndSignal) == SIG_ERR)
                 {
                         TR_ERROR("singal() error\n");
                         exit(0);
                 }
 	}
 
-	while ( true )
+	// threads do not survive fork(), so start them here
+	g_pTR->StartPipeline();
+
+	if( TR_Arg.pLog )
+		TR_Arg.pLog->Start();
+
+	if( config.nMetricsPort )
+		CMetrics::StartServer( config.nMetricsPort );
+
+	// a signal interrupts the wait in CheckAllSocket(), or at the latest
+	// SOCKET_WAIT_TIMEOUT ends it
+	while ( ! s_bEndTR )
 	{
 		//if( TR_Arg.bInteractive )	
 		//{
@@ -318,5 +366,5 @@ int main(int argc, char** argv)
         g_pTR->Timer();
 	}
 
-	EndTR(0);
+	EndTR();
 }
@@ -0,0 +1,357 @@
+/*
+* "Copyright (c) 2006 University of Southern California.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software and its
+* documentation for any purpose, without fee, and without written
+* agreement is hereby granted, provided that the above copyright
+* notice, the following two paragraphs and the author appear in all
+* copies of this software.
+*
+* IN NO EVENT SHALL THE UNIVERSITY OF SOUTHERN CALIFORNIA BE LIABLE TO
+* ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+* DAMAGES ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS
+* DOCUMENTATION, EVEN IF THE UNIVERSITY OF SOUTHERN CALIFORNIA HAS BEEN
+* ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+* THE UNIVERSITY OF SOUTHERN CALIFORNIA SPECIFICALLY DISCLAIMS ANY
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  THE SOFTWARE
+* PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND THE UNIVERSITY OF
+* SOUTHERN CALIFORNIA HAS NO OBLIGATION TO PROVIDE MAINTENANCE,
+* SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
+*
+*/
+
+/*
+* Counters of the Tenet router
+*/
+
+#include "Metrics.h"
+#include "TR_Common.h"
+
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define METRICS_TEXT_SIZE	65536
+#define METRICS_TIMEOUT		1		// sec, for a client to send its request
+
+MetricShard		CMetrics::s_pShards[MAX_METRIC_SHARDS];
+int				CMetrics::s_nShards = 0;
+__thread MetricShard*	CMetrics::t_pShard = NULL;
+
+void			(*CMetrics::s_pSample)(Metrics_Packet*) = NULL;
+
+int				CMetrics::s_fdListen = -1;
+pthread_t		CMetrics::s_thread;
+bool			CMetrics::s_bStarted = false;
+
+struct MetricInfo
+{
+	const char*	pName;
+	const char*	pLabel;		// NULL for none
+	const char*	pType;
+	const char*	pHelp;
+};
+
+// in the order of the METRIC_* enum; metrics of one name must be adjacent
+static const MetricInfo s_pMetricInfo[METRIC_COUNT] =
+{
+	{ "tenet_router_packets_received_total", "source=\"mote\"", "counter", "Packets received, by source" },
+	{ "tenet_router_packets_received_total", "source=\"neighbor\"", "counter", NULL },
+	{ "tenet_router_packets_received_total", "source=\"transport\"", "counter", NULL },
+	{ "tenet_router_packets_sent_total", "destination=\"mote\"", "counter", "Packets sent, by destination" },
+	{ "tenet_router_packets_sent_total", "destination=\"neighbor\"", "counter", NULL },
+	{ "tenet_router_packets_sent_total", "destination=\"transport\"", "counter", NULL },
+	{ "tenet_router_mrt_lookups_total", "result=\"hit\"", "counter", "Unicast lookups of the mote routing table" },
+	{ "tenet_router_mrt_lookups_total", "result=\"miss\"", "counter", NULL },
+	{ "tenet_router_drops_total", "reason=\"loop\"", "counter", "Packets dropped, by reason" },
+	{ "tenet_router_drops_total", "reason=\"ttl\"", "counter", NULL },
+	{ "tenet_router_drops_total", "reason=\"unknown_neighbor\"", "counter", NULL },
+	{ "tenet_router_drops_total", "reason=\"ingress_queue_full\"", "counter", NULL },
+	{ "tenet_router_drops_total", "reason=\"egress_queue_full\"", "counter", NULL },
+	{ "tenet_router_drops_total", "reason=\"tcp_output_full\"", "counter", NULL },
+	{ "tenet_router_drops_total", "reason=\"shm_ring_full\"", "counter", NULL },
+	{ "tenet_router_drops_total", "reason=\"duplicate\"", "counter", NULL },
+	{ "tenet_router_drops_total", "reason=\"next_hop_queue_full\"", "counter", NULL },
+	{ "tenet_router_drops_total", "reason=\"log_ring_full\"", "counter", NULL },
+	{ "tenet_router_queue_depth", "queue=\"ingress\"", "gauge", "Packets waiting between the router threads" },
+	{ "tenet_router_queue_depth", "queue=\"egress\"", "gauge", NULL },
+	{ "tenet_router_queue_depth", "queue=\"shaped\"", "gauge", NULL }
+};
+
+static const char* s_pPathName[METRIC_PATHS] = { "mote", "neighbor", "transport" };
+
+MetricShard* CMetrics::NewShard(void)
+{
+	int nShard = __sync_fetch_and_add(&s_nShards, 1);
+
+	// more threads than shards share the last one and may lose counts
+	if( nShard >= MAX_METRIC_SHARDS )
+	{
+		TR_ERROR("Too many threads for the metrics\n");
+		nShard = MAX_METRIC_SHARDS - 1;
+	}
+
+	return &s_pShards[nShard];
+}
+
+void CMetrics::Initialize(void (*pSample)(Metrics_Packet*))
+{
+	s_pSample = pSample;
+}
+
+// listens on the loopback only; must be called after fork()
+bool CMetrics::StartServer(int nPort)
+{
+	struct sockaddr_in addr;
+	int nOption = 1;
+	sigset_t sigAll;
+	sigset_t sigOld;
+
+	if( 0 > ( s_fdListen = socket(AF_INET, SOCK_STREAM, 0) ) )
+	{
+		TR_ERROR("socket() failed : %s\n", strerror(errno));
+		return false;
+	}
+
+	setsockopt(s_fdListen, SOL_SOCKET, SO_REUSEADDR, &nOption, sizeof(nOption));
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(nPort);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if( 0 > bind(s_fdListen, (struct sockaddr*) &addr, sizeof(addr))
+		|| 0 > listen(s_fdListen, 4) )
+	{
+		TR_ERROR("Cannot listen on port %d : %s\n", nPort, strerror(errno));
+		close(s_fdListen);
+		s_fdListen = -1;
+		return false;
+	}
+
+	// signals are handled by the main thread, as with the pipeline
+	sigfillset(&sigAll);
+	pthread_sigmask(SIG_BLOCK, &sigAll, &sigOld);
+
+	if( 0 != pthread_create(&s_thread, NULL, CMetrics::ServerThread, NULL) )
+	{
+		TR_ERROR("pthread_create() failed\n");
+		pthread_sigmask(SIG_SETMASK, &sigOld, NULL);
+		close(s_fdListen);
+		s_fdListen = -1;
+		return false;
+	}
+
+	pthread_sigmask(SIG_SETMASK, &sigOld, NULL);
+
+	s_bStarted = true;
+
+	return true;
+}
+
+void CMetrics::Finalize(void)
+{
+	if( !s_bStarted )
+		return;
+
+	// wakes accept() up
+	shutdown(s_fdListen, SHUT_RDWR);
+	pthread_join(s_thread, NULL);
+
+	close(s_fdListen);
+	s_fdListen = -1;
+	s_bStarted = false;
+}
+
+void* CMetrics::ServerThread(void* arg)
+{
+	int fd;
+
+	while( true )
+	{
+		if( 0 > ( fd = accept(s_fdListen, NULL, NULL) ) )
+		{
+			if( EINTR == errno || ECONNABORTED == errno )
+				continue;
+
+			break;
+		}
+
+		Serve(fd);
+		close(fd);
+	}
+
+	return NULL;
+}
+
+static bool WriteAll(int fd, const char* pData, int nLen)
+{
+	int nWritten;
+
+	while( nLen > 0 )
+	{
+		if( 0 > ( nWritten = send(fd, pData, nLen, MSG_NOSIGNAL) ) )
+		{
+			if( EINTR == errno )
+				continue;
+
+			return false;
+		}
+
+		pData += nWritten;
+		nLen -= nWritten;
+	}
+
+	return true;
+}
+
+// one snapshot per connection: "binary" gets a Metrics_Packet, an HTTP
+// GET or anything else the Prometheus text
+void CMetrics::Serve(int fd)
+{
+	struct timeval timeout = { METRICS_TIMEOUT, 0 };
+	char	pRequest[MAX_STRING_SIZE];
+	int		nLen;
+
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+	if( 0 > ( nLen = recv(fd, pRequest, sizeof(pRequest) - 1, 0) ) )
+		return;
+
+	pRequest[nLen] = '\0';
+
+	if( 0 == strncmp(pRequest, "binary", 6) )
+	{
+		Metrics_Packet packet;
+
+		MakeMetrics_Packet(&packet);
+		WriteAll(fd, (char*) &packet, sizeof(packet));
+	}
+	else
+	{
+		char*	pStr = (char*) malloc(METRICS_TEXT_SIZE);
+		char	pHeader[MAX_STRING_SIZE];
+
+		if( NULL == pStr )
+			return;
+
+		nLen = MakePrometheusText(pStr, METRICS_TEXT_SIZE);
+
+		if( 0 == strncmp(pRequest, "GET ", 4) )
+		{
+			sprintf(pHeader, "HTTP/1.0 200 OK\r\n"
+				"Content-Type: text/plain; version=0.0.4\r\n"
+				"Content-Length: %d\r\n\r\n", nLen);
+
+			WriteAll(fd, pHeader, strlen(pHeader));
+		}
+
+		WriteAll(fd, pStr, nLen);
+		free(pStr);
+	}
+}
+
+void CMetrics::MakeMetrics_Packet(Metrics_Packet* pPacket)
+{
+	int nShards = s_nShards < MAX_METRIC_SHARDS ? s_nShards : MAX_METRIC_SHARDS;
+
+	memset(pPacket, 0, sizeof(Metrics_Packet));
+
+	pPacket->nMagic = METRICS_MAGIC;
+	pPacket->nVersion = METRICS_VERSION;
+	pPacket->nTime = time(NULL);
+
+	// the shards are read while their threads write them; every value is
+	// a word, so a sum may only miss the latest increments
+	for( int i = 0 ; i < nShards ; i++ )
+	{
+		MetricShard* pShard = &s_pShards[i];
+
+		for( int j = 0 ; j < METRIC_COUNT ; j++ )
+			pPacket->pCounters[j] += pShard->pCounters[j];
+
+		for( int nFrom = 0 ; nFrom < METRIC_PATHS ; nFrom++ )
+		{
+			for( int nTo = 0 ; nTo < METRIC_PATHS ; nTo++ )
+			{
+				for( int k = 0 ; k <= METRIC_LATENCY_BUCKETS ; k++ )
+					pPacket->pLatency[nFrom][nTo][k] += pShard->pLatency[nFrom][nTo][k];
+
+				pPacket->pLatencySum[nFrom][nTo] += pShard->pLatencySum[nFrom][nTo];
+			}
+		}
+	}
+
+	if( s_pSample )
+		s_pSample(pPacket);
+}
+
+int CMetrics::MakePrometheusText(char* pStr, int nSize)
+{
+	Metrics_Packet packet;
+	int nLen = 0;
+
+	MakeMetrics_Packet(&packet);
+
+#define APPEND(fmt, args...) \
+	if( nLen < nSize ) \
+		nLen += snprintf(pStr + nLen, nSize - nLen, fmt, ## args);
+
+	for( int i = 0 ; i < METRIC_COUNT ; i++ )
+	{
+		const MetricInfo* pInfo = &s_pMetricInfo[i];
+
+		if( pInfo->pHelp )
+		{
+			APPEND("# HELP %s %s\n", pInfo->pName, pInfo->pHelp);
+			APPEND("# TYPE %s %s\n", pInfo->pName, pInfo->pType);
+		}
+
+		APPEND("%s{%s} %llu\n", pInfo->pName, pInfo->pLabel, (unsigned long long) packet.pCounters[i]);
+	}
+
+	APPEND("# HELP tenet_router_latency_microseconds Time from receiving a packet to sending it on, by path\n");
+	APPEND("# TYPE tenet_router_latency_microseconds histogram\n");
+
+	for( int nFrom = 0 ; nFrom < METRIC_PATHS ; nFrom++ )
+	{
+		for( int nTo = 0 ; nTo < METRIC_PATHS ; nTo++ )
+		{
+			unsigned long long lCount = 0;
+
+			for( int k = 0 ; k <= METRIC_LATENCY_BUCKETS ; k++ )
+			{
+				lCount += packet.pLatency[nFrom][nTo][k];
+
+				if( k < METRIC_LATENCY_BUCKETS )
+				{
+					APPEND("tenet_router_latency_microseconds_bucket{source=\"%s\",destination=\"%s\",le=\"%lu\"} %llu\n",
+						s_pPathName[nFrom], s_pPathName[nTo], 1UL << k, lCount);
+				}
+				else
+				{
+					APPEND("tenet_router_latency_microseconds_bucket{source=\"%s\",destination=\"%s\",le=\"+Inf\"} %llu\n",
+						s_pPathName[nFrom], s_pPathName[nTo], lCount);
+				}
+			}
+
+			APPEND("tenet_router_latency_microseconds_sum{source=\"%s\",destination=\"%s\"} %llu\n",
+				s_pPathName[nFrom], s_pPathName[nTo], (unsigned long long) packet.pLatencySum[nFrom][nTo]);
+			APPEND("tenet_router_latency_microseconds_count{source=\"%s\",destination=\"%s\"} %llu\n",
+				s_pPathName[nFrom], s_pPathName[nTo], lCount);
+		}
+	}
+
+#undef APPEND
+
+	return nLen < nSize ? nLen : nSize - 1;
+}
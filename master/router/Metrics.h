@@ -0,0 +1,168 @@
+/*
+* "Copyright (c) 2006 University of Southern California.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software and its
+* documentation for any purpose, without fee, and without written
+* agreement is hereby granted, provided that the above copyright
+* notice, the following two paragraphs and the author appear in all
+* copies of this software.
+*
+* IN NO EVENT SHALL THE UNIVERSITY OF SOUTHERN CALIFORNIA BE LIABLE TO
+* ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+* DAMAGES ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS
+* DOCUMENTATION, EVEN IF THE UNIVERSITY OF SOUTHERN CALIFORNIA HAS BEEN
+* ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+* THE UNIVERSITY OF SOUTHERN CALIFORNIA SPECIFICALLY DISCLAIMS ANY
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  THE SOFTWARE
+* PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND THE UNIVERSITY OF
+* SOUTHERN CALIFORNIA HAS NO OBLIGATION TO PROVIDE MAINTENANCE,
+* SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
+*
+*/
+
+/*
+* Counters of the Tenet router
+*
+* Every thread counts into a shard of its own, so recording is a plain
+* increment without locks or atomic instructions; a snapshot adds the
+* shards up. Snapshots are served on a local TCP port (-mp), either as
+* Prometheus text (also to an HTTP GET, so it can be scraped directly)
+* or, to a "binary" request, as a Metrics_Packet.
+*/
+
+#ifndef _METRICS_H_
+#define _METRICS_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+
+#define MAX_METRIC_SHARDS		16
+#define METRIC_PATHS			3		// PACKET_FROM_* and EGRESS_TO_* share their numbers
+#define METRIC_LATENCY_BUCKETS	20		// up to 2^19 usec, and one for anything slower
+
+#define METRICS_MAGIC			0x4d525454	// "TTRM"
+#define METRICS_VERSION			4
+
+enum
+{
+	// counted where it happens
+	METRIC_RX_MOTE = 0,				// received, by PACKET_FROM_*
+	METRIC_RX_NEIGHBOR,
+	METRIC_RX_TRANSPORT,
+	METRIC_TX_MOTE,					// sent, by EGRESS_TO_*
+	METRIC_TX_NEIGHBOR,
+	METRIC_TX_TRANSPORT,
+	METRIC_MRT_HIT,
+	METRIC_MRT_MISS,
+	METRIC_DROP_LOOP,
+	METRIC_DROP_TTL,
+	METRIC_DROP_UNKNOWN_NEIGHBOR,
+	METRIC_DROP_INGRESS_FULL,
+	METRIC_DROP_EGRESS_FULL,
+	METRIC_DROP_TCP_OUTPUT_FULL,	// by CTCP_Client::Queue()
+	METRIC_DROP_SHM_FULL,			// by CShmClient::Send()
+	METRIC_DROP_DUPLICATE,			// by CDedupCache
+	METRIC_DROP_NEXT_HOP_FULL,		// by CEgressShaper
+
+	// sampled by the snapshot callback, except where noted
+	METRIC_DROP_LOG_FULL,
+	METRIC_QUEUE_INGRESS,
+	METRIC_QUEUE_EGRESS,
+	METRIC_QUEUE_SHAPED,			// kept by CEgressShaper with Add()
+
+	METRIC_COUNT
+};
+
+struct MetricShard
+{
+	unsigned long	pCounters[METRIC_COUNT];
+	unsigned long	pLatency[METRIC_PATHS][METRIC_PATHS][METRIC_LATENCY_BUCKETS + 1];
+	unsigned long	pLatencySum[METRIC_PATHS][METRIC_PATHS];	// usec
+}__attribute__((aligned(64)));
+
+// the binary snapshot, in the byte order of the router
+struct Metrics_Packet
+{
+	uint32_t	nMagic;
+	uint32_t	nVersion;
+	uint64_t	nTime;		// sec since the epoch
+	uint64_t	pCounters[METRIC_COUNT];
+	uint64_t	pLatency[METRIC_PATHS][METRIC_PATHS][METRIC_LATENCY_BUCKETS + 1];
+	uint64_t	pLatencySum[METRIC_PATHS][METRIC_PATHS];
+}__attribute__((packed));
+
+class CMetrics
+{
+public:
+	static void	Count(int nMetric)
+	{
+		GetShard()->pCounters[nMetric]++;
+	}
+
+	// for a gauge that a single thread counts up and down
+	static void	Add(int nMetric, long nDelta)
+	{
+		GetShard()->pCounters[nMetric] += nDelta;
+	}
+
+	// a packet received at lReceived (Now()) from nFrom left towards nTo
+	static void	Latency(int nFrom, int nTo, unsigned long lReceived, unsigned long lNow)
+	{
+		MetricShard* pShard = GetShard();
+		unsigned long lLatency = lNow - lReceived;
+		int nBucket = 0 == lLatency ? 0 : 8 * sizeof(long) - __builtin_clzl(lLatency);
+
+		if( nBucket > METRIC_LATENCY_BUCKETS )
+			nBucket = METRIC_LATENCY_BUCKETS;
+
+		pShard->pLatency[nFrom][nTo][nBucket]++;
+		pShard->pLatencySum[nFrom][nTo] += lLatency;
+	}
+
+	// monotonic usec
+	static unsigned long	Now(void)
+	{
+		struct timespec timeNow;
+
+		clock_gettime(CLOCK_MONOTONIC, &timeNow);
+
+		return timeNow.tv_sec * 1000000UL + timeNow.tv_nsec / 1000;
+	}
+
+	// pSample fills the sampled values in; called on the metrics thread
+	static void	Initialize(void (*pSample)(Metrics_Packet*));
+	static bool	StartServer(int nPort);
+	static void	Finalize(void);
+
+	static void	MakeMetrics_Packet(Metrics_Packet* pPacket);
+	static int	MakePrometheusText(char* pStr, int nSize);
+
+private:
+	static MetricShard	s_pShards[MAX_METRIC_SHARDS];
+	static int			s_nShards;
+	static __thread MetricShard*	t_pShard;
+
+	static void		(*s_pSample)(Metrics_Packet*);
+
+	static int			s_fdListen;
+	static pthread_t	s_thread;
+	static bool			s_bStarted;
+
+	static MetricShard*	GetShard(void)
+	{
+		if( NULL == t_pShard )
+			t_pShard = NewShard();
+
+		return t_pShard;
+	}
+
+	static MetricShard*	NewShard(void);
+	static void*	ServerThread(void* arg);
+	static void		Serve(int fd);
+};
+
+#endif
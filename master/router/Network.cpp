@@ -43,6 +43,7 @@
 //#include <netinet/in.h>
 #include <arpa/inet.h>
 #include <sys/time.h>
+#include <fcntl.h>
 
 #include "TR_Common.h"
 
@@ -318,29 +319,67 @@ bool GetDefaultNetworkInterface(char* pStr)
 	return bResult;
 }
 
+// GetMyIP() is on the packet path, so both addresses are looked up once
+// and kept until InvalidateMyAddr() reports an address change
+static volatile uint32_t	s_nMyIP;
+static volatile uint32_t	s_nMyBroadcastAddr;
+
+// where they come from, see SetMyAddrSource()
+static char		s_pMyInterface[MAX_STRING_SIZE];
+static uint32_t	s_nDefaultIP;
+static uint32_t	s_nDefaultBroadcastAddr;
+
+void SetMyAddrSource(const char* pInterface, uint32_t nDefaultIP, uint32_t nDefaultBroadcastAddr)
+{
+	strncpy( s_pMyInterface, pInterface, MAX_STRING_SIZE - 1 );
+	s_nDefaultIP = nDefaultIP;
+	s_nDefaultBroadcastAddr = nDefaultBroadcastAddr;
+
+	InvalidateMyAddr();
+}
+
+static uint32_t LoadMyIP(void)
+{
+	if( s_nDefaultIP )
+		return s_nDefaultIP;
+
+	return GetAddress( s_pMyInterface, IP_ADDRESS );
+}
+
+static uint32_t LoadMyBroadcastAddr(void)
+{
+	if( s_nDefaultBroadcastAddr )
+		return s_nDefaultBroadcastAddr;
+
+	return GetAddress( s_pMyInterface, BROADCAST_ADDRESS );
+}
+
+// an interface without an address is not cached, it is asked again
 uint32_t GetMyIP(void)
 {
-        if( getenv("TENET_ROUTER_DEFAULT_IP_ADDRESS") )
-        {
-             uint32_t nAddr;
-             inet_aton( getenv("TENET_ROUTER_DEFAULT_IP_ADDRESS"), (in_addr*) &nAddr);
-             //printf("TENET_ROUTER_DEFAULT_IP_ADDRESS %X\n", nAddr);
-             return nAddr;
-        }
+	uint32_t nAddr = s_nMyIP;
+
+	if( 0 == nAddr )
+		s_nMyIP = nAddr = LoadMyIP();
 
-        return GetAddress( getenv("TENET_ROUTER_INTERFACE"), IP_ADDRESS );}
+	return nAddr;
+}
 
 uint32_t GetMyBroadcastAddr(void)
 {
-        if( getenv("TENET_ROUTER_DEFAULT_BROADCAST_ADDRESS") )
-        {
-             uint32_t nAddr;
-             inet_aton( getenv("TENET_ROUTER_DEFAULT_BROADCAST_ADDRESS"), (in_addr*) &nAddr);
-             //printf("TENET_ROUTER_DEFAULT_BROADCAST_ADDRESS %X\n", nAddr);
-             return nAddr;
-        }
+	uint32_t nAddr = s_nMyBroadcastAddr;
 
-        return GetAddress( getenv("TENET_ROUTER_INTERFACE"), BROADCAST_ADDRESS );}
+	if( 0 == nAddr )
+		s_nMyBroadcastAddr = nAddr = LoadMyBroadcastAddr();
+
+	return nAddr;
+}
+
+void InvalidateMyAddr(void)
+{
+	s_nMyIP = 0;
+	s_nMyBroadcastAddr = 0;
+}
 
 bool IsInTheSameMachine( uint32_t nAddr )
 {
@@ -350,10 +389,25 @@ bool IsInTheSameMachine( uint32_t nAddr )
 	return false;
 }
 
+bool SetNonBlocking( int fd )
+{
+	int	nFlags = fcntl( fd, F_GETFL, 0 );
+
+	return ( -1 != nFlags && -1 != fcntl( fd, F_SETFL, nFlags | O_NONBLOCK ) );
+}
+
 NetworkSocketMap	CNetwork::m_NetworkSocketMap;
+NetworkReadyList	CNetwork::s_listReady;
+#ifdef USE_EPOLL
+int					CNetwork::s_fdEpoll = -1;
+#endif
 
 CNetwork::CNetwork(void)
 {
+	m_fdSocket = -1;
+	m_bReady = false;
+	m_bWatchOutput = false;
+
 	CNetwork::Add(this);
 }
 
@@ -362,83 +416,195 @@ CNetwork::~CNetwork(void)
 	CNetwork::Remove(this);
 }
 
-
+// Registers pNetwork->m_fdSocket for readiness notification.
+// Calling it again after the socket changed (e.g. reconnect) re-registers
+// the object with its new descriptor.
 void CNetwork::Add(CNetwork* pNetwork)
 {
-	CNetwork::m_NetworkSocketMap.insert( NetworkSocketPair( pNetwork, pNetwork->m_fdSocket ) );
+	NetworkSocketMapIter iter = CNetwork::m_NetworkSocketMap.find( pNetwork );
+
+	if( iter != CNetwork::m_NetworkSocketMap.end() )
+	{
+		if( iter->second == pNetwork->m_fdSocket )
+			return;
+
+#ifdef USE_EPOLL
+		if( -1 != iter->second )
+			epoll_ctl( CNetwork::s_fdEpoll, EPOLL_CTL_DEL, iter->second, NULL );
+#endif
+		iter->second = pNetwork->m_fdSocket;
+	}
+	else
+	{
+		CNetwork::m_NetworkSocketMap.insert( NetworkSocketPair( pNetwork, pNetwork->m_fdSocket ) );
+	}
+
+#ifdef USE_EPOLL
+	if( -1 == pNetwork->m_fdSocket )
+		return;
+
+	if( -1 == CNetwork::s_fdEpoll && -1 == ( CNetwork::s_fdEpoll = epoll_create( MAX_EPOLL_EVENTS ) ) )
+	{
+		TR_ERROR("epoll_create() failed\n");
+		exit(1);
+	}
+
+	struct epoll_event ev;
+
+	memset( &ev, 0, sizeof(ev) );
+	ev.events = EPOLLIN | EPOLLET | ( pNetwork->m_bWatchOutput ? EPOLLOUT : 0 );
+	ev.data.ptr = pNetwork;
+
+	if( epoll_ctl( CNetwork::s_fdEpoll, EPOLL_CTL_ADD, pNetwork->m_fdSocket, &ev ) < 0 )
+		TR_ERROR("epoll_ctl(EPOLL_CTL_ADD) failed\n");
+#endif
 }
 
+// Unregisters pNetwork. Must be called before its socket is closed.
 void CNetwork::Remove(CNetwork* pNetwork)
 {
-	CNetwork::m_NetworkSocketMap.erase( CNetwork::m_NetworkSocketMap.find( pNetwork ) );
+	NetworkSocketMapIter iter = CNetwork::m_NetworkSocketMap.find( pNetwork );
+
+	if( iter == CNetwork::m_NetworkSocketMap.end() )
+		return;
+
+#ifdef USE_EPOLL
+	if( -1 != iter->second )
+		epoll_ctl( CNetwork::s_fdEpoll, EPOLL_CTL_DEL, iter->second, NULL );
+#endif
+
+	if( pNetwork->m_bReady )
+	{
+		CNetwork::s_listReady.remove( pNetwork );
+		pNetwork->m_bReady = false;
+	}
+
+	CNetwork::m_NetworkSocketMap.erase( iter );
 }
 
-void CNetwork::CheckAllSocket(void)
+bool CNetwork::IsRegistered(CNetwork* pNetwork)
 {
-	CNetwork* pNetwork;
+	NetworkSocketMapIter iter = CNetwork::m_NetworkSocketMap.find( pNetwork );
 
-	NetworkSocketMapIter iter;
+	return ( iter != CNetwork::m_NetworkSocketMap.end() && -1 != iter->second );
+}
 
-	int		nMaxFD = -1;
-	fd_set	fds;
-	struct timeval	tv;
+void CNetwork::CheckAllSocket(void)
+{
+	CNetwork* pNetwork;
 
-	tv.tv_sec = 1;
-	tv.tv_usec = 0;
+	int		nTimeout = CNetwork::s_listReady.empty() ? SOCKET_WAIT_TIMEOUT : 0;
+	int		n;
 
-	FD_ZERO(&fds);			
+#ifdef USE_EPOLL
+	struct epoll_event	events[MAX_EPOLL_EVENTS];
 
-	if( 0 == CNetwork::m_NetworkSocketMap.size() )
+	if( -1 == CNetwork::s_fdEpoll )
 		return;
 
-	iter = CNetwork::m_NetworkSocketMap.begin();
+	n = epoll_wait( CNetwork::s_fdEpoll, events, MAX_EPOLL_EVENTS, nTimeout );
 
-	do
+	for( int i = 0 ; i < n ; i++ )
 	{
-		pNetwork = ( (CNetwork*)iter->first );
+		pNetwork = (CNetwork*) events[i].data.ptr;
 
-		if( NULL == pNetwork )
-			break;
+		if( events[i].events & EPOLLOUT )
+			pNetwork->OnWritable();
 
-		if( -1 != pNetwork->m_fdSocket)
-		{
-			FD_SET(pNetwork->m_fdSocket, &fds);	
+		if( 0 == ( events[i].events & ( EPOLLIN | EPOLLERR | EPOLLHUP ) ) )
+			continue;
 
-			if( nMaxFD < pNetwork->m_fdSocket )
-				nMaxFD = pNetwork->m_fdSocket;
+		if( ! pNetwork->m_bReady )
+		{
+			pNetwork->m_bReady = true;
+			CNetwork::s_listReady.push_back( pNetwork );
 		}
+	}
+#else
+	NetworkSocketMapIter iter;
+
+	int		nMaxFD = -1;
+	fd_set	fds;
+	fd_set	fdsWrite;
+	struct timeval	tv;
 
-		iter++;
+	tv.tv_sec = nTimeout / 1000;
+	tv.tv_usec = ( nTimeout % 1000 ) * 1000;
 
-		if( iter == CNetwork::m_NetworkSocketMap.end() )
-			break;
+	FD_ZERO(&fds);			
+	FD_ZERO(&fdsWrite);
 
-	}while(1);
+	for( iter = CNetwork::m_NetworkSocketMap.begin() ; iter != CNetwork::m_NetworkSocketMap.end() ; iter++ )
+	{
+		if( -1 != iter->second )
+		{
+			FD_SET(iter->second, &fds);	
 
+			if( iter->first->m_bWatchOutput && iter->first->HasPendingOutput() )
+				FD_SET(iter->second, &fdsWrite);
 
-	if (select(nMaxFD+1, &fds, NULL, NULL, &tv) <= 0)
+			if( nMaxFD < iter->second )
+				nMaxFD = iter->second;
+		}
+	}
+
+	if( -1 == nMaxFD )
 		return;
 
-	iter = CNetwork::m_NetworkSocketMap.begin();
+	n = select(nMaxFD+1, &fds, &fdsWrite, NULL, &tv);
 
-	do
+	for( iter = CNetwork::m_NetworkSocketMap.begin() ; n > 0 && iter != CNetwork::m_NetworkSocketMap.end() ; iter++ )
 	{
-		pNetwork = ( (CNetwork*)iter->first );
+		pNetwork = iter->first;
 
-		if( NULL == pNetwork )
-			break;
+		if( -1 != iter->second && FD_ISSET(iter->second, &fdsWrite) )
+			pNetwork->OnWritable();
 
-		if (FD_ISSET (pNetwork->m_fdSocket, &fds))
-			pNetwork->Process();
+		if( -1 != iter->second && FD_ISSET(iter->second, &fds) && ! pNetwork->m_bReady )
+		{
+			pNetwork->m_bReady = true;
+			CNetwork::s_listReady.push_back( pNetwork );
+		}
+	}
+#endif
 
-		iter++;
+	// Give every ready object one Process() per round, so that one busy
+	// socket cannot starve the others. Process() may unregister or delete
+	// any object, which also takes it off s_listReady.
+	for( size_t nReady = CNetwork::s_listReady.size() ; 
+		nReady > 0 && ! CNetwork::s_listReady.empty() ; nReady-- )
+	{
+		pNetwork = CNetwork::s_listReady.front();
+		CNetwork::s_listReady.pop_front();
+		pNetwork->m_bReady = false;
+
+#ifdef USE_EPOLL
+		// Edge-triggered readiness is reported only once, so an object
+		// that did not read its socket dry stays queued for the next round.
+		if( pNetwork->Process() && CNetwork::IsRegistered( pNetwork ) )
+		{
+			pNetwork->m_bReady = true;
+			CNetwork::s_listReady.push_back( pNetwork );
+		}
+#else
+		pNetwork->Process();
+#endif
+	}
+}
 
-		if( iter == CNetwork::m_NetworkSocketMap.end() )
-			break;
-	}while(1);
+bool CNetwork::Process()
+{
+	return false;
 }
 
-void CNetwork::Process()
+// called by the socket loop when m_bWatchOutput is set and the socket
+// can take more output
+void CNetwork::OnWritable(void)
 {
 	return;
 }
+
+bool CNetwork::HasPendingOutput(void)
+{
+	return false;
+}
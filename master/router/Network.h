@@ -40,8 +40,19 @@
 #include <arpa/inet.h>	//inet_addr()
 #include <unistd.h>		//close()
 #include <map>
+#include <list>
 using namespace std;
 
+// On Linux, sockets are multiplexed with an edge-triggered epoll set.
+// Other platforms fall back to select().
+#ifdef __linux__
+#define USE_EPOLL
+#include <sys/epoll.h>
+#endif
+
+#define MAX_EPOLL_EVENTS	64
+#define SOCKET_WAIT_TIMEOUT	1000	// msec
+
 #define	REGULAR_PACKET		0
 #define WITH_ACK_REQUEST	1
 #define	ACK					2
@@ -57,15 +68,21 @@ enum ADDRESS_TYPE
 
 uint32_t GetAddress(char* pName, int nType, uint32_t nIsMyAddr = 0);
 bool GetDefaultNetworkInterface(char* pStr);
+// the interface, or fixed addresses if not 0, that GetMyIP() and
+// GetMyBroadcastAddr() report
+void SetMyAddrSource(const char* pInterface, uint32_t nDefaultIP, uint32_t nDefaultBroadcastAddr);
 uint32_t GetMyIP(void);
 uint32_t GetMyBroadcastAddr(void);
+void InvalidateMyAddr(void);
 bool IsInTheSameMachine( uint32_t nAddr );
+bool SetNonBlocking( int fd );
 
 class CNetwork;
 
 typedef map <CNetwork*, int> NetworkSocketMap;
 typedef map <CNetwork*, int>::iterator NetworkSocketMapIter;
 typedef pair <CNetwork*, int> NetworkSocketPair;
+typedef list <CNetwork*> NetworkReadyList;
 
 // Socket base class
 class CNetwork
@@ -78,13 +95,25 @@ public:
 
 protected:
 	int		m_fdSocket;				// Socket descriptor for server 
+	bool	m_bReady;				// queued on s_listReady
+	bool	m_bWatchOutput;			// also wants OnWritable() calls; set before Add()
 
-	static NetworkSocketMap	m_NetworkSocketMap;
+	static NetworkSocketMap	m_NetworkSocketMap;	// object -> registered socket
+	static NetworkReadyList	s_listReady;		// objects that may have unread input
+#ifdef USE_EPOLL
+	static int		s_fdEpoll;
+#endif
 
 	static void Add(CNetwork* pNetwork);
 	static void Remove(CNetwork* pNetwork);
-
-	virtual void Process(void);
+	static bool IsRegistered(CNetwork* pNetwork);
+
+	// Reads what the socket has. Returns true if it stopped before the
+	// socket ran dry (EAGAIN, or a short read), so that the socket loop
+	// calls it again: edge-triggered readiness is not reported twice.
+	virtual bool Process(void);
+	virtual void OnWritable(void);
+	virtual bool HasPendingOutput(void);
 };
 
 #endif
@@ -0,0 +1,280 @@
+/*
+* "Copyright (c) 2006 University of Southern California.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software and its
+* documentation for any purpose, without fee, and without written
+* agreement is hereby granted, provided that the above copyright
+* notice, the following two paragraphs and the author appear in all
+* copies of this software.
+*
+* IN NO EVENT SHALL THE UNIVERSITY OF SOUTHERN CALIFORNIA BE LIABLE TO
+* ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+* DAMAGES ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS
+* DOCUMENTATION, EVEN IF THE UNIVERSITY OF SOUTHERN CALIFORNIA HAS BEEN
+* ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+* THE UNIVERSITY OF SOUTHERN CALIFORNIA SPECIFICALLY DISCLAIMS ANY
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  THE SOFTWARE
+* PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND THE UNIVERSITY OF
+* SOUTHERN CALIFORNIA HAS NO OBLIGATION TO PROVIDE MAINTENANCE,
+* SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
+*
+*/
+
+/*
+* Binary packet log of the Tenet router (-l)
+*/
+
+#include "PacketLog.h"
+#include "TR_Common.h"
+
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+CPacketLog::CPacketLog(char* pStrPath, unsigned long nMaxSize, unsigned int nMaxAge)
+{
+	strncpy(m_pStrPath, pStrPath, sizeof(m_pStrPath) - 1);
+	m_pStrPath[sizeof(m_pStrPath) - 1] = '\0';
+
+	m_nMaxSize = nMaxSize;
+	m_nMaxAge = nMaxAge;
+
+	m_fd = -1;
+	m_nHead = 0;
+	m_nTail = 0;
+	m_nDrops = 0;
+
+	m_bStarted = false;
+	m_bStop = false;
+	sem_init(&m_semFlush, 0, 0);
+
+	if( NULL == ( m_pRing = (char*) malloc(PACKET_LOG_RING_SIZE) ) )
+	{
+		TR_ERROR("malloc() failed\n");
+		exit(1);
+	}
+
+	if( !Open() )
+		exit(1);
+}
+
+CPacketLog::~CPacketLog(void)
+{
+	if( m_bStarted )
+	{
+		m_bStop = true;
+		sem_post(&m_semFlush);
+		pthread_join(m_thread, NULL);
+	}
+	else
+	{
+		Flush();
+	}
+
+	if( m_fd >= 0 )
+		close(m_fd);
+
+	free(m_pRing);
+	sem_destroy(&m_semFlush);
+}
+
+bool CPacketLog::Start(void)
+{
+	sigset_t sigAll;
+	sigset_t sigOld;
+
+	// signals are handled by the main thread, as with the pipeline
+	sigfillset(&sigAll);
+	pthread_sigmask(SIG_BLOCK, &sigAll, &sigOld);
+
+	if( 0 != pthread_create(&m_thread, NULL, CPacketLog::WriterThread, (void*)this) )
+	{
+		TR_ERROR("pthread_create() failed\n");
+		pthread_sigmask(SIG_SETMASK, &sigOld, NULL);
+		return false;
+	}
+
+	pthread_sigmask(SIG_SETMASK, &sigOld, NULL);
+
+	m_bStarted = true;
+
+	return true;
+}
+
+// names a file after the time it was opened, as the text log was
+bool CPacketLog::Open(void)
+{
+	struct tm *t;
+	char	pStrLog[MAX_STRING_SIZE * 2];
+	int		fd;
+	PacketLogHeader header;
+
+	time(&m_timeOpened);
+	t = localtime(&m_timeOpened);
+
+	sprintf( pStrLog, "%s/%d-%d-%d-%d-%d",
+			m_pStrPath,
+			t->tm_mon+1,
+			t->tm_mday,
+			t->tm_hour,
+			t->tm_min,
+			t->tm_sec);
+
+	// rotated more than once a second
+	for( int i = 1 ; 0 > ( fd = open(pStrLog, O_WRONLY | O_CREAT | O_EXCL, 0644) ) && EEXIST == errno ; i++ )
+	{
+		sprintf( pStrLog + strlen(m_pStrPath) + 1, "%d-%d-%d-%d-%d-%d",
+				t->tm_mon+1,
+				t->tm_mday,
+				t->tm_hour,
+				t->tm_min,
+				t->tm_sec,
+				i);
+	}
+
+	if( fd < 0 )
+	{
+		TR_ERROR("File open error : [%s]\n", pStrLog);
+		return false;
+	}
+
+	if( m_fd >= 0 )
+		close(m_fd);
+
+	m_fd = fd;
+	m_nSize = 0;
+
+	header.nMagic = PACKET_LOG_MAGIC;
+	header.nVersion = PACKET_LOG_VERSION;
+	WriteFile((char*) &header, sizeof(header));
+
+	return true;
+}
+
+void CPacketLog::WriteFile(char* pData, unsigned long nLen)
+{
+	ssize_t	nWritten;
+
+	while( nLen > 0 )
+	{
+		if( 0 > ( nWritten = write(m_fd, pData, nLen) ) )
+		{
+			if( EINTR == errno )
+				continue;
+
+			TR_ERROR("write() failed : %s\n", strerror(errno));
+			return;
+		}
+
+		pData += nWritten;
+		nLen -= nWritten;
+		m_nSize += nWritten;
+	}
+}
+
+// copies to position nPos of the ring; returns the position after it
+unsigned long CPacketLog::Copy(unsigned long nPos, char* pData, unsigned long nLen)
+{
+	unsigned long nOffset = nPos & (PACKET_LOG_RING_SIZE - 1);
+	unsigned long nFirst = PACKET_LOG_RING_SIZE - nOffset;
+
+	if( nFirst > nLen )
+		nFirst = nLen;
+
+	memcpy(m_pRing + nOffset, pData, nFirst);
+	memcpy(m_pRing, pData + nFirst, nLen - nFirst);
+
+	return nPos + nLen;
+}
+
+void CPacketLog::Write(char* pData, int nLen, unsigned int nFrom, unsigned int nBase,
+	uint32_t lMasterIP, uint32_t nNeighborIP)
+{
+	PacketLogRecord record;
+	struct timeval	tv;
+	unsigned long	nUsed = m_nTail - m_nHead;
+	unsigned long	nRecord = sizeof(PacketLogRecord) + nLen;
+
+	if( PACKET_LOG_RING_SIZE - nUsed < nRecord )
+	{
+		m_nDrops++;
+		return;
+	}
+
+	gettimeofday(&tv, NULL);
+
+	record.nLen = nLen;
+	record.nFrom = nFrom;
+	record.nBase = nBase;
+	record.nSec = tv.tv_sec;
+	record.nUsec = tv.tv_usec;
+	record.lMasterIP = lMasterIP;
+	record.nNeighborIP = nNeighborIP;
+
+	// the writer must be done with the space before we reuse it
+	__sync_synchronize();
+
+	Copy( Copy(m_nTail, (char*) &record, sizeof(record)), pData, nLen );
+
+	// publish the record before the new tail
+	__sync_synchronize();
+	m_nTail += nRecord;
+
+	if( nUsed < PACKET_LOG_FLUSH_SIZE && nUsed + nRecord >= PACKET_LOG_FLUSH_SIZE )
+		sem_post(&m_semFlush);
+}
+
+// writes out everything published so far, in a new file if it is time to
+void CPacketLog::Flush(void)
+{
+	unsigned long nTail = m_nTail;
+	unsigned long nOffset;
+	unsigned long nFirst;
+
+	if( nTail == m_nHead )
+		return;
+
+	__sync_synchronize();
+
+	if( ( m_nMaxSize && m_nSize >= m_nMaxSize )
+		|| ( m_nMaxAge && time(NULL) - m_timeOpened >= (time_t) m_nMaxAge ) )
+		Open();
+
+	nOffset = m_nHead & (PACKET_LOG_RING_SIZE - 1);
+	nFirst = PACKET_LOG_RING_SIZE - nOffset;
+
+	if( nFirst > nTail - m_nHead )
+		nFirst = nTail - m_nHead;
+
+	WriteFile(m_pRing + nOffset, nFirst);
+	WriteFile(m_pRing, nTail - m_nHead - nFirst);
+
+	__sync_synchronize();
+	m_nHead = nTail;
+}
+
+void* CPacketLog::WriterThread(void* arg)
+{
+	CPacketLog* pLog = (CPacketLog*) arg;
+	struct timespec timeAbs;
+
+	while( !pLog->m_bStop )
+	{
+		clock_gettime(CLOCK_REALTIME, &timeAbs);
+		timeAbs.tv_sec += PACKET_LOG_FLUSH_INTERVAL;
+
+		sem_timedwait(&pLog->m_semFlush, &timeAbs);
+
+		pLog->Flush();
+	}
+
+	pLog->Flush();
+
+	return NULL;
+}
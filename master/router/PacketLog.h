@@ -0,0 +1,121 @@
+/*
+* "Copyright (c) 2006 University of Southern California.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software and its
+* documentation for any purpose, without fee, and without written
+* agreement is hereby granted, provided that the above copyright
+* notice, the following two paragraphs and the author appear in all
+* copies of this software.
+*
+* IN NO EVENT SHALL THE UNIVERSITY OF SOUTHERN CALIFORNIA BE LIABLE TO
+* ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+* DAMAGES ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS
+* DOCUMENTATION, EVEN IF THE UNIVERSITY OF SOUTHERN CALIFORNIA HAS BEEN
+* ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+* THE UNIVERSITY OF SOUTHERN CALIFORNIA SPECIFICALLY DISCLAIMS ANY
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  THE SOFTWARE
+* PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND THE UNIVERSITY OF
+* SOUTHERN CALIFORNIA HAS NO OBLIGATION TO PROVIDE MAINTENANCE,
+* SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
+*
+*/
+
+/*
+* Binary packet log of the Tenet router (-l)
+*
+* Write() only copies a record into a ring buffer; a thread of its own
+* writes the ring to the file and starts a new file once the current one
+* is too large or too old. Records that do not fit into the ring are
+* dropped and counted. logconv turns a log back into the text format the
+* router used to write.
+*
+* A log starts with a PacketLogHeader, followed by one PacketLogRecord
+* and nLen bytes of TOS_Msg per packet, in the byte order of the router.
+* Every packet that reaches DispatchPacket() is recorded, with what it
+* takes to route it again, so a log can be replayed (-rr).
+*/
+
+#ifndef _PACKET_LOG_H_
+#define _PACKET_LOG_H_
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdint.h>
+#include <time.h>
+
+#define PACKET_LOG_MAGIC		0x4c505254	// "TRPL"
+#define PACKET_LOG_VERSION		2		// 1 had no addresses in PacketLogRecord
+
+#define PACKET_LOG_RING_SIZE	(1 << 20)	// must be a power of 2
+#define PACKET_LOG_FLUSH_SIZE	(1 << 16)	// wakes the writer up early
+#define PACKET_LOG_FLUSH_INTERVAL	1		// sec
+
+struct PacketLogHeader
+{
+	uint32_t	nMagic;
+	uint32_t	nVersion;
+}__attribute__((packed));
+
+struct PacketLogRecord
+{
+	uint16_t	nLen;		// of the packet following the record
+	uint8_t		nFrom;		// PACKET_FROM_*
+	uint8_t		nBase;		// base station of a packet from my mote
+	uint32_t	nSec;		// time the router saw the packet
+	uint32_t	nUsec;
+	uint32_t	lMasterIP;
+	uint32_t	nNeighborIP;	// sender of a packet from my neighbor
+}__attribute__((packed));
+
+#define PACKET_LOG_RECORD_V1_SIZE	12	// up to nUsec
+
+class CPacketLog
+{
+public:
+	// pStrPath is the log directory; nMaxSize in bytes and nMaxAge in
+	// seconds start a new file, 0 never does
+	CPacketLog(char* pStrPath, unsigned long nMaxSize = 0, unsigned int nMaxAge = 0);
+	~CPacketLog(void);
+
+	// starts the writer thread; must be called after fork()
+	bool	Start(void);
+
+	// called by one thread at a time
+	void	Write(char* pData, int nLen, unsigned int nFrom, unsigned int nBase,
+				uint32_t lMasterIP, uint32_t nNeighborIP);
+
+	unsigned long	GetDrops(void)
+	{
+		return m_nDrops;
+	}
+
+private:
+	char			m_pStrPath[256];
+	unsigned long	m_nMaxSize;
+	unsigned int	m_nMaxAge;
+
+	int				m_fd;
+	unsigned long	m_nSize;		// of the current file
+	time_t			m_timeOpened;
+
+	char*			m_pRing;
+	volatile unsigned long	m_nHead;	// written by the writer thread only
+	volatile unsigned long	m_nTail;	// written by Write() only
+	unsigned long	m_nDrops;
+
+	bool			m_bStarted;
+	volatile bool	m_bStop;
+	sem_t			m_semFlush;
+	pthread_t		m_thread;
+
+	static void*	WriterThread(void* arg);
+	void			Flush(void);
+	bool			Open(void);
+	void			WriteFile(char* pData, unsigned long nLen);
+	unsigned long	Copy(unsigned long nPos, char* pData, unsigned long nLen);
+};
+
+#endif
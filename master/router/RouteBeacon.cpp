@@ -0,0 +1,295 @@
+/*
+* "Copyright (c) 2006 University of Southern California.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software and its
+* documentation for any purpose, without fee, and without written
+* agreement is hereby granted, provided that the above copyright
+* notice, the following two paragraphs and the author appear in all
+* copies of this software.
+*
+* IN NO EVENT SHALL THE UNIVERSITY OF SOUTHERN CALIFORNIA BE LIABLE TO
+* ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+* DAMAGES ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS
+* DOCUMENTATION, EVEN IF THE UNIVERSITY OF SOUTHERN CALIFORNIA HAS BEEN
+* ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+* THE UNIVERSITY OF SOUTHERN CALIFORNIA SPECIFICALLY DISCLAIMS ANY
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  THE SOFTWARE
+* PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND THE UNIVERSITY OF
+* SOUTHERN CALIFORNIA HAS NO OBLIGATION TO PROVIDE MAINTENANCE,
+* SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
+*
+*/
+
+
+/*
+* Routing advertisements between masters (see RouteBeacon.h)
+*/
+
+#include "RouteBeacon.h"
+#include "TenetRouter.h"
+#include "IPRT_Manager.h"
+#include "TR_Common.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+extern struct Debug TR_Debug;
+
+CRouteBeacon::CRouteBeacon(void)
+{
+	// tells the neighbors that this is another run of the router
+	m_nEpoch = (uint32_t) time(NULL) ^ ( (uint32_t) getpid() << 16 );
+	m_nSeq = 0;
+
+	// the first beacon is the whole set
+	m_nUntilFull = 0;
+	m_bFullDue = true;
+
+	memset(m_pAdvertised, 0, sizeof(m_pAdvertised));
+	memset(m_pNeighbors, 0, sizeof(m_pNeighbors));
+}
+
+CRouteBeacon::~CRouteBeacon(void)
+{
+	for( int i = 0 ; i < MAX_BEACON_NEIGHBORS ; i++ )
+		free(m_pNeighbors[i].pFull);
+}
+
+void CRouteBeacon::Send(uint8_t nFlags, uint16_t* pAdded, int nAdded, uint16_t* pWithdrawn, int nWithdrawn)
+{
+	char pData[MAX_BUFFFER_SIZE];
+	TR_Beacon* pBeacon = (TR_Beacon*) pData;
+
+	pBeacon->nEpoch = htonl(m_nEpoch);
+	pBeacon->nSeq = htonl(++m_nSeq);
+	pBeacon->nFlags = nFlags;
+	pBeacon->nAdded = htons(nAdded);
+	pBeacon->nWithdrawn = htons(nWithdrawn);
+
+	for( int i = 0 ; i < nAdded ; i++ )
+		pBeacon->pMotes[i] = htons(pAdded[i]);
+
+	for( int i = 0 ; i < nWithdrawn ; i++ )
+		pBeacon->pMotes[nAdded + i] = htons(pWithdrawn[i]);
+
+	CTenetRouter::GetTenetRouter()->SendBeacon(pData,
+		BEACON_HEADER_LENGTH + ( nAdded + nWithdrawn ) * sizeof(uint16_t));
+}
+
+void CRouteBeacon::Advertise(void)
+{
+	uint8_t	nWant = IsAnyUnsynced() ? BEACON_FLAG_WANT_FULL : 0;
+	int		nAdded = 0;
+	int		nWithdrawn = 0;
+
+	CMRT_Manager::MakeMoteSet(GetMyIP(), m_pMotes);
+
+	if( m_bFullDue || --m_nUntilFull <= 0 )
+	{
+		int nSent = 0;
+
+		for( int i = 0 ; i < MRT_SIZE / 32 ; i++ )
+		{
+			for( uint32_t bits = m_pMotes[i] ; bits ; bits &= bits - 1 )
+				m_pAdded[nAdded++] = i * 32 + __builtin_ctz(bits);
+		}
+
+		// an empty set still takes one beacon
+		do
+		{
+			int n = nAdded - nSent < (int) BEACON_MAX_MOTES ? nAdded - nSent : BEACON_MAX_MOTES;
+
+			Send(BEACON_FLAG_FULL | nWant
+				| ( 0 == nSent ? BEACON_FLAG_FIRST : 0 )
+				| ( nSent + n == nAdded ? BEACON_FLAG_LAST : 0 ),
+				m_pAdded + nSent, n, NULL, 0);
+
+			nSent += n;
+		} while( nSent < nAdded );
+
+		m_nUntilFull = BEACON_FULL_EVERY;
+		m_bFullDue = false;
+	}
+	else
+	{
+		int nSentAdded = 0;
+		int nSentWithdrawn = 0;
+
+		for( int i = 0 ; i < MRT_SIZE / 32 ; i++ )
+		{
+			for( uint32_t bits = m_pMotes[i] & ~m_pAdvertised[i] ; bits ; bits &= bits - 1 )
+				m_pAdded[nAdded++] = i * 32 + __builtin_ctz(bits);
+
+			for( uint32_t bits = m_pAdvertised[i] & ~m_pMotes[i] ; bits ; bits &= bits - 1 )
+				m_pWithdrawn[nWithdrawn++] = i * 32 + __builtin_ctz(bits);
+		}
+
+		// nothing changed still takes one beacon, so that the neighbors
+		// know I am there
+		do
+		{
+			int n = nAdded - nSentAdded < (int) BEACON_MAX_MOTES ? nAdded - nSentAdded : BEACON_MAX_MOTES;
+			int m = nWithdrawn - nSentWithdrawn < (int) BEACON_MAX_MOTES - n ? nWithdrawn - nSentWithdrawn : BEACON_MAX_MOTES - n;
+
+			Send(nWant, m_pAdded + nSentAdded, n, m_pWithdrawn + nSentWithdrawn, m);
+
+			nSentAdded += n;
+			nSentWithdrawn += m;
+		} while( nSentAdded < nAdded || nSentWithdrawn < nWithdrawn );
+	}
+
+	memcpy(m_pAdvertised, m_pMotes, sizeof(m_pAdvertised));
+}
+
+void CRouteBeacon::OnBeacon(AddrMaster nIP, char* pData, int nLen)
+{
+	TR_Beacon*		pBeacon = (TR_Beacon*) pData;
+	BeaconNeighbor*	pNeighbor;
+	uint32_t		nEpoch;
+	uint32_t		nSeq;
+	int				nAdded;
+	int				nWithdrawn;
+	AddrMaster		nNextHop;
+
+	if( nLen < (int) BEACON_HEADER_LENGTH )
+		return;
+
+	nEpoch = ntohl(pBeacon->nEpoch);
+	nSeq = ntohl(pBeacon->nSeq);
+	nAdded = ntohs(pBeacon->nAdded);
+	nWithdrawn = ntohs(pBeacon->nWithdrawn);
+
+	if( nLen < (int) ( BEACON_HEADER_LENGTH + ( nAdded + nWithdrawn ) * sizeof(uint16_t) ) )
+		return;
+
+	if( NULL == ( pNeighbor = GetNeighbor(nIP) ) )
+	{
+		CONDITIONAL_DEBUG( TR_Debug.bTraceMRT, "CRouteBeacon::OnBeacon()// no room for neighbor %s\n", inet_ntoa((in_addr&)nIP));
+		return;
+	}
+
+	if( 0 == pNeighbor->timeHeard || pNeighbor->nEpoch != nEpoch )
+	{
+		// a new neighbor, or one that restarted: its old routes stay until
+		// its next whole set says otherwise
+		pNeighbor->nEpoch = nEpoch;
+		pNeighbor->bSynced = false;
+		pNeighbor->bInFull = false;
+	}
+	else if( (int32_t) ( nSeq - pNeighbor->nSeq ) <= 0 )
+	{
+		// a duplicate, or overtaken by a later one
+		return;
+	}
+	else if( nSeq != pNeighbor->nSeq + 1 )
+	{
+		CONDITIONAL_DEBUG( TR_Debug.bTraceMRT, "CRouteBeacon::OnBeacon()// missed %u beacons of %s\n",
+			nSeq - pNeighbor->nSeq - 1, inet_ntoa((in_addr&)nIP));
+
+		pNeighbor->bSynced = false;
+		pNeighbor->bInFull = false;
+	}
+
+	pNeighbor->nSeq = nSeq;
+	time(&pNeighbor->timeHeard);
+
+	if( pBeacon->nFlags & BEACON_FLAG_WANT_FULL )
+		m_bFullDue = true;
+
+	for( int i = 0 ; i < nAdded ; i++ )
+		m_pAdded[i] = ntohs(pBeacon->pMotes[i]);
+
+	for( int i = 0 ; i < nWithdrawn ; i++ )
+		m_pWithdrawn[i] = ntohs(pBeacon->pMotes[nAdded + i]);
+
+	if( pBeacon->nFlags & BEACON_FLAG_FULL )
+	{
+		if( pBeacon->nFlags & BEACON_FLAG_FIRST )
+		{
+			if( NULL == pNeighbor->pFull )
+				pNeighbor->pFull = (uint32_t*) malloc(MRT_SIZE / 8);
+
+			memset(pNeighbor->pFull, 0, MRT_SIZE / 8);
+			pNeighbor->bInFull = true;
+		}
+
+		if( pNeighbor->bInFull )
+		{
+			for( int i = 0 ; i < nAdded ; i++ )
+				pNeighbor->pFull[m_pAdded[i] >> 5] |= 1u << ( m_pAdded[i] & 31 );
+		}
+	}
+
+	CMRT_Manager::Learn(nIP, m_pAdded, nAdded, m_pWithdrawn, nWithdrawn);
+
+	// all of the set arrived, so whatever it leaves out is gone
+	if( ( pBeacon->nFlags & BEACON_FLAG_LAST ) && pNeighbor->bInFull )
+	{
+		CMRT_Manager::EraseMaster(nIP, pNeighbor->pFull);
+
+		pNeighbor->bInFull = false;
+		pNeighbor->bSynced = true;
+	}
+
+	// the neighbor is on my subnet; a route of the kernel still wins
+	nNextHop = CIPRT_Manager::LookUpNextHop(nIP);
+
+	if( 0 == nNextHop || nIP == nNextHop )
+		CIPRT_Manager::Update(nIP, nIP);
+}
+
+void CRouteBeacon::Age(time_t timeNow, int nInterval)
+{
+	for( int i = 0 ; i < MAX_BEACON_NEIGHBORS ; i++ )
+	{
+		BeaconNeighbor* pNeighbor = &m_pNeighbors[i];
+
+		if( pNeighbor->nIP && timeNow - pNeighbor->timeHeard > BEACON_NEIGHBOR_LOSS * nInterval )
+		{
+			CONDITIONAL_DEBUG( TR_Debug.bTraceMRT, "CRouteBeacon::Age()// lost neighbor %s\n", inet_ntoa((in_addr&)pNeighbor->nIP));
+			Forget(pNeighbor);
+		}
+	}
+}
+
+BeaconNeighbor* CRouteBeacon::GetNeighbor(AddrMaster nIP)
+{
+	BeaconNeighbor* pFree = NULL;
+
+	for( int i = 0 ; i < MAX_BEACON_NEIGHBORS ; i++ )
+	{
+		if( m_pNeighbors[i].nIP == nIP )
+			return &m_pNeighbors[i];
+
+		if( 0 == m_pNeighbors[i].nIP && NULL == pFree )
+			pFree = &m_pNeighbors[i];
+	}
+
+	if( pFree )
+		pFree->nIP = nIP;
+
+	return pFree;
+}
+
+void CRouteBeacon::Forget(BeaconNeighbor* pNeighbor)
+{
+	CMRT_Manager::EraseMaster(pNeighbor->nIP, NULL);
+
+	free(pNeighbor->pFull);
+	memset(pNeighbor, 0, sizeof(BeaconNeighbor));
+}
+
+bool CRouteBeacon::IsAnyUnsynced(void)
+{
+	for( int i = 0 ; i < MAX_BEACON_NEIGHBORS ; i++ )
+	{
+		if( m_pNeighbors[i].nIP && !m_pNeighbors[i].bSynced )
+			return true;
+	}
+
+	return false;
+}
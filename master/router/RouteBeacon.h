@@ -0,0 +1,125 @@
+/*
+* "Copyright (c) 2006 University of Southern California.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software and its
+* documentation for any purpose, without fee, and without written
+* agreement is hereby granted, provided that the above copyright
+* notice, the following two paragraphs and the author appear in all
+* copies of this software.
+*
+* IN NO EVENT SHALL THE UNIVERSITY OF SOUTHERN CALIFORNIA BE LIABLE TO
+* ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+* DAMAGES ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS
+* DOCUMENTATION, EVEN IF THE UNIVERSITY OF SOUTHERN CALIFORNIA HAS BEEN
+* ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+* THE UNIVERSITY OF SOUTHERN CALIFORNIA SPECIFICALLY DISCLAIMS ANY
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  THE SOFTWARE
+* PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND THE UNIVERSITY OF
+* SOUTHERN CALIFORNIA HAS NO OBLIGATION TO PROVIDE MAINTENANCE,
+* SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
+*
+*/
+
+
+/*
+* Routing advertisements between masters. Every beacon interval a master
+* broadcasts the motes it is the master of to the routers of its subnet,
+* so that they can fill their MRT/IPRT before the first packet.
+*
+* A beacon lists the motes added and withdrawn since the beacon before it.
+* Every BEACON_FULL_EVERY beacons, and whenever a neighbor asks for it,
+* the whole set is sent instead, split over as many beacons as it takes.
+* Beacons are numbered per epoch (one run of the router). A receiver that
+* misses one, or sees a new epoch, asks for the whole set with its own
+* next beacon and only then withdraws what that set leaves out. The routes
+* of a neighbor that stays silent for BEACON_NEIGHBOR_LOSS intervals are
+* erased; the rest age out of the MRT as before.
+*
+* Everything here runs on the route thread.
+*/
+
+#ifndef _ROUTE_BEACON_H_
+#define _ROUTE_BEACON_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "MRT_Manager.h"
+
+#define BEACON_FULL_EVERY		10		// beacons
+#define BEACON_NEIGHBOR_LOSS	4		// beacon intervals
+#define MAX_BEACON_NEIGHBORS	32
+
+enum
+{
+	BEACON_FLAG_FULL = 0x01,		// part of the whole set
+	BEACON_FLAG_FIRST = 0x02,		// first beacon of the whole set
+	BEACON_FLAG_LAST = 0x04,		// last beacon of the whole set
+	BEACON_FLAG_WANT_FULL = 0x08	// the sender wants the whole set of its neighbors
+};
+
+// the payload of a TR_PACKET_TYPE_BEACON, in network byte order
+struct TR_Beacon
+{
+	uint32_t	nEpoch;
+	uint32_t	nSeq;
+	uint8_t		nFlags;
+	uint16_t	nAdded;
+	uint16_t	nWithdrawn;
+	uint16_t	pMotes[1];		// nAdded motes, then nWithdrawn motes
+}__attribute__((packed));
+
+#define BEACON_HEADER_LENGTH	offsetof(TR_Beacon, pMotes)
+#define BEACON_MAX_MOTES		( ( MAX_BUFFFER_SIZE - BEACON_HEADER_LENGTH ) / sizeof(uint16_t) )
+
+struct BeaconNeighbor
+{
+	AddrMaster	nIP;			// 0 for a free slot
+	uint32_t	nEpoch;
+	uint32_t	nSeq;			// of the last beacon
+	time_t		timeHeard;
+	bool		bSynced;		// has all of its motes since the last whole set
+	bool		bInFull;		// is receiving a whole set in order
+	uint32_t*	pFull;			// the motes of that set so far, MRT_SIZE bits
+};
+
+class CRouteBeacon
+{
+public:
+	CRouteBeacon(void);
+	~CRouteBeacon(void);
+
+	// sends the next beacon(s) of this master
+	void	Advertise(void);
+
+	// a beacon of the master at nIP
+	void	OnBeacon(AddrMaster nIP, char* pData, int nLen);
+
+	// forgets the neighbors that stopped sending beacons
+	void	Age(time_t timeNow, int nInterval);
+
+private:
+	uint32_t	m_nEpoch;
+	uint32_t	m_nSeq;
+	int			m_nUntilFull;		// beacons until the next whole set
+	bool		m_bFullDue;
+
+	uint32_t	m_pMotes[MRT_SIZE / 32];		// my motes now
+	uint32_t	m_pAdvertised[MRT_SIZE / 32];	// my motes as of the last beacon
+
+	uint16_t	m_pAdded[MRT_SIZE];
+	uint16_t	m_pWithdrawn[MRT_SIZE];
+
+	BeaconNeighbor	m_pNeighbors[MAX_BEACON_NEIGHBORS];
+
+	void	Send(uint8_t nFlags, uint16_t* pAdded, int nAdded, uint16_t* pWithdrawn, int nWithdrawn);
+	BeaconNeighbor*	GetNeighbor(AddrMaster nIP);
+	void	Forget(BeaconNeighbor* pNeighbor);
+	bool	IsAnyUnsynced(void);
+};
+
+#endif
@@ -0,0 +1,169 @@
+/*
+* "Copyright (c) 2006 University of Southern California.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software and its
+* documentation for any purpose, without fee, and without written
+* agreement is hereby granted, provided that the above copyright
+* notice, the following two paragraphs and the author appear in all
+* copies of this software.
+*
+* IN NO EVENT SHALL THE UNIVERSITY OF SOUTHERN CALIFORNIA BE LIABLE TO
+* ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+* DAMAGES ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS
+* DOCUMENTATION, EVEN IF THE UNIVERSITY OF SOUTHERN CALIFORNIA HAS BEEN
+* ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+* THE UNIVERSITY OF SOUTHERN CALIFORNIA SPECIFICALLY DISCLAIMS ANY
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  THE SOFTWARE
+* PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND THE UNIVERSITY OF
+* SOUTHERN CALIFORNIA HAS NO OBLIGATION TO PROVIDE MAINTENANCE,
+* SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
+*
+*/
+
+/*
+* Applies the kernel's route and address events to the IPRT
+*/
+
+#include "RouteMonitor.h"
+#include "IPRT_Manager.h"
+#include "TR_Common.h"
+
+#include <errno.h>
+#include <string.h>
+
+#ifdef USE_RTNETLINK
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#endif
+
+extern struct Debug TR_Debug;
+
+CRouteMonitor::CRouteMonitor(void)
+: CNetwork()
+{
+}
+
+CRouteMonitor::~CRouteMonitor(void)
+{
+	CIPRT_Manager::SetMonitored(false);
+
+	CNetwork::Remove(this);
+
+	if( -1 != m_fdSocket )
+		close(m_fdSocket);
+}
+
+bool CRouteMonitor::Start(void)
+{
+#ifdef USE_RTNETLINK
+	struct sockaddr_nl addr;
+
+	if( -1 == ( m_fdSocket = socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE) ) )
+	{
+		TR_ERROR("Creating netlink socket failed\n");
+		return false;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+	addr.nl_groups = RTMGRP_IPV4_ROUTE | RTMGRP_IPV4_IFADDR;
+
+	if( -1 == bind(m_fdSocket, (struct sockaddr*) &addr, sizeof(addr)) )
+	{
+		TR_ERROR("Binding netlink socket failed\n");
+		close(m_fdSocket);
+		m_fdSocket = -1;
+		return false;
+	}
+
+	CNetwork::Add(this);
+
+	// from now on no event is missed; catch up on what happened before
+	CIPRT_Manager::SetMonitored(true);
+	CIPRT_Manager::Resync();
+	InvalidateMyAddr();
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool CRouteMonitor::Process(void)
+{
+#ifdef USE_RTNETLINK
+	char	pBuffer[RTNETLINK_BUFFER_SIZE];
+	int		nLen;
+
+	while( 0 < ( nLen = recv(m_fdSocket, pBuffer, sizeof(pBuffer), MSG_DONTWAIT) ) )
+	{
+		struct nlmsghdr* pHeader = (struct nlmsghdr*) pBuffer;
+
+		for( ; NLMSG_OK(pHeader, (unsigned int) nLen) ; pHeader = NLMSG_NEXT(pHeader, nLen) )
+		{
+			switch( pHeader->nlmsg_type )
+			{
+				case RTM_NEWROUTE:
+				case RTM_DELROUTE:
+					OnRoute(pHeader);
+					break;
+
+				case RTM_NEWADDR:
+				case RTM_DELADDR:
+					InvalidateMyAddr();
+					break;
+			}
+		}
+	}
+
+	// the kernel dropped events, so the table may be out of date
+	if( -1 == nLen && ENOBUFS == errno )
+	{
+		TR_ERROR("Route events were lost, reloading the routing table\n");
+		CIPRT_Manager::Resync();
+	}
+#endif
+
+	return false;	// read until recv() failed
+}
+
+#ifdef USE_RTNETLINK
+// mirrors what CIPRT_Manager reads from ROUTE_FILE: host routes of the
+// main table whose gateway is not this machine
+void CRouteMonitor::OnRoute(struct nlmsghdr* pHeader)
+{
+	struct rtmsg*	pRoute = (struct rtmsg*) NLMSG_DATA(pHeader);
+	struct rtattr*	pAttr = RTM_RTA(pRoute);
+	int				nLen = RTM_PAYLOAD(pHeader);
+
+	AddrMaster	destIP = 0;
+	AddrMaster	gatewayIP = 0;
+
+	if( AF_INET != pRoute->rtm_family
+		|| RT_TABLE_MAIN != pRoute->rtm_table
+		|| 32 != pRoute->rtm_dst_len )
+		return;
+
+	for( ; RTA_OK(pAttr, nLen) ; pAttr = RTA_NEXT(pAttr, nLen) )
+	{
+		if( RTA_DST == pAttr->rta_type )
+			memcpy(&destIP, RTA_DATA(pAttr), sizeof(AddrMaster));
+		else if( RTA_GATEWAY == pAttr->rta_type )
+			memcpy(&gatewayIP, RTA_DATA(pAttr), sizeof(AddrMaster));
+	}
+
+	if( RTM_DELROUTE == pHeader->nlmsg_type )
+	{
+		CIPRT_Manager::Erase(destIP);
+		return;
+	}
+
+	if ( IsInTheSameMachine( gatewayIP ) )
+		return;
+
+	CIPRT_Manager::Update(destIP, gatewayIP, true);
+}
+#endif
@@ -0,0 +1,60 @@
+/*
+* "Copyright (c) 2006 University of Southern California.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software and its
+* documentation for any purpose, without fee, and without written
+* agreement is hereby granted, provided that the above copyright
+* notice, the following two paragraphs and the author appear in all
+* copies of this software.
+*
+* IN NO EVENT SHALL THE UNIVERSITY OF SOUTHERN CALIFORNIA BE LIABLE TO
+* ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+* DAMAGES ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS
+* DOCUMENTATION, EVEN IF THE UNIVERSITY OF SOUTHERN CALIFORNIA HAS BEEN
+* ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+* THE UNIVERSITY OF SOUTHERN CALIFORNIA SPECIFICALLY DISCLAIMS ANY
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  THE SOFTWARE
+* PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND THE UNIVERSITY OF
+* SOUTHERN CALIFORNIA HAS NO OBLIGATION TO PROVIDE MAINTENANCE,
+* SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
+*
+*/
+
+/*
+* Keeps the IP routing table and the cached local addresses current by
+* listening to the kernel's route and address events (rtnetlink).
+* Without it (other platforms, or if the socket cannot be opened) the
+* IPRT falls back to re-reading ROUTE_FILE on every refresh.
+*/
+
+#ifndef _ROUTE_MONITOR_H_
+#define _ROUTE_MONITOR_H_
+
+#include "Network.h"
+
+#ifdef __linux__
+#define USE_RTNETLINK
+#endif
+
+#define RTNETLINK_BUFFER_SIZE	8192
+
+class CRouteMonitor
+	: public CNetwork
+{
+public:
+	CRouteMonitor(void);
+	~CRouteMonitor(void);
+
+	bool	Start(void);
+	virtual bool Process(void);
+
+private:
+#ifdef USE_RTNETLINK
+	void	OnRoute(struct nlmsghdr* pHeader);
+#endif
+};
+
+#endif
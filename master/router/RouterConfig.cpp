@@ -0,0 +1,480 @@
+/*
+* "Copyright (c) 2006 University of Southern California.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software and its
+* documentation for any purpose, without fee, and without written
+* agreement is hereby granted, provided that the above copyright
+* notice, the following two paragraphs and the author appear in all
+* copies of this software.
+*
+* IN NO EVENT SHALL THE UNIVERSITY OF SOUTHERN CALIFORNIA BE LIABLE TO
+* ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+* DAMAGES ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS
+* DOCUMENTATION, EVEN IF THE UNIVERSITY OF SOUTHERN CALIFORNIA HAS BEEN
+* ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+* THE UNIVERSITY OF SOUTHERN CALIFORNIA SPECIFICALLY DISCLAIMS ANY
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  THE SOFTWARE
+* PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND THE UNIVERSITY OF
+* SOUTHERN CALIFORNIA HAS NO OBLIGATION TO PROVIDE MAINTENANCE,
+* SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
+*
+*/
+
+
+/*
+* Startup configuration of the Tenet router
+*/
+
+#include "RouterConfig.h"
+#include "Network.h"
+
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+#include <arpa/inet.h>
+
+// every name Set() knows, for LoadEnvironment()
+static const char* s_pNames[] =
+{
+	"TENET_ROUTER_INTERFACE",
+	"TENET_ROUTER_DEFAULT_IP_ADDRESS",
+	"TENET_ROUTER_DEFAULT_BROADCAST_ADDRESS",
+	"TENET_LOCAL_ADDRESS",
+	"TENET_ROUTER_STANDALONE_MODE",
+	"TENET_ROUTER_PORT_FOR_TRANSPORT",
+	"TENET_ROUTER_PORT_FOR_OTHER_ROUTER",
+	"TENET_ROUTER_PORT_FOR_METRICS",
+	"TENET_ROUTER_SHM",
+	"TENET_DEDUP_WINDOW",
+	"TENET_BEACON_INTERVAL",
+	"TENET_SF_HOST",
+	"TENET_SF_PORT",
+	"TENET_EGRESS_MOTE_RATE",
+	"TENET_EGRESS_MOTE_BURST",
+	"TENET_EGRESS_NEIGHBOR_RATE",
+	"TENET_EGRESS_NEIGHBOR_BURST",
+	"TENET_TCP_OUTPUT_BUDGET",
+	"TENET_TCP_OVERFLOW_POLICY",
+	"TENET_LOG_PATH",
+	"TENET_LOG_MAX_SIZE",
+	"TENET_LOG_MAX_AGE",
+	"TENET_REPLAY_PATH",
+	"TENET_REPLAY_TIMING",
+	"TENET_REPLAY_DECISIONS",
+	NULL
+};
+
+static bool GetNumber(const char* pName, const char* pValue, unsigned long nMin, unsigned long nMax, unsigned long* pNumber)
+{
+	char* pEnd;
+
+	*pNumber = strtoul(pValue, &pEnd, 10);
+
+	if( pEnd == pValue || '\0' != *pEnd || '-' == *pValue || *pNumber < nMin || *pNumber > nMax )
+	{
+		TR_ERROR("%s must be a number from %lu to %lu, not \"%s\"\n", pName, nMin, nMax, pValue);
+		return false;
+	}
+
+	return true;
+}
+
+static bool GetBool(const char* pName, const char* pValue, bool* pBool)
+{
+	if( 0 == strcmp("1", pValue) || 0 == strcasecmp("TRUE", pValue) )
+		*pBool = true;
+	else if( 0 == strcmp("0", pValue) || 0 == strcasecmp("FALSE", pValue) )
+		*pBool = false;
+	else
+	{
+		TR_ERROR("%s must be 0 or 1, not \"%s\"\n", pName, pValue);
+		return false;
+	}
+
+	return true;
+}
+
+static bool GetIP(const char* pName, const char* pValue, uint32_t* pIP)
+{
+	if( 0 == inet_aton(pValue, (in_addr*) pIP) )
+	{
+		TR_ERROR("%s must be an IP address, not \"%s\"\n", pName, pValue);
+		return false;
+	}
+
+	return true;
+}
+
+static bool GetString(const char* pName, const char* pValue, char* pStr)
+{
+	if( strlen(pValue) >= MAX_STRING_SIZE )
+	{
+		TR_ERROR("%s is longer than %d characters\n", pName, MAX_STRING_SIZE - 1);
+		return false;
+	}
+
+	strcpy(pStr, pValue);
+
+	return true;
+}
+
+CRouterConfig::CRouterConfig(void)
+{
+	pInterface[0] = '\0';
+	nDefaultIP = 0;
+	nDefaultBroadcastIP = 0;
+	nBroadcastIP = 0;
+	nLocalAddr = 0;
+	bStandalone = false;
+	nSF = 0;
+	pLogFilePath[0] = '\0';
+	nLogMaxSize = 0;
+	nLogMaxAge = 0;
+	pReplayPath[0] = '\0';
+	bReplayTiming = false;
+	pReplayDecisions[0] = '\0';
+
+	Set("TENET_ROUTER_PORT_FOR_TRANSPORT", _TENET_ROUTER_PORT_FOR_TRANSPORT);
+	Set("TENET_ROUTER_PORT_FOR_OTHER_ROUTER", _TENET_ROUTER_PORT_FOR_OTHER_ROUTER);
+	Set("TENET_ROUTER_PORT_FOR_METRICS", _TENET_ROUTER_PORT_FOR_METRICS);
+	Set("TENET_ROUTER_SHM", _TENET_ROUTER_SHM);
+	Set("TENET_DEDUP_WINDOW", _TENET_DEDUP_WINDOW);
+	Set("TENET_BEACON_INTERVAL", _TENET_BEACON_INTERVAL);
+	Set("TENET_SF_HOST", _TENET_SF_HOST);
+	Set("TENET_SF_PORT", _TENET_SF_PORT);
+	Set("TENET_EGRESS_MOTE_RATE", _TENET_EGRESS_MOTE_RATE);
+	Set("TENET_EGRESS_MOTE_BURST", _TENET_EGRESS_MOTE_BURST);
+	Set("TENET_EGRESS_NEIGHBOR_RATE", _TENET_EGRESS_NEIGHBOR_RATE);
+	Set("TENET_EGRESS_NEIGHBOR_BURST", _TENET_EGRESS_NEIGHBOR_BURST);
+	Set("TENET_TCP_OUTPUT_BUDGET", _TENET_TCP_OUTPUT_BUDGET);
+	Set("TENET_TCP_OVERFLOW_POLICY", _TENET_TCP_OVERFLOW_POLICY);
+}
+
+bool CRouterConfig::Set(const char* pName, const char* pValue)
+{
+	unsigned long nNumber;
+
+	if( 0 == strcmp("TENET_ROUTER_INTERFACE", pName) )
+		return GetString(pName, pValue, pInterface);
+
+	if( 0 == strcmp("TENET_ROUTER_DEFAULT_IP_ADDRESS", pName) )
+		return GetIP(pName, pValue, &nDefaultIP);
+
+	if( 0 == strcmp("TENET_ROUTER_DEFAULT_BROADCAST_ADDRESS", pName) )
+		return GetIP(pName, pValue, &nDefaultBroadcastIP);
+
+	if( 0 == strcmp("TENET_ROUTER_STANDALONE_MODE", pName) )
+		return GetBool(pName, pValue, &bStandalone);
+
+	if( 0 == strcmp("TENET_ROUTER_SHM", pName) )
+		return GetBool(pName, pValue, &bShm);
+
+	if( 0 == strcmp("TENET_SF_HOST", pName) )
+		return GetString(pName, pValue, pStrSFHost);
+
+	if( 0 == strcmp("TENET_SF_PORT", pName) )
+		return GetString(pName, pValue, pStrSFPort);
+
+	if( 0 == strcmp("TENET_LOG_PATH", pName) )
+		return GetString(pName, pValue, pLogFilePath);
+
+	if( 0 == strcmp("TENET_REPLAY_PATH", pName) )
+		return GetString(pName, pValue, pReplayPath);
+
+	if( 0 == strcmp("TENET_REPLAY_TIMING", pName) )
+		return GetBool(pName, pValue, &bReplayTiming);
+
+	if( 0 == strcmp("TENET_REPLAY_DECISIONS", pName) )
+		return GetString(pName, pValue, pReplayDecisions);
+
+	if( 0 == strcmp("TENET_TCP_OVERFLOW_POLICY", pName) )
+	{
+		if( strcmp("oldest", pValue) && strcmp("newest", pValue) && strcmp("disconnect", pValue) )
+		{
+			TR_ERROR("%s must be oldest, newest or disconnect, not \"%s\"\n", pName, pValue);
+			return false;
+		}
+
+		return GetString(pName, pValue, pOverflowPolicy);
+	}
+
+	if( 0 == strcmp("TENET_LOCAL_ADDRESS", pName) )
+	{
+		if( ! GetNumber(pName, pValue, 0, 0xFFFF, &nNumber) )
+			return false;
+
+		nLocalAddr = nNumber;
+	}
+	else if( 0 == strcmp("TENET_ROUTER_PORT_FOR_TRANSPORT", pName) )
+	{
+		if( ! GetNumber(pName, pValue, 1, 0xFFFF, &nNumber) )
+			return false;
+
+		nTransportPort = nNumber;
+	}
+	else if( 0 == strcmp("TENET_ROUTER_PORT_FOR_OTHER_ROUTER", pName) )
+	{
+		if( ! GetNumber(pName, pValue, 1, 0xFFFF, &nNumber) )
+			return false;
+
+		nRouterPort = nNumber;
+	}
+	else if( 0 == strcmp("TENET_ROUTER_PORT_FOR_METRICS", pName) )
+	{
+		if( ! GetNumber(pName, pValue, 0, 0xFFFF, &nNumber) )
+			return false;
+
+		nMetricsPort = nNumber;
+	}
+	else if( 0 == strcmp("TENET_DEDUP_WINDOW", pName) )
+	{
+		if( ! GetNumber(pName, pValue, 0, 3600000, &nNumber) )
+			return false;
+
+		nDedupWindow = nNumber;
+	}
+	else if( 0 == strcmp("TENET_BEACON_INTERVAL", pName) )
+	{
+		if( ! GetNumber(pName, pValue, 0, 3600, &nNumber) )
+			return false;
+
+		nBeaconInterval = nNumber;
+	}
+	else if( 0 == strcmp("TENET_EGRESS_MOTE_RATE", pName) )
+	{
+		if( ! GetNumber(pName, pValue, 0, 1000000, &nNumber) )
+			return false;
+
+		nMoteRate = nNumber;
+	}
+	else if( 0 == strcmp("TENET_EGRESS_MOTE_BURST", pName) )
+	{
+		if( ! GetNumber(pName, pValue, 1, 1000000, &nNumber) )
+			return false;
+
+		nMoteBurst = nNumber;
+	}
+	else if( 0 == strcmp("TENET_EGRESS_NEIGHBOR_RATE", pName) )
+	{
+		if( ! GetNumber(pName, pValue, 0, 1000000, &nNumber) )
+			return false;
+
+		nNeighborRate = nNumber;
+	}
+	else if( 0 == strcmp("TENET_EGRESS_NEIGHBOR_BURST", pName) )
+	{
+		if( ! GetNumber(pName, pValue, 1, 1000000, &nNumber) )
+			return false;
+
+		nNeighborBurst = nNumber;
+	}
+	else if( 0 == strcmp("TENET_TCP_OUTPUT_BUDGET", pName) )
+	{
+		if( ! GetNumber(pName, pValue, 0, 1024 * 1024, &nNumber) )
+			return false;
+
+		nOutputBudget = nNumber;
+	}
+	else if( 0 == strcmp("TENET_LOG_MAX_SIZE", pName) )
+	{
+		if( ! GetNumber(pName, pValue, 0, ULONG_MAX / 1024, &nNumber) )
+			return false;
+
+		nLogMaxSize = nNumber * 1024;
+	}
+	else if( 0 == strcmp("TENET_LOG_MAX_AGE", pName) )
+	{
+		if( ! GetNumber(pName, pValue, 0, 0x7FFFFFFF, &nNumber) )
+			return false;
+
+		nLogMaxAge = nNumber;
+	}
+	else
+	{
+		TR_ERROR("Unknown setting %s\n", pName);
+		return false;
+	}
+
+	return true;
+}
+
+bool CRouterConfig::LoadFile(const char* pPath)
+{
+	FILE* fp;
+	char pLine[2 * MAX_STRING_SIZE];
+	int nLine = 0;
+	bool bResult = true;
+
+	if( NULL == ( fp = fopen(pPath, "r") ) )
+	{
+		TR_ERROR("Cannot open config file %s\n", pPath);
+		return false;
+	}
+
+	while( bResult && fgets(pLine, sizeof(pLine), fp) )
+	{
+		char* pName;
+		char* pValue;
+		char* pEnd;
+
+		nLine++;
+
+		if( NULL != ( pEnd = strchr(pLine, '#') ) )
+			*pEnd = '\0';
+
+		for( pName = pLine ; isspace(*pName) ; pName++ );
+
+		if( '\0' == *pName )
+			continue;
+
+		if( NULL == ( pValue = strchr(pName, '=') ) )
+		{
+			TR_ERROR("%s:%d: expected NAME = value\n", pPath, nLine);
+			bResult = false;
+			break;
+		}
+
+		// trim both sides of the name and of the value
+		for( pEnd = pValue ; pEnd > pName && isspace(pEnd[-1]) ; pEnd-- );
+		*pEnd = '\0';
+
+		for( pValue++ ; isspace(*pValue) ; pValue++ );
+		for( pEnd = pValue + strlen(pValue) ; pEnd > pValue && isspace(pEnd[-1]) ; pEnd-- );
+		*pEnd = '\0';
+
+		if( ! Set(pName, pValue) )
+		{
+			TR_ERROR("%s:%d: in the setting above\n", pPath, nLine);
+			bResult = false;
+		}
+	}
+
+	fclose(fp);
+
+	return bResult;
+}
+
+bool CRouterConfig::LoadEnvironment(void)
+{
+	for( int i = 0 ; s_pNames[i] ; i++ )
+	{
+		char* pValue = getenv(s_pNames[i]);
+
+		if( pValue && ! Set(s_pNames[i], pValue) )
+			return false;
+	}
+
+	return true;
+}
+
+// one base station per port; the last host serves the ports after it
+bool CRouterConfig::ParseSF(void)
+{
+	char pStrHosts[MAX_STRING_SIZE];
+	char pStrPorts[MAX_STRING_SIZE];
+	char* pHostNext;
+	char* pPortNext;
+	char* pStrHost;
+	char* pStrPort;
+
+	strcpy(pStrHosts, pStrSFHost);
+	strcpy(pStrPorts, pStrSFPort);
+
+	if( NULL == ( pStrHost = strtok_r(pStrHosts, ",", &pHostNext) ) )
+		pStrHost = (char*) _TENET_SF_HOST;
+
+	for( nSF = 0, pStrPort = strtok_r(pStrPorts, ",", &pPortNext) ;
+		 NULL != pStrPort ;
+		 pStrPort = strtok_r(NULL, ",", &pPortNext) )
+	{
+		unsigned long nPort;
+		char* pStrNextHost;
+
+		if( MAX_BASE_STATIONS == nSF )
+		{
+			TR_ERROR("Only %d base stations are supported, %s and after are ignored\n", MAX_BASE_STATIONS, pStrPort);
+			break;
+		}
+
+		if( ! GetNumber("TENET_SF_PORT", pStrPort, 1, 0xFFFF, &nPort) )
+			return false;
+
+		strcpy(pSFHost[nSF], pStrHost);
+		pSFPort[nSF] = nPort;
+		nSF++;
+
+		if( NULL != ( pStrNextHost = strtok_r(NULL, ",", &pHostNext) ) )
+			pStrHost = pStrNextHost;
+	}
+
+	return true;
+}
+
+bool CRouterConfig::Finish(void)
+{
+	if( '\0' == pInterface[0] && ! GetDefaultNetworkInterface(pInterface) )
+	{
+		TR_ERROR("No network interface found\n");
+		return false;
+	}
+
+	if( ! ParseSF() )
+		return false;
+
+	if( ! bStandalone && 0 == nSF )
+	{
+		TR_ERROR("TENET_SF_PORT names no base station, use standalone mode instead\n");
+		return false;
+	}
+
+	SetMyAddrSource(pInterface, nDefaultIP, nDefaultBroadcastIP);
+
+	if( 0 == GetMyIP() )
+	{
+		TR_ERROR("Please specify network interface\n");
+		return false;
+	}
+
+	// the low 16 bits of my IP
+	if( 0 == nLocalAddr )
+		nLocalAddr = ( 0xFF000000 & GetMyIP() ) >> 24 | ( 0x00FF0000 & GetMyIP() ) >> 8;
+
+	nBroadcastIP = GetMyBroadcastAddr();
+
+	return true;
+}
+
+void CRouterConfig::Show(void) const
+{
+	struct in_addr in;
+
+	MSG("[CONFIG] TENET_ROUTER_INTERFACE : %s\n", pInterface);
+	MSG("[CONFIG] TENET_LOCAL_ADDRESS : %u\n", nLocalAddr);
+	in.s_addr = nBroadcastIP;
+	MSG("[CONFIG] broadcast address : %s\n", inet_ntoa( in ));
+	MSG("[CONFIG] TENET_ROUTER_PORT_FOR_TRANSPORT : %d\n", nTransportPort);
+	MSG("[CONFIG] TENET_ROUTER_PORT_FOR_OTHER_ROUTER : %d\n", nRouterPort);
+	MSG("[CONFIG] TENET_ROUTER_PORT_FOR_METRICS : %d\n", nMetricsPort);
+	MSG("[CONFIG] TENET_ROUTER_SHM : %d\n", bShm);
+
+	if( bStandalone )
+	{
+		MSG("[CONFIG] TENET_ROUTER_STANDALONE_MODE : TRUE\n");
+	}
+
+	for( int i = 0 ; i < nSF && ! bStandalone ; i++ )
+		MSG("[CONFIG] base station %d : %s:%d\n", i, pSFHost[i], pSFPort[i]);
+
+	MSG("[CONFIG] TENET_BEACON_INTERVAL : %u\n", nBeaconInterval);
+	MSG("[CONFIG] TENET_DEDUP_WINDOW : %u\n", nDedupWindow);
+	MSG("[CONFIG] egress mote %u/s burst %u, neighbor %u/s burst %u\n", nMoteRate, nMoteBurst, nNeighborRate, nNeighborBurst);
+	MSG("[CONFIG] TCP output %u kbytes, %s\n", nOutputBudget, pOverflowPolicy);
+
+	if( pReplayPath[0] )
+	{
+		MSG("[CONFIG] TENET_REPLAY_PATH : %s%s\n", pReplayPath, bReplayTiming ? ", original timing" : "");
+	}
+}
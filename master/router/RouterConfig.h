@@ -0,0 +1,107 @@
+/*
+* "Copyright (c) 2006 University of Southern California.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software and its
+* documentation for any purpose, without fee, and without written
+* agreement is hereby granted, provided that the above copyright
+* notice, the following two paragraphs and the author appear in all
+* copies of this software.
+*
+* IN NO EVENT SHALL THE UNIVERSITY OF SOUTHERN CALIFORNIA BE LIABLE TO
+* ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+* DAMAGES ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS
+* DOCUMENTATION, EVEN IF THE UNIVERSITY OF SOUTHERN CALIFORNIA HAS BEEN
+* ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+* THE UNIVERSITY OF SOUTHERN CALIFORNIA SPECIFICALLY DISCLAIMS ANY
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  THE SOFTWARE
+* PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND THE UNIVERSITY OF
+* SOUTHERN CALIFORNIA HAS NO OBLIGATION TO PROVIDE MAINTENANCE,
+* SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
+*
+*/
+
+
+/*
+* Startup configuration of the Tenet router
+*
+* Every setting has a TENET_* name. It is taken, later ones winning, from
+* the defaults in TR_Common.h, a config file of "NAME = value" lines (-c),
+* the environment variable of that name, and the command line. The result
+* is checked once by Finish() and from then on only read, so nothing on
+* the packet path has to look at the environment.
+*/
+
+#ifndef _ROUTER_CONFIG_H_
+#define _ROUTER_CONFIG_H_
+
+#include <stdint.h>
+#include "TR_Common.h"
+
+class CRouterConfig
+{
+public:
+	CRouterConfig(void);
+
+	// false if pName is unknown or pValue is not valid for it
+	bool	Set(const char* pName, const char* pValue);
+
+	// '#' starts a comment; false if the file cannot be read or has an error
+	bool	LoadFile(const char* pPath);
+
+	// the TENET_* variables that are set
+	bool	LoadEnvironment(void);
+
+	// fills in what was left to be found (interface, addresses); false if
+	// the router cannot start with this configuration
+	bool	Finish(void);
+
+	void	Show(void) const;
+
+	char		pInterface[MAX_STRING_SIZE];	// TENET_ROUTER_INTERFACE
+	uint32_t	nDefaultIP;			// TENET_ROUTER_DEFAULT_IP_ADDRESS, 0 uses the interface's
+	uint32_t	nDefaultBroadcastIP;	// TENET_ROUTER_DEFAULT_BROADCAST_ADDRESS
+	uint32_t	nBroadcastIP;		// the one in use, found by Finish()
+	uint16_t	nLocalAddr;			// TENET_LOCAL_ADDRESS, 0 takes it from my IP
+	bool		bStandalone;		// TENET_ROUTER_STANDALONE_MODE, no base station
+
+	int			nTransportPort;		// TENET_ROUTER_PORT_FOR_TRANSPORT
+	int			nRouterPort;		// TENET_ROUTER_PORT_FOR_OTHER_ROUTER
+	int			nMetricsPort;		// TENET_ROUTER_PORT_FOR_METRICS, 0 serves none
+	bool		bShm;				// TENET_ROUTER_SHM
+
+	unsigned int	nDedupWindow;		// TENET_DEDUP_WINDOW, msec
+	unsigned int	nBeaconInterval;	// TENET_BEACON_INTERVAL, sec
+
+	// TENET_SF_HOST and TENET_SF_PORT, comma separated; the last host
+	// serves the ports after it
+	int			nSF;
+	char		pSFHost[MAX_BASE_STATIONS][MAX_STRING_SIZE];
+	int			pSFPort[MAX_BASE_STATIONS];
+
+	unsigned int	nMoteRate;			// TENET_EGRESS_MOTE_RATE
+	unsigned int	nMoteBurst;			// TENET_EGRESS_MOTE_BURST
+	unsigned int	nNeighborRate;		// TENET_EGRESS_NEIGHBOR_RATE
+	unsigned int	nNeighborBurst;		// TENET_EGRESS_NEIGHBOR_BURST
+
+	unsigned int	nOutputBudget;		// TENET_TCP_OUTPUT_BUDGET, kbytes
+	char		pOverflowPolicy[MAX_STRING_SIZE];	// TENET_TCP_OVERFLOW_POLICY
+
+	char		pLogFilePath[MAX_STRING_SIZE];	// TENET_LOG_PATH, none if empty
+	unsigned long	nLogMaxSize;		// TENET_LOG_MAX_SIZE, kbytes in the file, bytes here
+	unsigned int	nLogMaxAge;			// TENET_LOG_MAX_AGE, sec
+
+	char		pReplayPath[MAX_STRING_SIZE];	// TENET_REPLAY_PATH, a log to route instead of the network
+	bool		bReplayTiming;		// TENET_REPLAY_TIMING, keep the time between its packets
+	char		pReplayDecisions[MAX_STRING_SIZE];	// TENET_REPLAY_DECISIONS, file for what was sent
+
+private:
+	char		pStrSFHost[MAX_STRING_SIZE];
+	char		pStrSFPort[MAX_STRING_SIZE];
+
+	bool	ParseSF(void);
+};
+
+#endif
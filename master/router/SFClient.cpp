@@ -32,6 +32,7 @@
 */
 
 #include <stddef.h>
+#include <errno.h>
 
 #include "TR_Common.h"
 #include "sfsource.h"
@@ -44,6 +45,7 @@ CSFClient::CSFClient(void)
 :CTCP_Client(CSFClient::OnSFReceive)
 {
 	this->OnReceive=CSFClient::OnSFReceive;
+	m_nInput = 0;
 }
 
 CSFClient::~CSFClient(void)
@@ -52,7 +54,15 @@ CSFClient::~CSFClient(void)
 
 bool CSFClient::Connect(char *strIP, int nPort)
 {
-	this->m_fdSocket = open_sf_source(strIP, nPort);
+	int fdSocket = open_sf_source(strIP, nPort);
+
+	pthread_mutex_lock(&m_lockSend);
+	this->m_fdSocket = fdSocket;
+	pthread_mutex_unlock(&m_lockSend);
+
+	m_nInput = 0;	// nothing left from an earlier connection
+
+	CNetwork::Add(this);
 
 	if (this->m_fdSocket < 0)
 	{
@@ -65,20 +75,24 @@ bool CSFClient::Connect(char *strIP, int nPort)
 	return true;
 }
 
+// the frame goes through the output buffer of CTCP_Client, so a stalled
+// serial forwarder cannot block the egress thread
 bool CSFClient::Send(TOS_Msg* pMsg)
 {
-	struct timeval t;
-	gettimeofday(&t, NULL);
+	char	pFrame[MAX_BUFFFER_SIZE + 1];
+	int		nLen = pMsg->length + offsetof(TOS_Msg, data);
 
-	if ( this->GetValid()
-		&& -1 == write_sf_packet( this->m_fdSocket, (void*) pMsg, pMsg->length + offsetof(TOS_Msg, data)) )
+	if( nLen > MAX_BUFFFER_SIZE || nLen > 255 )
 	{
-		TR_ERROR("send() sent a different number of bytes than expected\n");
-		this->SetValid(false);
+		TR_ERROR("packet too long for the serial forwarder : %d\n", nLen);
 		return false;
 	}
 
-	return true;
+	// same framing as write_sf_packet()
+	pFrame[0] = (unsigned char) nLen;
+	memcpy( pFrame + 1, pMsg, nLen );
+
+	return CTCP_Client::Send( pFrame, nLen + 1 );
 }
 
 void CSFClient::OnSFReceive(CTCP_Client *pClient, char* pData, int nLen)
@@ -94,29 +108,39 @@ void CSFClient::OnSFReceive(CTCP_Client *pClient, char* pData, int nLen)
 
 }
 
+// Reads what the socket has, without waiting, and passes on every whole
+// frame (a length byte and the packet, as read_sf_packet() reads them).
+// Returns the number of bytes read.
 int CSFClient::Receive(void)
 {
 	int		nBytesRcvd=0;
-	char	pData[MAX_BUFFFER_SIZE];
-	char*	pDataTemp;
+	int		nOffset=0;
+	int		nLen;
 
 	if(!this->GetValid())
 		return -1;
 
-	pDataTemp = (char*) read_sf_packet( this->m_fdSocket, &nBytesRcvd );
-
-	if( NULL == pDataTemp )
+	if ((nBytesRcvd=recv(this->m_fdSocket, m_pInput + m_nInput, SF_INPUT_SIZE - m_nInput, MSG_DONTWAIT))<=0)
 	{
+		if( 0 > nBytesRcvd && ( EAGAIN == errno || EWOULDBLOCK == errno || EINTR == errno ) )
+			return 0;
+
 		TR_ERROR("CSFClient::Receive()// recv() error!\n");
 		this->SetValid(false);
 		return 0;
 	}
 
-	memcpy( pData, pDataTemp, nBytesRcvd );
+	m_nInput += nBytesRcvd;
 
-	free(pDataTemp);
+	while( nOffset < m_nInput && 
+		( nLen = (unsigned char) m_pInput[nOffset] ) < m_nInput - nOffset )
+	{
+		this->OnReceive(this, m_pInput + nOffset + 1, nLen);
+		nOffset += nLen + 1;
+	}
 
-	this->OnReceive(this,pData, nBytesRcvd);
+	m_nInput -= nOffset;
+	memmove( m_pInput, m_pInput + nOffset, m_nInput );
 
 	return nBytesRcvd;
 }
@@ -148,7 +172,21 @@ void CSFClient::WritePacketToFile(CFile *pFile, char *pData, int nLen)
 	pFile->WriteLine(pStr);
 }
 
-void CSFClient::Process()
+bool CSFClient::Process()
 {
-	this->Receive();
+	int		nRoom = SF_INPUT_SIZE - m_nInput;
+
+	// a read that filled the buffer may have left more in the socket
+	if( this->GetValid() && this->Receive() == nRoom )
+		return true;
+
+	if( !this->GetValid() )
+	{
+		CNetwork::Remove(this);
+
+		if( m_pOwner )
+			m_pOwner->RetireClient(this);
+	}
+
+	return false;
 }
@@ -37,6 +37,8 @@
 #include "TCP_Socket.h"
 #include "tosmsg.h"
 
+#define SF_INPUT_SIZE	2048	// bytes read at a time; a frame is at most 256
+
 // Serial forwarder client class
 class CSFClient :
 	public CTCP_Client
@@ -46,13 +48,18 @@ public:
 	~CSFClient(void);
 
 	bool	Connect(char *strIP, int nPort);
-	bool	Send(TOS_Msg* pMsg);
+	virtual bool	Send(TOS_Msg* pMsg);
 	int		Receive(void);
-	virtual void Process(void);
+	virtual bool Process(void);
 
 	static 	void	OnSFReceive(CTCP_Client *pClient, char* pData, int nLen);
 	static 	void	ShowPacket(char *pData, int nLen);
 	static 	void	WritePacketToFile(CFile *pFile, char *pData, int nLen);
+
+protected:
+	// what Receive() read past the last whole frame
+	char	m_pInput[SF_INPUT_SIZE];
+	int		m_nInput;
 };
 
 #endif
@@ -0,0 +1,165 @@
+/*
+* "Copyright (c) 2006 University of Southern California.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software and its
+* documentation for any purpose, without fee, and without written
+* agreement is hereby granted, provided that the above copyright
+* notice, the following two paragraphs and the author appear in all
+* copies of this software.
+*
+* IN NO EVENT SHALL THE UNIVERSITY OF SOUTHERN CALIFORNIA BE LIABLE TO
+* ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+* DAMAGES ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS
+* DOCUMENTATION, EVEN IF THE UNIVERSITY OF SOUTHERN CALIFORNIA HAS BEEN
+* ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+* THE UNIVERSITY OF SOUTHERN CALIFORNIA SPECIFICALLY DISCLAIMS ANY
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  THE SOFTWARE
+* PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND THE UNIVERSITY OF
+* SOUTHERN CALIFORNIA HAS NO OBLIGATION TO PROVIDE MAINTENANCE,
+* SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
+*
+*/
+
+/*
+* Bounded single-producer/single-consumer queue used between the
+* stages of the Tenet router.
+*
+* Slots are filled and drained in place: the producer fills the slot
+* returned by GetWriteSlot() and then calls Push(), the consumer reads
+* the slot returned by GetReadSlot() and then calls Pop(). Neither side
+* takes a lock. Wait() blocks the consumer until something was pushed,
+* TimedWait() at most for a given time.
+*
+* N must be a power of 2.
+*/
+
+#ifndef _SPSC_QUEUE_H_
+#define _SPSC_QUEUE_H_
+
+#include <semaphore.h>
+#include <time.h>
+#include <errno.h>
+
+template <class T, unsigned int N>
+class CSPSC_Queue
+{
+public:
+	CSPSC_Queue(void)
+	{
+		m_nHead = 0;
+		m_nTail = 0;
+		m_nDrops = 0;
+		sem_init(&m_semItems, 0, 0);
+	}
+
+	~CSPSC_Queue(void)
+	{
+		sem_destroy(&m_semItems);
+	}
+
+	// producer side
+	T*	GetWriteSlot(void)
+	{
+		if( m_nTail - m_nHead >= N )
+		{
+			m_nDrops++;
+			return NULL;
+		}
+
+		// the consumer must be done with the slot before we reuse it
+		__sync_synchronize();
+
+		return &m_pSlots[ m_nTail & (N - 1) ];
+	}
+
+	void	Push(void)
+	{
+		// publish the slot contents before the new tail
+		__sync_synchronize();
+		m_nTail++;
+
+		sem_post(&m_semItems);
+	}
+
+	// consumer side; nIndex looks past the head without popping
+	T*	GetReadSlot(unsigned int nIndex = 0)
+	{
+		if( m_nTail - m_nHead <= nIndex )
+			return NULL;
+
+		__sync_synchronize();
+
+		return &m_pSlots[ ( m_nHead + nIndex ) & (N - 1) ];
+	}
+
+	void	Pop(unsigned int nCount = 1)
+	{
+		__sync_synchronize();
+		m_nHead += nCount;
+	}
+
+	void	Wait(void)
+	{
+		while( 0 != sem_wait(&m_semItems) )
+			;
+	}
+
+	// like Wait(), but gives up after lUsec microseconds; false on timeout
+	bool	TimedWait(long lUsec)
+	{
+		struct timespec timeAbs;
+
+		clock_gettime(CLOCK_REALTIME, &timeAbs);
+		timeAbs.tv_sec += lUsec / 1000000;
+		timeAbs.tv_nsec += ( lUsec % 1000000 ) * 1000;
+
+		if( timeAbs.tv_nsec >= 1000000000 )
+		{
+			timeAbs.tv_sec++;
+			timeAbs.tv_nsec -= 1000000000;
+		}
+
+		while( 0 != sem_timedwait(&m_semItems, &timeAbs) )
+		{
+			if( ETIMEDOUT == errno )
+				return false;
+		}
+
+		return true;
+	}
+
+	// takes one more item without blocking, for a consumer popping several
+	bool	TryWait(void)
+	{
+		return 0 == sem_trywait(&m_semItems);
+	}
+
+	// wakes the consumer up without pushing anything
+	void	Wakeup(void)
+	{
+		sem_post(&m_semItems);
+	}
+
+	unsigned int	GetSize(void)
+	{
+		return m_nTail - m_nHead;
+	}
+
+	unsigned long	GetDrops(void)
+	{
+		return m_nDrops;
+	}
+
+private:
+	volatile unsigned int	m_nHead;	// written by the consumer only
+	volatile unsigned int	m_nTail;	// written by the producer only
+	unsigned long	m_nDrops;			// written by the producer only
+
+	sem_t	m_semItems;
+	T		m_pSlots[N];
+};
+
+#endif
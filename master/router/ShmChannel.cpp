@@ -0,0 +1,313 @@
+/*
+* "Copyright (c) 2006 University of Southern California.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software and its
+* documentation for any purpose, without fee, and without written
+* agreement is hereby granted, provided that the above copyright
+* notice, the following two paragraphs and the author appear in all
+* copies of this software.
+*
+* IN NO EVENT SHALL THE UNIVERSITY OF SOUTHERN CALIFORNIA BE LIABLE TO
+* ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+* DAMAGES ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS
+* DOCUMENTATION, EVEN IF THE UNIVERSITY OF SOUTHERN CALIFORNIA HAS BEEN
+* ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+* THE UNIVERSITY OF SOUTHERN CALIFORNIA SPECIFICALLY DISCLAIMS ANY
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  THE SOFTWARE
+* PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND THE UNIVERSITY OF
+* SOUTHERN CALIFORNIA HAS NO OBLIGATION TO PROVIDE MAINTENANCE,
+* SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
+*
+*/
+
+/*
+* Shared-memory channel to transports on the same host
+*/
+
+#include "ShmChannel.h"
+#include "Metrics.h"
+#include "TR_Common.h"
+
+#include <stddef.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+
+#ifdef USE_SHM_CHANNEL
+
+CShmDoorbell::CShmDoorbell(CShmClient* pClient, int fd)
+: CNetwork()
+{
+	m_pClient = pClient;
+	m_fdSocket = fd;
+
+	CNetwork::Add(this);
+}
+
+CShmDoorbell::~CShmDoorbell(void)
+{
+	CNetwork::Remove(this);
+}
+
+// Drain() reads the eventfd dry, and rings it again if it stops early
+bool CShmDoorbell::Process()
+{
+	m_pClient->Drain();
+
+	return false;
+}
+
+CShmClient::CShmClient(void (*OnReceive)(CTCP_Client *, char*, int))
+: CSFClient()
+{
+	this->OnReceive = OnReceive;
+
+	// Send() never queues, there is nothing to flush
+	m_bWatchOutput = false;
+
+	m_pChannel = NULL;
+	m_pDoorbell = NULL;
+
+	for( int i = 0 ; i < SHM_FD_COUNT ; i++ )
+		m_pFD[i] = -1;
+}
+
+CShmClient::~CShmClient(void)
+{
+	if( m_pDoorbell )
+		delete m_pDoorbell;
+
+	if( m_pChannel )
+		munmap( m_pChannel, sizeof(shm_channel) );
+
+	for( int i = 0 ; i < SHM_FD_COUNT ; i++ )
+	{
+		if( -1 != m_pFD[i] )
+			close( m_pFD[i] );
+	}
+}
+
+// sets the channel up and hands it to the transport at the other end of
+// fdSocket
+bool CShmClient::Open(int fdSocket)
+{
+	struct msghdr	msg;
+	struct iovec	iov;
+	struct cmsghdr*	pCmsg;
+	char	pControl[CMSG_SPACE(sizeof(m_pFD))];
+	uint32_t	pHello[2] = { SHM_CHANNEL_MAGIC, SHM_CHANNEL_VERSION };
+
+	this->SetClientSocket(fdSocket);
+
+	if( 0 > ( m_pFD[SHM_FD_MEMORY] = memfd_create("tenet_router", MFD_CLOEXEC) )
+		|| 0 > ftruncate( m_pFD[SHM_FD_MEMORY], sizeof(shm_channel) ) )
+	{
+		TR_ERROR("memfd_create() failed : %s\n", strerror(errno));
+		return false;
+	}
+
+	m_pChannel = (shm_channel*) mmap( NULL, sizeof(shm_channel), PROT_READ | PROT_WRITE, MAP_SHARED, m_pFD[SHM_FD_MEMORY], 0 );
+
+	if( MAP_FAILED == m_pChannel )
+	{
+		TR_ERROR("mmap() failed : %s\n", strerror(errno));
+		m_pChannel = NULL;
+		return false;
+	}
+
+	m_pChannel->magic = SHM_CHANNEL_MAGIC;
+	m_pChannel->version = SHM_CHANNEL_VERSION;
+	shm_ring_init( &m_pChannel->to_transport );
+	shm_ring_init( &m_pChannel->to_router );
+
+	if( 0 > ( m_pFD[SHM_FD_TO_TRANSPORT] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC) )
+		|| 0 > ( m_pFD[SHM_FD_TO_ROUTER] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC) ) )
+	{
+		TR_ERROR("eventfd() failed : %s\n", strerror(errno));
+		return false;
+	}
+
+	memset( &msg, 0, sizeof(msg) );
+	iov.iov_base = pHello;
+	iov.iov_len = sizeof(pHello);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = pControl;
+	msg.msg_controllen = sizeof(pControl);
+
+	pCmsg = CMSG_FIRSTHDR(&msg);
+	pCmsg->cmsg_level = SOL_SOCKET;
+	pCmsg->cmsg_type = SCM_RIGHTS;
+	pCmsg->cmsg_len = CMSG_LEN(sizeof(m_pFD));
+	memcpy( CMSG_DATA(pCmsg), m_pFD, sizeof(m_pFD) );
+
+	if( sizeof(pHello) != sendmsg( fdSocket, &msg, MSG_NOSIGNAL ) )
+	{
+		TR_ERROR("sendmsg() failed : %s\n", strerror(errno));
+		return false;
+	}
+
+	m_pDoorbell = new CShmDoorbell( this, m_pFD[SHM_FD_TO_ROUTER] );
+
+	this->SetValid(true);
+
+	return true;
+}
+
+// called by the egress thread only, the one producer of to_transport
+bool CShmClient::Send(TOS_Msg* pMsg)
+{
+	if( !this->GetValid() )
+		return false;
+
+	if( 0 > shm_ring_write( &m_pChannel->to_transport, pMsg, pMsg->length + offsetof(TOS_Msg, data) ) )
+	{
+		CMetrics::Count(METRIC_DROP_SHM_FULL);
+		return false;
+	}
+
+	shm_ring_notify( &m_pChannel->to_transport, m_pFD[SHM_FD_TO_TRANSPORT] );
+
+	return true;
+}
+
+void CShmClient::Drain(void)
+{
+	char	pData[MAX_BUFFFER_SIZE];
+	eventfd_t	nCount;
+	int		nLen;
+	int		nBudget = SHM_DRAIN_BUDGET;
+
+	eventfd_read( m_pFD[SHM_FD_TO_ROUTER], &nCount );
+
+	if( !this->GetValid() )
+		return;
+
+	do
+	{
+		while( nBudget > 0 && 0 < ( nLen = shm_ring_read( &m_pChannel->to_router, pData, sizeof(pData) ) ) )
+		{
+			this->OnReceive(this, pData, nLen);
+			nBudget--;
+		}
+
+		// more is waiting: ring ourselves, so that the socket loop comes
+		// back after serving the others
+		if( 0 == nBudget )
+		{
+			eventfd_write( m_pFD[SHM_FD_TO_ROUTER], 1 );
+			return;
+		}
+	} while( ! shm_ring_sleep( &m_pChannel->to_router ) );
+}
+
+bool CShmClient::Process()
+{
+	char	pData[16];
+	int		n;
+
+	// the transport never writes to the socket; reading tells if it left
+	if( this->GetValid() )
+	{
+		n = recv( m_fdSocket, pData, sizeof(pData), MSG_DONTWAIT );
+
+		if( 0 == n || ( 0 > n && EAGAIN != errno && EWOULDBLOCK != errno && EINTR != errno ) )
+			this->SetValid(false);
+	}
+
+	if( !this->GetValid() )
+	{
+		CNetwork::Remove(this);
+
+		if( m_pOwner )
+			m_pOwner->RetireClient(this);
+	}
+
+	return false;
+}
+
+CShmServer::CShmServer(CTCP_Server* pOwner, void (*OnReceive)(CTCP_Client *, char*, int), int nPort)
+: CNetwork()
+{
+	m_pOwner = pOwner;
+	this->OnReceive = OnReceive;
+
+	snprintf( m_pPath, sizeof(m_pPath), SHM_CHANNEL_PATH, nPort );
+}
+
+CShmServer::~CShmServer(void)
+{
+	CNetwork::Remove(this);
+
+	if( -1 != m_fdSocket )
+	{
+		close(m_fdSocket);
+		unlink(m_pPath);
+	}
+}
+
+bool CShmServer::StartServer(void)
+{
+	struct sockaddr_un	addr;
+
+	if( 0 > ( m_fdSocket = socket(AF_UNIX, SOCK_STREAM, 0) ) )
+	{
+		TR_ERROR("socket() failed : %s\n", strerror(errno));
+		return false;
+	}
+
+	memset( &addr, 0, sizeof(addr) );
+	addr.sun_family = AF_UNIX;
+	strncpy( addr.sun_path, m_pPath, sizeof(addr.sun_path) - 1 );
+
+	// left behind by a router that was killed
+	unlink(m_pPath);
+
+	if( 0 > bind( m_fdSocket, (struct sockaddr*) &addr, sizeof(addr) ) || 0 > listen( m_fdSocket, 5 )
+		|| ! SetNonBlocking( m_fdSocket ) )	// Process() accepts until accept() fails
+	{
+		TR_ERROR("bind() to %s failed : %s\n", m_pPath, strerror(errno));
+		close(m_fdSocket);
+		m_fdSocket = -1;
+		return false;
+	}
+
+	CNetwork::Add(this);
+
+	MSG("[ENV] TENET_ROUTER_SHM : %s\n", m_pPath);
+
+	return true;
+}
+
+bool CShmServer::Process()
+{
+	int	fd = accept( m_fdSocket, NULL, NULL );
+
+	if( 0 > fd )
+		return false;
+
+	CShmClient*	pClient = new CShmClient( this->OnReceive );
+
+	if( ! pClient->Open(fd) )
+	{
+		pClient->Close();
+		delete pClient;
+		return true;	// one more may be waiting
+	}
+
+	m_pOwner->AddClient(pClient);
+
+#ifdef DEBUG_MODE
+	TRACE("a Transport is connected over shared memory.\n");
+#endif
+
+	return true;	// one more may be waiting
+}
+
+#endif
@@ -0,0 +1,97 @@
+/*
+* "Copyright (c) 2006 University of Southern California.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software and its
+* documentation for any purpose, without fee, and without written
+* agreement is hereby granted, provided that the above copyright
+* notice, the following two paragraphs and the author appear in all
+* copies of this software.
+*
+* IN NO EVENT SHALL THE UNIVERSITY OF SOUTHERN CALIFORNIA BE LIABLE TO
+* ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+* DAMAGES ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS
+* DOCUMENTATION, EVEN IF THE UNIVERSITY OF SOUTHERN CALIFORNIA HAS BEEN
+* ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+* THE UNIVERSITY OF SOUTHERN CALIFORNIA SPECIFICALLY DISCLAIMS ANY
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  THE SOFTWARE
+* PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND THE UNIVERSITY OF
+* SOUTHERN CALIFORNIA HAS NO OBLIGATION TO PROVIDE MAINTENANCE,
+* SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
+*
+*/
+
+/*
+* Shared-memory channel to transports on the same host
+*
+* A transport that finds the unix socket of CShmServer gets a
+* shm_channel (see shmring.h) instead of talking to the router over TCP.
+* The channel is a CShmClient in the client list of the transport
+* interface, so SendToAll() reaches it like any other transport; what
+* the transport writes goes to the same OnReceive() as TCP traffic.
+*/
+
+#ifndef _SHM_CHANNEL_H_
+#define _SHM_CHANNEL_H_
+
+#include "SFClient.h"
+#include "shmring.h"
+
+#define SHM_DRAIN_BUDGET	64		// packets read per round of the socket loop
+
+class CShmClient;
+
+// eventfd the transport rings after writing to the router
+class CShmDoorbell
+	: public CNetwork
+{
+public:
+	CShmDoorbell(CShmClient* pClient, int fd);
+	~CShmDoorbell(void);
+
+protected:
+	CShmClient*	m_pClient;
+
+	virtual bool Process(void);
+};
+
+// one transport; m_fdSocket is its unix socket, watched only for hangup
+class CShmClient
+	: public CSFClient
+{
+public:
+	CShmClient(void (*OnReceive)(CTCP_Client *, char*, int));
+	~CShmClient(void);
+
+	bool	Open(int fdSocket);
+	virtual bool	Send(TOS_Msg* pMsg);
+	void	Drain(void);
+
+	virtual bool Process(void);
+
+protected:
+	shm_channel*	m_pChannel;
+	int		m_pFD[SHM_FD_COUNT];
+	CShmDoorbell*	m_pDoorbell;
+};
+
+class CShmServer
+	: public CNetwork
+{
+public:
+	CShmServer(CTCP_Server* pOwner, void (*OnReceive)(CTCP_Client *, char*, int), int nPort);
+	~CShmServer(void);
+
+	bool	StartServer(void);
+
+protected:
+	CTCP_Server*	m_pOwner;
+	char	m_pPath[MAX_STRING_SIZE];
+	void	(*OnReceive)(CTCP_Client *pClient, char* pData, int nLen);
+
+	virtual bool Process(void);
+};
+
+#endif
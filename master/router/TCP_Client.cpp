@@ -38,10 +38,12 @@
 
 #include "TCP_Socket.h"
 #include "TR_Common.h"
+#include "Metrics.h"
 
 int				CTCP_Client::s_nMaxSocket;
-ListTCP_Client	CTCP_Client::s_listClient;
 unsigned long	CTCP_Client::s_nMyIP;
+unsigned int	CTCP_Client::s_nOutputBudget = 64 * 1024;
+int				CTCP_Client::s_nOverflowPolicy = TCP_OVERFLOW_DROP_NEWEST;
 
 CTCP_Client::CTCP_Client(void (*OnReceive)(CTCP_Client *, char*, int ))
 : CNetwork()
@@ -49,14 +51,47 @@ CTCP_Client::CTCP_Client(void (*OnReceive)(CTCP_Client *, char*, int ))
 	this->m_bValid = false;
 	this->OnReceive = OnReceive;
 	this->m_pOwner = NULL;
+	this->m_pPrevClient = NULL;
+	this->m_pNextClient = NULL;
+	this->m_bWatchOutput = true;
+
+	this->m_pOutput = NULL;
+	this->m_nOutputHead = 0;
+	this->m_nOutputTail = 0;
+	this->m_nHeadSent = 0;
+	this->m_bHeadStarted = false;
 
 	this->s_nMyIP = GetMyIP();
-	s_listClient.push_back(this);
+
+	pthread_mutex_init(&m_lockSend, NULL);
 }
 
 CTCP_Client::~CTCP_Client(void)
 {
 	this->SetValid(false);
+
+	if( this->m_pOutput )
+		free( this->m_pOutput );
+
+	pthread_mutex_destroy(&m_lockSend);
+}
+
+// nBudget in bytes; pStrPolicy is "oldest", "newest" or "disconnect"
+bool CTCP_Client::SetOutputPolicy(unsigned int nBudget, char* pStrPolicy)
+{
+	if( 0 == strcmp( "oldest", pStrPolicy ) )
+		s_nOverflowPolicy = TCP_OVERFLOW_DROP_OLDEST;
+	else if( 0 == strcmp( "newest", pStrPolicy ) )
+		s_nOverflowPolicy = TCP_OVERFLOW_DROP_NEWEST;
+	else if( 0 == strcmp( "disconnect", pStrPolicy ) )
+		s_nOverflowPolicy = TCP_OVERFLOW_DISCONNECT;
+	else
+		return false;
+
+	// room for at least one message of the largest size
+	s_nOutputBudget = nBudget > MAX_BUFFFER_SIZE + sizeof(int) ? nBudget : MAX_BUFFFER_SIZE + sizeof(int);
+
+	return true;
 }
 
 bool CTCP_Client::Connect(char *strIP, int nPort)
@@ -87,42 +122,215 @@ bool CTCP_Client::Connect(char *strIP, int nPort)
 
 	s_nMaxSocket=this->m_fdSocket;
 
+	CNetwork::Add(this);
+
 	return true;
 }
 
 bool CTCP_Client::Close(void)
 {
-	close(this->m_fdSocket);
+	CNetwork::Remove(this);
+
+	pthread_mutex_lock(&m_lockSend);
+
+	if( -1 != this->m_fdSocket )
+		close(this->m_fdSocket);
+
+	this->m_fdSocket = -1;
+
+	// whatever is still waiting has nowhere to go
+	m_nOutputHead = m_nOutputTail;
+	m_nHeadSent = 0;
+	m_bHeadStarted = false;
+
+	pthread_mutex_unlock(&m_lockSend);
+
 	return false;
 }
 
 bool CTCP_Client::Send(char* pData, int nLen)
 {
-	int total = 0;	// how many bytes we've sent
-	int bytesleft = nLen; // how many we have left to send
 	int n = 0;
+	bool bResult;
 
 	if(!this->GetValid())
-		return -1;
+		return false;
+
+	pthread_mutex_lock(&m_lockSend);
+
+	if( -1 == this->m_fdSocket )
+	{
+		pthread_mutex_unlock(&m_lockSend);
+		return false;
+	}
+
+	// nothing is waiting, so the message may go out right away
+	if( m_nOutputHead == m_nOutputTail )
+	{
+		n = send(this->m_fdSocket, pData, nLen, MSG_DONTWAIT | MSG_NOSIGNAL);
+
+		if( n == nLen )
+		{
+			pthread_mutex_unlock(&m_lockSend);
+			return true;
+		}
+
+		if( n < 0 )
+		{
+			if( EAGAIN != errno && EWOULDBLOCK != errno && EINTR != errno )
+			{
+				TR_ERROR("send() failed : %s\n", strerror(errno));
+				this->SetValid(false);
+				pthread_mutex_unlock(&m_lockSend);
+				return false;
+			}
+
+			n = 0;
+		}
+	}
+
+	bResult = Queue(pData + n, nLen - n, n > 0);
+
+	pthread_mutex_unlock(&m_lockSend);
+
+	return bResult;
+}
+
+void CTCP_Client::CopyOutput(unsigned long nPos, char* pData, int nLen, bool bToRing)
+{
+	unsigned int nOffset = nPos % s_nOutputBudget;
+	unsigned int nFirst = s_nOutputBudget - nOffset;
+
+	if( nFirst > (unsigned int) nLen )
+		nFirst = nLen;
+
+	if( bToRing )
+	{
+		memcpy(m_pOutput + nOffset, pData, nFirst);
+		memcpy(m_pOutput, pData + nFirst, nLen - nFirst);
+	}
+	else
+	{
+		memcpy(pData, m_pOutput + nOffset, nFirst);
+		memcpy(pData + nFirst, m_pOutput, nLen - nFirst);
+	}
+}
+
+// bStarted: the beginning of pData was written already, so it has to
+// be completed or the stream is broken
+bool CTCP_Client::Queue(char* pData, int nLen, bool bStarted)
+{
+	unsigned long nNeed = sizeof(int) + nLen;
+	int nHeadLen;
+
+	if( NULL == m_pOutput && NULL == ( m_pOutput = (char*) malloc(s_nOutputBudget) ) )
+	{
+		TR_ERROR("malloc() failed\n");
+		exit(1);
+	}
+
+	while( m_nOutputTail - m_nOutputHead + nNeed > s_nOutputBudget )
+	{
+		if( bStarted || TCP_OVERFLOW_DISCONNECT == s_nOverflowPolicy )
+		{
+			Disconnect();
+			return false;
+		}
+
+		// a message already being written must be completed
+		if( TCP_OVERFLOW_DROP_NEWEST == s_nOverflowPolicy
+			|| m_nOutputHead == m_nOutputTail
+			|| m_bHeadStarted )
+		{
+			CMetrics::Count(METRIC_DROP_TCP_OUTPUT_FULL);
+			return false;
+		}
+
+		CopyOutput(m_nOutputHead, (char*) &nHeadLen, sizeof(int), false);
+		m_nOutputHead += sizeof(int) + nHeadLen;
+		CMetrics::Count(METRIC_DROP_TCP_OUTPUT_FULL);
+	}
+
+	CopyOutput(m_nOutputTail, (char*) &nLen, sizeof(int), true);
+	CopyOutput(m_nOutputTail + sizeof(int), pData, nLen, true);
+	m_nOutputTail += nNeed;
+
+	if( bStarted )
+		m_bHeadStarted = true;
+
+	return true;
+}
+
+// writes waiting messages until the socket takes no more; false if the
+// connection broke
+bool CTCP_Client::Flush(void)
+{
+	int nHeadLen;
+	unsigned int nOffset;
+	unsigned int nChunk;
+	int n;
 
-	while(0!=bytesleft) 
+	while( m_nOutputHead != m_nOutputTail )
 	{
-		n=send(this->m_fdSocket, (char *) pData, bytesleft, 0);
+		CopyOutput(m_nOutputHead, (char*) &nHeadLen, sizeof(int), false);
+
+		nOffset = ( m_nOutputHead + sizeof(int) + m_nHeadSent ) % s_nOutputBudget;
+		nChunk = nHeadLen - m_nHeadSent;
+
+		if( nChunk > s_nOutputBudget - nOffset )
+			nChunk = s_nOutputBudget - nOffset;
 
-		if(n==-1)
+		if( 0 > ( n = send(this->m_fdSocket, m_pOutput + nOffset, nChunk, MSG_DONTWAIT | MSG_NOSIGNAL) ) )
 		{
-			TR_ERROR("send() sent a different number of bytes than expected\n");
+			if( EINTR == errno )
+				continue;
+
+			if( EAGAIN == errno || EWOULDBLOCK == errno )
+				return true;
+
+			TR_ERROR("send() failed : %s\n", strerror(errno));
 			this->SetValid(false);
 			return false;
 		}
 
-		total+= n;
-		bytesleft-=n;
+		m_nHeadSent += n;
+		m_bHeadStarted = true;
+
+		if( m_nHeadSent == nHeadLen )
+		{
+			m_nOutputHead += sizeof(int) + nHeadLen;
+			m_nHeadSent = 0;
+			m_bHeadStarted = false;
+		}
 	}
 
 	return true;
 }
 
+// called by the socket loop
+void CTCP_Client::OnWritable(void)
+{
+	pthread_mutex_lock(&m_lockSend);
+
+	if( -1 != this->m_fdSocket && this->GetValid() )
+		Flush();
+
+	pthread_mutex_unlock(&m_lockSend);
+}
+
+// the socket loop sees the shutdown and stops watching the client
+void CTCP_Client::Disconnect(void)
+{
+	TR_ERROR("Client output exceeded %u bytes, disconnecting\n", s_nOutputBudget);
+
+	this->SetValid(false);
+	shutdown(this->m_fdSocket, SHUT_RDWR);
+
+	m_nOutputHead = m_nOutputTail;
+	m_nHeadSent = 0;
+	m_bHeadStarted = false;
+}
+
 bool CTCP_Client::IsThereAnyNewPacket()
 {
 	fd_set			fds;
@@ -154,8 +362,11 @@ int CTCP_Client::Receive(void)
 	if(!this->GetValid())
 		return -1;
 
-	if ((nBytesRcvd=recv(this->m_fdSocket,pData,MAX_BUFFFER_SIZE, 0))<=0)
+	if ((nBytesRcvd=recv(this->m_fdSocket,pData,MAX_BUFFFER_SIZE, MSG_DONTWAIT))<=0)
 	{
+		if( 0 > nBytesRcvd && ( EAGAIN == errno || EWOULDBLOCK == errno || EINTR == errno ) )
+			return 0;
+
 		TR_ERROR("CTCP_Client::Receive()// recv() error!\n");
 		this->SetValid(false);
 		return 0;
@@ -166,7 +377,20 @@ int CTCP_Client::Receive(void)
 	return nBytesRcvd;
 }
 
-void CTCP_Client::Process()
+bool CTCP_Client::Process()
 {
-	this->Receive();
+	// a short read emptied the socket, a full one may have left more
+	if( this->GetValid() && this->Receive() == MAX_BUFFFER_SIZE )
+		return true;
+
+	// stop watching a dead connection, or it stays readable forever
+	if( !this->GetValid() )
+	{
+		CNetwork::Remove(this);
+
+		if( m_pOwner )
+			m_pOwner->RetireClient(this);
+	}
+
+	return false;
 }
@@ -44,14 +44,22 @@ CTCP_Server::CTCP_Server(void (*OnReceive)(CTCP_Client *, char*, int), int nPort
 
 	m_fdSocket=-1;
 	m_bStart=false;
+
+	m_pClients=NULL;
+	m_nClients=0;
+	m_pInvalidClients=NULL;
+	pthread_mutex_init(&m_lockClients, NULL);
 }
 
 CTCP_Server::~CTCP_Server(void)
 {
+	CNetwork::Remove(this);
 	close(this->m_fdSocket);
 
 	// Delete All Client
-	CTCP_Server::DestoryAll( this );
+	this->DestoryAll();
+
+	pthread_mutex_destroy(&m_lockClients);
 }
 
 bool CTCP_Server::StartServer(void)
@@ -83,6 +91,8 @@ bool CTCP_Server::StartServer(void)
 
 	Listen();
 
+	CNetwork::Add(this);
+
 #ifdef DEBUG_MODE
 	TRACE("Server Module Started.\n\tTCP Server Port : %d\n", this->m_nPort);
 #endif
@@ -107,6 +117,12 @@ bool CTCP_Server::Listen(void)
 		TR_ERROR("listen() failed\n");
 		exit(1);
 	}
+
+#ifdef USE_EPOLL
+	// Process() accepts until accept() fails, which must not block.
+	// Accepted sockets do not inherit O_NONBLOCK on Linux.
+	SetNonBlocking(m_fdSocket);
+#endif
 	return true;
 }
 
@@ -140,8 +156,8 @@ CTCP_Client* CTCP_Server::Accept()
 	if(pClient->SetClientSocket
 		(accept(this->m_fdSocket,(struct sockaddr *) pClient->GetClientAddr(),&nAddrLen))>= 0)
 	{
-		pClient->SetOwner(this);
 		pClient->SetValid(true);
+		this->AddClient(pClient);
 
 #ifdef DEBUG_MODE
 		TRACE("a Client is accepted.\n");
@@ -150,95 +166,121 @@ CTCP_Client* CTCP_Server::Accept()
 	}
 	else
 	{
-		pClient->SetValid(false);
+		delete pClient;
 		return NULL;
 	}
 }
 
+void CTCP_Server::AddClient(CTCP_Client* pClient)
+{
+	pClient->SetOwner(this);
+	pClient->m_pPrevClient = NULL;
+
+	pthread_mutex_lock(&m_lockClients);
+
+	pClient->m_pNextClient = m_pClients;
+
+	if( m_pClients )
+		m_pClients->m_pPrevClient = pClient;
+
+	m_pClients = pClient;
+	m_nClients++;
+
+	pthread_mutex_unlock(&m_lockClients);
+}
+
+// Unlinks a client that became invalid. It is deleted by the next
+// DestoryInvalidSocket(), once nothing else may be using it.
+void CTCP_Server::RetireClient(CTCP_Client* pClient)
+{
+	pthread_mutex_lock(&m_lockClients);
+
+	if( pClient->m_pPrevClient )
+		pClient->m_pPrevClient->m_pNextClient = pClient->m_pNextClient;
+	else
+		m_pClients = pClient->m_pNextClient;
+
+	if( pClient->m_pNextClient )
+		pClient->m_pNextClient->m_pPrevClient = pClient->m_pPrevClient;
+
+	m_nClients--;
+
+	pthread_mutex_unlock(&m_lockClients);
+
+	pClient->m_pPrevClient = NULL;
+	pClient->m_pNextClient = m_pInvalidClients;
+	m_pInvalidClients = pClient;
+}
+
 void CTCP_Server::SendToAll(char* pData, int nLen)
 {
 	CTCP_Client	*pClient;
-	list <CTCP_Client*>::iterator	iter;
 
+	pthread_mutex_lock(&m_lockClients);
 
-	for(iter=CTCP_Client::s_listClient.begin();iter!=CTCP_Client::s_listClient.end();iter++)
-	{
-		pClient=(CTCP_Client *)*iter;
+	for( pClient = m_pClients ; pClient ; pClient = pClient->m_pNextClient )
+		pClient->Send(pData, nLen);
 
-		if( pClient->GetOwner() == this )
-		{
-			pClient->Send(pData, nLen);
-		}
-	}
+	pthread_mutex_unlock(&m_lockClients);
 }
 
 void CTCP_Server::ReceiveFromAll()
 {
 	CTCP_Client	*pClient;
-	list <CTCP_Client*>::iterator	iter;
 
+	pthread_mutex_lock(&m_lockClients);
 
-	for(iter=CTCP_Client::s_listClient.begin();iter!=CTCP_Client::s_listClient.end();iter++)
+	for( pClient = m_pClients ; pClient ; pClient = pClient->m_pNextClient )
 	{
-		pClient=(CTCP_Client *)*iter;
-
-		if( pClient->GetOwner() == this && pClient->IsThereAnyNewPacket())
+		if( pClient->IsThereAnyNewPacket() )
 			pClient->Receive();
 	}
+
+	pthread_mutex_unlock(&m_lockClients);
 }
 
-void CTCP_Server::DestoryAll(CTCP_Server* pOwner)
+void CTCP_Server::DestoryAll(void)
 {
-	CTCP_Client	*pClient=NULL;
-	list <CTCP_Client*>::iterator	iter;
+	CTCP_Client	*pClient;
 
-	for(iter=CTCP_Client::s_listClient.begin();iter!=CTCP_Client::s_listClient.end();iter++)
+	pthread_mutex_lock(&m_lockClients);
+
+	while( NULL != ( pClient = m_pClients ) )
 	{
-		if(pClient && 
-			pOwner == pClient->GetOwner() )
-			delete pClient;
+		m_pClients = pClient->m_pNextClient;
 
-		pClient=(CTCP_Client *)*iter;
+		pClient->Close();
+		delete pClient;
 	}
 
-	if(pClient)
-		delete pClient;
+	m_nClients = 0;
+
+	pthread_mutex_unlock(&m_lockClients);
+
+	this->DestoryInvalidSocket();
 }
 
-void CTCP_Server::DestoryInvalidSocket(CTCP_Server* pOwner)
+// Deletes every client retired since the last call; called by the socket
+// loop, so none of them can be in the middle of Process()
+void CTCP_Server::DestoryInvalidSocket(void)
 {
-	CTCP_Client	*pClient=NULL;
-	list <CTCP_Client*>::iterator	iter;
-	list <CTCP_Client*>::iterator	iterTemp;
+	CTCP_Client	*pClient;
 
-	for(iter=CTCP_Client::s_listClient.begin();iter!=CTCP_Client::s_listClient.end();iter++)
+	while( NULL != ( pClient = m_pInvalidClients ) )
 	{
-		pClient=(CTCP_Client *)*iter;
-		if(NULL!=pClient)
-		{
-			if(!pClient->GetValid() &&
-				pOwner == pClient->GetOwner())
-			{
-				iterTemp=iter;
-				iterTemp++;
-
-				CTCP_Client::s_listClient.remove(*iter);
+		m_pInvalidClients = pClient->m_pNextClient;
 
-				delete pClient;
-
-				iter=iterTemp;
-				
-				return;
-
-			}
-		}
+		pClient->Close();
+		delete pClient;
 	}
 }
 
-void CTCP_Server::Process()
+bool CTCP_Server::Process()
 {
 	if( this->IsStart() )
 	{
-		this->Accept();
+		return NULL != this->Accept();	// one more may be waiting
 	}
+
+	return false;
 }
@@ -56,7 +56,14 @@ using namespace std;
 #include "Network.h"
 
 class CTCP_Client;
-typedef struct list <CTCP_Client *> ListTCP_Client;
+
+// what Send() does when a client's output would exceed its budget
+enum
+{
+	TCP_OVERFLOW_DROP_OLDEST = 0,	// drop whole waiting messages, oldest first
+	TCP_OVERFLOW_DROP_NEWEST = 1,	// drop the message being sent
+	TCP_OVERFLOW_DISCONNECT = 2
+};
 
 // TCP Server class
 class CTCP_Server
@@ -77,6 +84,15 @@ public:
 	void	SendToAll(char* pData, int nLen);
 	void	ReceiveFromAll();
 
+	void	AddClient(CTCP_Client* pClient);
+	void	RetireClient(CTCP_Client* pClient);
+	void	DestoryInvalidSocket(void);
+
+	unsigned int	GetClientCount(void)
+	{
+		return m_nClients;
+	}
+
 protected:
 	static unsigned long	s_nMyIP;
 	struct	sockaddr_in	m_addr;
@@ -84,7 +100,17 @@ protected:
 
 	bool	m_bStart;
 
-	virtual void Process(void);
+	// clients of this server, linked through CTCP_Client::m_pNextClient;
+	// m_lockClients guards the list against SendToAll() on another thread
+	CTCP_Client*	m_pClients;
+	unsigned int	m_nClients;
+	pthread_mutex_t	m_lockClients;
+
+	// retired clients waiting for DestoryInvalidSocket(); touched by the
+	// socket loop only
+	CTCP_Client*	m_pInvalidClients;
+
+	virtual bool Process(void);
 
 protected:
 	CTCP_Client* Accept();
@@ -93,8 +119,7 @@ protected:
 	bool	IsThereAnyNewClient();
 	void	(*OnReceive)(CTCP_Client *pClient, char* pData, int nLen);
 
-	static void DestoryAll(CTCP_Server* pOwner);
-	static void DestoryInvalidSocket(CTCP_Server* pOwner);
+	void	DestoryAll(void);
 };
 
 // TCP client class
@@ -108,12 +133,17 @@ public:
 	bool	Connect(char *strIP, int nPort);
 	bool	Close(void);
 
+	// never blocks: what the socket does not take now waits in a ring
+	// and is written by the socket loop once the socket is writable
 	bool	Send(char* pData, int nLen);
 	int		Receive(void);
 
+	static bool	SetOutputPolicy(unsigned int nBudget, char* pStrPolicy);
+
 	int	SetClientSocket(int nSocket)
 	{
 		m_fdSocket=nSocket;
+		CNetwork::Add(this);
 		return m_fdSocket;
 	}
 
@@ -142,6 +172,11 @@ public:
 		return m_pOwner;
 	}
 
+	CTCP_Client* GetNextClient()
+	{
+		return m_pNextClient;
+	}
+
 	struct sockaddr_in* GetClientAddr()
 	{
 		return &m_addr;
@@ -150,19 +185,44 @@ public:
 	bool	IsThereAnyNewPacket();
 
 	void	(*OnReceive)(CTCP_Client *pClient, char* pData, int nLen);
-	virtual void Process(void);
+	virtual bool Process(void);
+	virtual void OnWritable(void);
+	virtual bool HasPendingOutput(void)
+	{
+		return m_nOutputHead != m_nOutputTail;
+	}
 
 public:
 	static int				s_nMaxSocket;
-	static ListTCP_Client	s_listClient;
 
 protected:
 	static unsigned long	s_nMyIP;
 	struct	sockaddr_in		m_addr;
 	int		m_nPort;				// Port Number
-	bool	m_bValid;
+	volatile bool	m_bValid;
+	pthread_mutex_t	m_lockSend;		// Send() vs. Close() on another thread
 
 	CTCP_Server*	m_pOwner;
+	CTCP_Client*	m_pPrevClient;	// in the client list of m_pOwner
+	CTCP_Client*	m_pNextClient;
+
+	friend class CTCP_Server;
+
+	// messages waiting for the socket, each an int length and its bytes;
+	// guarded by m_lockSend
+	char*			m_pOutput;
+	unsigned long	m_nOutputHead;
+	unsigned long	m_nOutputTail;
+	int				m_nHeadSent;		// bytes of the first message already written
+	bool			m_bHeadStarted;		// so it cannot be dropped anymore
+
+	static unsigned int	s_nOutputBudget;	// bytes of m_pOutput
+	static int			s_nOverflowPolicy;
+
+	bool	Queue(char* pData, int nLen, bool bStarted);
+	bool	Flush(void);
+	void	Disconnect(void);
+	void	CopyOutput(unsigned long nPos, char* pData, int nLen, bool bToRing);
 };
 
 #endif
@@ -0,0 +1,302 @@
+/*
+* "Copyright (c) 2006 University of Southern California.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software and its
+* documentation for any purpose, without fee, and without written
+* agreement is hereby granted, provided that the above copyright
+* notice, the following two paragraphs and the author appear in all
+* copies of this software.
+*
+* IN NO EVENT SHALL THE UNIVERSITY OF SOUTHERN CALIFORNIA BE LIABLE TO
+* ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+* DAMAGES ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS
+* DOCUMENTATION, EVEN IF THE UNIVERSITY OF SOUTHERN CALIFORNIA HAS BEEN
+* ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+* THE UNIVERSITY OF SOUTHERN CALIFORNIA SPECIFICALLY DISCLAIMS ANY
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  THE SOFTWARE
+* PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND THE UNIVERSITY OF
+* SOUTHERN CALIFORNIA HAS NO OBLIGATION TO PROVIDE MAINTENANCE,
+* SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
+*
+*/
+
+/*
+* tcpstress: transport connect/disconnect churn against a router it starts
+* on loopback. Each cycle connects, does the sf handshake, has a neighbor
+* packet forwarded to the transports, and closes (every other one with a
+* RST). One transport stays connected throughout and must get every packet.
+* Prints the router's fds and RSS before and after, and handshake latency.
+* Exits 1 if the router kept fds or the kept transport missed a packet.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <poll.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "TenetRouter.h"
+#include "shmring.h"
+
+#define TCP_STRESS_CYCLES	2000
+#define TCP_STRESS_NEIGHBOR	"127.0.0.2"		// the router's loopback neighbor
+
+void ShowUsage(char* argv)
+{
+	MSG("   - Usage: %s [options]\n", argv);
+	MSG("   - [options] \n");
+	MSG("       -h            : print this message\n");
+	MSG("       -c <cycles>   : connect/close cycles (default %d)\n", TCP_STRESS_CYCLES);
+	MSG("       -r <router>   : router binary to start (default ./router)\n");
+
+	exit(1);
+}
+
+static double Now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static int CountFds(pid_t pid)
+{
+	char	pPath[64];
+	DIR*	pDir;
+	int		nFds = 0;
+
+	sprintf(pPath, "/proc/%d/fd", pid);
+
+	if( NULL == ( pDir = opendir(pPath) ) )
+		return -1;
+
+	while( struct dirent* pEntry = readdir(pDir) )
+	{
+		if( '.' != pEntry->d_name[0] )
+			nFds++;
+	}
+
+	closedir(pDir);
+	return nFds;
+}
+
+static int GetRSS(pid_t pid)
+{
+	char	pPath[64];
+	char	pLine[256];
+	FILE*	pFile;
+	int		nRSS = -1;
+
+	sprintf(pPath, "/proc/%d/status", pid);
+
+	if( NULL == ( pFile = fopen(pPath, "r") ) )
+		return -1;
+
+	while( fgets(pLine, sizeof(pLine), pFile) )
+	{
+		if( 1 == sscanf(pLine, "VmRSS: %d", &nRSS) )
+			break;
+	}
+
+	fclose(pFile);
+	return nRSS;
+}
+
+// connects to the router's transport port and does the sf handshake
+static int ConnectTransport(int nPort)
+{
+	struct	sockaddr_in	addr;
+	char	pHello[2];
+	int		fd;
+
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(nPort);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	bzero(&(addr.sin_zero), 8);
+
+	if( ( fd = socket(AF_INET, SOCK_STREAM, 0) ) == -1
+		|| connect(fd, (struct sockaddr*) &addr, sizeof(addr)) == -1 )
+	{
+		TR_ERROR("connect() failed\n");
+		exit(1);
+	}
+
+	if( write(fd, "U ", 2) != 2 || read(fd, pHello, 2) != 2 || memcmp(pHello, "U ", 2) )
+	{
+		TR_ERROR("sf handshake failed\n");
+		exit(1);
+	}
+
+	return fd;
+}
+
+// counts the sf frames (one length byte, then the packet) that arrive
+// until the router stays quiet for a second
+static int DrainTransport(int fd)
+{
+	struct	pollfd	pfd;
+	unsigned char	pBuffer[65536];
+	int		nBuffer = 0;
+	int		nFrames = 0;
+	int		n;
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+
+	while( poll(&pfd, 1, 1000) > 0 )
+	{
+		if( ( n = read(fd, pBuffer + nBuffer, sizeof(pBuffer) - nBuffer) ) <= 0 )
+			break;
+
+		nBuffer += n;
+
+		while( nBuffer > 0 && nBuffer >= 1 + pBuffer[0] )
+		{
+			n = 1 + pBuffer[0];
+			memmove(pBuffer, pBuffer + n, nBuffer - n);
+			nBuffer -= n;
+			nFrames++;
+		}
+	}
+
+	return nFrames;
+}
+
+static int CompareLatency(const void* p1, const void* p2)
+{
+	double d = *(const double*) p1 - *(const double*) p2;
+
+	return d < 0 ? -1 : ( d > 0 ? 1 : 0 );
+}
+
+int main(int argc, char** argv)
+{
+	const char*	pRouter = "./router";
+	int		nCycles = TCP_STRESS_CYCLES;
+	char	pTransportPort[16], pRouterPort[16];
+	char	pPath[108];
+	int		nTransportPort, nRouterPort;
+	int		fdKeep, fdNeighbor, fd;
+	int		nFds, nFdsAfter, nRSS, nFrames;
+	double*	pLatency;
+	double	dStart;
+	pid_t	pid;
+	struct	sockaddr_in	addr;
+	struct	linger	lingerRST = { 1, 0 };
+	TR_Packet	packet;
+	TOS_Msg*	pMsg = (TOS_Msg*) packet.pData;
+	int		i;
+
+	for( i = 1 ; i < argc ; i++ )
+	{
+		if( 0 == strcmp(argv[i], "-c") && i + 1 < argc )
+			nCycles = atoi(argv[++i]);
+		else if( 0 == strcmp(argv[i], "-r") && i + 1 < argc )
+			pRouter = argv[++i];
+		else
+			ShowUsage(argv[0]);
+	}
+
+	srand(getpid());
+	nTransportPort = 20000 + rand() % 10000;
+	nRouterPort = nTransportPort + 1;
+	sprintf(pTransportPort, "%d", nTransportPort);
+	sprintf(pRouterPort, "%d", nRouterPort);
+
+	if( 0 == ( pid = fork() ) )
+	{
+		int fdNull = open("/dev/null", O_WRONLY);
+
+		dup2(fdNull, 1);
+		dup2(fdNull, 2);
+		execl(pRouter, pRouter, "-s", "-i", "-n", "lo", "-a", "1",
+			"-tp", pTransportPort, "-rp", pRouterPort, (char*) NULL);
+		_exit(1);
+	}
+
+	usleep(500000);
+
+	fdKeep = ConnectTransport(nTransportPort);
+
+	// a TOS_Msg from my neighbor, which the router hands to every transport
+	memset(&packet, 0, sizeof(packet));
+	pMsg->addr = htons(1);
+	pMsg->src = htons(7);
+	pMsg->length = 4;
+	pMsg->group = 0x7d;
+	pMsg->type = 5;
+	memcpy(pMsg->data, "abcd", 4);
+	packet.header.type = TR_PACKET_TYPE_TOSMSG;
+	packet.header.lMasterIP = inet_addr(TCP_STRESS_NEIGHBOR);
+	packet.header.nDataLength = offsetof(TOS_Msg, data) + pMsg->length;
+
+	fdNeighbor = socket(AF_INET, SOCK_DGRAM, 0);
+	addr.sin_family = AF_INET;
+	addr.sin_port = 0;
+	addr.sin_addr.s_addr = inet_addr(TCP_STRESS_NEIGHBOR);
+	bzero(&(addr.sin_zero), 8);
+
+	if( bind(fdNeighbor, (struct sockaddr*) &addr, sizeof(addr)) == -1 )
+	{
+		TR_ERROR("bind() failed\n");
+		exit(1);
+	}
+
+	addr.sin_port = htons(nRouterPort);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	usleep(200000);
+
+	nFds = CountFds(pid);
+	nRSS = GetRSS(pid);
+	pLatency = (double*) malloc(nCycles * sizeof(double));
+
+	for( i = 0 ; i < nCycles ; i++ )
+	{
+		dStart = Now();
+		fd = ConnectTransport(nTransportPort);
+		pLatency[i] = Now() - dStart;
+
+		sendto(fdNeighbor, &packet, packet.GetTotalPacketLength(), 0,
+			(struct sockaddr*) &addr, sizeof(addr));
+
+		if( 0 == ( i & 1 ) )
+			setsockopt(fd, SOL_SOCKET, SO_LINGER, &lingerRST, sizeof(lingerRST));
+
+		close(fd);
+	}
+
+	usleep(500000);
+	nFrames = DrainTransport(fdKeep);
+	nFdsAfter = CountFds(pid);
+
+	qsort(pLatency, nCycles, sizeof(double), CompareLatency);
+
+	MSG("cycles %d, fds %d -> %d, rss %d -> %d kB\n",
+		nCycles, nFds, nFdsAfter, nRSS, GetRSS(pid));
+	MSG("handshake p50 %.3f p99 %.3f max %.3f ms\n",
+		pLatency[nCycles / 2] * 1e3, pLatency[nCycles * 99 / 100] * 1e3, pLatency[nCycles - 1] * 1e3);
+	MSG("kept transport got %d of %d packets\n", nFrames, nCycles);
+
+	// -i leaves the router without a clean exit; remove its channel socket
+	kill(pid, SIGKILL);
+	waitpid(pid, NULL, 0);
+	snprintf(pPath, sizeof(pPath), SHM_CHANNEL_PATH, nTransportPort);
+	unlink(pPath);
+	free(pLatency);
+
+	return ( nFrames == nCycles && nFdsAfter <= nFds ) ? 0 : 1;
+}
@@ -43,8 +43,19 @@
 #define _TENET_ROUTER_PORT_FOR_TRANSPORT	"9999"
 #define _TENET_SF_HOST		"127.0.0.1"
 #define _TENET_SF_PORT		"9000"
+#define MAX_BASE_STATIONS	8		// serial forwarders one router drives
 #define _TENET_ROUTER_INTERFACE	"wlan0"
 #define TENET_ROUTER_PORT_FOR_DEBUGGER	19999
+#define _TENET_ROUTER_PORT_FOR_METRICS	"0"		// 0 serves no metrics
+#define _TENET_ROUTER_SHM	"1"		// serve transports on this host over shared memory
+#define _TENET_DEDUP_WINDOW	"1000"	// msec a routed packet is remembered, 0 for never
+#define _TENET_BEACON_INTERVAL	"3"		// sec between routing advertisements, 0 for none
+#define _TENET_EGRESS_MOTE_RATE		"0"		// packets/sec, 0 is unshaped
+#define _TENET_EGRESS_MOTE_BURST	"12"	// the smaller UART_QUEUE_LEN of BaseStationP.nc
+#define _TENET_EGRESS_NEIGHBOR_RATE	"0"
+#define _TENET_EGRESS_NEIGHBOR_BURST	"32"
+#define _TENET_TCP_OUTPUT_BUDGET	"64"	// kbytes a TCP client may have waiting
+#define _TENET_TCP_OVERFLOW_POLICY	"newest"
 #define MAX_BUFFFER_SIZE		1000
 
 #define MSG(fmt, args...) fprintf(stdout, fmt, ## args);
@@ -62,6 +73,7 @@
 
 
 class CFile;
+class CPacketLog;
 
 typedef struct Debug
 {
@@ -74,8 +86,7 @@ typedef struct Debug
 
 typedef struct Arg
 {
-	char	pLogFilePath[MAX_STRING_SIZE];
-        CFile*	pLogFile;
+	CPacketLog*	pLog;
 	bool	bInteractive;
         char    pNameOfNetworkInterface[MAX_STRING_SIZE];
 };
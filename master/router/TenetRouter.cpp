@@ -35,11 +35,15 @@
 #include "TenetRouter.h"
 #include "TenetSFClient.h"
 #include "File.h"
+#include "PacketLog.h"
+#include "TraceReplay.h"
 #include "TR_Common.h"
 
 #include "routinglayer.h"
 #include "trd.h"
 
+#include <signal.h>
+
 CTenetRouter*    CTenetRouter::s_pTenetRouter = NULL;
 AddrMote        CTenetRouter::s_nTenetLocalAddr = 0;
 
@@ -49,53 +53,79 @@ struct Debug TR_Debug;
 
 extern struct Arg TR_Arg;
 
-CTenetRouter::CTenetRouter(void)
-    : CUDP_Server(CTenetRouter::OnReceive, atoi(getenv("TENET_ROUTER_PORT_FOR_OTHER_ROUTER")))
+CTenetRouter::CTenetRouter(const CRouterConfig& config)
+    : CUDP_Server(CTenetRouter::OnReceive, config.nRouterPort, CTenetRouter::OnReceiveBatch)
 {
     s_pTenetRouter = this;
-    s_nTenetLocalAddr = atoi(getenv("TENET_LOCAL_ADDRESS"));
+    s_nTenetLocalAddr = config.nLocalAddr;
 
-    MSG("[ENV] TENET_ROUTER_INTERFACE : %s\n", getenv("TENET_ROUTER_INTERFACE"));
-    MSG("[ENV] TENET_ROUTER_PORT_FOR_OTHER_ROUTER : %s\n", getenv("TENET_ROUTER_PORT_FOR_OTHER_ROUTER"));
-    MSG("[ENV] TENET_LOCAL_ADDRESS : %s\n", getenv("TENET_LOCAL_ADDRESS"));
+    m_nSF = 0;
 
-    if( 0 == strcmp ( getenv("TENET_ROUTER_STANDALONE_MODE"), "FALSE" ))
-    {
-        m_pSF = new CTenetSFClient();
-    }
-    else
+    for( int i = 0 ; i < config.nSF && ! config.bStandalone ; i++ )
     {
-        m_pSF = NULL;
+        m_pSF[m_nSF] = new CTenetSFClient(m_nSF, (char*) config.pSFHost[i], config.pSFPort[i]);
+        m_nSF++;
     }
 
-    m_pTransport = new CTenetTransportInterface();
+    m_nBeaconInterval = config.nBeaconInterval;
+    m_pBeacon = m_nBeaconInterval > 0 ? new CRouteBeacon() : NULL;
+
+    m_pDedup = config.nDedupWindow > 0 ? new CDedupCache(config.nDedupWindow) : NULL;
+    m_pReplay = NULL;
+
+    m_pTransport = new CTenetTransportInterface(config);
+    m_pRouteMonitor = new CRouteMonitor();
+    m_pShaper = new CEgressShaper(config.nMoteRate, config.nMoteBurst, config.nNeighborRate, config.nNeighborBurst);
+
+    m_bPipeline = false;
+    m_bStopPipeline = false;
+    m_nRouteFrom = 0;
+    m_lRouteReceived = 0;
+    m_nRouteBase = 0;
+
+    CMetrics::Initialize(CTenetRouter::SampleMetrics);
+
+    memset(&m_addrNeighbor, 0, sizeof(m_addrNeighbor));
+    m_addrNeighbor.sin_family = AF_INET;
+    m_addrNeighbor.sin_port = htons(m_nPort);
+
+    m_nBroadcastIP = config.nBroadcastIP;
 }
 
 CTenetRouter::~CTenetRouter(void)
 {
-    if(m_pSF)
-        delete m_pSF;
+    StopPipeline();
+
+    for( int i = 0 ; i < m_nSF ; i++ )
+        delete m_pSF[i];
 
     if(m_pTransport)
     {
         m_pTransport->Terminate();
         //delete m_pTransport;
     }
+
+    if(m_pRouteMonitor)
+        delete m_pRouteMonitor;
+
+    if(m_pShaper)
+        delete m_pShaper;
+
+    if(m_pBeacon)
+        delete m_pBeacon;
+
+    if(m_pDedup)
+        delete m_pDedup;
 }
 
-// just for debugging
+// advertises my motes to the routers of my subnet; called by RouteTimer()
 int CTenetRouter::Beacon(int nType)
 {
-    struct TR_Packet packet;
+    CTenetRouter* pRouter = CTenetRouter::GetTenetRouter();
 
-    packet.header.type = TR_PACKET_TYPE_BEACON;
+    if( pRouter->m_pBeacon )
+        pRouter->m_pBeacon->Advertise();
 
-#ifdef BEACON_WITH_MRT
-    packet.header.nDataLength = CMRT_Manager::MakeMRT_Packet(packet.pData);
-#else
-    memcpy(packet.pData,"Beacon!!",8);
-    packet.header.nDataLength=8; 
-#endif
     return 0;
 }
 
@@ -157,25 +187,581 @@ bool CTenetRouter::StartServer(void)
 
     this->m_pTransport->StartServer();
 
-    if(this->m_pSF)
-        this->m_pSF->Connect();
+    for( int i = 0 ; i < m_nSF ; i++ )
+        this->m_pSF[i]->Connect();
+
+    this->m_pRouteMonitor->Start();
 
     return true;
 }
 
-void CTenetRouter::Send(char *pAddr, TOS_Msg* pMsg, unsigned long lMasterIP, bool bBroadcast)
+// Starts the route and egress threads. Must be called after fork().
+// Until then every packet is routed and sent on the calling thread.
+bool CTenetRouter::StartPipeline(void)
+{
+    sigset_t sigAll;
+    sigset_t sigOld;
+
+    // signals (OnEndSignal, interactive mode) are handled by the main thread
+    sigfillset(&sigAll);
+    pthread_sigmask(SIG_BLOCK, &sigAll, &sigOld);
+
+    m_bStopPipeline = false;
+    m_bPipeline = true;
+
+    if( 0 != pthread_create(&m_threadEgress, NULL, CTenetRouter::EgressThread, (void*)this) )
+    {
+        TR_ERROR("pthread_create() failed\n");
+        exit(1);
+    }
+
+    if( 0 != pthread_create(&m_threadRoute, NULL, CTenetRouter::RouteThread, (void*)this) )
+    {
+        TR_ERROR("pthread_create() failed\n");
+        exit(1);
+    }
+
+    pthread_sigmask(SIG_SETMASK, &sigOld, NULL);
+
+    return true;
+}
+
+void CTenetRouter::StopPipeline(void)
+{
+    if( !m_bPipeline )
+        return;
+
+    m_bStopPipeline = true;
+
+    // route thread first, it is the only producer of the egress queue
+    m_queueIngress.Wakeup();
+    pthread_join(m_threadRoute, NULL);
+
+    m_queueEgress.Wakeup();
+    pthread_join(m_threadEgress, NULL);
+
+    m_bPipeline = false;
+}
+
+void* CTenetRouter::RouteThread(void* arg)
+{
+    CTenetRouter* pRouter = (CTenetRouter*) arg;
+    TR_IngressJob* pJob;
+
+    while( true )
+    {
+        pRouter->m_queueIngress.Wait();
+
+        if( pRouter->m_bStopPipeline )
+            break;
+
+        if( NULL != ( pJob = pRouter->m_queueIngress.GetReadSlot() ) )
+        {
+            pRouter->Route(pJob);
+            pRouter->m_queueIngress.Pop();
+        }
+    }
+
+    return NULL;
+}
+
+void* CTenetRouter::EgressThread(void* arg)
+{
+    CTenetRouter* pRouter = (CTenetRouter*) arg;
+    TR_EgressJob* pJob;
+
+    long lDelay;
+
+    while( true )
+    {
+        // shaped packets are waiting: wake up when the next may leave
+        if( ( lDelay = pRouter->m_pShaper->GetDelay() ) < 0 )
+        {
+            pRouter->m_queueEgress.Wait();
+        }
+        else if( !pRouter->m_queueEgress.TimedWait(lDelay) )
+        {
+            pRouter->EgressShaped();
+            continue;
+        }
+
+        if( pRouter->m_bStopPipeline )
+            break;
+
+        if( NULL == ( pJob = pRouter->m_queueEgress.GetReadSlot() ) )
+            continue;
+
+        if( pRouter->EnqueueShaped(pJob) )
+        {
+            pRouter->m_queueEgress.Pop();
+        }
+        else if( EGRESS_TO_NEIGHBOR == pJob->nType )
+        {
+            pRouter->m_queueEgress.Pop( pRouter->EgressToNeighbors() );
+        }
+        else
+        {
+            pRouter->Egress(pJob);
+            pRouter->m_queueEgress.Pop();
+        }
+
+        pRouter->EgressShaped();
+    }
+
+    return NULL;
+}
+
+// called by the socket loop only
+TR_IngressJob* CTenetRouter::GetIngressSlot(unsigned char nType)
+{
+    TR_IngressJob* pJob = &m_jobIngress;
+
+    if( m_bPipeline && NULL == ( pJob = m_queueIngress.GetWriteSlot() ) )
+    {
+        CONDITIONAL_DEBUG( TR_Debug.bTracePacket, " Packet dropped. (ingress queue full, %lu drops)\n", m_queueIngress.GetDrops());
+        CMetrics::Count(METRIC_DROP_INGRESS_FULL);
+        return NULL;
+    }
+
+    pJob->nType = nType;
+    pJob->lReceived = INGRESS_TIMER == nType ? 0 : CMetrics::Now();
+
+    return pJob;
+}
+
+void CTenetRouter::PushIngress(void)
+{
+    if( m_bPipeline )
+        m_queueIngress.Push();
+    else
+        Route(&m_jobIngress);
+}
+
+// called by the route thread only
+TR_EgressJob* CTenetRouter::GetEgressSlot(unsigned char nType)
+{
+    TR_EgressJob* pJob = &m_jobEgress;
+
+    if( m_bPipeline && NULL == ( pJob = m_queueEgress.GetWriteSlot() ) )
+    {
+        CONDITIONAL_DEBUG( TR_Debug.bTracePacket, " Packet dropped. (egress queue full, %lu drops)\n", m_queueEgress.GetDrops());
+        CMetrics::Count(METRIC_DROP_EGRESS_FULL);
+        return NULL;
+    }
+
+    pJob->nType = nType;
+    pJob->nFrom = m_nRouteFrom;
+    pJob->lReceived = m_lRouteReceived;
+
+    return pJob;
+}
+
+void CTenetRouter::PushEgress(void)
 {
-    struct TR_Packet packet;
+    if( m_bPipeline )
+        m_queueEgress.Push();
+    else
+        Egress(&m_jobEgress);
+}
+
+void CTenetRouter::Route(TR_IngressJob* pJob)
+{
+    // stamped on everything the packet makes us send
+    m_nRouteFrom = INGRESS_TOSMSG == pJob->nType ? pJob->nFrom : PACKET_FROM_MY_NEIGHBOR;
+    m_lRouteReceived = pJob->lReceived;
+    m_nRouteBase = INGRESS_TOSMSG == pJob->nType ? pJob->nBase : 0;
 
-    packet.header.type = TR_PACKET_TYPE_TOSMSG;
-    packet.header.lMasterIP = lMasterIP;
-    packet.header.nDataLength = pMsg->length + offsetof(TOS_Msg, data);
-    memcpy(packet.pData, pMsg, packet.header.nDataLength );
+    switch( pJob->nType )
+    {
+        case INGRESS_TOSMSG:
+            CTenetRouter::DispatchPacket((TOS_Msg*) pJob->pData, pJob->nFrom, pJob->lMasterIP);
+            break;
 
-    ((CUDP_Server*) this)->Send(pAddr, (char*)&packet, packet.GetTotalPacketLength(), bBroadcast);
+        case INGRESS_ROUTER_PACKET:
+            CTenetRouter::OnRouterPacket(&pJob->addr, pJob->pData, pJob->nLen);
+            break;
+
+        case INGRESS_TIMER:
+            RouteTimer();
+            break;
+    }
 }
 
+void CTenetRouter::Egress(TR_EgressJob* pJob)
+{
+    if( EGRESS_SHOW == pJob->nType )
+    {
+        ShowEgress(pJob);
+        return;
+    }
+
+    if( m_pReplay )
+    {
+        m_pReplay->OnEgress(pJob);
+        Sent(pJob, CMetrics::Now());
+        return;
+    }
+
+    switch( pJob->nType )
+    {
+        case EGRESS_TO_MOTE:
+            if( pJob->nBase < m_nSF )
+                m_pSF[pJob->nBase]->Send((TOS_Msg*) pJob->pData);
+            break;
+
+        case EGRESS_TO_NEIGHBOR:
+            {
+                struct iovec iov[2];
+
+                iov[0].iov_base = &pJob->header;
+                iov[0].iov_len = sizeof(TR_PacketHeader);
+                iov[1].iov_base = pJob->pMsg;
+                iov[1].iov_len = pJob->header.nDataLength;
+
+                CUDP_Server::Send(&pJob->addr, iov, 2);
+            }
+            break;
+
+        case EGRESS_TO_TRANSPORT:
+            m_pTransport->SendToAll((TOS_Msg*) pJob->pData);
+            break;
+    }
+
+    Sent(pJob, CMetrics::Now());
+}
+
+void CTenetRouter::Sent(TR_EgressJob* pJob, unsigned long lNow)
+{
+    CMetrics::Count(METRIC_TX_MOTE + pJob->nType);
+
+    if( pJob->lReceived )
+        CMetrics::Latency(pJob->nFrom, pJob->nType, pJob->lReceived, lNow);
+}
+
+// called on the egress thread for an EGRESS_SHOW job, which the route
+// thread queued with the egress queue's counters and the debugger's IP
+void CTenetRouter::ShowEgress(TR_EgressJob* pJob)
+{
+    EGRESS_Packet* pEGRESS_Packet = (EGRESS_Packet*) pJob->pData;
+    TR_Packet packet;
+
+    m_pShaper->MakeEGRESS_Packet( pEGRESS_Packet );
+
+    CEgressShaper::Show( pEGRESS_Packet );
+
+    if( 0 == pJob->header.lMasterIP )
+        return;
+
+    memcpy( packet.pData, pEGRESS_Packet, pEGRESS_Packet->GetEGRESS_PacketLength() );
+    packet.header.lMasterIP = CTenetRouter::s_nMyIP;
+    packet.header.type = TR_PACKET_TYPE_CTRL_RES_EGRESS;
+    packet.header.nDataLength = pEGRESS_Packet->GetEGRESS_PacketLength();
+    DEBUG("Send %s\n",inet_ntoa((in_addr&) pJob->header.lMasterIP));
+    CUDP_Client::DirectSend( inet_ntoa( (in_addr&) pJob->header.lMasterIP ), TENET_ROUTER_PORT_FOR_DEBUGGER,  (char*) &packet, packet.GetTotalPacketLength() ); 
+}
+
+// queue depths and drops counted elsewhere; called on the metrics thread
+void CTenetRouter::SampleMetrics(Metrics_Packet* pPacket)
+{
+    CTenetRouter* pRouter = CTenetRouter::GetTenetRouter();
+
+    if( NULL == pRouter )
+        return;
+
+    pPacket->pCounters[METRIC_DROP_LOG_FULL] = TR_Arg.pLog ? TR_Arg.pLog->GetDrops() : 0;
+    pPacket->pCounters[METRIC_QUEUE_INGRESS] = pRouter->m_queueIngress.GetSize();
+    pPacket->pCounters[METRIC_QUEUE_EGRESS] = pRouter->m_queueEgress.GetSize();
+}
+
+// sends the run of TR_Packets at the head of the egress queue with one
+// system call; returns how many jobs were used
+int CTenetRouter::EgressToNeighbors(void)
+{
+    UDP_Datagram    pDatagrams[UDP_BATCH_SIZE];
+    struct iovec    pIov[UDP_BATCH_SIZE][2];
+    TR_EgressJob*   pJob;
+    int             nJobs = 0;
+    unsigned long   lNow;
+
+    // the first job was already waited for, every further one takes its
+    // own count from the queue
+    while( nJobs < UDP_BATCH_SIZE
+        && NULL != ( pJob = m_queueEgress.GetReadSlot(nJobs) )
+        && EGRESS_TO_NEIGHBOR == pJob->nType
+        && ( 0 == nJobs || m_queueEgress.TryWait() ) )
+    {
+        pIov[nJobs][0].iov_base = &pJob->header;
+        pIov[nJobs][0].iov_len = sizeof(TR_PacketHeader);
+        pIov[nJobs][1].iov_base = pJob->pMsg;
+        pIov[nJobs][1].iov_len = pJob->header.nDataLength;
+
+        pDatagrams[nJobs].pAddr = &pJob->addr;
+        pDatagrams[nJobs].pIov = pIov[nJobs];
+        pDatagrams[nJobs].nIov = 2;
+
+        nJobs++;
+    }
+
+    CUDP_Server::Send(pDatagrams, nJobs);
+
+    lNow = CMetrics::Now();
+
+    for( int i = 0 ; i < nJobs ; i++ )
+        Sent(m_queueEgress.GetReadSlot(i), lNow);
+
+    return nJobs;
+}
+
+// hands a job for a shaped link to its next hop's queue; false if the
+// link is not shaped and the job is still to be sent
+bool CTenetRouter::EnqueueShaped(TR_EgressJob* pJob)
+{
+    uint32_t nHop;
+
+    switch( pJob->nType )
+    {
+        case EGRESS_TO_MOTE:
+            if( 0 == m_nSF )
+                return false;
+
+            nHop = pJob->nBase;
+            break;
+
+        case EGRESS_TO_NEIGHBOR:
+            nHop = pJob->addr.sin_addr.s_addr;
+            break;
+
+        default:
+            return false;
+    }
+
+    if( !m_pShaper->IsShaped(nHop) )
+        return false;
+
+    if( !m_pShaper->Enqueue(nHop, pJob) )
+        CONDITIONAL_DEBUG( TR_Debug.bTracePacket, " Packet dropped. (next hop queue full)\n");
+
+    return true;
+}
+
+// sends whatever the token buckets allow now, TR_Packets batched as above
+void CTenetRouter::EgressShaped(void)
+{
+    UDP_Datagram    pDatagrams[UDP_BATCH_SIZE];
+    struct iovec    pIov[UDP_BATCH_SIZE][2];
+    TR_EgressJob*   pJobs[UDP_BATCH_SIZE];
+    TR_EgressJob*   pJob;
+    int             nJobs = 0;
+
+    do
+    {
+        if( NULL != ( pJob = m_pShaper->Dequeue() ) && EGRESS_TO_NEIGHBOR != pJob->nType )
+        {
+            Egress(pJob);
+            m_pShaper->Release(pJob);
+        }
+        else if( NULL != pJob )
+        {
+            pIov[nJobs][0].iov_base = &pJob->header;
+            pIov[nJobs][0].iov_len = sizeof(TR_PacketHeader);
+            pIov[nJobs][1].iov_base = pJob->pMsg;
+            pIov[nJobs][1].iov_len = pJob->header.nDataLength;
+
+            pDatagrams[nJobs].pAddr = &pJob->addr;
+            pDatagrams[nJobs].pIov = pIov[nJobs];
+            pDatagrams[nJobs].nIov = 2;
+
+            pJobs[nJobs++] = pJob;
+        }
+
+        if( nJobs > 0 && ( NULL == pJob || UDP_BATCH_SIZE == nJobs ) )
+        {
+            unsigned long lNow = CMetrics::Now();
+
+            CUDP_Server::Send(pDatagrams, nJobs);
+
+            while( nJobs > 0 )
+            {
+                Sent(pJobs[--nJobs], lNow);
+                m_pShaper->Release( pJobs[nJobs] );
+            }
+        }
+    } while( NULL != pJob );
+}
+
+void CTenetRouter::QueueTOS_Msg(unsigned char nType, TOS_Msg* pMsg, unsigned char nBase)
+{
+    TR_EgressJob* pJob = GetEgressSlot(nType);
+
+    if( NULL == pJob )
+        return;
+
+    pJob->nBase = nBase;
+    pJob->nLen = pMsg->length + offsetof(TOS_Msg, data);
+    memcpy(pJob->pData, pMsg, pJob->nLen);
+
+    PushEgress();
+}
+
+// nBase if it is connected, otherwise the next base station that is;
+// -1 if none is
+int CTenetRouter::GetBaseStation(unsigned char nBase)
+{
+    for( int i = 0 ; i < m_nSF ; i++ )
+    {
+        int nNext = ( nBase + i ) % m_nSF;
+
+        if( IsBaseStationUp(nNext) )
+            return nNext;
+    }
+
+    return -1;
+}
+
+// a replay has every base station there is
+bool CTenetRouter::IsBaseStationUp(int nBase)
+{
+    return m_pReplay || m_pSF[nBase]->GetValid();
+}
+
+// to a mote through the base station that reached it
+void CTenetRouter::SendToMote(TOS_Msg* pMsg, unsigned char nBase)
+{
+    int nUp = GetBaseStation(nBase);
+
+    if( nUp >= 0 )
+        QueueTOS_Msg(EGRESS_TO_MOTE, pMsg, nUp);
+}
+
+// to the motes of every base station, each on its own channel
+void CTenetRouter::SendToAllMotes(TOS_Msg* pMsg)
+{
+    for( int i = 0 ; i < m_nSF ; i++ )
+    {
+        if( IsBaseStationUp(i) )
+            QueueTOS_Msg(EGRESS_TO_MOTE, pMsg, i);
+    }
+}
+
+void CTenetRouter::SendToTransport(TOS_Msg* pMsg)
+{
+    QueueTOS_Msg(EGRESS_TO_TRANSPORT, pMsg);
+}
+
+// sends pMsg to the router at nIP (or the broadcast address) as a TR_Packet
+void CTenetRouter::Send(uint32_t nIP, TOS_Msg* pMsg, unsigned long lMasterIP)
+{
+    TR_EgressJob* pJob = GetEgressSlot(EGRESS_TO_NEIGHBOR);
+
+    if( NULL == pJob )
+        return;
+
+    pJob->header.type = TR_PACKET_TYPE_TOSMSG;
+    pJob->header.lMasterIP = lMasterIP;
+    pJob->header.nDataLength = pMsg->length + offsetof(TOS_Msg, data);
+
+    pJob->addr = m_addrNeighbor;
+    pJob->addr.sin_addr.s_addr = nIP;
+
+    // the egress thread sends after pMsg is gone, so only the pipeline
+    // needs a copy; the header and the message are gathered by sendmsg()
+    if( m_bPipeline )
+    {
+        memcpy(pJob->pData, pMsg, pJob->header.nDataLength);
+        pJob->pMsg = pJob->pData;
+    }
+    else
+    {
+        pJob->pMsg = (char*) pMsg;
+    }
+
+    pJob->nLen = pJob->header.nDataLength;
+
+    PushEgress();
+}
+
+// a beacon of mine to the routers of my subnet; called by the route thread
+void CTenetRouter::SendBeacon(char* pData, int nLen)
+{
+    TR_EgressJob* pJob;
+
+    // If MyIP is loopback, ignore
+    if( ( (int)(CTenetRouter::s_nMyIP & 0x000000FF) == 0x7F )
+        && ( (int)(CTenetRouter::s_nMyIP & 0x0000FF00) >> 8 ) == 0x00 )
+        return;
+
+    if( NULL == ( pJob = GetEgressSlot(EGRESS_TO_NEIGHBOR) ) )
+        return;
+
+    pJob->header.type = TR_PACKET_TYPE_BEACON;
+    pJob->header.lMasterIP = s_nMyIP;
+    pJob->header.nDataLength = nLen;
+
+    pJob->addr = m_addrNeighbor;
+    pJob->addr.sin_addr.s_addr = m_nBroadcastIP;
+
+    memcpy(pJob->pData, pData, nLen);
+    pJob->pMsg = pJob->pData;
+    pJob->nLen = nLen;
+
+    PushEgress();
+}
+
+// a packet from a mote or a transport; called by the socket loop
+void CTenetRouter::EnqueuePacket(char* pData, int nLen, unsigned int nFrom, unsigned long lMasterIP, unsigned char nBase)
+{
+    CTenetRouter* pRouter = CTenetRouter::GetTenetRouter();
+    TR_IngressJob* pJob;
+
+    CMetrics::Count(METRIC_RX_MOTE + nFrom);
+
+    if( NULL == ( pJob = pRouter->GetIngressSlot(INGRESS_TOSMSG) ) )
+        return;
+
+    if( nLen > MAX_BUFFFER_SIZE )
+        nLen = MAX_BUFFFER_SIZE;
+
+    pJob->nFrom = nFrom;
+    pJob->lMasterIP = lMasterIP;
+    pJob->nBase = nBase;
+    pJob->nLen = nLen;
+    memcpy(pJob->pData, pData, nLen);
+
+    pRouter->PushIngress();
+}
+
+// a packet from another router; called by the socket loop
 void CTenetRouter::OnReceive(struct sockaddr_in* pAddr, char* pData, int nLen)
+{
+    CTenetRouter* pRouter = CTenetRouter::GetTenetRouter();
+    TR_IngressJob* pJob;
+
+    if( (unsigned long) pAddr->sin_addr.s_addr == CTenetRouter::s_nMyIP)
+        return;
+
+    CMetrics::Count(METRIC_RX_NEIGHBOR);
+
+    if( NULL == ( pJob = pRouter->GetIngressSlot(INGRESS_ROUTER_PACKET) ) )
+        return;
+
+    if( nLen > MAX_BUFFFER_SIZE )
+        nLen = MAX_BUFFFER_SIZE;
+
+    pJob->addr = *pAddr;
+    pJob->nLen = nLen;
+    memcpy(pJob->pData, pData, nLen);
+
+    pRouter->PushIngress();
+}
+
+// everything one Receive() read from other routers
+void CTenetRouter::OnReceiveBatch(UDP_Packet* pPackets, int nPackets)
+{
+    for( int i = 0 ; i < nPackets ; i++ )
+        CTenetRouter::OnReceive(&pPackets[i].addr, pPackets[i].pData, pPackets[i].nLen);
+}
+
+void CTenetRouter::OnRouterPacket(struct sockaddr_in* pAddr, char* pData, int nLen)
 {
     CTenetRouter* pRouter=CTenetRouter::GetTenetRouter();
 
@@ -188,12 +774,12 @@ void CTenetRouter::OnReceive(struct sockaddr_in* pAddr, char* pData, int nLen)
     switch(pPacket->header.type)
     {
         case TR_PACKET_TYPE_BEACON:
-            //CMRT_Manager::Update( 
-            //    (((uint32_t&) pAddr->sin_addr) & 0xFF000000) >> 24 | (((uint32_t&) pAddr->sin_addr) & 0x00FF0000) >> 16,  
-            //    (uint32_t&) pAddr->sin_addr);
-
-            //CIPRT_Manager::Update( (uint32_t&) pAddr->sin_addr, (uint32_t&) pAddr->sin_addr);
-
+            if( pRouter->m_pBeacon && nLen >= (int) sizeof(TR_PacketHeader) )
+            {
+                pRouter->m_pBeacon->OnBeacon( (uint32_t&) pAddr->sin_addr, pPacket->pData,
+                        nLen - (int) sizeof(TR_PacketHeader) < pPacket->header.nDataLength
+                        ? nLen - (int) sizeof(TR_PacketHeader) : pPacket->header.nDataLength );
+            }
             break;
 
         case TR_PACKET_TYPE_CTRL_REQ:
@@ -242,6 +828,8 @@ void CTenetRouter::Unicast(TOS_Msg* pMsg, unsigned long lMasterIP)
     AddrMote addr = CTenetRouter::GetDstMoteID(pMsg);
     uint32_t  nNextHopIP = CMRT_Manager::LookUpNextHopMaster(addr);
 
+    CMetrics::Count( nNextHopIP ? METRIC_MRT_HIT : METRIC_MRT_MISS );
+
     if( nNextHopIP ) // I know the Destination
     {
         if( nNextHopIP == pRouter->s_nMyIP)
@@ -253,21 +841,21 @@ void CTenetRouter::Unicast(TOS_Msg* pMsg, unsigned long lMasterIP)
                     CMRT_Manager::LookUpNextHopMote(addr));
 
             // the destination is one of my children
-            if( pRouter->m_pSF )
+            if( pRouter->m_nSF > 0 )
             {
                 pMsg->addr = htons(CMRT_Manager::LookUpNextHopMote(addr));
 
                 if( pMsg->type == AM_COL_DATA )
                     ( (collection_header_t*) pMsg->data )->prevhop = s_nTenetLocalAddr;
 
-                pRouter->m_pSF->Send(pMsg);
+                pRouter->SendToMote(pMsg, CMRT_Manager::LookUpBaseStation(addr));
             }
         }
         else
         {
             CONDITIONAL_DEBUG( TR_Debug.bTracePacket, " [ %16s (%16s) ] -> %5d","Known Neighbor", inet_ntoa((in_addr&)nNextHopIP), addr);
             // the destination can be reached by forwarding the packet to one of my neighbors
-            pRouter->Send(inet_ntoa((in_addr&)nNextHopIP), pMsg, lMasterIP);
+            pRouter->Send(nNextHopIP, pMsg, lMasterIP);
         }
     }
     else // I don't know the Destination (No matching entry on MRT)
@@ -275,7 +863,10 @@ void CTenetRouter::Unicast(TOS_Msg* pMsg, unsigned long lMasterIP)
         // If MyIP is loopback, ignore
         if( ( (int)(CTenetRouter::s_nMyIP & 0x000000FF) == 0x7F )
             && ( (int)(CTenetRouter::s_nMyIP & 0x0000FF00) >> 8 ) == 0x00 )
+        {
+            CMetrics::Count(METRIC_DROP_UNKNOWN_NEIGHBOR);
             return;
+        }
 
         /*
 
@@ -287,25 +878,20 @@ void CTenetRouter::Unicast(TOS_Msg* pMsg, unsigned long lMasterIP)
         CONDITIONAL_DEBUG( 
         (addr != 0xFFED) && TR_Debug.bTracePacket, 
         " [ %16s (%16s) ] -> %5d","Unknown Child", "TRD Control", addr);
-        pRouter->m_pSF->Send(pMsg);                
+        pRouter->SendToMote(pMsg);                
         }
         else
          */
 
         {
-            // So, send it IP
-            char pAddr[MAX_STRING_SIZE];
-
-            sprintf( pAddr, "%d.%d.%d.%d", 
-                    (int)(CTenetRouter::s_nMyIP & 0x000000FF),
-                    (int)(CTenetRouter::s_nMyIP & 0x0000FF00) >> 8,
-                    (int)(addr & 0xFF00) >> 8,
-                    (int)(addr & 0x00FF)
-                   );
+            // So, send it IP: the first two octets of my subnet, the mote ID in the last two
+            uint32_t nIP = ( 0x0000FFFF & CTenetRouter::s_nMyIP )
+                    | ( 0xFF00 & addr ) << 8
+                    | ( 0x00FF & addr ) << 24;
 
             CONDITIONAL_DEBUG( 
                     (addr != 0xFFED) && TR_Debug.bTracePacket, 
-                    " [ %16s (%16s) ] -> %5d","Unknown Neighbor", pAddr, addr);
+                    " [ %16s (%16s) ] -> %5d","Unknown Neighbor", inet_ntoa((in_addr&)nIP), addr);
             CONDITIONAL_DEBUG( 
                     (addr == 0xFFED) && TR_Debug.bTracePacket, 
                     " [Routing beacon]");
@@ -313,7 +899,11 @@ void CTenetRouter::Unicast(TOS_Msg* pMsg, unsigned long lMasterIP)
             if( addr != 0xFFED )
             {
                 // Foward the packet directly to a possible master
-                pRouter->Send(pAddr, pMsg, lMasterIP);
+                pRouter->Send(nIP, pMsg, lMasterIP);
+            }
+            else
+            {
+                CMetrics::Count(METRIC_DROP_UNKNOWN_NEIGHBOR);
             }
         }
     }
@@ -321,15 +911,33 @@ void CTenetRouter::Unicast(TOS_Msg* pMsg, unsigned long lMasterIP)
 
 void CTenetRouter::DispatchPacket(TOS_Msg* pMsg, unsigned int nFrom, unsigned long lMasterIP, unsigned long nFromNeighborIP)
 {
-    CTenetTransportInterface* pTenetTransport = CTenetTransportInterface::GetTenetTransport();
     CTenetRouter* pRouter = CTenetRouter::GetTenetRouter();
     AddrMote addr = CTenetRouter::GetDstMoteID(pMsg);
 
+    // before anything is decided, so that a log can be replayed
+    if ( TR_Arg.pLog )
+        TR_Arg.pLog->Write( (char*)pMsg, pMsg->length + offsetof(TOS_Msg, data), nFrom,
+                pRouter->m_nRouteBase, lMasterIP, nFromNeighborIP );
+
     // the packet was sent by me
     if ( PACKET_FROM_MY_NEIGHBOR == nFrom
             && nFromNeighborIP == GetMyIP() )
+    {
+        CMetrics::Count(METRIC_DROP_LOOP);
         return;
+    }
 
+    // the same packet again, flooded by several masters or heard by
+    // several base stations; what my transports send is theirs to repeat
+    if ( PACKET_FROM_MY_TRANSPORT != nFrom
+            && pRouter->m_pDedup
+            && pRouter->m_pDedup->IsDuplicate(pMsg,
+                pRouter->m_pReplay ? pRouter->m_pReplay->GetClock() : pRouter->m_lRouteReceived) )
+    {
+        CONDITIONAL_DEBUG( TR_Debug.bTracePacket, " Packet dropped. (duplicate)\n");
+        CMetrics::Count(METRIC_DROP_DUPLICATE);
+        return;
+    }
 
     switch( pMsg->type )
     {
@@ -346,7 +954,7 @@ void CTenetRouter::DispatchPacket(TOS_Msg* pMsg, unsigned int nFrom, unsigned lo
                         if ( ( ( (collection_header_t*) pMsg->data )->protocol & PROTOCOL_MASK) == PROTOCOL_TCMP )
                         {
                             // To Transport
-                            pTenetTransport->SendToAll(pMsg);
+                            pRouter->SendToTransport(pMsg);
                             MSG("TCMP && (TTL=0)\n");
                             CTenetSFClient::ShowPacket( (char*)pMsg, pMsg->length + offsetof(TOS_Msg, data) );
                         }
@@ -362,6 +970,7 @@ void CTenetRouter::DispatchPacket(TOS_Msg* pMsg, unsigned int nFrom, unsigned lo
                     //} else 
                     if ( ( (collection_header_t*) pMsg->data )->originaddr == s_nTenetLocalAddr ) {
                         MSG("Packet dropped. (Loop, SRC=LocalAddr)\n");
+                        CMetrics::Count(METRIC_DROP_LOOP);
                         CTenetSFClient::ShowPacket( (char*)pMsg, pMsg->length + offsetof(TOS_Msg, data) );
 
                         return;
@@ -410,7 +1019,8 @@ void CTenetRouter::DispatchPacket(TOS_Msg* pMsg, unsigned int nFrom, unsigned lo
                     CMRT_Manager::Update(
                             CTenetRouter::GetSrcMoteID(pMsg),    // Sender MoteID 
                             CTenetRouter::GetNextHopMoteID(pMsg),
-                            CTenetRouter::s_nMyIP                // I'm the master of this mote
+                            CTenetRouter::s_nMyIP,               // I'm the master of this mote
+                            pRouter->m_nRouteBase                // heard through this base station
                             );    
                 }
 
@@ -419,7 +1029,7 @@ void CTenetRouter::DispatchPacket(TOS_Msg* pMsg, unsigned int nFrom, unsigned lo
                     CONDITIONAL_DEBUG( TR_Debug.bTracePacket, " [ %16s ] ","Transport");
 
                     // To Transport
-                    pTenetTransport->SendToAll(pMsg);
+                    pRouter->SendToTransport(pMsg);
                 }
                 else
                 {
@@ -435,7 +1045,7 @@ void CTenetRouter::DispatchPacket(TOS_Msg* pMsg, unsigned int nFrom, unsigned lo
                     CONDITIONAL_DEBUG( TR_Debug.bTracePacket, " [ %16s ] ","Transport");
 
                     // To Transport
-                    pTenetTransport->SendToAll(pMsg);
+                    pRouter->SendToTransport(pMsg);
                 }
                 else
                 {
@@ -449,12 +1059,12 @@ void CTenetRouter::DispatchPacket(TOS_Msg* pMsg, unsigned int nFrom, unsigned lo
                     CONDITIONAL_DEBUG(TR_Debug.bTracePacket, " [ %16s ] ","Mote");
                     // To Mote
                     // the destination is one of my children
-                    if(pRouter->m_pSF)
+                    if(pRouter->m_nSF > 0)
                     {
 		      if( pMsg->type == AM_COL_DATA )
 			((collection_header_t*) pMsg->data )->prevhop = s_nTenetLocalAddr;
 
-                        pRouter->m_pSF->Send(pMsg);
+                        pRouter->SendToAllMotes(pMsg);
                     }
                 }
                 else
@@ -474,7 +1084,7 @@ void CTenetRouter::DispatchPacket(TOS_Msg* pMsg, unsigned int nFrom, unsigned lo
                 CONDITIONAL_DEBUG( TR_Debug.bTracePacket, " [ %16s ]","Transport(bcast)");
 
                 // To Transport
-                pTenetTransport->SendToAll(pMsg);
+                pRouter->SendToTransport(pMsg);
 
                 break;
             case PACKET_FROM_MY_TRANSPORT:
@@ -484,12 +1094,12 @@ void CTenetRouter::DispatchPacket(TOS_Msg* pMsg, unsigned int nFrom, unsigned lo
 
                     // To Mote
                     // the destination is one of my children
-                    if(pRouter->m_pSF)
+                    if(pRouter->m_nSF > 0)
                     {
                         if( pMsg->type == AM_COL_DATA )
                             ((collection_header_t*) pMsg->data )->prevhop = s_nTenetLocalAddr;
 
-                        pRouter->m_pSF->Send(pMsg);
+                        pRouter->SendToAllMotes(pMsg);
                     }
 
                     // If MyIP is loopback, ignore
@@ -500,7 +1110,7 @@ void CTenetRouter::DispatchPacket(TOS_Msg* pMsg, unsigned int nFrom, unsigned lo
                     }
                     else
                     {
-                        pRouter->Send( getenv("TENET_BROADCAST_ADDRESS"), pMsg, lMasterIP, true);
+                        pRouter->Send( pRouter->m_nBroadcastIP, pMsg, lMasterIP );
                     }
                 }
                 break;
@@ -512,16 +1122,6 @@ void CTenetRouter::DispatchPacket(TOS_Msg* pMsg, unsigned int nFrom, unsigned lo
 
         if( TR_Debug.bShowPacket )
             CTenetSFClient::ShowPacket( (char*)pMsg, pMsg->length + offsetof(TOS_Msg, data) );
-
-        if ( TR_Arg.pLogFile )
-        {
-            char pStr[MAX_STRING_SIZE];
-
-            sprintf( pStr, "%02d ", ( nFrom == 2 ? 1:0 ));
-            TR_Arg.pLogFile->WriteLine( pStr );
-            CTenetSFClient::WritePacketToFile( TR_Arg.pLogFile, (char*)pMsg, pMsg->length + offsetof(TOS_Msg, data) );
-
-        }
     }
 
 }
@@ -541,17 +1141,55 @@ void CTenetRouter::DispatchPacket(TOS_Msg* pMsg, unsigned int nFrom, unsigned lo
 //    return NULL;
 //}
 
-void CTenetRouter::Process()
+bool CTenetRouter::Process()
 {
     if( this->IsStart() )
-        this->Receive();
+        return this->Receive() == UDP_BATCH_SIZE;   // a full batch may have left more
+
+    return false;
 }
 
 void CTenetRouter::Timer()
+{
+    static time_t  timeCur=0;
+    static time_t  timerRoute=0;
+    static time_t  timerSF=0;
+
+    if( this->IsStart() )
+    {
+        time(&timeCur);
+
+        // a broken SF connection is not watched by the socket loop anymore
+        if( (timeCur - timerSF) >= SF_RECONNECT_INTERVAL )
+        {
+            time(&timerSF);
+
+            for( int i = 0 ; i < m_nSF ; i++ )
+            {
+                if( !m_pSF[i]->GetValid() )
+                    m_pSF[i]->Reconnect();
+            }
+        }
+
+        // transports that went away since the last round
+        if( m_pTransport )
+            m_pTransport->DestoryInvalidSocket();
+
+        // MRT/IPRT are maintained by the route thread
+        if( timeCur != timerRoute && NULL != GetIngressSlot(INGRESS_TIMER) )
+        {
+            timerRoute = timeCur;
+            PushIngress();
+        }
+    }
+}
+
+void CTenetRouter::RouteTimer()
 {
     static time_t  timeCur=0;
     static time_t  timerMRT=0;
     static time_t  timerIPRT=0;
+    static time_t  timerBeacon=0;
 
     if( timeCur == 0 )
     {
@@ -559,22 +1197,26 @@ void CTenetRouter::Timer()
         time(&timerIPRT);
     }
 
-    if( this->IsStart() )
+    time(&timeCur);
+
+    if( m_pBeacon && (timeCur - timerBeacon) >= m_nBeaconInterval )
     {
-        time(&timeCur);
+        time(&timerBeacon);
+        m_pBeacon->Age(timeCur, m_nBeaconInterval);
+        CTenetRouter::Beacon(0);
+    }
 
-        if( (timeCur - timerMRT) > MRT_REFRESH_TIMEOUT )
-        {
-            time(&timerMRT);
-            CMRT_Manager::Refresh(0);
-            //CMRT_Manager::Show();
-        }
+    if( (timeCur - timerMRT) > MRT_REFRESH_TIMEOUT )
+    {
+        time(&timerMRT);
+        CMRT_Manager::Refresh(0);
+        //CMRT_Manager::Show();
+    }
 
-        if( (timeCur - timerIPRT) > IPRT_REFRESH_TIMEOUT )
-        {
-            time(&timerIPRT);
-            CIPRT_Manager::Refresh(0);
-        }
+    if( (timeCur - timerIPRT) > IPRT_REFRESH_TIMEOUT )
+    {
+        time(&timerIPRT);
+        CIPRT_Manager::Refresh(0);
     }
 }
 
@@ -653,6 +1295,10 @@ bool CTenetRouter::ParseTR_Command(TR_Packet *pPacket, bool bConsole)
 
         goto SHOW_IPRT;
     }
+    else if( strcmp ( "egress" , pStrToken ) == 0 || strcmp ( "e" , pStrToken ) == 0 )
+    {
+        goto SHOW_EGRESS;
+    }
     else if( strcmp ( "h" , pStrToken ) == 0 )
     {
         ShowHelp();
@@ -706,6 +1352,27 @@ SHOW_IPRT:
         CUDP_Client::DirectSend( inet_ntoa( (in_addr&) pPacket->header.lMasterIP ), TENET_ROUTER_PORT_FOR_DEBUGGER,  (char*) &packet, packet.GetTotalPacketLength() ); 
     }
 
+    return true;
+SHOW_EGRESS:
+
+    {
+        CTenetRouter* pRouter = CTenetRouter::GetTenetRouter();
+        TR_EgressJob* pJob;
+        EGRESS_Packet* pEGRESS_Packet;
+
+        // the shaper belongs to the egress thread, which takes the rest
+        if( NULL == ( pJob = pRouter->GetEgressSlot(EGRESS_SHOW) ) )
+            return true;
+
+        // counted by the producer of the egress queue, which is me
+        pEGRESS_Packet = (EGRESS_Packet*) pJob->pData;
+        pEGRESS_Packet->nQueueDepth = pRouter->m_queueEgress.GetSize();
+        pEGRESS_Packet->nQueueDrops = pRouter->m_queueEgress.GetDrops();
+        pJob->header.lMasterIP = bConsole ? 0 : pPacket->header.lMasterIP;
+
+        pRouter->PushEgress();
+    }
+
     return true;
 }
 
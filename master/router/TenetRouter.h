@@ -39,6 +39,13 @@
 #include "UDP_Socket.h"
 #include "MRT_Manager.h"
 #include "IPRT_Manager.h"
+#include "SPSC_Queue.h"
+#include "RouteMonitor.h"
+#include "RouteBeacon.h"
+#include "DedupCache.h"
+#include "EgressShaper.h"
+#include "Metrics.h"
+#include "RouterConfig.h"
 
 
 #include "tosmsg.h"
@@ -47,10 +54,13 @@
 #define AddrMaster	uint32_t
 
 #define BEACON_TIMER_ID		10000
-#define BEACON_INTERVAL		3		//sec
+
+#define INGRESS_QUEUE_SIZE	256		// must be a power of 2
+#define EGRESS_QUEUE_SIZE	1024	// must be a power of 2
 
 class	CTenetSFClient;
 class	CTenetTransportInterface;
+class	CTraceReplay;
 
 enum
 {
@@ -69,7 +79,8 @@ enum
 
 	TR_PACKET_TYPE_CTRL_RES = 0x20,
 	TR_PACKET_TYPE_CTRL_RES_MRT = 0x21,
-	TR_PACKET_TYPE_CTRL_RES_IPRT = 0x22
+	TR_PACKET_TYPE_CTRL_RES_IPRT = 0x22,
+	TR_PACKET_TYPE_CTRL_RES_EGRESS = 0x23
 };
 
 typedef struct TR_PacketHeader
@@ -101,21 +112,110 @@ typedef struct TR_Packet
 	}
 };
 
+// Packets flow ingress (socket loop) -> route thread -> egress thread
+enum
+{
+	INGRESS_TOSMSG = 0x00,			// TOS_Msg from my mote or my transport
+	INGRESS_ROUTER_PACKET = 0x01,	// TR_Packet from another router
+	INGRESS_TIMER = 0x02			// periodic MRT/IPRT maintenance
+};
+
+enum
+{
+	EGRESS_TO_MOTE = 0x00,
+	EGRESS_TO_NEIGHBOR = 0x01,
+	EGRESS_TO_TRANSPORT = 0x02,
+	EGRESS_SHOW = 0x03				// the shaper's state for the debugger, sends no packet
+};
+
+struct TR_IngressJob
+{
+	unsigned char	nType;			// INGRESS_*
+	unsigned int	nFrom;			// PACKET_FROM_*
+	unsigned long	lMasterIP;
+	unsigned long	lReceived;		// CMetrics::Now()
+	unsigned char	nBase;			// base station a packet from my mote came through
+	struct	sockaddr_in	addr;		// sender of a TR_Packet
+	int		nLen;
+	char	pData[MAX_BUFFFER_SIZE];
+};
+
+struct TR_EgressJob
+{
+	unsigned char	nType;			// EGRESS_*
+	unsigned int	nFrom;			// PACKET_FROM_* of the packet routed, for the metrics
+	unsigned long	lReceived;		// of the packet routed, 0 for none
+	unsigned char	nBase;			// base station of a packet to the mote
+	struct	sockaddr_in	addr;		// destination of a TR_Packet
+	struct	TR_PacketHeader	header;	// of a TR_Packet, sent ahead of pMsg
+	char*	pMsg;					// pData, or the caller's TOS_Msg without the pipeline
+	int		nLen;
+	char	pData[MAX_BUFFFER_SIZE];
+};
+
+typedef CSPSC_Queue <TR_IngressJob, INGRESS_QUEUE_SIZE> IngressQueue;
+typedef CSPSC_Queue <TR_EgressJob, EGRESS_QUEUE_SIZE> EgressQueue;
+
 //Tenet router main class
 class CTenetRouter
 	: public CUDP_Server
 {
 public:
-	CTenetRouter(void);
+	CTenetRouter(const CRouterConfig& config);
 	~CTenetRouter(void);
 
 private:
 	static	CTenetRouter*	s_pTenetRouter;
 	static	AddrMote		s_nTenetLocalAddr;
 
-	int				m_nBeaconTimer;
-	CTenetSFClient*	m_pSF; // this instance communicates with basestation mote
+	int				m_nBeaconInterval;	// sec, 0 sends no beacons
+	CRouteBeacon*	m_pBeacon; // advertises my motes to the other masters
+	CTenetSFClient*	m_pSF[MAX_BASE_STATIONS]; // these instances communicate with basestation motes
+	int				m_nSF;
 	CTenetTransportInterface* m_pTransport; // this instance communicate with Tenet transport
+	CRouteMonitor*	m_pRouteMonitor; // keeps IPRT current between refreshes
+	CEgressShaper*	m_pShaper; // per next hop queues, used by the egress thread
+	CDedupCache*	m_pDedup; // packets routed recently, NULL without a window
+	CTraceReplay*	m_pReplay; // takes what would be sent while a log is replayed
+
+	// routing and sending run on their own threads (see StartPipeline)
+	bool			m_bPipeline;
+	pthread_t		m_threadRoute;
+	pthread_t		m_threadEgress;
+	IngressQueue	m_queueIngress;	// socket loop -> route thread
+	EgressQueue		m_queueEgress;	// route thread -> egress thread
+
+	volatile bool	m_bStopPipeline;
+	unsigned int	m_nRouteFrom;	// the packet the route thread is at
+	unsigned long	m_lRouteReceived;
+	unsigned char	m_nRouteBase;
+	TR_IngressJob	m_jobIngress;	// used instead of the queues
+	TR_EgressJob	m_jobEgress;	// until the pipeline is started
+
+	struct sockaddr_in	m_addrNeighbor;	// router port filled in, sin_addr per next hop
+	uint32_t		m_nBroadcastIP;
+
+	static	void*	RouteThread(void* arg);
+	static	void*	EgressThread(void* arg);
+	int				EgressToNeighbors(void);
+	bool			EnqueueShaped(TR_EgressJob* pJob);
+	void			EgressShaped(void);
+	void			StopPipeline(void);
+
+	TR_IngressJob*	GetIngressSlot(unsigned char nType);
+	void			PushIngress(void);
+	void			Route(TR_IngressJob* pJob);
+	void			RouteTimer(void);
+
+	TR_EgressJob*	GetEgressSlot(unsigned char nType);
+	void			PushEgress(void);
+	void			QueueTOS_Msg(unsigned char nType, TOS_Msg* pMsg, unsigned char nBase = 0);
+	int				GetBaseStation(unsigned char nBase);
+	bool			IsBaseStationUp(int nBase);
+	void			Egress(TR_EgressJob* pJob);
+	void			Sent(TR_EgressJob* pJob, unsigned long lNow);
+	void			ShowEgress(TR_EgressJob* pJob);
+	static	void	SampleMetrics(Metrics_Packet* pPacket);
 
 	static	AddrMote	IPtoMoteID(AddrMaster masterID);
 	static	AddrMaster	MoteIDtoIP(AddrMote moteID);
@@ -123,19 +223,34 @@ private:
 	static	AddrMote	GetDstMoteID(TOS_Msg* pMsg);
 	static	AddrMote	GetNextHopMoteID(TOS_Msg* pMsg);
 	static	void		OnReceive(struct sockaddr_in* pAddr, char* pData, int nLen);
+	static	void		OnReceiveBatch(UDP_Packet* pPackets, int nPackets);
+	static	void		OnRouterPacket(struct sockaddr_in* pAddr, char* pData, int nLen);
+
+	// feeds packets the way the sockets do
+	friend class CTraceReplay;
 
 public:
 void		Timer();
 
 public:
 	bool	StartServer(void);
-	void	Send(char *pAddr, TOS_Msg* pMsg, unsigned long lMasterIP, bool bBroadcast = false);
+	bool	StartPipeline(void);
+	void	SetReplay(CTraceReplay* pReplay)
+	{
+		m_pReplay = pReplay;
+	}
+	void	Send(uint32_t nIP, TOS_Msg* pMsg, unsigned long lMasterIP);
+	void	SendToMote(TOS_Msg* pMsg, unsigned char nBase);
+	void	SendToAllMotes(TOS_Msg* pMsg);
+	void	SendToTransport(TOS_Msg* pMsg);
+	void	SendBeacon(char* pData, int nLen);
 
 	static	int		Beacon(int nType);
     static  void    Unicast(TOS_Msg* pMsg, unsigned long lMasterIP);
+	static	void	EnqueuePacket(char* pData, int nLen, unsigned int nFrom, unsigned long lMasterIP, unsigned char nBase = 0);
 	static	void	DispatchPacket(TOS_Msg* pMsg, unsigned int nFrom, unsigned long lMasterIP, unsigned long nFromNeighborIP = 0);
 
-	virtual void Process(void);
+	virtual bool Process(void);
 
 	static CTenetRouter* GetTenetRouter()
 	{
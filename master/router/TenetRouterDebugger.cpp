@@ -71,6 +71,10 @@ void CTenetRouterDebugger::OnReceive(struct sockaddr_in* pAddr, char* pData, int
 		CIPRT_Manager::Show((IPRT_Packet*)pPacket->pData);
 		break;
 
+	case TR_PACKET_TYPE_CTRL_RES_EGRESS:
+		CEgressShaper::Show((EGRESS_Packet*)pPacket->pData);
+		break;
+
 	case TR_PACKET_TYPE_CTRL_RES:
 		MSG(" %s\n", pPacket->pData);
 		break;
@@ -83,9 +87,11 @@ void CTenetRouterDebugger::OnReceive(struct sockaddr_in* pAddr, char* pData, int
 	pRouterDebugger->Terminate();
 }
 
-void CTenetRouterDebugger::Process()
+bool CTenetRouterDebugger::Process()
 {
 	this->Receive();
+
+	return false;
 }
 
 void ShowUsage(char* argv) 
@@ -109,6 +115,7 @@ void ShowHelp()
     MSG("  trace(t) iprt(i)       : enable/disable to trace iprt \n");  
 	MSG("  mrt(m)                 : show mote routing table\n");
     MSG("  iprt(i)                : show ip routing table\n");
+    MSG("  egress(e)              : show egress queues\n");
     MSG("  q                      : quit\n");
 	MSG("------------------------------------------------------------\n");
 }
@@ -50,7 +50,7 @@ private:
 
 public:
 	static	void		OnReceive(struct sockaddr_in* pAddr, char* pData, int nLen);
-	virtual void Process(void);
+	virtual bool Process(void);
 
 	static CTenetRouterDebugger* GetTenetRouterDebugger()
 	{
@@ -37,12 +37,16 @@
 
 #include "tosmsg.h"
 
-CTenetSFClient::CTenetSFClient(void)
+CTenetSFClient::CTenetSFClient(unsigned char nBase, char* pStrHost, int nPort)
 {
 	this->OnReceive = CTenetSFClient::OnSFReceive;
 
-	MSG("[ENV] TENET_SF_HOST : %s\n", getenv("TENET_SF_HOST"));
-	MSG("[ENV] TENET_SF_PORT : %s\n", getenv("TENET_SF_PORT"));
+	m_nBase = nBase;
+	strncpy(m_pStrHost, pStrHost, MAX_STRING_SIZE - 1);
+	m_pStrHost[MAX_STRING_SIZE - 1] = '\0';
+	m_nSFPort = nPort;
+
+	MSG("[ENV] base station %d : %s:%d\n", m_nBase, m_pStrHost, m_nSFPort);
 }
 
 CTenetSFClient::~CTenetSFClient(void)
@@ -51,17 +55,25 @@ CTenetSFClient::~CTenetSFClient(void)
 
 bool CTenetSFClient::Connect()
 {
-	((CSFClient*)this)->Connect( getenv("TENET_SF_HOST"), atoi(getenv("TENET_SF_PORT")) );
+	((CSFClient*)this)->Connect( m_pStrHost, m_nSFPort );
 	//pthread_create(&m_thread, NULL, CTenetSFClient::SFThread, (void*)this);
 	return true;
 }
 
+bool CTenetSFClient::Reconnect()
+{
+	TR_ERROR("CTenetSFClient::Reconnect()//Connect Again (base station %d)\n", m_nBase);
+
+	this->Close();
+
+	return ((CSFClient*)this)->Connect( m_pStrHost, m_nSFPort );
+}
+
 
 void CTenetSFClient::OnSFReceive(CTCP_Client* pClient, char* pData, int nLen)
 {
-	CTenetRouter* pTenetRouter=CTenetRouter::GetTenetRouter();
-
-	pTenetRouter->DispatchPacket((TOS_Msg*) pData, PACKET_FROM_MY_MOTE, CTenetSFClient::s_nMyIP);
+	CTenetRouter::EnqueuePacket(pData, nLen, PACKET_FROM_MY_MOTE, CTenetSFClient::s_nMyIP,
+		( (CTenetSFClient*) pClient )->GetBase() );
 }
 
 //void* CTenetSFClient::SFThread(void* arg)
@@ -87,23 +99,26 @@ void CTenetSFClient::OnSFReceive(CTCP_Client* pClient, char* pData, int nLen)
 //	return NULL;
 //}
 
-void CTenetSFClient::Process()
+bool CTenetSFClient::Process()
 {
 	CTenetRouter* pTenetRouter = CTenetRouter::GetTenetRouter();
 
 	if( pTenetRouter->IsStart() )
 	{
+		int		nRoom = SF_INPUT_SIZE - m_nInput;
+
+		// a read that filled the buffer may have left more in the socket
+		if( this->GetValid() && this->Receive() == nRoom )
+			return true;
+
 		if( !this->GetValid() )
 		{
-			TR_ERROR("CTenetSFClient::Process()//Connect Again\n");
-			((CSFClient*)this)->Connect( getenv("TENET_SF_HOST"), atoi(getenv("TENET_SF_PORT")) );
-			usleep(1000000);
-		}
-		else
-		{
-			this->Receive();
+			// CTenetRouter::Timer() will reconnect
+			this->Close();
 		}
 	}
+
+	return false;
 }
 
 void CTenetSFClient::ShowPacket(char *pData, int nLen)
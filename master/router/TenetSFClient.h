@@ -39,11 +39,13 @@
 
 #include "SFClient.h"
 
+#define SF_RECONNECT_INTERVAL	1	// sec
+
 class CTenetSFClient
 	: public CSFClient
 {
 public:
-	CTenetSFClient(void);
+	CTenetSFClient(unsigned char nBase, char* pStrHost, int nPort);
 	~CTenetSFClient(void);
 
 private:
@@ -52,11 +54,20 @@ private:
 
 public:
 	bool	Connect(void);
+	bool	Reconnect(void);
 	static 	void	ShowPacket(char *pData, int nLen);
-	void	Process();
+	bool	Process();
+
+	unsigned char	GetBase(void)
+	{
+		return m_nBase;
+	}
 
 private:
 	//pthread_t		m_thread;
+	unsigned char	m_nBase;	// index of this base station in the router
+	char	m_pStrHost[MAX_STRING_SIZE];
+	int		m_nSFPort;
 
 };
 
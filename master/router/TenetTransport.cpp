@@ -42,16 +42,24 @@
 
 CTenetTransportInterface*	CTenetTransportInterface::s_pTenetTransport = NULL;
 
-CTenetTransportInterface::CTenetTransportInterface(void)
-:CTCP_Server(CTenetTransportInterface::OnReceive, atoi(getenv("TENET_ROUTER_PORT_FOR_TRANSPORT")))
+CTenetTransportInterface::CTenetTransportInterface(const CRouterConfig& config)
+:CTCP_Server(CTenetTransportInterface::OnReceive, config.nTransportPort)
 {
-	MSG("[ENV] TENET_ROUTER_PORT_FOR_TRANSPORT : %s\n", getenv("TENET_ROUTER_PORT_FOR_TRANSPORT"));
+#ifdef USE_SHM_CHANNEL
+	m_bShm = config.bShm;
+	m_pShm = NULL;
+#endif
 
 	s_pTenetTransport = this;
 }
 
 CTenetTransportInterface::~CTenetTransportInterface(void)
 {
+#ifdef USE_SHM_CHANNEL
+	if( m_pShm )
+		delete m_pShm;
+#endif
+
 		printf("HERE!3-3\n");
 }
 
@@ -59,6 +67,20 @@ bool CTenetTransportInterface::StartServer(void)
 {
 	((CTCP_Server*)this)->StartServer();
 
+#ifdef USE_SHM_CHANNEL
+	// transports on other hosts still come in over TCP
+	if( m_bShm )
+	{
+		m_pShm = new CShmServer( this, CTenetTransportInterface::OnReceive, this->m_nPort );
+
+		if( ! m_pShm->StartServer() )
+		{
+			delete m_pShm;
+			m_pShm = NULL;
+		}
+	}
+#endif
+
 	return true;
 }
 
@@ -72,7 +94,6 @@ CTCP_Client* CTenetTransportInterface::Accept()
 	if(pClient->SetClientSocket
 		(accept(this->m_fdSocket,(struct sockaddr *) pClient->GetClientAddr(),&nAddrLen))>= 0)
 	{
-		pClient->SetOwner(this);
 		pClient->SetValid(true);
 		pClient->OnReceive = CTenetTransportInterface::OnReceive;
 
@@ -80,53 +101,53 @@ CTCP_Client* CTenetTransportInterface::Accept()
 		TRACE("a Transport is connected.\n");
 #endif
 		if ( init_sf_source( pClient->GetClientSocket() ) < 0)
-			pClient->SetValid( false );
+		{
+			pClient->Close();
+			delete pClient;
+			return NULL;
+		}
+
+		this->AddClient(pClient);
 
 		return pClient;
 	}
 	else
 	{
-		pClient->SetValid(false);
+		delete pClient;
 		return NULL;
 	}
 }
 
 void CTenetTransportInterface::SendToAll(TOS_Msg* pMsg)
 {
-	CSFClient*	pClient;
-	list <CTCP_Client*>::iterator	iter;
+	CTCP_Client*	pClient;
 
+	pthread_mutex_lock(&m_lockClients);
 
-	for(iter=CTCP_Client::s_listClient.begin();iter!=CTCP_Client::s_listClient.end();iter++)
-	{
-		pClient=(CSFClient *)*iter;
+	for( pClient = m_pClients ; pClient ; pClient = pClient->GetNextClient() )
+		((CSFClient*) pClient)->Send(pMsg);
 
-		if( pClient->GetOwner() == this )
-		{
-			pClient->Send(pMsg);
-		}
-	}
+	pthread_mutex_unlock(&m_lockClients);
 }
 
 void CTenetTransportInterface::ReceiveFromAll()
 {
-	CSFClient	*pClient;
-	list <CTCP_Client*>::iterator	iter;
+	CTCP_Client*	pClient;
 
+	pthread_mutex_lock(&m_lockClients);
 
-	for(iter=CTCP_Client::s_listClient.begin();iter!=CTCP_Client::s_listClient.end();iter++)
+	for( pClient = m_pClients ; pClient ; pClient = pClient->GetNextClient() )
 	{
-		pClient=(CSFClient *)*iter;
-
-		if( pClient->GetOwner() == this && pClient->IsThereAnyNewPacket())
-			pClient->Receive();
+		if( pClient->IsThereAnyNewPacket() )
+			((CSFClient*) pClient)->Receive();
 	}
+
+	pthread_mutex_unlock(&m_lockClients);
 }
 
 void CTenetTransportInterface::OnReceive(CTCP_Client *pClient, char* pData, int nLen)
 {
-	CTenetRouter* pRouter = CTenetRouter::GetTenetRouter();
-	pRouter->DispatchPacket( (TOS_Msg*)pData, PACKET_FROM_MY_TRANSPORT, CTenetTransportInterface::s_nMyIP);
+	CTenetRouter::EnqueuePacket(pData, nLen, PACKET_FROM_MY_TRANSPORT, CTenetTransportInterface::s_nMyIP);
 }
 
 //void* CTenetTransportInterface::TransportThread(void* arg)
@@ -150,10 +171,12 @@ void CTenetTransportInterface::OnReceive(CTCP_Client *pClient, char* pData, int
 //	return NULL;
 //}
 
-void CTenetTransportInterface::Process()
+bool CTenetTransportInterface::Process()
 {
 	if( this->IsStart() )
 	{
-		this->Accept();
+		return NULL != this->Accept();	// one more may be waiting
 	}
+
+	return false;
 }
@@ -38,6 +38,8 @@
 #include <pthread.h>
 
 #include "TCP_Socket.h"
+#include "ShmChannel.h"
+#include "RouterConfig.h"
 
 #include "tosmsg.h"
 
@@ -48,7 +50,7 @@ class CTenetTransportInterface
 	: public CTCP_Server
 {
 public:
-	CTenetTransportInterface(void);
+	CTenetTransportInterface(const CRouterConfig& config);
 	~CTenetTransportInterface(void);
 
 private:
@@ -58,6 +60,11 @@ private:
 protected:
 	CTCP_Client* Accept();
 
+#ifdef USE_SHM_CHANNEL
+	bool		m_bShm;
+	CShmServer*	m_pShm;		// NULL when not serving shared memory (-sm 0)
+#endif
+
 public:
 	static	CTenetTransportInterface* GetTenetTransport()
 	{
@@ -68,7 +75,7 @@ public:
 	void	SendToAll(TOS_Msg* pMsg);
 	void	ReceiveFromAll();
 
-	virtual void Process(void);
+	virtual bool Process(void);
 };
 
 #endif
@@ -0,0 +1,258 @@
+/*
+* "Copyright (c) 2006 University of Southern California.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software and its
+* documentation for any purpose, without fee, and without written
+* agreement is hereby granted, provided that the above copyright
+* notice, the following two paragraphs and the author appear in all
+* copies of this software.
+*
+* IN NO EVENT SHALL THE UNIVERSITY OF SOUTHERN CALIFORNIA BE LIABLE TO
+* ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+* DAMAGES ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS
+* DOCUMENTATION, EVEN IF THE UNIVERSITY OF SOUTHERN CALIFORNIA HAS BEEN
+* ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+* THE UNIVERSITY OF SOUTHERN CALIFORNIA SPECIFICALLY DISCLAIMS ANY
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  THE SOFTWARE
+* PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND THE UNIVERSITY OF
+* SOUTHERN CALIFORNIA HAS NO OBLIGATION TO PROVIDE MAINTENANCE,
+* SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
+*
+*/
+
+
+/*
+* Replays a packet log of the Tenet router (-rr)
+*/
+
+#include "TraceReplay.h"
+#include "TenetRouter.h"
+#include "TR_Common.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+static const char* s_pFromNames[] = { "mote", "neighbor", "transport" };
+
+static int CompareRouted(const void* p1, const void* p2)
+{
+	uint32_t n1 = *(const uint32_t*) p1;
+	uint32_t n2 = *(const uint32_t*) p2;
+
+	return n1 < n2 ? -1 : n1 > n2;
+}
+
+static unsigned long NowNsec(void)
+{
+	struct timespec timeNow;
+
+	clock_gettime(CLOCK_MONOTONIC, &timeNow);
+
+	return timeNow.tv_sec * 1000000000UL + timeNow.tv_nsec;
+}
+
+CTraceReplay::CTraceReplay(bool bOriginalTiming, const char* pStrDecisions)
+{
+	m_bOriginalTiming = bOriginalTiming;
+	m_pDecisions = NULL;
+
+	m_lClock = 0;
+	m_lElapsed = 0;
+	m_nPackets = 0;
+	memset(m_pFrom, 0, sizeof(m_pFrom));
+	memset(m_pSent, 0, sizeof(m_pSent));
+	m_nUnsent = 0;
+
+	m_pRouted = NULL;
+	m_nRoutedSize = 0;
+
+	m_nOutputs = 0;
+	m_nDecision = 0;
+
+	if( pStrDecisions && pStrDecisions[0] && NULL == ( m_pDecisions = fopen(pStrDecisions, "w") ) )
+		TR_ERROR("File open error : [%s]\n", pStrDecisions);
+}
+
+CTraceReplay::~CTraceReplay(void)
+{
+	if( m_pDecisions )
+		fclose(m_pDecisions);
+
+	free(m_pRouted);
+}
+
+// as the socket that received it would have
+void CTraceReplay::Feed(PacketLogRecord* pRecord, char* pData)
+{
+	if( PACKET_FROM_MY_NEIGHBOR == pRecord->nFrom )
+	{
+		TR_Packet packet;
+		struct sockaddr_in addr;
+
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = pRecord->nNeighborIP;
+
+		packet.header.type = TR_PACKET_TYPE_TOSMSG;
+		packet.header.lMasterIP = pRecord->lMasterIP;
+		packet.header.nDataLength = pRecord->nLen;
+		memcpy(packet.pData, pData, pRecord->nLen);
+
+		CTenetRouter::OnReceive(&addr, (char*) &packet, packet.GetTotalPacketLength());
+	}
+	else
+	{
+		CTenetRouter::EnqueuePacket(pData, pRecord->nLen, pRecord->nFrom, pRecord->lMasterIP, pRecord->nBase);
+	}
+}
+
+bool CTraceReplay::Run(const char* pStrPath)
+{
+	FILE*	pIn;
+	PacketLogHeader	header;
+	PacketLogRecord	record;
+	char	pData[65536];
+	unsigned long	lStart;
+	unsigned long	lFirst = 0;
+
+	if( NULL == ( pIn = fopen( pStrPath, "rb" ) ) )
+	{
+		TR_ERROR("File open error : [%s]\n", pStrPath);
+		return false;
+	}
+
+	if( 1 != fread( &header, sizeof(header), 1, pIn )
+		|| PACKET_LOG_MAGIC != header.nMagic
+		|| PACKET_LOG_VERSION != header.nVersion )
+	{
+		TR_ERROR("Not a packet log of this version : [%s]\n", pStrPath);
+		fclose( pIn );
+		return false;
+	}
+
+	lStart = CMetrics::Now();
+
+	while( 1 == fread( &record, sizeof(record), 1, pIn ) )
+	{
+		unsigned long lBegin;
+
+		// a log cut short while the router was writing it
+		if( record.nLen != fread( pData, 1, record.nLen, pIn ) )
+			break;
+
+		if( record.nFrom > PACKET_FROM_MY_TRANSPORT || record.nLen > MAX_BUFFFER_SIZE )
+		{
+			TR_ERROR("Packet %lu of %s is broken\n", m_nPackets, pStrPath);
+			break;
+		}
+
+		m_lClock = record.nSec * 1000000UL + record.nUsec;
+
+		if( 0 == m_nPackets )
+			lFirst = m_lClock;
+
+		if( m_bOriginalTiming && m_lClock > lFirst )
+		{
+			long lWait = (long) ( lStart + ( m_lClock - lFirst ) - CMetrics::Now() );
+
+			if( lWait > 0 )
+				usleep(lWait);
+		}
+
+		if( m_nPackets == m_nRoutedSize )
+		{
+			m_nRoutedSize = m_nRoutedSize ? m_nRoutedSize * 2 : 4096;
+
+			if( NULL == ( m_pRouted = (uint32_t*) realloc(m_pRouted, m_nRoutedSize * sizeof(uint32_t)) ) )
+			{
+				TR_ERROR("realloc() failed\n");
+				exit(1);
+			}
+		}
+
+		m_nOutputs = 0;
+		m_nDecision = 0;
+
+		lBegin = NowNsec();
+		Feed(&record, pData);
+		m_pRouted[m_nPackets] = (uint32_t) ( NowNsec() - lBegin );
+
+		if( 0 == m_nOutputs )
+			m_nUnsent++;
+
+		if( m_pDecisions )
+		{
+			fprintf( m_pDecisions, "%lu %s %02x ->%s\n", m_nPackets, s_pFromNames[record.nFrom],
+				( (TOS_Msg*) pData )->type, m_nOutputs ? m_pDecision : " none" );
+		}
+
+		m_pFrom[record.nFrom]++;
+		m_nPackets++;
+	}
+
+	m_lElapsed = CMetrics::Now() - lStart;
+
+	fclose( pIn );
+
+	return true;
+}
+
+void CTraceReplay::OnEgress(TR_EgressJob* pJob)
+{
+	int nLeft = REPLAY_DECISION_SIZE - m_nDecision;
+	int nLen = 0;
+
+	m_nOutputs++;
+	m_pSent[pJob->nType]++;
+
+	if( NULL == m_pDecisions || nLeft <= 1 )
+		return;
+
+	switch( pJob->nType )
+	{
+		case EGRESS_TO_MOTE:
+			nLen = snprintf( m_pDecision + m_nDecision, nLeft, " mote %u", pJob->nBase );
+			break;
+
+		case EGRESS_TO_NEIGHBOR:
+			nLen = snprintf( m_pDecision + m_nDecision, nLeft, " neighbor %s", inet_ntoa( pJob->addr.sin_addr ) );
+			break;
+
+		case EGRESS_TO_TRANSPORT:
+			nLen = snprintf( m_pDecision + m_nDecision, nLeft, " transport" );
+			break;
+	}
+
+	m_nDecision += nLen < nLeft ? nLen : nLeft - 1;
+}
+
+void CTraceReplay::Report(void)
+{
+	double	dElapsed = m_lElapsed / 1000000.0;
+
+	MSG("------------------------------------------------------------\n");
+	MSG(" replayed %lu packets in %.3f msec, %.0f packets/sec\n",
+		m_nPackets, dElapsed * 1000, dElapsed > 0 ? m_nPackets / dElapsed : 0.0);
+	MSG("   from mote %lu, neighbor %lu, transport %lu\n",
+		m_pFrom[PACKET_FROM_MY_MOTE], m_pFrom[PACKET_FROM_MY_NEIGHBOR], m_pFrom[PACKET_FROM_MY_TRANSPORT]);
+
+	if( m_nPackets > 0 )
+	{
+		qsort(m_pRouted, m_nPackets, sizeof(uint32_t), CompareRouted);
+
+		MSG(" nsec to route and send a packet: 50%% %u, 90%% %u, 99%% %u, 99.9%% %u, max %u\n",
+			m_pRouted[ m_nPackets * 50 / 100 ],
+			m_pRouted[ m_nPackets * 90 / 100 ],
+			m_pRouted[ m_nPackets * 99 / 100 ],
+			m_pRouted[ m_nPackets * 999 / 1000 ],
+			m_pRouted[ m_nPackets - 1 ]);
+	}
+
+	MSG(" sent to mote %lu, neighbor %lu, transport %lu; %lu packets sent nowhere\n",
+		m_pSent[EGRESS_TO_MOTE], m_pSent[EGRESS_TO_NEIGHBOR], m_pSent[EGRESS_TO_TRANSPORT], m_nUnsent);
+	MSG("------------------------------------------------------------\n");
+}
@@ -0,0 +1,97 @@
+/*
+* "Copyright (c) 2006 University of Southern California.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software and its
+* documentation for any purpose, without fee, and without written
+* agreement is hereby granted, provided that the above copyright
+* notice, the following two paragraphs and the author appear in all
+* copies of this software.
+*
+* IN NO EVENT SHALL THE UNIVERSITY OF SOUTHERN CALIFORNIA BE LIABLE TO
+* ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+* DAMAGES ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS
+* DOCUMENTATION, EVEN IF THE UNIVERSITY OF SOUTHERN CALIFORNIA HAS BEEN
+* ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+* THE UNIVERSITY OF SOUTHERN CALIFORNIA SPECIFICALLY DISCLAIMS ANY
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  THE SOFTWARE
+* PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND THE UNIVERSITY OF
+* SOUTHERN CALIFORNIA HAS NO OBLIGATION TO PROVIDE MAINTENANCE,
+* SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
+*
+*/
+
+
+/*
+* Replays a packet log of the Tenet router (-rr)
+*
+* Each logged packet is handed to the router the way its socket would
+* have, a TOS_Msg from a base station or a transport, a TR_Packet from a
+* neighbor, as fast as possible or with the time between packets of the
+* log. Nothing is routed on threads: every packet is routed and "sent"
+* before the next one is fed, so the decisions come out in the order of
+* the log. The router gives what it would have sent to OnEgress() instead
+* of its base stations, neighbors and transports.
+*
+* Report() prints the throughput and how long packets took to route. The
+* decisions, one line per packet of the log, can be written to a file to
+* be compared between builds.
+*/
+
+#ifndef _TRACE_REPLAY_H_
+#define _TRACE_REPLAY_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "PacketLog.h"
+
+#define REPLAY_DECISION_SIZE	512
+
+struct TR_EgressJob;
+
+class CTraceReplay
+{
+public:
+	// pStrDecisions is where the decisions go, none if NULL or empty
+	CTraceReplay(bool bOriginalTiming, const char* pStrDecisions);
+	~CTraceReplay(void);
+
+	// routes every packet of the log; false if it cannot be read
+	bool	Run(const char* pStrPath);
+
+	// called by the router for everything it would have sent
+	void	OnEgress(TR_EgressJob* pJob);
+
+	// the time of the packet being replayed, in usec as CMetrics::Now()
+	unsigned long	GetClock(void)
+	{
+		return m_lClock;
+	}
+
+	void	Report(void);
+
+private:
+	bool			m_bOriginalTiming;
+	FILE*			m_pDecisions;
+
+	unsigned long	m_lClock;
+	unsigned long	m_lElapsed;		// usec, of the whole replay
+	unsigned long	m_nPackets;
+	unsigned long	m_pFrom[3];		// by PACKET_FROM_*
+	unsigned long	m_pSent[3];		// by EGRESS_*
+	unsigned long	m_nUnsent;		// packets that made the router send nothing
+
+	uint32_t*		m_pRouted;		// nsec each packet took to route
+	unsigned long	m_nRoutedSize;
+
+	int				m_nOutputs;		// of the packet being replayed
+	char			m_pDecision[REPLAY_DECISION_SIZE];
+	int				m_nDecision;
+
+	void	Feed(PacketLogRecord* pRecord, char* pData);
+};
+
+#endif
@@ -0,0 +1,308 @@
+/*
+* "Copyright (c) 2006 University of Southern California.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software and its
+* documentation for any purpose, without fee, and without written
+* agreement is hereby granted, provided that the above copyright
+* notice, the following two paragraphs and the author appear in all
+* copies of this software.
+*
+* IN NO EVENT SHALL THE UNIVERSITY OF SOUTHERN CALIFORNIA BE LIABLE TO
+* ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+* DAMAGES ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS
+* DOCUMENTATION, EVEN IF THE UNIVERSITY OF SOUTHERN CALIFORNIA HAS BEEN
+* ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+* THE UNIVERSITY OF SOUTHERN CALIFORNIA SPECIFICALLY DISCLAIMS ANY
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  THE SOFTWARE
+* PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND THE UNIVERSITY OF
+* SOUTHERN CALIFORNIA HAS NO OBLIGATION TO PROVIDE MAINTENANCE,
+* SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
+*
+*/
+
+/*
+* tracetest: writes a packet log (-l format) of a made up but routable
+* mix, replays it with ./router -rr as fast as possible and with the
+* log's timing (-rt 1), and checks that both made the same decisions
+* (-rd). Prints the router's replay reports.
+*
+* The mix, one packet per millisecond from a fixed seed:
+*   50% COL data from motes 10-49, through base station 0 or 1
+*   10% the same packet again through the other base station (a duplicate)
+*   25% packets from my transport to motes 10-59 (50-59 are unknown)
+*   15% COL data of motes 100-119 from a neighbor master
+* Exits 1 if a replay failed or the decisions differ.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <arpa/inet.h>
+
+#include "TenetRouter.h"
+#include "PacketLog.h"
+#include "routinglayer.h"
+
+#define TRACE_TEST_PACKETS	3000
+#define TRACE_TEST_MY_IP	"127.0.0.1"		// the router replays on lo
+#define TRACE_TEST_NEIGHBOR	"127.0.0.2"
+
+static FILE*	s_pLog;
+static uint32_t	s_nSec = 1000;
+static uint32_t	s_nUsec;
+
+static void WriteRecord(TOS_Msg* pMsg, int nFrom, int nBase, const char* pMaster, const char* pNeighbor)
+{
+	PacketLogRecord	record;
+
+	record.nLen = offsetof(TOS_Msg, data) + pMsg->length;
+	record.nFrom = nFrom;
+	record.nBase = nBase;
+	record.nSec = s_nSec;
+	record.nUsec = s_nUsec;
+	record.lMasterIP = pMaster ? inet_addr(pMaster) : 0;
+	record.nNeighborIP = pNeighbor ? inet_addr(pNeighbor) : 0;
+
+	fwrite(&record, sizeof(record), 1, s_pLog);
+	fwrite(pMsg, record.nLen, 1, s_pLog);
+}
+
+// COL data from nOrigin to nDst, sent on by nPrevHop
+static void MakeCollection(TOS_Msg* pMsg, uint16_t nOrigin, uint16_t nDst, uint16_t nPrevHop, uint16_t nSeq)
+{
+	collection_header_t* pHeader = (collection_header_t*) pMsg->data;
+
+	memset(pMsg, 0, sizeof(TOS_Msg));
+	pMsg->type = AM_COL_DATA;
+	pMsg->addr = htons(nDst);
+	pMsg->src = htons(nPrevHop);
+	pMsg->group = 0x7d;
+	pMsg->length = sizeof(collection_header_t) + 4;
+
+	pHeader->originaddr = htons(nOrigin);
+	pHeader->dstaddr = htons(nDst);
+	pHeader->prevhop = htons(nPrevHop);
+	pHeader->originseqno = htons(nSeq);
+	pHeader->ttl = htons(5);
+	pHeader->protocol = 5;
+}
+
+static bool WriteLog(const char* pPath, int nPackets)
+{
+	PacketLogHeader	header;
+	TOS_Msg		msg;
+	TOS_Msg		last;
+	int			nLastBase = 0;
+	uint16_t	pSeq[256];
+	int			i;
+
+	if( NULL == ( s_pLog = fopen(pPath, "wb") ) )
+	{
+		TR_ERROR("File open error : [%s]\n", pPath);
+		return false;
+	}
+
+	header.nMagic = PACKET_LOG_MAGIC;
+	header.nVersion = PACKET_LOG_VERSION;
+	fwrite(&header, sizeof(header), 1, s_pLog);
+
+	memset(pSeq, 0, sizeof(pSeq));
+	memset(&last, 0, sizeof(last));
+	srand(1);
+
+	for( i = 0 ; i < nPackets ; i++ )
+	{
+		int nKind = rand() % 100;
+
+		if( nKind < 50 || 0 == last.length )
+		{
+			uint16_t nMote = 10 + rand() % 40;
+
+			nLastBase = rand() % 2;
+			MakeCollection(&msg, nMote, 1, nMote, ++pSeq[nMote]);
+			WriteRecord(&msg, PACKET_FROM_MY_MOTE, nLastBase, NULL, NULL);
+			last = msg;
+		}
+		else if( nKind < 60 )
+		{
+			WriteRecord(&last, PACKET_FROM_MY_MOTE, 1 - nLastBase, NULL, NULL);
+		}
+		else if( nKind < 85 )
+		{
+			MakeCollection(&msg, 1, 10 + rand() % 50, 1, ++pSeq[1]);
+			WriteRecord(&msg, PACKET_FROM_MY_TRANSPORT, 0, TRACE_TEST_MY_IP, NULL);
+		}
+		else
+		{
+			uint16_t nMote = 100 + rand() % 20;
+
+			MakeCollection(&msg, nMote, 1, nMote, ++pSeq[nMote]);
+			WriteRecord(&msg, PACKET_FROM_MY_NEIGHBOR, 0, TRACE_TEST_NEIGHBOR, TRACE_TEST_NEIGHBOR);
+		}
+
+		if( ( s_nUsec += 1000 ) >= 1000000 )
+		{
+			s_nSec++;
+			s_nUsec -= 1000000;
+		}
+	}
+
+	fclose(s_pLog);
+	return true;
+}
+
+// runs the router on the log; its output goes to pOutput
+static bool Replay(const char* pRouter, const char* pLog, bool bTiming, const char* pDecisions, const char* pOutput)
+{
+	int		nStatus;
+	pid_t	pid;
+
+	if( 0 == ( pid = fork() ) )
+	{
+		int fdOut = open(pOutput, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+		dup2(fdOut, 1);
+		dup2(fdOut, 2);
+		// two base stations, never connected by a replay
+		execl(pRouter, pRouter, "-i", "-n", "lo", "-a", "1", "-sp", "9001,9002",
+			"-rr", pLog, "-rt", bTiming ? "1" : "0", "-rd", pDecisions, (char*) NULL);
+		_exit(1);
+	}
+
+	waitpid(pid, &nStatus, 0);
+
+	return WIFEXITED(nStatus) && 0 == WEXITSTATUS(nStatus);
+}
+
+// prints the report at the end of a replay's output, the last block
+// between two lines of dashes
+static void ShowReport(const char* pName, const char* pOutput)
+{
+	FILE*	pIn = fopen(pOutput, "r");
+	char	pLine[1024];
+	char	pReport[4096];
+	bool	bReport = false;
+
+	if( NULL == pIn )
+		return;
+
+	pReport[0] = '\0';
+
+	while( fgets(pLine, sizeof(pLine), pIn) )
+	{
+		if( 0 == strncmp(pLine, "----", 4) )
+		{
+			if( ( bReport = !bReport ) )
+				pReport[0] = '\0';
+		}
+		else if( bReport && strlen(pReport) + strlen(pLine) < sizeof(pReport) )
+		{
+			strcat(pReport, pLine);
+		}
+	}
+
+	fclose(pIn);
+
+	MSG("%s:\n%s", pName, pReport);
+}
+
+static bool IsSameFile(const char* pPath1, const char* pPath2)
+{
+	FILE*	pIn1 = fopen(pPath1, "rb");
+	FILE*	pIn2 = fopen(pPath2, "rb");
+	bool	bSame = ( NULL != pIn1 && NULL != pIn2 );
+	int		c;
+
+	while( bSame && EOF != ( c = fgetc(pIn1) ) )
+		bSame = ( c == fgetc(pIn2) );
+
+	if( bSame )
+		bSame = ( EOF == fgetc(pIn2) );
+
+	if( pIn1 )
+		fclose(pIn1);
+	if( pIn2 )
+		fclose(pIn2);
+
+	return bSame;
+}
+
+int main(int argc, char** argv)
+{
+	const char*	pRouter = "./router";
+	int		nPackets = TRACE_TEST_PACKETS;
+	char	pDir[] = "/tmp/tracetest.XXXXXX";
+	char	pLog[64], pFast[64], pTimed[64], pFastOut[64], pTimedOut[64];
+	bool	bPassed = true;
+	int		i;
+
+	for( i = 1 ; i < argc ; i++ )
+	{
+		if( 0 == strcmp(argv[i], "-n") && i + 1 < argc )
+			nPackets = atoi(argv[++i]);
+		else if( 0 == strcmp(argv[i], "-r") && i + 1 < argc )
+			pRouter = argv[++i];
+		else
+		{
+			MSG("   - Usage: %s [-n <packets> (default %d)] [-r <router> (default ./router)]\n",
+				argv[0], TRACE_TEST_PACKETS);
+			exit(1);
+		}
+	}
+
+	if( NULL == mkdtemp(pDir) )
+	{
+		TR_ERROR("mkdtemp() failed\n");
+		exit(1);
+	}
+
+	sprintf(pLog, "%s/trace.log", pDir);
+	sprintf(pFast, "%s/fast.txt", pDir);
+	sprintf(pTimed, "%s/timed.txt", pDir);
+	sprintf(pFastOut, "%s/fast.out", pDir);
+	sprintf(pTimedOut, "%s/timed.out", pDir);
+
+	if( !WriteLog(pLog, nPackets) )
+		exit(1);
+
+	if( !Replay(pRouter, pLog, false, pFast, pFastOut) )
+	{
+		MSG("fast replay failed, see %s\n", pFastOut);
+		exit(1);
+	}
+
+	if( !Replay(pRouter, pLog, true, pTimed, pTimedOut) )
+	{
+		MSG("timed replay failed, see %s\n", pTimedOut);
+		exit(1);
+	}
+
+	ShowReport("fast replay", pFastOut);
+	ShowReport("timed replay (-rt 1)", pTimedOut);
+
+	bPassed = IsSameFile(pFast, pTimed);
+	MSG("decisions %s\n", bPassed ? "identical" : "DIFFER");
+
+	if( bPassed )
+	{
+		unlink(pLog);
+		unlink(pFast);
+		unlink(pTimed);
+		unlink(pFastOut);
+		unlink(pTimedOut);
+		rmdir(pDir);
+	}
+	else
+	{
+		MSG("compare %s and %s\n", pFast, pTimed);
+	}
+
+	return bPassed ? 0 : 1;
+}
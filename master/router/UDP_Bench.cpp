@@ -0,0 +1,155 @@
+/*
+* "Copyright (c) 2006 University of Southern California.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software and its
+* documentation for any purpose, without fee, and without written
+* agreement is hereby granted, provided that the above copyright
+* notice, the following two paragraphs and the author appear in all
+* copies of this software.
+*
+* IN NO EVENT SHALL THE UNIVERSITY OF SOUTHERN CALIFORNIA BE LIABLE TO
+* ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+* DAMAGES ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS
+* DOCUMENTATION, EVEN IF THE UNIVERSITY OF SOUTHERN CALIFORNIA HAS BEEN
+* ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+* THE UNIVERSITY OF SOUTHERN CALIFORNIA SPECIFICALLY DISCLAIMS ANY
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  THE SOFTWARE
+* PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND THE UNIVERSITY OF
+* SOUTHERN CALIFORNIA HAS NO OBLIGATION TO PROVIDE MAINTENANCE,
+* SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
+*
+*/
+
+/*
+* udpbench: inter-router UDP over loopback, one system call per datagram
+* (sendmsg()/recvfrom()) against CUDP_Server's batched sendmmsg()/recvmmsg().
+* Sends UDP_BATCH_SIZE datagrams, reads them back, and prints packets per
+* second and system calls per packet for each.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "UDP_Socket.h"
+
+#define UDP_BENCH_PORT		9997
+#define UDP_BENCH_PACKETS	1000000
+#define UDP_BENCH_LENGTH	64		// about a TR_Packet carrying a TOS_Msg
+
+static long	s_nReceived;
+
+static void OnBenchBatch(UDP_Packet* pPackets, int nPackets)
+{
+	s_nReceived += nPackets;
+}
+
+// what CUDP_Server did before Receive() was batched
+class CUDP_BenchServer
+	: public CUDP_Server
+{
+public:
+	CUDP_BenchServer(int nPort)
+	: CUDP_Server(NULL, nPort, OnBenchBatch)
+	{
+	}
+
+	void ReceiveOne(void)
+	{
+		int		nAddrSize = sizeof(struct sockaddr);
+
+		if ((m_pPackets[0].nLen =
+			recvfrom(m_fdSocket, m_pPackets[0].pData, MAX_BUFFFER_SIZE, 0, (struct sockaddr *)&m_pPackets[0].addr,
+			(socklen_t*)&nAddrSize)) == -1)
+		{
+			TR_ERROR("Receive() failed");
+			exit(1);
+		}
+
+		s_nReceived++;
+	}
+};
+
+static double Now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+int main(int argc, char** argv)
+{
+	CUDP_BenchServer	server(UDP_BENCH_PORT);
+	struct	sockaddr_in	addr;
+	struct	iovec		iov;
+	UDP_Datagram		pDatagrams[UDP_BATCH_SIZE];
+	char	pData[UDP_BENCH_LENGTH];
+	long	nCalls;
+	double	dStart, dSingle, dBatch;
+	int		i, j;
+
+	memset(pData, 0x5A, sizeof(pData));
+
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(UDP_BENCH_PORT);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	bzero(&(addr.sin_zero), 8);
+
+	iov.iov_base = pData;
+	iov.iov_len = sizeof(pData);
+
+	for( i = 0 ; i < UDP_BATCH_SIZE ; i++ )
+	{
+		pDatagrams[i].pAddr = &addr;
+		pDatagrams[i].pIov = &iov;
+		pDatagrams[i].nIov = 1;
+	}
+
+	server.StartServer();
+
+	// one system call per datagram each way
+	s_nReceived = 0;
+	dStart = Now();
+	for( i = 0 ; i < UDP_BENCH_PACKETS ; i += UDP_BATCH_SIZE )
+	{
+		for( j = 0 ; j < UDP_BATCH_SIZE ; j++ )
+			server.Send(&addr, &iov, 1);
+
+		for( j = 0 ; j < UDP_BATCH_SIZE ; j++ )
+			server.ReceiveOne();
+	}
+	dSingle = Now() - dStart;
+
+	MSG("single : %ld packets, %.0f pps, 2.00 calls/packet\n",
+		s_nReceived, s_nReceived / dSingle);
+
+	// a batch of UDP_BATCH_SIZE each way
+	s_nReceived = 0;
+	nCalls = 0;
+	dStart = Now();
+	for( i = 0 ; i < UDP_BENCH_PACKETS ; i += UDP_BATCH_SIZE )
+	{
+		long nExpected = s_nReceived + UDP_BATCH_SIZE;
+
+		server.Send(pDatagrams, UDP_BATCH_SIZE);
+		nCalls++;
+
+		while( s_nReceived < nExpected )
+		{
+			server.Receive();
+			nCalls++;
+		}
+	}
+	dBatch = Now() - dStart;
+
+	MSG("mmsg   : %ld packets, %.0f pps, %.2f calls/packet\n",
+		s_nReceived, s_nReceived / dBatch, (double) nCalls / s_nReceived);
+	MSG("speedup: x%.2f\n", dSingle / dBatch);
+
+	return 0;
+}
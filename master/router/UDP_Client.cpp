@@ -88,7 +88,7 @@ void CUDP_Client::DirectSend(char *pAddr, unsigned int nPort, char* pData, int n
 	close(fdSocket);
 }
 
-void CUDP_Client::Process()
+bool CUDP_Client::Process()
 {
-	return;
+	return false;
 }
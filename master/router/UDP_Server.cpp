@@ -35,20 +35,27 @@
 
 unsigned long	CUDP_Server::s_nMyIP;
 
-CUDP_Server::CUDP_Server(void (*OnReceive)(struct sockaddr_in* , char*, int ), int nPort)
+CUDP_Server::CUDP_Server(void (*OnReceive)(struct sockaddr_in* , char*, int ), int nPort,
+	void (*OnReceiveBatch)(UDP_Packet* , int ))
 : CNetwork()
 {
 	this->OnReceive=OnReceive;
+	this->OnReceiveBatch=OnReceiveBatch;
 	this->m_nPort=nPort;
 	this->s_nMyIP=GetMyIP();
 
 	m_fdSocket=-1;
+	m_fdSend=-1;
 	m_bStart=false;
 }
 
 CUDP_Server::~CUDP_Server(void)
 {
+	CNetwork::Remove(this);
 	close(m_fdSocket);
+
+	if( m_fdSend >= 0 )
+		close(m_fdSend);
 }
 
 bool CUDP_Server::StartServer(void)
@@ -70,6 +77,23 @@ bool CUDP_Server::StartServer(void)
 		exit(1);
 	}
 
+	CNetwork::Add(this);
+
+	int nBroadcast = 1;
+
+	if ((this->m_fdSend = socket(AF_INET, SOCK_DGRAM, 0)) == -1) 
+	{
+		TR_ERROR("Creating socket failed");
+		exit(1);
+	}
+
+	if (setsockopt(m_fdSend, SOL_SOCKET, SO_BROADCAST, &nBroadcast,
+		sizeof(nBroadcast)) == -1) 
+	{
+		TR_ERROR("setsockopt(SO_BROADCAST) failed");
+		exit(1);
+	}
+
 	TRACE("Server Module Started.\n");
  
 	m_bStart=true;
@@ -104,19 +128,12 @@ bool CUDP_Server::IsThereAnyNewPacket()
 	return false;
 }
 
+// bBroadcast is kept for compatibility; m_fdSend always allows broadcasts
 void CUDP_Server::Send(char *pAddr, char* pData, int nLen, bool bBroadcast)
 {
-	int	fdSocket ;
-	int		nBroadcast = 1;
 	struct	sockaddr_in	addr;
 	struct	hostent*	he;
-	int		nSent = 0;
-
-	if ((fdSocket = socket(AF_INET, SOCK_DGRAM, 0)) == -1) 
-	{
-		TR_ERROR("Creating socket failed");
-		exit(1);
-	}
+	struct	iovec	iov;
 
 	if ((he = gethostbyname(pAddr)) == NULL) 
 	{
@@ -129,47 +146,131 @@ void CUDP_Server::Send(char *pAddr, char* pData, int nLen, bool bBroadcast)
 	addr.sin_addr = *((struct in_addr *)he->h_addr);
 	bzero(&(addr.sin_zero), 8);
 
-	if(bBroadcast
-		&&setsockopt(fdSocket, SOL_SOCKET, SO_BROADCAST, &nBroadcast,
-		sizeof(nBroadcast)) == -1) 
-	{
-		TR_ERROR("setsockopt(SO_BROADCAST) failed");
-		exit(1);
-	}
+	iov.iov_base = pData;
+	iov.iov_len = nLen;
+
+	Send(&addr, &iov, 1);
+}
+
+// sends one datagram gathered from pIov to a resolved address
+void CUDP_Server::Send(struct sockaddr_in* pAddr, struct iovec* pIov, int nIov)
+{
+	struct	msghdr	msg;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_name = pAddr;
+	msg.msg_namelen = sizeof(struct sockaddr_in);
+	msg.msg_iov = pIov;
+	msg.msg_iovlen = nIov;
 
-	if ((nSent=sendto(fdSocket, pData, nLen, 0,
-		(struct sockaddr *)&addr, sizeof(struct sockaddr))) == -1) 
+	if (sendmsg(m_fdSend, &msg, 0) == -1) 
 	{
-		TR_ERROR("sendto() failed");
+		TR_ERROR("sendmsg() failed");
 		//exit(1);
 	}
+}
+
+// sends several datagrams, as few system calls as possible
+void CUDP_Server::Send(UDP_Datagram* pDatagrams, int nDatagrams)
+{
+#ifdef USE_MMSG
+	struct	mmsghdr	pMsgs[UDP_BATCH_SIZE];
+	int		nSent;
+
+	while( nDatagrams > 0 )
+	{
+		int n = nDatagrams < UDP_BATCH_SIZE ? nDatagrams : UDP_BATCH_SIZE;
+
+		memset(pMsgs, 0, n * sizeof(struct mmsghdr));
+
+		for( int i = 0 ; i < n ; i++ )
+		{
+			pMsgs[i].msg_hdr.msg_name = pDatagrams[i].pAddr;
+			pMsgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+			pMsgs[i].msg_hdr.msg_iov = pDatagrams[i].pIov;
+			pMsgs[i].msg_hdr.msg_iovlen = pDatagrams[i].nIov;
+		}
+
+		if ((nSent = sendmmsg(m_fdSend, pMsgs, n, 0)) <= 0) 
+		{
+			TR_ERROR("sendmmsg() failed");
 
-	close(fdSocket);
+			// skip the datagram that failed, like a failed sendmsg()
+			nSent = 1;
+		}
+
+		pDatagrams += nSent;
+		nDatagrams -= nSent;
+	}
+#else
+	for( int i = 0 ; i < nDatagrams ; i++ )
+		Send(pDatagrams[i].pAddr, pDatagrams[i].pIov, pDatagrams[i].nIov);
+#endif
 }
 
-void CUDP_Server::Receive(void)
+int CUDP_Server::Receive(void)
 {
-	struct	sockaddr_in	addr;
-	int		nBytesRcvd = 0;
-	char	pData[MAX_BUFFFER_SIZE];
+	int		nPackets;
+
+#ifdef USE_MMSG
+	struct	mmsghdr	pMsgs[UDP_BATCH_SIZE];
+	struct	iovec	pIov[UDP_BATCH_SIZE];
 
-	memset( pData, 0, MAX_BUFFFER_SIZE);
+	memset(pMsgs, 0, sizeof(pMsgs));
 
+	for( int i = 0 ; i < UDP_BATCH_SIZE ; i++ )
+	{
+		pIov[i].iov_base = m_pPackets[i].pData;
+		pIov[i].iov_len = MAX_BUFFFER_SIZE;
+
+		pMsgs[i].msg_hdr.msg_name = &m_pPackets[i].addr;
+		pMsgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+		pMsgs[i].msg_hdr.msg_iov = &pIov[i];
+		pMsgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	// everything that is already queued, without waiting for more
+	if ((nPackets = recvmmsg(m_fdSocket, pMsgs, UDP_BATCH_SIZE, MSG_DONTWAIT, NULL)) == -1) 
+	{
+		if( EAGAIN == errno || EWOULDBLOCK == errno || EINTR == errno )
+			return 0;
+
+		TR_ERROR("Receive() failed");
+		exit(1);
+	}
+
+	for( int i = 0 ; i < nPackets ; i++ )
+		m_pPackets[i].nLen = pMsgs[i].msg_len;
+#else
 	int		nAddrSize = sizeof(struct sockaddr);
 
-	if ((nBytesRcvd = 
-		recvfrom(m_fdSocket, pData, MAX_BUFFFER_SIZE, 0, (struct sockaddr *)&addr,  
+	if ((m_pPackets[0].nLen = 
+		recvfrom(m_fdSocket, m_pPackets[0].pData, MAX_BUFFFER_SIZE, 0, (struct sockaddr *)&m_pPackets[0].addr,  
 		(socklen_t*)&nAddrSize)) == -1) 
 	{
 		TR_ERROR("Receive() failed");
 		exit(1);
 	}
 
-	OnReceive(&addr, pData, nBytesRcvd);
+	nPackets = 1;
+#endif
+
+	if( OnReceiveBatch )
+	{
+		OnReceiveBatch(m_pPackets, nPackets);
+		return nPackets;
+	}
+
+	for( int i = 0 ; i < nPackets ; i++ )
+		OnReceive(&m_pPackets[i].addr, m_pPackets[i].pData, m_pPackets[i].nLen);
+
+	return nPackets;
 }
 
-void CUDP_Server::Process()
+bool CUDP_Server::Process()
 {
 	if( this->IsStart() )
-		this->Receive();
+		return this->Receive() == UDP_BATCH_SIZE;	// a full batch may have left more
+
+	return false;
 }
@@ -43,18 +43,42 @@
 #include <errno.h>
 #include <signal.h>
 #include <sys/wait.h>	//waitpid()
+#include <sys/uio.h>
 #include <pthread.h>
 #include <utility>
 
 #include "TR_Common.h"
 #include "Network.h"
 
+#ifdef __linux__
+#define USE_MMSG	// recvmmsg()/sendmmsg()
+#endif
+
+#define UDP_BATCH_SIZE	32	// datagrams per system call
+
+// a received datagram
+struct UDP_Packet
+{
+	struct sockaddr_in	addr;
+	int		nLen;
+	char	pData[MAX_BUFFFER_SIZE];
+};
+
+// a datagram to send, gathered from pIov
+struct UDP_Datagram
+{
+	struct sockaddr_in*	pAddr;
+	struct iovec*	pIov;
+	int		nIov;
+};
+
 
 class CUDP_Server
 	: public CNetwork
 {
 public:
-	CUDP_Server(void (*OnReceive)(struct sockaddr_in* , char* , int ), int nPort);
+	CUDP_Server(void (*OnReceive)(struct sockaddr_in* , char* , int ), int nPort,
+		void (*OnReceiveBatch)(UDP_Packet* , int ) = NULL);
 	~CUDP_Server(void);
 
 	bool	StartServer(void);
@@ -67,18 +91,26 @@ public:
 
 	bool	IsThereAnyNewPacket(void);
 	void	Send(char *pAddr, char* pData, int nLen, bool bBroadcast = false);
-	void	Receive(void);
-	virtual void Process(void);
+	void	Send(struct sockaddr_in* pAddr, struct iovec* pIov, int nIov);
+	void	Send(UDP_Datagram* pDatagrams, int nDatagrams);
+	int		Receive(void);	// returns the number of datagrams read
+	virtual bool Process(void);
 
 protected:
 	static unsigned long	s_nMyIP;
 	struct	sockaddr_in m_addr;
 	int		m_nPort;			// Port Number
+	int		m_fdSend;			// for all outgoing packets, broadcasts allowed
 
 	bool	m_bStart;
 
+	UDP_Packet	m_pPackets[UDP_BATCH_SIZE];	// filled by Receive()
+
 protected:
 	void	(*OnReceive)(struct sockaddr_in* addr, char* pData, int nLen);
+
+	// if set, gets everything one Receive() read instead of OnReceive
+	void	(*OnReceiveBatch)(UDP_Packet* pPackets, int nPackets);
 };
 
 class CUDP_Client
@@ -89,7 +121,7 @@ public:
 	~CUDP_Client(void);
 
 	static void	DirectSend(char *pAddr, unsigned int nPort, char* pData, int nLen, bool bBroadcast = false);
-	virtual void Process(void);
+	virtual bool Process(void);
 
 private:
 	static unsigned long	s_nMyIP;
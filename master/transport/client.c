@@ -54,6 +54,7 @@
 #include "client.h"
 #include "tidlist.h"
 #include "transport.h"
+#include "eventloop.h"
 
 struct client_list *clients;
 extern int packets_read, packets_written;
@@ -76,12 +77,6 @@ void *xmalloc(size_t s) {
     return p;
 }
 
-void fd_wait(fd_set *fds, int *maxfd, int fd) {
-    if (fd > *maxfd)
-        *maxfd = fd;
-    FD_SET(fd, fds);
-}
-
 void pstatus(void) {
     if (verbosemode)
     printf("clients %d, tids %d, read %d, wrote %d\n", 
@@ -95,6 +90,8 @@ void add_client(int fd) {
     num_clients++;
     //pstatus();
     c->fd = fd;
+    tr_reader_open(fd, 2);
+    ev_add(fd, check_client, NULL);
 }
 
 void rem_client(struct client_list **c) {
@@ -103,6 +100,8 @@ void rem_client(struct client_list **c) {
     *c = dead->next;
     num_clients--;
     //pstatus();
+    ev_del(dead->fd);
+    tr_reader_close(dead->fd);
     close(dead->fd);
     free(dead);
 }
@@ -113,15 +112,19 @@ void new_client(int fd) {
         close(fd);
     } else {
         //printf("New client added \n");
+        tr_tune_socket(fd);
         add_client(fd);
     }
 }
 
-void wait_clients(fd_set *fds, int *maxfd) {
-    struct client_list *c;
+/* the link to the client on 'fd', or NULL */
+struct client_list **find_client(int fd) {
+    struct client_list **c;
 
-    for (c = clients; c; c = c->next)
-        fd_wait(fds, maxfd, c->fd);
+    for (c = &clients; *c; c = &(*c)->next)
+        if ((*c)->fd == fd)
+            return c;
+    return NULL;
 }
 
 void rem_client_list() {
@@ -130,16 +133,33 @@ void rem_client_list() {
         rem_client(c);
 }
 
-void dispatch_packet(const void *packet, int len) {
+void dispatch_packetv(const struct iovec *iov, int iovcnt) {
     struct client_list **c;
 
     for (c = &clients; *c; )
-        if (write_tr_packet((*c)->fd, packet, len) >= 0) // send UP to all clients
+        if (write_tr_packetv((*c)->fd, iov, iovcnt) >= 0) // send UP to all clients
             c = &(*c)->next;
         else
             rem_client(c);
 }
 
+/* hold back (on) or push out (off) what is written to the clients, so
+   that the packets of one batch from the router share segments */
+void cork_clients(int on) {
+    struct client_list *c;
+
+    for (c = clients; c; c = c->next)
+        tr_set_cork(c->fd, on);
+}
+
+void dispatch_packet(const void *packet, int len) {
+    struct iovec iov;
+
+    iov.iov_base = (void *)packet;
+    iov.iov_len = len;
+    dispatch_packetv(&iov, 1);
+}
+
 void open_server_socket(int port) {
     struct sockaddr_in me;
     int opt;
@@ -163,7 +183,7 @@ void open_server_socket(int port) {
     unix_check("listen", listen(server_socket, 5));
 }
 
-void check_new_client(void) {
+void check_new_client(int fd, void *arg) {
     int clientfd = accept(server_socket, NULL, NULL);
     if (clientfd >= 0)
         new_client(clientfd);
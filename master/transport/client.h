@@ -44,6 +44,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 
 int server_socket;
 int num_clients;
@@ -53,16 +54,19 @@ struct client_list {
 	int fd;
 };
 
-void fd_wait(fd_set *fds, int *maxfd, int fd);
-void check_new_client(void);
+void check_new_client(int fd, void *arg);
+void check_client(int fd, void *arg);   // a client sent something (transportmain.c)
 void open_server_socket(int port);
 void dispatch_packet(const void *packet, int len);
-void wait_clients(fd_set *fds, int *maxfd);
+void dispatch_packetv(const struct iovec *iov, int iovcnt);  // packet in pieces, see write_tr_packetv
+void cork_clients(int on);
+struct client_list **find_client(int fd);
 void new_client(int fd);
 void rem_client(struct client_list **c);
 void rem_client_list(void);
 void add_client(int fd);
 void pstatus(void);
+void *xmalloc(size_t s);
 
 #endif
 
@@ -115,7 +115,7 @@ void write_collection_msg(uint8_t *msg, int len, uint8_t protocol, uint16_t addr
     header->protocol = protocol | PROTOCOL_DOWNLINK_BIT;
     len += sizeof(collection_header_t);
 
-    packets_written++;
+    __sync_fetch_and_add(&packets_written, 1);  // shards write too
     send_TOS_Msg(rt_fd, packet, len, type, addr, TOS_DEFAULT_GROUP);
     free((void *)packet);
     return;
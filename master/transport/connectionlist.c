@@ -45,9 +45,6 @@ void add_connection(connectionlist_t **list, connectionlist_t *c, uint16_t tid,
     c->lastRecvSeqNo = 0;
     c->totalLostPackets = 0;
     c->totalRecvPackets = 0;
-    
-    c->alarm_time.tv_sec = 0;
-    c->alarm_time.tv_usec = 0;
 
     init_loss_ewma(&c->loss_ewma);
     init_loss_ali(&c->loss_ali);
@@ -61,6 +58,7 @@ connectionlist_t *create_connection(connectionlist_t **list, uint16_t tid, uint1
         fprintf(stderr, "FatalError: Not enough memory, failed to malloc!\n");
         exit(1);
     }
+    timer_init(&c->timer, &main_timers, NULL, c);
     add_connection(list, c, tid, addr);
     
     #ifdef LOG_CONNECTION_PACKET
@@ -74,6 +72,7 @@ connectionlist_t *create_connection(connectionlist_t **list, uint16_t tid, uint1
 void rem_connection(connectionlist_t **c) {
     connectionlist_t *dead = *c;
     *c = dead->next;
+    timer_stop(&dead->timer);
     free(dead);
 }
 
@@ -109,6 +108,7 @@ void delete_all_connection(connectionlist_t **list) {
     for (c = list; *c; ) {
         dead = *c;
         *c = dead->next;
+        timer_stop(&dead->timer);
         free(dead);
     }
 }
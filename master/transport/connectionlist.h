@@ -3,6 +3,7 @@
 #define _CONNECTION_LIST_H_
 
 #include "common.h"
+#include "timerheap.h"
 
 #define rate_alpha 0.05     /* EWMA constant for computing rate */
 
@@ -52,7 +53,7 @@ typedef struct connectionlist {  // connpkt transport passive connection list
     unsigned long int totalLostPackets;
     unsigned long int totalRecvPackets;
     
-    struct timeval alarm_time;
+    struct timer_event timer;   // set up by the owning transport
 
     rate_info_t pktrate;
     rate_info_t goodput;
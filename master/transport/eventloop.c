@@ -0,0 +1,188 @@
+/*
+* "Copyright (c) 2006 University of Southern California.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software and its
+* documentation for any purpose, without fee, and without written
+* agreement is hereby granted, provided that the above copyright
+* notice, the following two paragraphs and the author appear in all
+* copies of this software.
+*
+* IN NO EVENT SHALL THE UNIVERSITY OF SOUTHERN CALIFORNIA BE LIABLE TO
+* ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+* DAMAGES ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS
+* DOCUMENTATION, EVEN IF THE UNIVERSITY OF SOUTHERN CALIFORNIA HAS BEEN
+* ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+* THE UNIVERSITY OF SOUTHERN CALIFORNIA SPECIFICALLY DISCLAIMS ANY
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  THE SOFTWARE
+* PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND THE UNIVERSITY OF
+* SOUTHERN CALIFORNIA HAS NO OBLIGATION TO PROVIDE MAINTENANCE,
+* SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
+*
+*/
+
+/**
+ * File for the event loop of the transport layer.
+ **/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "eventloop.h"
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#define USE_EPOLL
+#else
+#include <poll.h>
+#endif
+
+struct ev_source {
+    ev_handler handler;
+    void *arg;
+    uint32_t gen;       // tells an event of a closed fd from one of its reuse
+};
+
+static struct ev_source *sources = NULL;    // indexed by fd
+static int num_sources = 0;
+
+#ifdef USE_EPOLL
+static int epoll_fd = -1;
+#else
+static struct pollfd *pollfds = NULL;
+static int num_pollfds = 0;
+#endif
+
+void ev_init(void) {
+#ifdef USE_EPOLL
+    epoll_fd = epoll_create(EV_MAX_EVENTS);
+    if (epoll_fd < 0) {
+        perror("epoll_create");
+        exit(2);
+    }
+#endif
+}
+
+int ev_add(int fd, ev_handler handler, void *arg) {
+    if (fd >= num_sources) {
+        int num = num_sources ? num_sources : 64;
+        struct ev_source *s;
+        while (num <= fd)
+            num *= 2;
+        s = realloc(sources, num * sizeof(*s));
+        if (!s) {
+            fprintf(stderr, "out of memory\n");
+            exit(2);
+        }
+        memset(&s[num_sources], 0, (num - num_sources) * sizeof(*s));
+        sources = s;
+        num_sources = num;
+    }
+    sources[fd].handler = handler;
+    sources[fd].arg = arg;
+    sources[fd].gen++;
+
+#ifdef USE_EPOLL
+    {
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.u64 = ((uint64_t)sources[fd].gen << 32) | (uint32_t)fd;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            perror("epoll_ctl");
+            sources[fd].handler = NULL;
+            return -1;
+        }
+    }
+#else
+    {
+        struct pollfd *p = realloc(pollfds, (num_pollfds + 1) * sizeof(*p));
+        if (!p) {
+            fprintf(stderr, "out of memory\n");
+            exit(2);
+        }
+        pollfds = p;
+        pollfds[num_pollfds].fd = fd;
+        pollfds[num_pollfds].events = POLLIN;
+        pollfds[num_pollfds].revents = 0;
+        num_pollfds++;
+    }
+#endif
+    return 0;
+}
+
+void ev_del(int fd) {
+    if ((fd < 0) || (fd >= num_sources) || (sources[fd].handler == NULL))
+        return;
+    sources[fd].handler = NULL;
+    sources[fd].gen++;      // events already returned for it are dropped
+#ifdef USE_EPOLL
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+#else
+    {
+        int i;
+        for (i = 0; i < num_pollfds; i++) {
+            if (pollfds[i].fd == fd) {
+                pollfds[i] = pollfds[--num_pollfds];
+                break;
+            }
+        }
+    }
+#endif
+}
+
+/* calls the handler of 'fd', if the event is not older than its registration */
+static void ev_dispatch(int fd, uint32_t gen) {
+    struct ev_source *s = &sources[fd];
+    if ((s->handler != NULL) && (s->gen == gen))
+        s->handler(fd, s->arg);
+}
+
+void ev_loop(void) {
+#ifdef USE_EPOLL
+    struct epoll_event events[EV_MAX_EVENTS];
+#endif
+
+    for (;;) {
+        int timeout = timer_heap_next_ms(&main_timers);
+        int n, i;
+
+#ifdef USE_EPOLL
+        n = epoll_wait(epoll_fd, events, EV_MAX_EVENTS, timeout);
+        if ((n < 0) && (errno != EINTR)) {
+            perror("epoll_wait");
+            exit(2);
+        }
+        for (i = 0; i < n; i++)
+            ev_dispatch((int)(events[i].data.u64 & 0xffffffff),
+                        (uint32_t)(events[i].data.u64 >> 32));
+#else
+        n = poll(pollfds, num_pollfds, timeout);
+        if ((n < 0) && (errno != EINTR)) {
+            perror("poll");
+            exit(2);
+        }
+        if (n > 0) {
+            /* handlers may add or remove fds, so take a snapshot first */
+            int num = num_pollfds;
+            int fds[num];
+            uint32_t gens[num];
+            for (i = 0; i < num; i++) {
+                fds[i] = (pollfds[i].revents ? pollfds[i].fd : -1);
+                gens[i] = (fds[i] >= 0 ? sources[fds[i]].gen : 0);
+            }
+            for (i = 0; i < num; i++)
+                if (fds[i] >= 0)
+                    ev_dispatch(fds[i], gens[i]);
+        }
+#endif
+        /* after every batch of events, not only when the sockets are idle */
+        timer_heap_fire(&main_timers);
+    }
+}
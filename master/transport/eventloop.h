@@ -0,0 +1,54 @@
+/*
+* "Copyright (c) 2006 University of Southern California.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software and its
+* documentation for any purpose, without fee, and without written
+* agreement is hereby granted, provided that the above copyright
+* notice, the following two paragraphs and the author appear in all
+* copies of this software.
+*
+* IN NO EVENT SHALL THE UNIVERSITY OF SOUTHERN CALIFORNIA BE LIABLE TO
+* ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+* DAMAGES ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS
+* DOCUMENTATION, EVEN IF THE UNIVERSITY OF SOUTHERN CALIFORNIA HAS BEEN
+* ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+* THE UNIVERSITY OF SOUTHERN CALIFORNIA SPECIFICALLY DISCLAIMS ANY
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  THE SOFTWARE
+* PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND THE UNIVERSITY OF
+* SOUTHERN CALIFORNIA HAS NO OBLIGATION TO PROVIDE MAINTENANCE,
+* SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
+*
+*/
+
+/**
+ * Header file for the event loop of the transport layer.
+ *
+ * Sockets (the router, the server socket, the clients) are registered
+ * with a handler that is called whenever the socket is readable, and
+ * the timers of 'main_timers' (see timerheap.h) fire from the same loop
+ * on time, however busy the sockets are.
+ * Uses epoll on Linux, and poll() elsewhere.
+ **/
+
+#ifndef _EVENTLOOP_H_
+#define _EVENTLOOP_H_
+
+#include "timerheap.h"
+
+#define EV_MAX_EVENTS   64  // handled before the timers are looked at again
+
+typedef void (*ev_handler)(int fd, void *arg);
+
+void ev_init(void);
+
+/* calls 'handler' whenever 'fd' is readable, until ev_del(fd) */
+int ev_add(int fd, ev_handler handler, void *arg);
+void ev_del(int fd);
+
+/* runs the loop, and the timers of 'main_timers', never returns */
+void ev_loop(void);
+
+#endif
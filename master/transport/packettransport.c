@@ -41,6 +41,8 @@
 #include "packettransport.h"
 #include "tr_checksum.h"
 #include "timeval.h"
+#include "timerheap.h"
+#include "shard.h"
 #include "connectionlist.h"
 #include "tr_packet.h"
 #include "tr_seqno.h"
@@ -315,27 +317,22 @@ void packettransport_receive(int len, unsigned char *packet, uint16_t addr) {
 /********************************************************/
 
 int PTR_Timer_start(connectionlist_t *c, unsigned long int interval_ms) {
-    struct timeval curr;
     if (c == NULL)
         return 0;
-    gettimeofday(&curr, NULL);
-    add_ms_to_timeval(&curr, interval_ms, &c->alarm_time);
+    timer_start(&c->timer, interval_ms);
     return 1;
 }
 
 void PTR_Timer_stop(connectionlist_t *c) {
     if (c == NULL)
         return;
-    c->alarm_time.tv_sec = 0;
-    c->alarm_time.tv_usec = 0;
+    timer_stop(&c->timer);
     return;
 }
 
-int PTR_Timer_fired(int user_id) {
-    connectionlist_t *c = (connectionlist_t *)user_id;
+void PTR_Timer_fired(void *arg) {
+    connectionlist_t *c = (connectionlist_t *)arg;
     struct ptrclist *cs = (struct ptrclist *)c;
-    if (!c)
-        return -1;
     if (cs->retxCount < PTR_MAX_NUM_RETX) {
         #ifdef DEBUG_PTR
             printf("[PTR] Timer fired, ACK timeout. Let's retx");
@@ -351,21 +348,6 @@ int PTR_Timer_fired(int user_id) {
         #endif
         send_PTR_Done(c, 0);
     }
-    return 1;
-}
-
-void polling_packettransport_timer() {
-    connectionlist_t *c;
-    struct timeval curr;
-    gettimeofday(&curr, NULL);
-
-    for (c = (connectionlist_t *)m_ptrcs; c; c = c->next) {
-        if (((c->alarm_time.tv_sec > 0) || (c->alarm_time.tv_usec > 0))
-                && (compare_timeval(&c->alarm_time, &curr) <= 0)) {
-            PTR_Timer_fired((int)c);
-            break;
-        }
-    }
 }
 
 /********************************************************/
@@ -385,6 +367,9 @@ connectionlist_t *create_ptr_connection(uint16_t tid, uint16_t addr, uint16_t se
     if (c == NULL) {
         cs = malloc(sizeof(struct ptrclist));   // must be size of ptrclist
         c = (connectionlist_t *)cs;
+        timer_init(&c->timer, shard_timers(SHARD_PTR), PTR_Timer_fired, c);
+    } else {
+        PTR_Timer_stop(c);
     }
     
     add_connection((connectionlist_t **)&m_ptrcs, c, tid, addr);
@@ -412,6 +397,7 @@ void _delete_ptrc(connectionlist_t **c) {
     d = (*c)->next;
     (*c)->next = NULL;
     *c = d;
+    timer_stop(&cs->c.timer);
     free(cs);
 }
 
@@ -44,6 +44,8 @@
 #include "tr_packet.h"
 #include "tr_checksum.h"
 #include "timeval.h"
+#include "timerheap.h"
+#include "shard.h"
 #include "sortedpacketlist.h"
 #include "connectionlist.h"
 #include "uint16list.h"
@@ -1309,7 +1311,7 @@ void rcrtransport_receive(int len, unsigned char *packet, uint16_t srcAddr) {
 
             if (send_feedback == 1) {
                 send_FEEDBACK(c, reason);
-                if (c->alarm_time.tv_sec == 0)  // if no timer running,
+                if (!timer_is_running(&c->timer))  // if no timer running,
                     RCRT_Timer_start(c, feedback_timeout(c));
             }
             break;
@@ -1329,21 +1331,19 @@ void rcrtransport_receive(int len, unsigned char *packet, uint16_t srcAddr) {
  * Timer functions for each connections
  ********************************************************/
 int RCRT_Timer_start(connectionlist_t *c, unsigned long int interval_ms) {
-    struct timeval curr;
     if (c == NULL) return 0;
-    gettimeofday(&curr, NULL);
-    add_ms_to_timeval(&curr, interval_ms, &c->alarm_time);
+    timer_start(&c->timer, interval_ms);
     return 1;
 }
 
 void RCRT_Timer_stop(connectionlist_t *c) {
     if (c == NULL) return;
-    clear_timeval(&c->alarm_time);
+    timer_stop(&c->timer);
     return;
 }
 
-int RCRT_Timer_fired(int user_id) {
-    connectionlist_t *c = (connectionlist_t *)user_id;
+void RCRT_Timer_fired(void *arg) {
+    connectionlist_t *c = (connectionlist_t *)arg;
     struct rcrt_conn *cs = (struct rcrt_conn *)c;
 
     RCRT_Timer_stop(c);
@@ -1367,7 +1367,7 @@ int RCRT_Timer_fired(int user_id) {
             } else {
                 RCRT_Timer_start(c, RCRT_CONNECTION_TIMEOUT);
             }
-            return user_id;
+            return;
         }
 
         /* update congestion ewma level */
@@ -1401,31 +1401,18 @@ int RCRT_Timer_fired(int user_id) {
                 printf("[RCRT] CONNECTION Timeout: (tid %d, node %2d) Terminating.\n", c->tid, c->addr);
             #endif
                 delete_rcrt_connection(c);
+                return;     // 'c' is gone
             }
             if (c->totalRecvPackets == 0) {
             #ifdef DEBUG_RCRT
                 printf("[RCRT] This must be a dead connection (tid %d, node %2d) Terminating.\n", c->tid, c->addr);
             #endif
                 delete_rcrt_connection(c);
+                return;
             }
             RCRT_Timer_start(c, RCRT_CONNECTION_TIMEOUT);
         }
     }
-    return user_id;
-}
-
-void polling_rcrtransport_timer() {
-    connectionlist_t *c;
-    struct timeval curr;
-    gettimeofday(&curr, NULL);
-
-    for (c = (connectionlist_t *)m_rcrtcs; c; c = c->next) {
-        if ((c->alarm_time.tv_sec > 0)
-                && (compare_timeval(&c->alarm_time, &curr) <= 0)) {
-            RCRT_Timer_fired((int)c);
-            break;
-        }
-    }
 }
 
 /********************************************************/
@@ -1487,6 +1474,7 @@ connectionlist_t *create_rcrt_connection(uint16_t tid, uint16_t srcAddr, uint16_
         bootup_time_ms = gettimeofday_ms() - 1;
 
     add_connection((connectionlist_t **)&m_rcrtcs, c, tid, srcAddr);
+    timer_init(&c->timer, shard_timers(SHARD_RCRT), RCRT_Timer_fired, c);
 
     c->connection_type = PROTOCOL_RCR_TRANSPORT;
     c->lastRecvSeqNo = 0;
@@ -1600,6 +1588,7 @@ void _delete_rcrtc(connectionlist_t **c) {
     d = (*c)->next;
     (*c)->next = NULL;
     *c = d;
+    timer_stop(&cs->c.timer);
     free(cs);
 }
 
@@ -1662,7 +1651,7 @@ int rcrtransport_delete_tid(uint16_t tid) {
             #ifdef DEBUG_RCRT
                 printf("[RCRT] cannot delete tid %d yet for node %2d\n", tid, (*c)->addr);
             #endif
-                if ((*c)->alarm_time.tv_sec == 0)   // if no timer running,
+                if (!timer_is_running(&(*c)->timer))   // if no timer running,
                     RCRT_Timer_start(*c, RCRT_CONNECTION_TIMEOUT);
                 cs->deletePending = 1;
                 result = -1;    // at least one connection is not finished.
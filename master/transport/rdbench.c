@@ -0,0 +1,181 @@
+/**
+ * "Copyright (c) 2006~2008 University of Southern California.
+ * All rights reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and its
+ * documentation for any purpose, without fee, and without written
+ * agreement is hereby granted, provided that the above copyright
+ * notice, the following two paragraphs and the author appear in all
+ * copies of this software.
+ *
+ * IN NO EVENT SHALL THE UNIVERSITY OF SOUTHERN CALIFORNIA BE LIABLE TO
+ * ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+ * DAMAGES ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS
+ * DOCUMENTATION, EVEN IF THE UNIVERSITY OF SOUTHERN CALIFORNIA HAS BEEN
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THE UNIVERSITY OF SOUTHERN CALIFORNIA SPECIFICALLY DISCLAIMS ANY
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  THE SOFTWARE
+ * PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND THE UNIVERSITY OF
+ * SOUTHERN CALIFORNIA HAS NO OBLIGATION TO PROVIDE MAINTENANCE,
+ * SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
+ *
+ **/
+
+/**
+ * rdbench: reading 2-byte length frames (what applications send the
+ * transport) from a socketpair, written by a child in large writes:
+ *   old    : read_tr_packet() as it was, three reads and a malloc a frame
+ *   packet : read_tr_packet() on an fd without a reader, two reads
+ *   reader : tr_reader_fill() and tr_reader_frame(), frames in place
+ * Exits 1 if a method read fewer frames or bytes than were written.
+ **/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include "trsource.h"
+
+#define RDBENCH_FRAMES      1000000
+#define RDBENCH_SIZE        40          /* bytes a frame, without its length */
+#define RDBENCH_BATCH       256         /* frames a write() */
+
+enum { RDBENCH_OLD, RDBENCH_PACKET, RDBENCH_READER, RDBENCH_METHODS };
+
+static const char *g_names[RDBENCH_METHODS] = {
+    "old read_tr_packet (3 reads+malloc)",
+    "read_tr_packet, no reader (2 reads)",
+    "tr_reader_fill/tr_reader_frame"
+};
+
+extern int saferead2(int fd, void *buffer, int count);
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* read_tr_packet() before the reader */
+static void *old_read_tr_packet(int fd, int *len) {
+    unsigned char l;
+    int l2;
+    void *packet;
+
+    if (saferead2(fd, &l, 1) != 1)
+        return NULL;
+    l2 = l << 8;
+    if (saferead2(fd, &l, 1) != 1)
+        return NULL;
+    l2 += l;
+
+    packet = malloc(l2);
+    if (packet == NULL)
+        return NULL;
+    if (saferead2(fd, packet, l2) != l2) {
+        free(packet);
+        return NULL;
+    }
+    *len = l2;
+    return packet;
+}
+
+static void write_frames(int fd, int frames, int size) {
+    unsigned char *buf = calloc(RDBENCH_BATCH, size + 2);
+    int i;
+
+    for (i = 0; i < RDBENCH_BATCH; i++) {
+        buf[i * (size + 2)] = size >> 8;
+        buf[i * (size + 2) + 1] = size & 0xff;
+    }
+    for (i = 0; i < frames / RDBENCH_BATCH; i++)
+        write(fd, buf, (size + 2) * RDBENCH_BATCH);
+    free(buf);
+}
+
+static int run(int method, int frames, int size) {
+    long bytes = 0;
+    double start;
+    int sv[2], got, len;
+    pid_t pid;
+
+    frames -= frames % RDBENCH_BATCH;
+    socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+
+    if ((pid = fork()) == 0) {
+        close(sv[0]);
+        write_frames(sv[1], frames, size);
+        _exit(0);
+    }
+    close(sv[1]);
+
+    if (method == RDBENCH_READER)
+        tr_reader_open(sv[0], 2);
+
+    start = now();
+    for (got = 0; got < frames; got++) {
+        if (method == RDBENCH_READER) {
+            void *frame;
+
+            while ((frame = tr_reader_frame(sv[0], &len)) == NULL)
+                if (tr_reader_fill(sv[0]) <= 0)
+                    break;
+            if (frame == NULL)
+                break;
+        } else {
+            void *packet = (method == RDBENCH_OLD) ? old_read_tr_packet(sv[0], &len)
+                                                   : read_tr_packet(sv[0], &len);
+            if (packet == NULL)
+                break;
+            free(packet);
+        }
+        bytes += len;
+    }
+
+    printf("%-36s %d-byte frames: %6.0f k frames/s\n",
+           g_names[method], size, got / (now() - start) / 1000);
+
+    if (method == RDBENCH_READER)
+        tr_reader_close(sv[0]);
+    close(sv[0]);
+    waitpid(pid, NULL, 0);
+
+    return got == frames && bytes == (long)frames * size;
+}
+
+static void usage(char *name) {
+    printf("Usage: %s [-n <frames>] [size ...]\n", name);
+    printf("  -n : frames per run (default %d)\n", RDBENCH_FRAMES);
+    printf("  size : bytes a frame, without its length (default %d)\n", RDBENCH_SIZE);
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    int sizes[16] = { RDBENCH_SIZE };
+    int frames = RDBENCH_FRAMES;
+    int nsizes = 1, given = 0, failed = 0, i, method;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            frames = atoi(argv[++i]);
+        } else if (argv[i][0] != '-' && given < 16) {
+            sizes[given++] = atoi(argv[i]);
+            nsizes = given;     /* sizes given replace the default */
+            if (sizes[given - 1] < 1 || sizes[given - 1] > 0xffff)
+                usage(argv[0]);
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    for (i = 0; i < nsizes; i++)
+        for (method = 0; method < RDBENCH_METHODS; method++)
+            failed += !run(method, frames, sizes[i]);
+
+    return failed ? 1 : 0;
+}
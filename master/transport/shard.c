@@ -0,0 +1,461 @@
+/*
+* "Copyright (c) 2006 University of Southern California.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software and its
+* documentation for any purpose, without fee, and without written
+* agreement is hereby granted, provided that the above copyright
+* notice, the following two paragraphs and the author appear in all
+* copies of this software.
+*
+* IN NO EVENT SHALL THE UNIVERSITY OF SOUTHERN CALIFORNIA BE LIABLE TO
+* ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+* DAMAGES ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS
+* DOCUMENTATION, EVEN IF THE UNIVERSITY OF SOUTHERN CALIFORNIA HAS BEEN
+* ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+* THE UNIVERSITY OF SOUTHERN CALIFORNIA SPECIFICALLY DISCLAIMS ANY
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  THE SOFTWARE
+* PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND THE UNIVERSITY OF
+* SOUTHERN CALIFORNIA HAS NO OBLIGATION TO PROVIDE MAINTENANCE,
+* SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
+*
+*/
+
+/**
+ * File for the protocol shards of the transport layer.
+ **/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sched.h>
+#include <poll.h>
+#include <pthread.h>
+
+#include "shard.h"
+#include "eventloop.h"
+#include "transportmain.h"
+#include "tr_if.h"
+#include "tidlist.h"
+#include "client.h"
+#include "tcmp.h"
+#include "packettransport.h"
+#include "streamtransport.h"
+#include "rcrtransport.h"
+
+/* A ring of one producer and one consumer thread. The producer fills
+   the slot and then moves 'tail', the consumer takes the slot and then
+   moves 'head'; each index is written by one side only. */
+struct shard_ring {
+    volatile unsigned int head;
+    volatile unsigned int tail;
+    struct shard_msg msgs[SHARD_QUEUE_SIZE];
+};
+
+struct shard {
+    const char *name;
+    pthread_t thread;
+    struct timer_heap timers;
+    struct shard_ring jobs;     // main thread -> shard
+    struct shard_ring events;   // shard -> main thread
+    int wake[2];                // pipe the shard sleeps on
+    volatile int sleeping;      // the shard is (about to be) asleep on 'wake'
+    volatile int done;          // the thread has ended
+    int posted;                 // events posted since the main thread was woken
+
+    void (*receive)(struct shard_msg *m);
+    int (*delete_tid)(uint16_t tid);
+    int (*tid_is_alive)(uint16_t tid);
+    void (*terminate)(void);
+};
+
+/* events taken off a full ring by the main thread (see shard_job) */
+struct shard_backlog {
+    struct shard_backlog *next;
+    int shard;
+    struct shard_msg msg;
+};
+
+static void ptr_receive(struct shard_msg *m);
+static void str_receive(struct shard_msg *m);
+static void rcrt_receive(struct shard_msg *m);
+static void tcmp_receive(struct shard_msg *m);
+
+static struct shard shards[NUM_SHARDS] = {
+    { "PTR", .receive = ptr_receive, .delete_tid = packettransport_delete_tid,
+      .tid_is_alive = packettransport_tid_is_alive, .terminate = packettransport_terminate },
+    { "STR", .receive = str_receive, .delete_tid = streamtransport_delete_tid,
+      .tid_is_alive = streamtransport_tid_is_alive, .terminate = streamtransport_terminate },
+    { "RCRT", .receive = rcrt_receive, .delete_tid = rcrtransport_delete_tid,
+      .tid_is_alive = rcrtransport_tid_is_alive, .terminate = rcrtransport_terminate },
+    { "TCMP", .receive = tcmp_receive },
+};
+
+static __thread struct shard *current_shard = NULL;    // NULL on the main thread
+
+static int main_wake[2];    // pipe the shards wake the main thread with
+static struct shard_backlog *backlog = NULL, **backlog_tail = &backlog;
+
+
+/*************************************************
+   Rings
+*************************************************/
+
+/* the slot to fill, or NULL if the ring is full */
+static struct shard_msg *ring_slot(struct shard_ring *r) {
+    if (r->tail - r->head >= SHARD_QUEUE_SIZE)
+        return NULL;
+    return &r->msgs[r->tail & (SHARD_QUEUE_SIZE - 1)];
+}
+
+static void ring_push(struct shard_ring *r) {
+    __sync_synchronize();   // the slot before the new tail
+    r->tail++;
+}
+
+/* the oldest message, or NULL if the ring is empty */
+static struct shard_msg *ring_peek(struct shard_ring *r) {
+    if (r->head == r->tail)
+        return NULL;
+    __sync_synchronize();   // the new tail before the slot
+    return &r->msgs[r->head & (SHARD_QUEUE_SIZE - 1)];
+}
+
+static void ring_pop(struct shard_ring *r) {
+    __sync_synchronize();   // done with the slot before it is reused
+    r->head++;
+}
+
+static void wake(int fd) {
+    char c = 0;
+    if (write(fd, &c, 1) < 0 && errno != EAGAIN)
+        perror("shard wake");
+}
+
+static void drain(int fd) {
+    char buf[64];
+    while (read(fd, buf, sizeof(buf)) > 0)
+        ;
+}
+
+static void open_wake(int p[2]) {
+    if ((pipe(p) < 0) ||
+        (fcntl(p[0], F_SETFL, O_NONBLOCK) < 0) ||
+        (fcntl(p[1], F_SETFL, O_NONBLOCK) < 0)) {
+        perror("shard pipe");
+        exit(2);
+    }
+}
+
+
+/*************************************************
+   Shard threads
+*************************************************/
+
+static void ptr_receive(struct shard_msg *m) {
+    packettransport_receive(m->len, m->data, m->addr);
+}
+
+static void str_receive(struct shard_msg *m) {
+    streamtransport_receive(m->len, m->data, m->addr);
+}
+
+static void rcrt_receive(struct shard_msg *m) {
+    rcrtransport_receive(m->len, m->data, m->addr);
+}
+
+static void tcmp_receive(struct shard_msg *m) {
+    TCMP_receive(m->len, m->data, m->addr, m->dst, m->ttl);
+}
+
+static void run_job(struct shard *s, struct shard_msg *m) {
+    switch (m->type) {
+        case SHARD_JOB_RECEIVE:
+            s->receive(m);
+            break;
+        case SHARD_JOB_SEND:
+            if (packettransport_send(m->tid, m->addr, m->len, m->data) < 0) {
+                printf("tr_send_packet: failed. (tid %d, addr %d)\n", m->tid, m->addr);
+                fflush(stdout);
+                /* the main thread NACKs and removes the tid */
+                shard_event(SHARD_EV_SENDDONE, m->tid, m->addr, 0, NULL, 0);
+            }
+            break;
+        case SHARD_JOB_PING:
+            TCMP_send_ping(m->tid, m->addr);
+            break;
+        case SHARD_JOB_TRACERT:
+            TCMP_send_tracert(m->tid, m->addr);
+            break;
+        case SHARD_JOB_DELETE_TID:
+            if (s->delete_tid)
+                s->delete_tid(m->tid);
+            shard_event(SHARD_EV_CLOSED, m->tid, 0, 0, NULL, 0);
+            break;
+        case SHARD_JOB_STOP:
+            if (s->terminate)
+                s->terminate();
+            break;
+    }
+}
+
+static void *shard_thread(void *arg) {
+    struct shard *s = (struct shard *)arg;
+    struct shard_msg *m;
+    struct pollfd pfd;
+    int n;
+
+    current_shard = s;
+    pfd.fd = s->wake[0];
+    pfd.events = POLLIN;
+
+    while (1) {
+        for (n = 0; (n < SHARD_BATCH) && ((m = ring_peek(&s->jobs)) != NULL); n++) {
+            int type = m->type;
+            run_job(s, m);
+            ring_pop(&s->jobs);
+            if ((type == SHARD_JOB_STOP) || (type == SHARD_JOB_PAUSE)) {
+                wake(main_wake[1]);
+                s->done = 1;
+                return NULL;
+            }
+        }
+        timer_heap_fire(&s->timers);
+
+        if (s->posted) {
+            s->posted = 0;
+            wake(main_wake[1]);
+        }
+        if (n == SHARD_BATCH)
+            continue;
+
+        /* shard_job wakes us if it sees 'sleeping' after queueing a job */
+        s->sleeping = 1;
+        __sync_synchronize();
+        if (ring_peek(&s->jobs) == NULL)
+            poll(&pfd, 1, timer_heap_next_ms(&s->timers));
+        s->sleeping = 0;
+        drain(s->wake[0]);
+    }
+    return NULL;
+}
+
+static void start_threads(void) {
+    sigset_t all, old;
+    int i;
+
+    /* signals are for the main thread (sig_int_handler) */
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    for (i = 0; i < NUM_SHARDS; i++) {
+        shards[i].done = 0;
+        if (pthread_create(&shards[i].thread, NULL, shard_thread, &shards[i]) != 0) {
+            fprintf(stderr, "failed to start the %s thread\n", shards[i].name);
+            exit(2);
+        }
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
+
+int shard_event(uint8_t type, uint16_t tid, uint16_t addr, int len,
+                const void *data, int success) {
+    struct shard *s = current_shard;
+    struct shard_msg *m;
+
+    if (s == NULL)
+        return 0;
+
+    while ((m = ring_slot(&s->events)) == NULL) {   // the main thread is behind
+        wake(main_wake[1]);
+        sched_yield();
+    }
+    if (len > SHARD_MSG_DATA) {
+        fprintf(stderr, "[%s] event of %d bytes cut to %d\n", s->name, len, SHARD_MSG_DATA);
+        len = SHARD_MSG_DATA;
+    }
+    m->type = type;
+    m->success = success;
+    m->alive = s->tid_is_alive ? (s->tid_is_alive(tid) != 0) : 0;
+    m->tid = tid;
+    m->addr = addr;
+    m->len = (data && (len > 0)) ? len : 0;
+    if (m->len)
+        memcpy(m->data, data, m->len);
+    ring_push(&s->events);
+    s->posted = 1;
+    return 1;
+}
+
+
+/*************************************************
+   Main thread
+*************************************************/
+
+/* calls the event function of transportmain.c the shard called */
+static void deliver_event(int shard, struct shard_msg *m) {
+    struct tid_list *t = tidlist_find_tid(m->tid);
+
+    /* what is left of a tid being closed */
+    if (t && (t->type == TRANS_TYPE_CLOSE)) {
+        if (m->alive)
+            t->live_shards |= (1 << shard);
+        else
+            t->live_shards &= ~(1 << shard);
+    }
+
+    switch (m->type) {
+        case SHARD_EV_RESPONSE:
+            if (shard == SHARD_PTR)
+                receive_packettransport(m->tid, m->addr, m->len, m->data);
+            else if (shard == SHARD_STR)
+                receive_streamtransport(m->tid, m->addr, m->len, m->data);
+            else
+                receive_rcrtransport(m->tid, m->addr, m->len, m->data);
+            break;
+        case SHARD_EV_SENDDONE:
+            senddone_packettransport(m->tid, m->addr, m->len, m->data, m->success);
+            break;
+        case SHARD_EV_PING_ACK:
+            receive_TCMP_ping_ack(m->tid, m->addr, m->len, m->data);
+            break;
+        case SHARD_EV_TRACERT_ACK:
+            receive_TCMP_tracert_ack(m->tid, m->addr, m->len, m->data);
+            break;
+        case SHARD_EV_TCMP_DONE:
+            TCMP_done(m->tid);
+            break;
+        case SHARD_EV_DELETE_DONE:
+        case SHARD_EV_CLOSED:
+            /* late for a tid no longer being closed, which may have been
+               handed out again (close_all_tid_for_a_client): ignore it */
+            if (t && (t->type == TRANS_TYPE_CLOSE))
+                check_close_done(m->tid);
+            break;
+    }
+}
+
+/* takes the events of 'shard' out of its ring, to be delivered later */
+static void collect_events(int shard) {
+    struct shard_msg *m;
+
+    while ((m = ring_peek(&shards[shard].events)) != NULL) {
+        struct shard_backlog *b = xmalloc(sizeof(*b));
+        b->next = NULL;
+        b->shard = shard;
+        b->msg = *m;
+        ring_pop(&shards[shard].events);
+        *backlog_tail = b;
+        backlog_tail = &b->next;
+    }
+    wake(main_wake[1]);
+}
+
+static void deliver_backlog(void) {
+    while (backlog) {
+        struct shard_backlog *b = backlog;
+        backlog = b->next;
+        if (backlog == NULL)
+            backlog_tail = &backlog;
+        deliver_event(b->shard, &b->msg);
+        free(b);
+    }
+}
+
+/* the shards have posted events */
+static void shard_deliver(int fd, void *arg) {
+    struct shard_msg msg, *m;
+    int i, n;
+
+    drain(main_wake[0]);
+    deliver_backlog();
+    for (i = 0; i < NUM_SHARDS; i++) {
+        for (n = 0; (n < SHARD_QUEUE_SIZE) && ((m = ring_peek(&shards[i].events)) != NULL); n++) {
+            msg = *m;   // an event function may take the rest (collect_events)
+            ring_pop(&shards[i].events);
+            deliver_event(i, &msg);
+            deliver_backlog();
+        }
+        if (n == SHARD_QUEUE_SIZE)  // come back after serving the others
+            wake(main_wake[1]);
+    }
+}
+
+void shard_job(int shard, uint8_t type, uint16_t tid, uint16_t addr,
+               uint16_t dst, uint8_t ttl, int len, const void *data) {
+    struct shard *s = &shards[shard];
+    struct shard_msg *m;
+
+    while ((m = ring_slot(&s->jobs)) == NULL) { // the shard is behind
+        collect_events(shard);  // it may be waiting for room for its events
+        wake(s->wake[1]);
+        sched_yield();
+    }
+    if (len > SHARD_MSG_DATA) {
+        fprintf(stderr, "[%s] job of %d bytes cut to %d\n", s->name, len, SHARD_MSG_DATA);
+        len = SHARD_MSG_DATA;
+    }
+    m->type = type;
+    m->ttl = ttl;
+    m->tid = tid;
+    m->addr = addr;
+    m->dst = dst;
+    m->len = (data && (len > 0)) ? len : 0;
+    if (m->len)
+        memcpy(m->data, data, m->len);
+    ring_push(&s->jobs);
+    /* the new tail before 'sleeping' is read; pairs with the fence in
+       shard_thread between setting 'sleeping' and peeking at the jobs,
+       so that one of us sees the other's store */
+    __sync_synchronize();
+    if (s->sleeping)
+        wake(s->wake[1]);
+}
+
+struct timer_heap *shard_timers(int shard) {
+    return &shards[shard].timers;
+}
+
+/* ends every thread with a 'type' job, keeping its events */
+static void end_threads(uint8_t type) {
+    int i;
+
+    for (i = 0; i < NUM_SHARDS; i++)
+        shard_job(i, type, 0, 0, 0, 0, 0, NULL);
+    for (i = 0; i < NUM_SHARDS; i++) {
+        while (!shards[i].done) {
+            collect_events(i);
+            usleep(1000);
+        }
+        pthread_join(shards[i].thread, NULL);
+    }
+}
+
+void shard_pause(void) {
+    end_threads(SHARD_JOB_PAUSE);
+}
+
+void shard_resume(void) {
+    start_threads();
+}
+
+void shard_stop(void) {
+    end_threads(SHARD_JOB_STOP);
+}
+
+void shard_init(void) {
+    int i;
+
+    open_wake(main_wake);
+    for (i = 0; i < NUM_SHARDS; i++) {
+        timer_heap_init(&shards[i].timers);
+        open_wake(shards[i].wake);
+    }
+    ev_add(main_wake[0], shard_deliver, NULL);
+    start_threads();
+}
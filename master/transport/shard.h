@@ -0,0 +1,117 @@
+/*
+* "Copyright (c) 2006 University of Southern California.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software and its
+* documentation for any purpose, without fee, and without written
+* agreement is hereby granted, provided that the above copyright
+* notice, the following two paragraphs and the author appear in all
+* copies of this software.
+*
+* IN NO EVENT SHALL THE UNIVERSITY OF SOUTHERN CALIFORNIA BE LIABLE TO
+* ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+* DAMAGES ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS
+* DOCUMENTATION, EVEN IF THE UNIVERSITY OF SOUTHERN CALIFORNIA HAS BEEN
+* ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+* THE UNIVERSITY OF SOUTHERN CALIFORNIA SPECIFICALLY DISCLAIMS ANY
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  THE SOFTWARE
+* PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND THE UNIVERSITY OF
+* SOUTHERN CALIFORNIA HAS NO OBLIGATION TO PROVIDE MAINTENANCE,
+* SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
+*
+*/
+
+/**
+ * Header file for the protocol shards of the transport layer.
+ *
+ * Packet transport, stream transport, RCRT and TCMP each run on a thread
+ * of their own (a shard), which alone touches the connections and the
+ * timers of that protocol. The main thread keeps the clients, the tid
+ * list, TRD and the services; it classifies what comes from the router
+ * and hands it, and the requests of the clients, to a shard as jobs.
+ * What a protocol tells the application (the event functions of
+ * transportmain.c) comes back to the main thread as events.
+ * Jobs and events go through single-producer single-consumer rings,
+ * without locks.
+ **/
+
+#ifndef _SHARD_H_
+#define _SHARD_H_
+
+#include <stdint.h>
+#include "timerheap.h"
+
+enum {
+    SHARD_PTR = 0,      // packet transport
+    SHARD_STR = 1,      // stream transport
+    SHARD_RCRT = 2,     // rcr transport
+    SHARD_TCMP = 3,     // ping, trace route
+    NUM_SHARDS = 4
+};
+
+/* the shards that keep connections of a tid (see close_transport_connections) */
+#define SHARDS_WITH_CONNECTIONS ((1 << SHARD_PTR) | (1 << SHARD_STR) | (1 << SHARD_RCRT))
+
+enum {  // jobs, main thread -> shard
+    SHARD_JOB_RECEIVE = 1,  // a packet of the protocol from the router
+    SHARD_JOB_SEND,         // packettransport_send
+    SHARD_JOB_PING,         // TCMP_send_ping
+    SHARD_JOB_TRACERT,      // TCMP_send_tracert
+    SHARD_JOB_DELETE_TID,   // delete the connections of tid, answered by SHARD_EV_CLOSED
+    SHARD_JOB_PAUSE,        // end the thread, leaving the protocol as it is
+    SHARD_JOB_STOP          // terminate the protocol, and the thread
+};
+
+enum {  // events, shard -> main thread
+    SHARD_EV_RESPONSE = 1,  // receive_packettransport, _streamtransport, _rcrtransport
+    SHARD_EV_SENDDONE,      // senddone_packettransport
+    SHARD_EV_PING_ACK,      // receive_TCMP_ping_ack
+    SHARD_EV_TRACERT_ACK,   // receive_TCMP_tracert_ack
+    SHARD_EV_TCMP_DONE,     // TCMP_done
+    SHARD_EV_DELETE_DONE,   // *_tid_delete_done
+    SHARD_EV_CLOSED         // done with SHARD_JOB_DELETE_TID
+};
+
+#define SHARD_QUEUE_SIZE    1024    // jobs or events a ring holds, a power of 2
+#define SHARD_MSG_DATA      256     // payload of a job or an event
+#define SHARD_BATCH         64      // jobs a shard serves before it looks at its timers
+
+struct shard_msg {
+    uint8_t type;       // SHARD_JOB_* or SHARD_EV_*
+    uint8_t ttl;        // of a received packet
+    uint8_t success;    // of SHARD_EV_SENDDONE
+    uint8_t alive;      // events: the shard still has connections of 'tid'
+    uint16_t tid;
+    uint16_t addr;      // destination, or source of a received packet
+    uint16_t dst;       // destination of a received packet
+    int len;
+    unsigned char data[SHARD_MSG_DATA];
+};
+
+/* starts the shard threads, and delivers their events from the event loop */
+void shard_init(void);
+
+/* terminates the protocols and waits for their threads */
+void shard_stop(void);
+
+/* ends the shard threads between two jobs, and starts them again; around
+   fork(), which would leave a thread behind wherever it happens to be */
+void shard_pause(void);
+void shard_resume(void);
+
+/* the timers of shard 'shard', for its protocol to use */
+struct timer_heap *shard_timers(int shard);
+
+/* hands a job to 'shard' (main thread only) */
+void shard_job(int shard, uint8_t type, uint16_t tid, uint16_t addr,
+               uint16_t dst, uint8_t ttl, int len, const void *data);
+
+/* Called from the event functions of transportmain.c: on a shard thread,
+   queues the event for the main thread, which calls the same function
+   again, and returns 1; on the main thread returns 0. */
+int shard_event(uint8_t type, uint16_t tid, uint16_t addr, int len,
+                const void *data, int success);
+
+#endif
@@ -0,0 +1,273 @@
+/**
+ * "Copyright (c) 2006~2008 University of Southern California.
+ * All rights reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and its
+ * documentation for any purpose, without fee, and without written
+ * agreement is hereby granted, provided that the above copyright
+ * notice, the following two paragraphs and the author appear in all
+ * copies of this software.
+ *
+ * IN NO EVENT SHALL THE UNIVERSITY OF SOUTHERN CALIFORNIA BE LIABLE TO
+ * ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+ * DAMAGES ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS
+ * DOCUMENTATION, EVEN IF THE UNIVERSITY OF SOUTHERN CALIFORNIA HAS BEEN
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THE UNIVERSITY OF SOUTHERN CALIFORNIA SPECIFICALLY DISCLAIMS ANY
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  THE SOFTWARE
+ * PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND THE UNIVERSITY OF
+ * SOUTHERN CALIFORNIA HAS NO OBLIGATION TO PROVIDE MAINTENANCE,
+ * SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
+ *
+ **/
+
+/**
+ * shmbench: router-to-transport delivery over TCP against the
+ * shared-memory channel. For each rate, starts a router on loopback,
+ * feeds it neighbor packets over UDP from a second thread, and reads
+ * them back as a transport would. Prints the delivered rate, the
+ * latency from sendto() to the transport, and the router's CPU ticks.
+ **/
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <time.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "tosmsg.h"
+#include "sfsource.h"
+#include "shmring.h"
+#include "shmsource.h"
+
+#define SHMBENCH_PACKETS    200000
+#define SHMBENCH_NEIGHBOR   "127.0.0.2"     /* the router's loopback neighbor */
+#define SHMBENCH_IDLE       1.0             /* sec without a packet that ends a run */
+
+/* what one router sends another (TR_Packet in the router) */
+typedef struct bench_packet {
+    uint8_t type;               /* TR_PACKET_TYPE_TOSMSG */
+    uint8_t pad[3];
+    uint32_t master_ip;
+    uint16_t length;
+    uint8_t pad2[2];
+    TOS_Msg msg;
+} bench_packet;
+
+/* the payload of every TOS_Msg */
+typedef struct bench_stamp {
+    double sent;
+    int seqno;
+} __attribute__((packed)) bench_stamp;
+
+static int g_packets = SHMBENCH_PACKETS;
+static int g_router_port;
+static int g_rate;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void *send_neighbor_packets(void *arg) {
+    struct sockaddr_in addr;
+    bench_packet p;
+    bench_stamp stamp;
+    double start;
+    int fd, i;
+
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr(SHMBENCH_NEIGHBOR);
+    bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+
+    addr.sin_port = htons(g_router_port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    memset(&p, 0, sizeof(p));
+    p.type = 1;
+    p.master_ip = inet_addr(SHMBENCH_NEIGHBOR);
+    p.msg.addr = htons(1);
+    p.msg.src = htons(7);
+    p.msg.length = sizeof(bench_stamp);
+    p.msg.group = 0x7d;
+    p.msg.type = 5;
+    p.length = offsetof(TOS_Msg, data) + p.msg.length;
+
+    start = now();
+    for (i = 0; i < g_packets; i++) {
+        stamp.sent = now();
+        stamp.seqno = i;
+        memcpy(p.msg.data, &stamp, sizeof(stamp));
+        sendto(fd, &p, offsetof(bench_packet, msg) + p.length, 0,
+               (struct sockaddr *)&addr, sizeof(addr));
+
+        if (g_rate) {   /* busy-wait; usleep() is far too coarse */
+            double due = start + (i + 1.0) / g_rate;
+            while (now() < due)
+                ;
+        }
+    }
+    close(fd);
+    return NULL;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static long router_ticks(pid_t pid) {
+    char path[64];
+    long utime, stime;
+    FILE *f;
+    int n;
+
+    sprintf(path, "/proc/%d/stat", pid);
+    if ((f = fopen(path, "r")) == NULL)
+        return -1;
+    /* utime and stime are fields 14 and 15 */
+    n = fscanf(f, "%*d %*s %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %ld %ld",
+               &utime, &stime);
+    fclose(f);
+    return (n == 2) ? utime + stime : -1;
+}
+
+/* -i leaves the router without a clean exit; remove its channel socket */
+static void stop_router(pid_t pid, int transport_port) {
+    char path[108];
+
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+    snprintf(path, sizeof(path), SHM_CHANNEL_PATH, transport_port);
+    unlink(path);
+}
+
+static void run(const char *router, int use_shm) {
+    char tport[16], rport[16];
+    unsigned char buf[256];
+    double *latency, start, last;
+    bench_stamp stamp;
+    pthread_t sender;
+    long ticks;
+    int transport_port, fd, got = 0, len;
+    pid_t pid;
+
+    transport_port = 20000 + rand() % 10000;
+    g_router_port = transport_port + 1;
+    sprintf(tport, "%d", transport_port);
+    sprintf(rport, "%d", g_router_port);
+
+    if ((pid = fork()) == 0) {
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, 1);
+        dup2(null, 2);
+        execl(router, router, "-s", "-i", "-n", "lo", "-a", "1",
+              "-tp", tport, "-rp", rport, (char *)NULL);
+        _exit(1);
+    }
+    usleep(500000);
+
+    fd = use_shm ? open_shm_source(transport_port)
+                 : open_sf_source("127.0.0.1", transport_port);
+    if (fd < 0) {
+        printf("%s: cannot reach the router\n", use_shm ? "shm" : "tcp");
+        stop_router(pid, transport_port);
+        return;
+    }
+
+    latency = malloc(g_packets * sizeof(double));
+    ticks = router_ticks(pid);
+    start = last = now();
+    pthread_create(&sender, NULL, send_neighbor_packets, NULL);
+
+    while (got < g_packets && now() - last < SHMBENCH_IDLE) {
+        struct pollfd pfd = { fd, POLLIN, 0 };
+
+        if (poll(&pfd, 1, 100) <= 0)
+            continue;
+
+        if (use_shm) {
+            drain_shm_source();
+            do {
+                while (got < g_packets && (len = read_shm_packet(buf, sizeof(buf))) > 0) {
+                    memcpy(&stamp, buf + offsetof(TOS_Msg, data), sizeof(stamp));
+                    last = now();
+                    latency[got++] = last - stamp.sent;
+                }
+            } while (!sleep_shm_source());
+        } else {
+            unsigned char *p = read_sf_packet(fd, &len);
+            if (p == NULL)
+                break;
+            memcpy(&stamp, p + offsetof(TOS_Msg, data), sizeof(stamp));
+            last = now();
+            latency[got++] = last - stamp.sent;
+            free(p);
+        }
+    }
+    pthread_join(sender, NULL);
+    ticks = router_ticks(pid) - ticks;
+
+    if (got > 0) {
+        qsort(latency, got, sizeof(double), compare_double);
+        printf("%s rate %6d: got %d/%d, %.0f pkt/s, latency p50 %.1f p99 %.1f us, router ticks %ld\n",
+               use_shm ? "shm" : "tcp", g_rate, got, g_packets, got / (last - start),
+               latency[got / 2] * 1e6, latency[(int)(got * .99)] * 1e6, ticks);
+    } else {
+        printf("%s rate %6d: nothing delivered\n", use_shm ? "shm" : "tcp", g_rate);
+    }
+
+    free(latency);
+    close(fd);
+    stop_router(pid, transport_port);
+}
+
+static void usage(char *name) {
+    printf("Usage: %s [-r <router>] [-n <packets>] [rate ...]\n", name);
+    printf("  -r : router binary to start (default ../router/router)\n");
+    printf("  -n : packets per run (default %d)\n", SHMBENCH_PACKETS);
+    printf("  rate : packets per second, 0 for unpaced (default 5000 50000 0)\n");
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    const char *router = "../router/router";
+    int rates[16] = { 5000, 50000, 0 };
+    int nrates = 3, given = 0, i, use_shm;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            router = argv[++i];
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            g_packets = atoi(argv[++i]);
+        } else if (argv[i][0] != '-' && given < 16) {
+            rates[given++] = atoi(argv[i]);
+            nrates = given;     /* rates given replace the defaults */
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    srand(getpid());
+    for (i = 0; i < nrates; i++) {
+        g_rate = rates[i];
+        for (use_shm = 0; use_shm <= 1; use_shm++)
+            run(router, use_shm);
+    }
+    return 0;
+}
@@ -0,0 +1,161 @@
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <poll.h>
+
+#include "shmring.h"
+#include "shmsource.h"
+
+#define SHM_WRITE_RETRY_USEC 100
+
+#ifdef USE_SHM_CHANNEL
+
+static shm_channel *channel = NULL;
+static int shm_fd[SHM_FD_COUNT];
+static int shm_socket = -1;    /* kept open; the router sees us leave */
+
+static int router_alive(void)
+{
+  struct pollfd pfd;
+
+  pfd.fd = shm_socket;
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+
+  /* the router never writes to the socket after the hello */
+  return poll(&pfd, 1, 0) == 0;
+}
+
+int open_shm_source(int port)
+{
+  struct sockaddr_un addr;
+  struct msghdr msg;
+  struct iovec iov;
+  struct cmsghdr *cmsg;
+  char control[CMSG_SPACE(sizeof(shm_fd))];
+  uint32_t hello[2];
+  int fd;
+
+  if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+    return -1;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  snprintf(addr.sun_path, sizeof(addr.sun_path), SHM_CHANNEL_PATH, port);
+
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+      close(fd);
+      return -1;
+    }
+
+  memset(&msg, 0, sizeof(msg));
+  iov.iov_base = hello;
+  iov.iov_len = sizeof(hello);
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  if (recvmsg(fd, &msg, MSG_WAITALL) != sizeof(hello) ||
+      hello[0] != SHM_CHANNEL_MAGIC || hello[1] != SHM_CHANNEL_VERSION ||
+      (cmsg = CMSG_FIRSTHDR(&msg)) == NULL ||
+      cmsg->cmsg_type != SCM_RIGHTS ||
+      cmsg->cmsg_len != CMSG_LEN(sizeof(shm_fd)))
+    {
+      close(fd);
+      return -1;
+    }
+
+  memcpy(shm_fd, CMSG_DATA(cmsg), sizeof(shm_fd));
+
+  channel = (shm_channel *)mmap(NULL, sizeof(shm_channel), PROT_READ | PROT_WRITE,
+                                MAP_SHARED, shm_fd[SHM_FD_MEMORY], 0);
+  if (channel == MAP_FAILED)
+    {
+      channel = NULL;
+      close(shm_fd[SHM_FD_MEMORY]);
+      close(shm_fd[SHM_FD_TO_TRANSPORT]);
+      close(shm_fd[SHM_FD_TO_ROUTER]);
+      close(fd);
+      return -1;
+    }
+
+  shm_socket = fd;
+
+  return shm_fd[SHM_FD_TO_TRANSPORT];
+}
+
+void drain_shm_source(void)
+{
+  eventfd_t count;
+
+  eventfd_read(shm_fd[SHM_FD_TO_TRANSPORT], &count);
+}
+
+int read_shm_packet(void *packet, int len)
+{
+  return shm_ring_read(&channel->to_transport, packet, len);
+}
+
+int write_shm_packet(int fd, const void *packet, int len)
+{
+  while (shm_ring_write(&channel->to_router, packet, len) < 0)
+    {
+      if (!router_alive())
+        return -1;
+
+      usleep(SHM_WRITE_RETRY_USEC);
+    }
+
+  shm_ring_notify(&channel->to_router, shm_fd[SHM_FD_TO_ROUTER]);
+
+  return 0;
+}
+
+int sleep_shm_source(void)
+{
+  return shm_ring_sleep(&channel->to_transport);
+}
+
+void wake_shm_source(void)
+{
+  eventfd_write(shm_fd[SHM_FD_TO_TRANSPORT], 1);
+}
+
+#else
+
+int open_shm_source(int port)
+{
+  return -1;
+}
+
+void drain_shm_source(void)
+{
+}
+
+int read_shm_packet(void *packet, int len)
+{
+  return 0;
+}
+
+int write_shm_packet(int fd, const void *packet, int len)
+{
+  return -1;
+}
+
+int sleep_shm_source(void)
+{
+  return 1;
+}
+
+void wake_shm_source(void)
+{
+}
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef SHMSOURCE_H
+#define SHMSOURCE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int open_shm_source(int port);
+/* Effects: attaches to the shared-memory channel of a router on this
+     host, the one that serves transports at 'port'
+   Returns: a file descriptor that becomes readable when the router has
+     written packets, or -1 if there is no such router (use TCP then)
+ */
+
+void drain_shm_source(void);
+/* Effects: clears the fd, once per wakeup and before reading, so that
+     what the router rings meanwhile makes it readable again
+ */
+
+int read_shm_packet(void *packet, int len);
+/* Effects: reads one packet from the router into 'packet' (at most len
+     bytes) without blocking
+   Returns: the packet length, or 0 if there is none
+ */
+
+int write_shm_packet(int fd, const void *packet, int len);
+/* Effects: writes len byte packet to the router; waits while the ring
+     is full. 'fd' is ignored, so that it can be given to
+     set_TOS_Msg_writer.
+   Returns: 0 if packet successfully written, -1 if the router is gone
+ */
+
+int sleep_shm_source(void);
+/* Effects: tells the router to ring the fd on its next packet
+   Returns: 1 if the caller may block on the fd, 0 if a packet came in
+     meanwhile
+ */
+
+void wake_shm_source(void);
+/* Effects: makes the fd readable again, for packets the caller left
+     unread
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -46,6 +46,8 @@
 #include "tr_packet.h"
 #include "tr_seqno.h"
 #include "timeval.h"
+#include "timerheap.h"
+#include "shard.h"
 
 
 //#define LOG_STR_PACKET
@@ -494,24 +496,21 @@ void streamtransport_receive(int len, unsigned char *packet, uint16_t srcAddr) {
 /********************************************************/
 
 int STR_Timer_start(connectionlist_t *c, unsigned long int interval_ms) {
-    struct timeval curr;
     if (c == NULL)
         return 0;
-    gettimeofday(&curr, NULL);
-    add_ms_to_timeval(&curr, interval_ms, &c->alarm_time);
+    timer_start(&c->timer, interval_ms);
     return 1;
 }
 
 void STR_Timer_stop(connectionlist_t *c) {
     if (c == NULL)
         return;
-    c->alarm_time.tv_sec = 0;
-    c->alarm_time.tv_usec = 0;
+    timer_stop(&c->timer);
     return;
 }
 
-int STR_Timer_fired(int user_id) {
-    connectionlist_t *c = (connectionlist_t *)user_id;
+void STR_Timer_fired(void *arg) {
+    connectionlist_t *c = (connectionlist_t *)arg;
     struct strclist *cs = (struct strclist *)c;
     
     if (cs->state == STR_C_S_FINISHED) {
@@ -563,24 +562,8 @@ int STR_Timer_fired(int user_id) {
         #endif
         }
     }
-    return user_id;
-}
-
-void polling_streamtransport_timer() {
-    connectionlist_t *c;
-    struct timeval curr;
-    gettimeofday(&curr, NULL);
-
-    for (c = (connectionlist_t *)m_strcs; c; c = c->next) {
-        if (((c->alarm_time.tv_sec > 0) || (c->alarm_time.tv_usec > 0))
-                && (compare_timeval(&c->alarm_time, &curr) <= 0)) {
-            STR_Timer_fired((int)c);
-            break;
-        }
-    }
 }
 
-
 /********************************************************/
 /**  connection functions            ********************/
 /********************************************************/
@@ -598,6 +581,9 @@ connectionlist_t *create_str_connection(uint16_t tid, uint16_t srcAddr, uint16_t
     if (c == NULL) {
         cs = malloc(sizeof(struct strclist));   // must be sizeof strclist
         c = (connectionlist_t *)cs;
+        timer_init(&c->timer, shard_timers(SHARD_STR), STR_Timer_fired, c);
+    } else {
+        STR_Timer_stop(c);
     }
 
     #ifdef DEBUG_STR1
@@ -634,6 +620,7 @@ void _delete_strc(connectionlist_t **c) {
     d = (*c)->next;
     (*c)->next = NULL;
     *c = d;
+    timer_stop(&cs->c.timer);
     free(cs);
 }
 
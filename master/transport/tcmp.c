@@ -38,7 +38,7 @@
 #include "transportmain.h"
 #include "transport.h"
 #include "tcmp.h"
-#include "tidlist.h"
+#include "shard.h"
 #include "tosmsg.h"
 #include "routinglayer.h"
 #include "timeval.h"
@@ -52,7 +52,7 @@ void remove_tcmp(uint16_t tid, uint16_t addr);
 struct tcmplist * find_tcmp(uint16_t tid, uint16_t addr);
 struct tcmplist *find_tcmp_by_tid(uint16_t tid);
 int TCMP_Timer_start(struct tcmplist *t, unsigned long int interval_ms);
-int TCMP_Timer_fired(int user_id);
+void TCMP_Timer_fired(void *arg);
 
 /*************************************************/
 /***   TCMP reply PING/TRACERT with ACK   ********/
@@ -205,7 +205,7 @@ void receive_PING_ACK(uint16_t tid, uint16_t addr, uint16_t seqno) {
         TCMP_send_ping(tid, t->addr);    // t->addr and addr might differ(can be broadcast address)
     } else {
         remove_tcmp(tid, t->addr);
-        tidlist_remove_tid(tid);
+        TCMP_done(tid);
     }
 }
 
@@ -251,7 +251,7 @@ void receive_TRACERT_ACK(uint16_t tid, uint16_t addr, uint16_t seqno) {
         TCMP_send_tracert(tid, actualDstAddr);
     } else {
         remove_tcmp(tid, actualDstAddr);
-        tidlist_remove_tid(tid);
+        TCMP_done(tid);
     }
 }
 
@@ -315,8 +315,7 @@ struct tcmplist *add_tcmp(uint16_t tid, uint16_t addr, int type) {
     t->addr = addr;
     t->seqno = 1;
     t->ttl = 1;
-    t->alarm_time.tv_sec = 0;
-    t->alarm_time.tv_usec = 0;
+    timer_init(&t->timer, shard_timers(SHARD_TCMP), TCMP_Timer_fired, t);
     print_all_tcmps();
     return t;
 }
@@ -324,6 +323,7 @@ struct tcmplist *add_tcmp(uint16_t tid, uint16_t addr, int type) {
 void rem_tcmp(struct tcmplist **t) {
     struct tcmplist *dead = *t;
     *t = dead->next;
+    timer_stop(&dead->timer);
     free(dead);
     print_all_tcmps();
 }
@@ -365,50 +365,32 @@ void remove_tcmp(uint16_t tid, uint16_t addr) {
 /********************************************************/
 
 int TCMP_Timer_start(struct tcmplist *c, unsigned long int interval_ms) {
-    struct timeval curr;
     if (c == NULL)
         return 0;
-    gettimeofday(&curr, NULL);
-    add_ms_to_timeval(&curr, interval_ms, &c->alarm_time);
+    timer_start(&c->timer, interval_ms);
     return 1;
 }
 
 void TCMP_Timer_stop(struct tcmplist *c) {
     if (c == NULL)
         return;
-    c->alarm_time.tv_sec = 0;
-    c->alarm_time.tv_usec = 0;
+    timer_stop(&c->timer);
     return;
 }
 
-int TCMP_Timer_fired(int user_id) {
-    struct tcmplist *t = (struct tcmplist *)user_id;
+void TCMP_Timer_fired(void *arg) {
+    struct tcmplist *t = (struct tcmplist *)arg;
     #ifdef DEBUG_TCMP
         printf("TCMP_Timerfired, ACK TimeOut...");
         printf(" (tid=%d, addr=%d, seqno=%d)\n", t->tid, t->addr, t->seqno);
     #endif
     if (t == NULL) {
         fprintf(stderr, "pointer error in TCMP_Timer_fired\n");
-        return -1;
+        return;
     }
     if (t->type == TCMP_FLAG_PING)
         receive_PING_ACK(t->tid, t->addr, t->seqno);
     else if (t->type == TCMP_FLAG_TRACERT)
         receive_TRACERT_ACK(t->tid, t->addr, t->seqno);
-    return 1;
-}
-
-void polling_tcmp_timer() {
-    struct tcmplist *c;
-    struct timeval curr;
-    gettimeofday(&curr, NULL);
-
-    for (c = tcmps; c; c = c->next) {
-        if (((c->alarm_time.tv_sec > 0) || (c->alarm_time.tv_usec > 0))
-                && (compare_timeval(&c->alarm_time, &curr) <= 0)) {
-            TCMP_Timer_fired((int)c);
-            break;
-        }
-    }
 }
 
@@ -37,6 +37,7 @@
 #define _TCMP_H
 
 #include "common.h"
+#include "timerheap.h"
 #include <sys/time.h>
 
 /* This msg is a 'payload' encapsulated in 'transport interface packet'
@@ -73,16 +74,15 @@ struct tcmplist {
     uint16_t seqno;
     uint8_t ttl;
     struct timeval sent_time;
-    struct timeval alarm_time;
+    struct timer_event timer;
 };
 
 void receive_TCMP_ping_ack(uint16_t tid, uint16_t addr, int len, unsigned char *msg);
 void receive_TCMP_tracert_ack(uint16_t tid, uint16_t addr, int len, unsigned char *msg);
+void TCMP_done(uint16_t tid);   // no more acks will come for tid
 
 void TCMP_receive(int len, uint8_t *rtmsg, uint16_t srcAddr, uint16_t dstAddr, uint8_t ttl);
 void TCMP_send_ping(uint16_t tid, uint16_t addr);
 void TCMP_send_tracert(uint16_t tid, uint16_t addr);
-
-void polling_tcmp_timer();
 #endif
 
@@ -28,7 +28,8 @@
  *
  * When an application sends a task, assign an unique tid and disseminate 
  * the task with that tid.
- * Maintains the list of tid's used for tasks.
+ * Maintains the list of tid's used for tasks, indexed by tid and, for
+ * each client, by the fd of that client.
  * When an application disconnects, automatically send out DELETE task
  * for the tid's that belong to that application.
  * When this transport itself terminates, automatically send out DELETE task
@@ -50,6 +51,8 @@
 #include <stdio.h>
 #include <string.h>
 #include <sys/time.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "transportmain.h"
 #include "trsource.h"
@@ -68,34 +71,53 @@ FILE *tid_fptr;
 char *tid_filename;
 char tid_filebuf[20];
 
-uint16_t myTID;
+uint16_t myTID;                                 // where tid=0 looks for a new tid
+uint16_t tid_high;                              // past every tid handed out, never moves back
+uint16_t tid_reserved_from, tid_reserved_to;   // tids in the stored block
 
-struct tid_list *tids;
+struct tid_list *tid_table[ALL_TID + 1];    // indexed by tid
+struct tid_list **client_tids;              // tids of each client, indexed by its fd
+int num_client_tids;
 int num_tids;
 
 
 /*************************************************
    Function declaration
 *************************************************/
-void rem_tid(struct tid_list **t);
-struct tid_list **_find_tid(uint16_t tid);
+void rem_tid(struct tid_list *t);
 void print_all_tids();
 
 
 /////////////////////////////////////////////////
 
 
-void store_tid() {
-    tid_fptr = fopen(tid_filename, "w");
-    if (tid_fptr != NULL) {
-        fprintf(tid_fptr, "%hu \n", myTID);
-        fflush(tid_fptr);
-        fclose(tid_fptr);
+/**
+ * Write 'next' to the tid file, as the first tid to use after a restart.
+ * The new file replaces the old one only once it is on disk, so a crash
+ * leaves one or the other, never an empty file.
+ **/
+void store_tid(uint16_t next) {
+    char *tmpname = xmalloc(strlen(tid_filename) + 5);
+    char buf[16];
+    int fd, len;
+
+    sprintf(tmpname, "%s.tmp", tid_filename);
+    len = sprintf(buf, "%hu \n", next);
+    fd = open(tmpname, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        free(tmpname);
+        return;
+    }
+    if ((write(fd, buf, len) != len) || (fsync(fd) < 0) ||
+        (close(fd) < 0) || (rename(tmpname, tid_filename) < 0)) {
+        fprintf(stderr, "Warning: failed to store tid in %s\n", tid_filename);
+        unlink(tmpname);
     }
+    free(tmpname);
 }
 
 void tidlist_terminate() {
-    store_tid();
+    store_tid(tid_high);    // nothing past tid_high was handed out
 }
 
 uint16_t tidlist_init() {
@@ -103,30 +125,61 @@ uint16_t tidlist_init() {
     tid_fptr = fopen(tid_filename, "r");
     if (tid_fptr == NULL) {
         myTID = 1;
-        store_tid();
+        store_tid(myTID);
     } else {
-        fscanf(tid_fptr, " %hu", &myTID);
+        if ((fscanf(tid_fptr, " %hu", &myTID) != 1) ||
+            (myTID < MIN_TID) || (myTID > MAX_TID))
+            myTID = MIN_TID;
         fclose(tid_fptr);
     }
+    tid_high = myTID;
+    tid_reserved_from = tid_reserved_to = myTID;  // nothing reserved yet
     return myTID;
 }
 
+/* distance from 'from' forward to 'to', in the MIN_TID..MAX_TID cycle */
+int tid_distance(uint16_t from, uint16_t to) {
+    return (to + (MAX_TID - MIN_TID + 1) - from) % (MAX_TID - MIN_TID + 1);
+}
+
+/**
+ * Raise tid_high past 'tid', unless 'tid' is behind it, and make sure
+ * tid_high is in the reserved block. Reserving TID_RESERVE_BLOCK tids at
+ * a time stores the end of the block, so the tid file is written once per
+ * block rather than once per tid, and a restart (even after a crash)
+ * carries on past anything handed out. A tid within half the cycle ahead
+ * of tid_high counts as ahead; an application may pick one further back,
+ * which must not pull the stored end back over the tids in use.
+ **/
+void reserve_tid(uint16_t tid) {
+    if (tid_distance(tid_high, tid) >= (MAX_TID - MIN_TID + 1) / 2)
+        return;     // behind tid_high, so already reserved
+    tid_high = tid + 1;
+    if (tid_high > MAX_TID) tid_high = MIN_TID;
+    if (tid_distance(tid_reserved_from, tid_high) <=
+            tid_distance(tid_reserved_from, tid_reserved_to))
+        return;
+    tid_reserved_from = tid_high;
+    tid_reserved_to = tid_high + TID_RESERVE_BLOCK;
+    if (tid_reserved_to > MAX_TID)
+        tid_reserved_to -= (MAX_TID - MIN_TID + 1);
+    store_tid(tid_reserved_to);
+}
+
 uint16_t assign_new_tid(uint16_t tid) {
     // let tid=0 to automatically generate new tid
-    while(1) {
-        if ((tid != 0) &&
-            (tid >= MIN_TID) && (tid <= MAX_TID) &&
-            (tidlist_find_tid(tid) == NULL)) {
-            break;
-        } else {
-            tid = myTID++;
-            if (tid > MAX_TID) tid = MIN_TID;
-        }
+    if ((tid != 0) &&
+        (tid >= MIN_TID) && (tid <= MAX_TID) &&
+        (tidlist_find_tid(tid) == NULL)) {
+        reserve_tid(tid);   // an application's choice leaves myTID alone
+        return tid;
     }
-    myTID = tid + 1; // the next tid to be used.
-    if (myTID > MAX_TID) myTID = MIN_TID;
+    do {
+        tid = myTID++;
+        if (myTID > MAX_TID) myTID = MIN_TID;
+    } while (tidlist_find_tid(tid) != NULL);
 
-    store_tid(); // store myTID to a file.
+    reserve_tid(tid); // store the end of its block to a file, if it is new.
     return tid;
 }
 
@@ -135,6 +188,35 @@ uint16_t assign_new_tid(uint16_t tid) {
    Functions
 *************************************************/
 
+/* link 't' into the list of the client on 't->fd' */
+void link_client_tid(struct tid_list *t) {
+    if (t->fd < 0) {
+        t->next = NULL;
+        t->prev = NULL;
+        return;
+    }
+    if (t->fd >= num_client_tids) {
+        int n = num_client_tids ? num_client_tids : 64;
+        struct tid_list **c;
+
+        while (n <= t->fd)
+            n *= 2;
+        c = realloc(client_tids, n * sizeof *c);
+        if (!c) {
+            fprintf(stderr, "out of memory\n");
+            exit(2);
+        }
+        memset(c + num_client_tids, 0, (n - num_client_tids) * sizeof *c);
+        client_tids = c;
+        num_client_tids = n;
+    }
+    t->next = client_tids[t->fd];
+    if (t->next)
+        t->next->prev = &t->next;
+    t->prev = &client_tids[t->fd];
+    client_tids[t->fd] = t;
+}
+
 struct tid_list *tidlist_add_tid(uint16_t tid, uint16_t addr, int type, int fd) {
     struct tid_list *t;
 
@@ -144,23 +226,28 @@ struct tid_list *tidlist_add_tid(uint16_t tid, uint16_t addr, int type, int fd)
         return t;
     }
     
-    t = malloc(sizeof *t);
-    t->next = tids;
-    tids = t;
+    t = xmalloc(sizeof *t);
+    tid_table[tid] = t;
     num_tids++;
     t->addr = addr;
     t->tid = tid;
     t->type = type;
     t->fd = fd;
+    t->live_shards = 0;
+    link_client_tid(t);
     gettimeofday(&t->timestamp, NULL);
     if (t->type == TRANS_TYPE_TASK)
         print_all_tids();
     return t;
 }
 
-void rem_tid(struct tid_list **t) {
-    struct tid_list *dead = *t;
-    *t = dead->next;
+void rem_tid(struct tid_list *dead) {
+    tid_table[dead->tid] = NULL;
+    if (dead->prev) {
+        *dead->prev = dead->next;
+        if (dead->next)
+            dead->next->prev = dead->prev;
+    }
     num_tids--;
     //close(dead->fd);  // do not close client fd. we might have other tids
     if (dead->type == TRANS_TYPE_TASK)
@@ -172,18 +259,20 @@ void rem_tid(struct tid_list **t) {
  * This function sends close/delete/stop command for all tid
  * - should becareful not to stop the stopping command (infinit loop).
  * - this is called by 'client.c' when a client disconnects.
+ * Only the tids of 'client_fd' are visited.
  **/
 void close_all_tid_for_a_client(int client_fd) {
-    struct tid_list **t;
-    for (t = &tids; *t; ) {
-        if ((client_fd == (*t)->fd) && 
-            (((*t)->type == TRANS_TYPE_TASK) || ((*t)->type == TRANS_TYPE_CLOSE))) {
-            (*t)->type = TRANS_TYPE_NULL;   // will be removed below...
-            tr_send_close_task((*t)->tid, (*t)->addr);
-            close_transport_connections((*t)->tid);
-            rem_tid(t); // removing will move t to next ptr
-        } else {
-            t = &((*t)->next);
+    struct tid_list *t, *next;
+
+    if ((client_fd < 0) || (client_fd >= num_client_tids))
+        return;
+    for (t = client_tids[client_fd]; t; t = next) {
+        next = t->next;
+        if ((t->type == TRANS_TYPE_TASK) || (t->type == TRANS_TYPE_CLOSE)) {
+            t->type = TRANS_TYPE_NULL;   // will be removed below...
+            tr_send_close_task(t->tid, t->addr);
+            close_transport_connections(t->tid);
+            rem_tid(t);
         }
     }
     print_all_tids();
@@ -192,54 +281,38 @@ void close_all_tid_for_a_client(int client_fd) {
 void print_all_tids() {
     pstatus();
     #ifdef DEBUG_TIDLIST
-        struct tid_list *t;
-        for (t = tids; t; t = t->next) {
-            printf("[tid_list]: tid=%d, addr=%d\n", t->tid, t->addr);
+        int i;
+        for (i = 0; i <= ALL_TID; i++) {
+            if (tid_table[i])
+                printf("[tid_list]: tid=%d, addr=%d\n", tid_table[i]->tid, tid_table[i]->addr);
         }
     #endif
 }
 
-struct tid_list ** _find_tid(uint16_t tid) {
-    struct tid_list **t;
-    for (t = &tids; *t; ) {
-        if ((*t)->tid == tid)
-            return t;
-        else
-            t = &((*t)->next);
-    }
-    return NULL;    // Error, not found
-}
-
 struct tid_list * tidlist_find_tid(uint16_t tid) {
-    struct tid_list **t;
-    t = _find_tid(tid);
-    if (t)
-        return (*t);
-    return NULL;
+    return tid_table[tid];
 }
 
 void tidlist_remove_tid(uint16_t tid) {
-    struct tid_list **t;
-    t = _find_tid(tid);
+    struct tid_list *t = tid_table[tid];
     if (t)
         rem_tid(t);
 }
 
 int find_client_fd(uint16_t tid) {
-    struct tid_list **t;
-    t = _find_tid(tid);
+    struct tid_list *t = tid_table[tid];
     if (t)
-        return (*t)->fd;
+        return t->fd;
     else
         return -1;  // Error, not found
 }
 
-int send_to_tid(const void *packet, int len, uint16_t tid, uint16_t addr) {
+int send_to_tidv(const struct iovec *iov, int iovcnt, uint16_t tid, uint16_t addr) {
     int ok;
     int fd = find_client_fd(tid);
 
     if (tid == ALL_TID) {
-        dispatch_packet(packet, len);
+        dispatch_packetv(iov, iovcnt);
         return 0;
     } else if (fd < 0) {
         #ifdef DEBUG_TIDLIST
@@ -249,7 +322,7 @@ int send_to_tid(const void *packet, int len, uint16_t tid, uint16_t addr) {
         return -1;
     }
     
-    ok = write_tr_packet(fd, packet, len);
+    ok = write_tr_packetv(fd, iov, iovcnt);
     
     if (ok < 0) {
         tidlist_remove_tid(tid);
@@ -263,6 +336,14 @@ int send_to_tid(const void *packet, int len, uint16_t tid, uint16_t addr) {
     return 0;
 }
 
+int send_to_tid(const void *packet, int len, uint16_t tid, uint16_t addr) {
+    struct iovec iov;
+
+    iov.iov_base = (void *)packet;
+    iov.iov_len = len;
+    return send_to_tidv(&iov, 1, tid, addr);
+}
+
 int tidlist_num_tids() {
     return num_tids;
 }
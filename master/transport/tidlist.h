@@ -50,6 +50,7 @@
 #define _TID_LIST_H_
 
 #include <sys/types.h>
+#include <sys/uio.h>
 #include "timeval.h"
 #include "transport.h"
 
@@ -58,6 +59,7 @@
 #define MIN_TID 1
 
 #define TID_LOGFILE  ".tenettid"
+#define TID_RESERVE_BLOCK 100   // tids handed out per write of TID_LOGFILE
 
 
 /*************************************************
@@ -75,6 +77,7 @@ struct tid_list *tidlist_add_tid(uint16_t tid, uint16_t addr, int type, int fd);
 struct tid_list *tidlist_find_tid(uint16_t tid);
 void tidlist_remove_tid(uint16_t tid);
 int send_to_tid(const void *packet, int len, uint16_t tid, uint16_t addr);
+int send_to_tidv(const struct iovec *iov, int iovcnt, uint16_t tid, uint16_t addr);
 void close_all_tid_for_a_client(int client_fd);
 int tidlist_num_tids();
 
@@ -83,11 +86,13 @@ int tidlist_num_tids();
    Data structure
 *************************************************/
 struct tid_list {
-    struct tid_list *next;  // linked list pointer
+    struct tid_list *next;  // next tid of the same client (fd)
+    struct tid_list **prev; // link to this one in the list of its client
     uint16_t tid;              // tid of this transactions
     uint16_t addr;          // destination address, usually the target mote
     int type;               // type of transaction: TRANS_TYPE
     int fd;                 // fd of the client that created this transaction
+    int live_shards;        // while closing: shards that may have connections of tid
     struct timeval timestamp;
 };
 
@@ -55,23 +55,31 @@
 void *read_transport_msg(int tr_fd, int *len, uint8_t *tr_type, uint16_t *tid, uint16_t *addr, void **payload) {
     int len2;
     unsigned char *packet = (unsigned char *)read_tr_packet(tr_fd, &len2); // free at bottom
-    tr_if_msg_t *tifMsg = (tr_if_msg_t *) packet;
-    int datalen = len2 - offsetof(tr_if_msg_t, data);
 
     if (!packet)
         return NULL;
-    if (datalen < 0) {
-        printf("datalen < 0.... must be a bug\n");
+    if (parse_transport_msg(packet, len2, len, tr_type, tid, addr, payload) < 0) {
         free((void *)packet);
         return NULL;
     }
+    return packet;
+}
+
+int parse_transport_msg(void *packet, int len2, int *len, uint8_t *tr_type, uint16_t *tid, uint16_t *addr, void **payload) {
+    tr_if_msg_t *tifMsg = (tr_if_msg_t *) packet;
+    int datalen = len2 - offsetof(tr_if_msg_t, data);
+
+    if (datalen < 0) {
+        printf("datalen < 0.... must be a bug\n");
+        return -1;
+    }
 
     *payload = tifMsg->data;
     *len = datalen;
     *tr_type = tifMsg->type;
     *tid = tifMsg->tid;
     *addr = tifMsg->addr;
-    return packet;
+    return 0;
 }
 
 /**
@@ -80,29 +88,26 @@ void *read_transport_msg(int tr_fd, int *len, uint8_t *tr_type, uint16_t *tid, u
 int write_transport_msg(int tr_fd, uint8_t *msg, int len, int tr_type, uint16_t tid, uint16_t addr) {
     // 'msg' is what you want to send to the mote, above transport layer.
     // 'msg' should be the payload of transport layer packet.
-    uint8_t *packet;
-    tr_if_msg_t *tifMsg;
+    tr_if_msg_t tifMsg;
+    struct iovec iov[2];
     int ok;
 
-    packet = (uint8_t *)malloc(len + offsetof(tr_if_msg_t, data));
-
-    tifMsg = (tr_if_msg_t *) packet;
-    tifMsg->type = tr_type;
-    tifMsg->tid = tid;
-    tifMsg->addr = addr;    
-    if ((len > 0) && (msg))
-        memcpy((uint8_t *)tifMsg->data, msg, len);
-    len = len + offsetof(tr_if_msg_t, data);
+    tifMsg.type = tr_type;
+    tifMsg.tid = tid;
+    tifMsg.addr = addr;
+    tifMsg.pad = 0;
+    iov[0].iov_base = &tifMsg;
+    iov[0].iov_len = offsetof(tr_if_msg_t, data);
+    iov[1].iov_base = msg;
+    iov[1].iov_len = ((len > 0) && (msg)) ? len : 0;
 
-    ok = write_tr_packet(tr_fd, packet, len);
-    //dump_packet(packet, len);
+    ok = write_tr_packetv(tr_fd, iov, 2);
     if (ok < 0) {
         fprintf(stderr, "Note: possible socket error within write_transport_msg\n");
         exit(2);
     }
     if (ok > 0)
         fprintf(stderr, "Note: write failed within write_transport_msg\n");
-    free((void *)packet);
     return ok;
 }
 
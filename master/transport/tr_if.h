@@ -93,6 +93,13 @@ int write_transport_msg(int fd, uint8_t *msg, int len, int type, uint16_t tid, u
  **/
 void *read_transport_msg(int fd, int *len, uint8_t *type, uint16_t *tid, uint16_t *addr, void **payload);
 
+/**
+ * 'parse_transport_msg' does the same for a packet that has been read
+ * already (e.g. a frame of 'tr_reader_frame'); it returns -1 if the
+ * packet is too short.
+ **/
+int parse_transport_msg(void *packet, int len2, int *len, uint8_t *type, uint16_t *tid, uint16_t *addr, void **payload);
+
 
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -60,6 +60,7 @@
 #include <sys/time.h>
 #include <stddef.h>
 #include <limits.h>
+#include <pthread.h>
 
 #include "transportmain.h"
 #include "trsource.h"
@@ -70,14 +71,17 @@
 #include "tidlist.h"
 #include "tosmsg.h"
 #include "sfsource.h"
+#include "shmsource.h"
 #include "tcmp.h"
 #include "client.h"
 #include "tr_if.h"
 #include "packettransport.h"
 #include "streamtransport.h"
 #include "rcrtransport.h"
+#include "shard.h"
 #include "trd_transport.h"
 #include "Network.h"
+#include "eventloop.h"
 
 #include "tenet_task.h" // from 'mote/lib/'
 
@@ -90,6 +94,9 @@ char *router_host; /* the host name where the router program will reside */
 char *transport_dir;
 char rhostbuf[100];
 int router_port;   /* the port number which the router program will open */
+int use_shm = 1;   /* use shared memory if the router is on this host */
+int rt_shm = 0;    /* rt_fd is the shared-memory channel, not a socket */
+int tcp_cork = 0;  /* cork the clients while a batch from the router is served */
 
 
 extern struct client_list *clients; /* list of client applications 
@@ -120,6 +127,8 @@ FILE *outfptr;
 char *outfilename = "tr_log.out";
 #endif
 
+#define INIT_POLL_INTERVAL 50     // ms, between checks for the end of TRD init
+
 int ready_to_task = 0;
 int autoclose = 1;
 
@@ -141,9 +150,7 @@ void sig_int_handler(int signo) {
     fprintf(stderr, "transport terminating... (closing all tasks/tid/clients)\n");
     tidlist_terminate();
     rem_client_list();
-    packettransport_terminate();
-    streamtransport_terminate();
-    rcrtransport_terminate();
+    shard_stop();   // the protocols terminate on their own threads
     exit(1);
 }
 
@@ -159,17 +166,13 @@ int tr_send_packet(uint16_t tid, uint16_t addr, unsigned char *packet, int len)
             if (verbosemode) printf("trd_send... OK ! (tid %d seqno %d)\n", tid, seqno);
         }
     } else { // if unicast, send using packet transport
-        int cid = packettransport_send(tid, addr, len, packet);
-        if (cid < 0) {
-            printf("tr_send_packet: failed. (tid %d, addr %d)\n", tid, addr);
-            fflush(stdout);
-            return -1;
-        } else {
-            if (verbosemode) printf("ptr_send... OK ! (tid %d addr %d)\n", tid, addr);
-            /* Although the unicast tasking packet has been sent via packet transport,
-               we cannot be sure whether the delivery is successful or not. */
-            return 2;
-        }
+        /* packet transport sends it on its own thread, and tells us how it
+           went through senddone_packettransport, a failure to send included */
+        shard_job(SHARD_PTR, SHARD_JOB_SEND, tid, addr, 0, 0, len, packet);
+        if (verbosemode) printf("ptr_send... OK ! (tid %d addr %d)\n", tid, addr);
+        /* Although the unicast tasking packet has been sent via packet transport,
+           we cannot be sure whether the delivery is successful or not. */
+        return 2;
     }
     return 1;
 }
@@ -206,47 +209,42 @@ int tr_send_close_task(uint16_t tid, uint16_t addr) {
  **/
 void send_toApp(const void *msg, int len, uint8_t type, uint16_t tid, uint16_t addr) {
     // 'len' is the total length of 'msg'
-    // 'msg' does not have TransportIfHdr yet. We'll put it here
-    int length = len + offsetof(tr_if_msg_t, data);
-    unsigned char *packet = (unsigned char *) malloc(length);
-    tr_if_msg_t *appmsg = (tr_if_msg_t *) packet;
-
-    appmsg->type = type;
-    appmsg->tid = tid;
-    appmsg->addr = addr;
-    if ((len > 0) && (msg))
-        memcpy(appmsg->data, msg, len);
+    // 'msg' does not have TransportIfHdr yet. It goes out ahead of 'msg'
+    tr_if_msg_t appmsg;
+    struct iovec iov[2];
+
+    appmsg.type = type;
+    appmsg.tid = tid;
+    appmsg.addr = addr;
+    appmsg.pad = 0;
+    iov[0].iov_base = &appmsg;
+    iov[0].iov_len = offsetof(tr_if_msg_t, data);
+    iov[1].iov_base = (void *)msg;
+    iov[1].iov_len = ((len > 0) && (msg)) ? len : 0;
 
     // send to a client associated with 'tid'
     if (tid == ALL_TID)
-        dispatch_packet(packet, length);
+        dispatch_packetv(iov, 2);
     else
-        send_to_tid(packet, length, tid, addr);
-    free((void *)packet);
+        send_to_tidv(iov, 2, tid, addr);
 }
 
+/* each protocol answers with SHARD_EV_CLOSED, once it has deleted them */
 void close_transport_connections(uint16_t tid) {
-    packettransport_delete_tid(tid);
-    streamtransport_delete_tid(tid);
-    rcrtransport_delete_tid(tid);
-}
-
-    int check_transport_connections(uint16_t tid) {
-        if (packettransport_tid_is_alive(tid))
-            return 1;
-        if (streamtransport_tid_is_alive(tid))
-            return 1;
-        if (rcrtransport_tid_is_alive(tid))
-            return 1;
-        return 0;
-    }
+    shard_job(SHARD_PTR, SHARD_JOB_DELETE_TID, tid, 0, 0, 0, 0, NULL);
+    shard_job(SHARD_STR, SHARD_JOB_DELETE_TID, tid, 0, 0, 0, 0, NULL);
+    shard_job(SHARD_RCRT, SHARD_JOB_DELETE_TID, tid, 0, 0, 0, 0, NULL);
+}
+
+/* as the protocols last told us (see deliver_event in shard.c) */
+int check_transport_connections(uint16_t tid) {
+    struct tid_list *t = tidlist_find_tid(tid);
+    return (t != NULL) && (t->live_shards != 0);
+}
 
 void check_close_done(uint16_t tid) {
     struct tid_list *t = tidlist_find_tid(tid);
-    if (t == NULL) return;
-    if (t->type != TRANS_TYPE_CLOSE) {
-        printf("check for buggggggggggggggg\n");
-    }
+    if ((t == NULL) || (t->type != TRANS_TYPE_CLOSE)) return;
     if (check_transport_connections(tid) == 0) {
         if (verbosemode) printf("check close done...\n");
         send_toApp(NULL, 0, TRANS_TYPE_CLOSE_ACK, tid, t->addr);
@@ -256,98 +254,98 @@ void check_close_done(uint16_t tid) {
 }
 
 /* We have received a packet from a client application */
-void check_clients(fd_set *fds) {
-    struct client_list **c;
-    unsigned char *packet;
+void client_msg(int fd, void *packet, int len2) {
     int len;
     uint16_t tid, addr;
     uint8_t type;
     struct tid_list *t;
     int ok;
+    void *payload = NULL;
+
+    if (parse_transport_msg(packet, len2, &len, &type, &tid, &addr, &payload) < 0)
+        return;
+
+    printf("from client: tid %d, addr %d, type %d, len %d:\n", tid, addr, type, len);
+#ifdef DEBUG_TOSMSG
+    fdump_packet(stdout, payload, len);
+#endif
 
-    for (c = &clients; *c; ) {
-        int next = 1;
-
-        if (FD_ISSET((*c)->fd, fds)) {
-            void *payload = NULL;
-            packet = read_transport_msg((*c)->fd, &len, &type, &tid, &addr, &payload);
-
-            if (packet) {
-
-                printf("from client: tid %d, addr %d, type %d, len %d:\n", tid, addr, type, len);
-            #ifdef DEBUG_TOSMSG
-                fdump_packet(stdout, payload, len);
-            #endif
-
-                switch (type) {
-
-                    /* a new task has been requested to be sent */
-                    case (TRANS_TYPE_TASK):
-                        tid = assign_new_tid(0); // assign new tid
-                        t = tidlist_add_tid(tid, addr, type, (*c)->fd);
-
-                        /* If you use SEND_TASK to send DELETE TASK,
-                           the binding will not be deleted.  Don't do that!!! */
-                        ok = tr_send_packet(tid, addr, payload, len);
-                        if (ok < 0) {
-                            send_toApp(NULL, 0, TRANS_TYPE_CMD_NACK, tid, addr);    // NACK - failed
-                            tidlist_remove_tid(tid);    // remove (don't need anymore)
-                        } else {
-                            if (addr == TOS_BCAST_ADDR) // sent using TRD
-                                send_toApp(NULL, 0, TRANS_TYPE_CMD_ACK, tid, addr);
-                            /* Since packet transport (unicast) awaits for acknowledgement,
-                               we return 'RETURN', not ACK nor NACK. */
-                            else
-                                send_toApp(NULL, 0, TRANS_TYPE_CMD_RETURN, tid, addr);
-                        }
-                        break;
-
-                    case (TRANS_TYPE_CLOSE):
-                        t = tidlist_find_tid(tid);
-                        if (t) {
-                            t->type = TRANS_TYPE_CLOSE; // close pending
-                            tr_send_close_task(tid, addr); // send close/delete task
-                            close_transport_connections(tid);
-                            check_close_done(tid);
-                        }
-                        break;
-
-                        /* special services... might be deprecated later */
-                    case (TRANS_TYPE_SERVICE):
-                        tid = assign_new_tid(0);
-                        t = tidlist_add_tid(tid, TOS_LOCAL_ADDRESS(), type, (*c)->fd);
-                        service_send_request(rt_fd, tid, len, payload);
-                        break;
-
-                    case (TRANS_TYPE_PING):
-                        tid = assign_new_tid(0);
-                        t = tidlist_add_tid(tid, addr, type, (*c)->fd);
-                        TCMP_send_ping(tid, addr);
-                        break;
-
-                    case (TRANS_TYPE_TRACERT):
-                        tid = assign_new_tid(0);
-                        t = tidlist_add_tid(tid, addr, type, (*c)->fd);
-                        TCMP_send_tracert(tid, addr);
-                        break;
-
-                    case (TRANS_TYPE_SNOOP):
-                        t = tidlist_add_tid(ALL_TID, TOS_BCAST_ADDR, type, (*c)->fd);
-                        break;
-
-                    default:
-                        printf( "  check_client: unidentified type app pkt detected\n");
-                }// End of switch
-
-                free((void *)packet);
+    switch (type) {
+
+        /* a new task has been requested to be sent */
+        case (TRANS_TYPE_TASK):
+            tid = assign_new_tid(0); // assign new tid
+            t = tidlist_add_tid(tid, addr, type, fd);
+
+            /* If you use SEND_TASK to send DELETE TASK,
+               the binding will not be deleted.  Don't do that!!! */
+            ok = tr_send_packet(tid, addr, payload, len);
+            if (ok < 0) {
+                send_toApp(NULL, 0, TRANS_TYPE_CMD_NACK, tid, addr);    // NACK - failed
+                tidlist_remove_tid(tid);    // remove (don't need anymore)
             } else {
-                rem_client(c);
-                next = 0;
+                if (addr == TOS_BCAST_ADDR) // sent using TRD
+                    send_toApp(NULL, 0, TRANS_TYPE_CMD_ACK, tid, addr);
+                /* Since packet transport (unicast) awaits for acknowledgement,
+                   we return 'RETURN', not ACK nor NACK. */
+                else
+                    send_toApp(NULL, 0, TRANS_TYPE_CMD_RETURN, tid, addr);
             }
-        }
-        if (next)
-            c = &(*c)->next;
+            break;
+
+        case (TRANS_TYPE_CLOSE):
+            t = tidlist_find_tid(tid);
+            if (t) {
+                t->type = TRANS_TYPE_CLOSE; // close pending
+                t->live_shards = SHARDS_WITH_CONNECTIONS; // until they say otherwise
+                tr_send_close_task(tid, addr); // send close/delete task
+                close_transport_connections(tid); // check_close_done once they are closed
+            }
+            break;
+
+            /* special services... might be deprecated later */
+        case (TRANS_TYPE_SERVICE):
+            tid = assign_new_tid(0);
+            t = tidlist_add_tid(tid, TOS_LOCAL_ADDRESS(), type, fd);
+            service_send_request(rt_fd, tid, len, payload);
+            break;
+
+        case (TRANS_TYPE_PING):
+            tid = assign_new_tid(0);
+            t = tidlist_add_tid(tid, addr, type, fd);
+            shard_job(SHARD_TCMP, SHARD_JOB_PING, tid, addr, 0, 0, 0, NULL);
+            break;
+
+        case (TRANS_TYPE_TRACERT):
+            tid = assign_new_tid(0);
+            t = tidlist_add_tid(tid, addr, type, fd);
+            shard_job(SHARD_TCMP, SHARD_JOB_TRACERT, tid, addr, 0, 0, 0, NULL);
+            break;
+
+        case (TRANS_TYPE_SNOOP):
+            t = tidlist_add_tid(ALL_TID, TOS_BCAST_ADDR, type, fd);
+            break;
+
+        default:
+            printf( "  check_client: unidentified type app pkt detected\n");
+    }// End of switch
+}
+
+/* A client socket is readable: serve every packet of one read */
+void check_client(int fd, void *arg) {
+    void *packet;
+    int len;
+
+    if (tr_reader_fill(fd) <= 0) {
+        struct client_list **c = find_client(fd);
+        if (c)
+            rem_client(c);
+        return;
     }
+
+    /* stops as well if the client is removed meanwhile (its reader goes) */
+    while ((packet = tr_reader_frame(fd, &len)) != NULL)
+        client_msg(fd, packet, len);
 }
 
 void check_init() {
@@ -359,7 +357,9 @@ void check_init() {
 
         // Write PID file. Added by Ki-Young Jang
         {
-            int pid = fork();
+            int pid;
+            shard_pause();  // fork() only takes this thread along
+            pid = fork();
             if (pid) {
                 char pStr[256];
                 char pOut[256];
@@ -368,67 +368,97 @@ void check_init() {
                 system( pOut );
                 exit(0);
             }
+            shard_resume();
         }
     }
 }
 
-void check_router(void) {   // a packet came from below (router or serial_forwarder)
-    int len;
-    unsigned char *packet = read_sf_packet(rt_fd, &len);// read from the router 
-
-    if (packet) {
-        TOS_Msg *msg = (TOS_Msg*)packet;
+void receive_router_packet(unsigned char *packet, int len) {
+    TOS_Msg *msg = (TOS_Msg*)packet;
 
 #ifdef DEBUG_TOSMSG
-        printf("from router: ");
-        fdump_packet(stdout, packet, len);
+    printf("from router: ");
+    fdump_packet(stdout, packet, len);
 #endif
-        packets_read++;
+    packets_read++;
 #ifdef LOG_INCOMING 
-        struct timeval tv;
-        gettimeofday(&tv, NULL);
-        fprintf(infptr, "%06ld.%03ld ",tv.tv_sec, tv.tv_usec/1000);
-        fdump_packet(infptr, packet, len);
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    fprintf(infptr, "%06ld.%03ld ",tv.tv_sec, tv.tv_usec/1000);
+    fdump_packet(infptr, packet, len);
 #endif
-        if (msg->type == AM_BS_SERVICE) { // service packet
-            service_receive_response(len, (uint8_t *)msg->data);
-        }
-        else if (is_trd_transport_packet(len, packet)) { // TRD packet
-            trd_transport_receive(len, packet);
+    if (msg->type == AM_BS_SERVICE) { // service packet
+        service_receive_response(len, (uint8_t *)msg->data);
+    }
+    else if (is_trd_transport_packet(len, packet)) { // TRD packet
+        trd_transport_receive(len, packet);
+    }
+    else if (msg->type == AM_COL_DATA) {
+        uint16_t srcAddr, dstAddr, prevhop;
+        uint8_t protocol, ttl;
+        int paylen;
+        // TOS header and routing header are both removed in rt_payload.
+        unsigned char *rt_payload = read_collection_msg(len, packet, &paylen,
+                &srcAddr, &dstAddr, &prevhop, &protocol, &ttl);
+        protocol = protocol & PROTOCOL_MASK;
+        if ((rt_payload == NULL) || (paylen <= 0)) {
+            // INVALID PACKET
+        } 
+        else if (protocol == PROTOCOL_PACKET_TRANSPORT) {
+            shard_job(SHARD_PTR, SHARD_JOB_RECEIVE, 0, srcAddr, dstAddr, ttl, paylen, rt_payload);
+        } 
+        else if (protocol == PROTOCOL_STREAM_TRANSPORT) {
+            shard_job(SHARD_STR, SHARD_JOB_RECEIVE, 0, srcAddr, dstAddr, ttl, paylen, rt_payload);
+        } 
+        else if (protocol == PROTOCOL_RCR_TRANSPORT) {
+            shard_job(SHARD_RCRT, SHARD_JOB_RECEIVE, 0, srcAddr, dstAddr, ttl, paylen, rt_payload);
+        } 
+        else if (protocol == PROTOCOL_TCMP) {
+            shard_job(SHARD_TCMP, SHARD_JOB_RECEIVE, 0, srcAddr, dstAddr, ttl, paylen, rt_payload);
         }
-        else if (msg->type == AM_COL_DATA) {
-            uint16_t srcAddr, dstAddr, prevhop;
-            uint8_t protocol, ttl;
-            int paylen;
-            // TOS header and routing header are both removed in rt_payload.
-            unsigned char *rt_payload = read_collection_msg(len, packet, &paylen,
-                    &srcAddr, &dstAddr, &prevhop, &protocol, &ttl);
-            protocol = protocol & PROTOCOL_MASK;
-            if ((rt_payload == NULL) || (paylen <= 0)) {
-                // INVALID PACKET
-            } 
-            else if (protocol == PROTOCOL_PACKET_TRANSPORT) {
-                packettransport_receive(paylen, rt_payload, srcAddr);
-            } 
-            else if (protocol == PROTOCOL_STREAM_TRANSPORT) {
-                streamtransport_receive(paylen, rt_payload, srcAddr);
-            } 
-            else if (protocol == PROTOCOL_RCR_TRANSPORT) {
-                rcrtransport_receive(paylen, rt_payload, srcAddr);
-            } 
-            else if (protocol == PROTOCOL_TCMP) {
-                TCMP_receive(paylen, rt_payload, srcAddr, dstAddr, ttl);
+    } else if (msg->type == 100) { // printf message packet
+        printf("PRINT: %s", (char*)msg->data);
+    } else if (msg->type == AM_COL_BEACON) {
+        //printf("Collection Beacon Received\n");
+    } else {
+        printf("unidentified packet (AM=%d) received at transport layer\n", msg->type);
+        //dump_packet(packet, len);
+    }
+}
+
+void check_router(int fd, void *arg) {   // a packet came from below (router or serial_forwarder)
+    int len;
+    unsigned char *packet;
+
+    if (tcp_cork)
+        cork_clients(1);
+
+    if (rt_shm) {
+        unsigned char buf[MAX_SHM_PACKET_LEN];
+        int budget = MAX_SHM_PACKETS_PER_CHECK;
+
+        drain_shm_source();
+        do {
+            while ((budget > 0) && ((len = read_shm_packet(buf, sizeof(buf))) > 0)) {
+                receive_router_packet(buf, len);
+                budget--;
             }
-        } else if (msg->type == 100) { // printf message packet
-            printf("PRINT: %s", (char*)msg->data);
-        } else if (msg->type == AM_COL_BEACON) {
-            //printf("Collection Beacon Received\n");
-        } else {
-            printf("unidentified packet (AM=%d) received at transport layer\n", msg->type);
-            //dump_packet(packet, len);
+            if (budget == 0) { // come back after serving the clients
+                wake_shm_source();
+                break;
+            }
+        } while (!sleep_shm_source());
+    } else {
+        if (tr_reader_fill(rt_fd) <= 0) { // the router is gone
+            fprintf(stderr, "Lost the router\n");
+            sig_int_handler(SIGTERM);
         }
-        free((void *)packet);
+        while ((packet = tr_reader_frame(rt_fd, &len)) != NULL) // read from the router
+            receive_router_packet(packet, len);
     }
+
+    if (tcp_cork)
+        cork_clients(0);
 }
 
 void print_intro() {
@@ -453,6 +483,7 @@ void print_usage(char *arg0) {
     printf("       -f <tid_filename> : set the filename for tid file\n");
     printf("       -t <rcrt setting> : set the setting # for rcrt\n");
     printf("       -c                : do not send delete task automatically\n");
+    printf("       -m                : use TCP even if the router is on this host\n");
 }
 
 void parse_argv(int argc, char **argv) {
@@ -484,6 +515,8 @@ void parse_argv(int argc, char **argv) {
     tmp = getenv("TENET_ROUTER_HOST");
     if (tmp) router_host = tmp;
     else router_host = DEFAULT_ROUTER_HOST;
+    tmp = getenv("TENET_TCP_CORK");
+    if (tmp) tcp_cork = atoi(tmp);
 
     /* Check for options passed through arguments */
     for (ind = first_ind; ind < argc; ind++) {
@@ -524,6 +557,9 @@ void parse_argv(int argc, char **argv) {
                 case 'c':
                     autoclose = 0;
                     break;
+                case 'm':
+                    use_shm = 0;
+                    break;
                 default :
                     printf("Unknown switch '%c'\n", argv[ind][1]);
                     print_usage(argv[0]);
@@ -565,7 +601,45 @@ void parse_argv(int argc, char **argv) {
     tid_filename = tid_filebuf;
 }
 
+/* Is the router at 'host' running on this machine? */
+int is_local_host(const char *host) {
+    struct hostent *entry = gethostbyname(host);
+    uint32_t addr;
+
+    if (!entry || entry->h_addrtype != AF_INET)
+        return 0;
+    memcpy(&addr, entry->h_addr, sizeof(addr));
+
+    if ((ntohl(addr) >> 24) == 127)
+        return 1;
+    return (GetAddress("", CHECK, addr) == addr);
+}
+
+/* the shards send to the router as well as this thread, one packet at a time */
+int write_router_packet(int fd, const void *packet, int len) {
+    static pthread_mutex_t router_lock = PTHREAD_MUTEX_INITIALIZER;
+    int ok;
+
+    pthread_mutex_lock(&router_lock);
+    if (rt_shm)
+        ok = write_shm_packet(fd, packet, len);
+    else
+        ok = write_sf_packet(fd, packet, len);
+    pthread_mutex_unlock(&router_lock);
+    return ok;
+}
+
 void open_router(const char *host, int port) {
+    /* a router on this host is reached over shared memory, if it offers it */
+    if (use_shm && is_local_host(host)) {
+        rt_fd = open_shm_source(port);
+        if (rt_fd >= 0) {
+            rt_shm = 1;
+            set_TOS_Msg_writer(rt_fd, write_router_packet);
+            return;
+        }
+    }
+
     /* open a TCP socket to the router program using 'sf' protocol. */
     rt_fd = open_sf_source(host, port);
     if (rt_fd < 0) {
@@ -573,6 +647,8 @@ void open_router(const char *host, int port) {
         print_usage("transport");
         exit(1);
     }
+    tr_reader_open(rt_fd, 1);   // sf framing
+    set_TOS_Msg_writer(rt_fd, write_router_packet);
 }
 
 void initialize_transport() {
@@ -596,7 +672,11 @@ void initialize_transport() {
     printf("[ENV] TENET_TRANSPORT_PORT (FOR APPLICATION) : %d\n", tr_server_port);
     printf("[ENV] TENET_ROUTER_HOST                      : %s\n", router_host);
     printf("[ENV] TENET_ROUTER_PORT                      : %d\n", router_port);
+    printf("[ENV] TENET ROUTER CHANNEL                   : %s\n", rt_shm ? "shared memory" : "TCP");
     printf("[ENV] TENET_LOCAL_ADDRESS                    : %d\n", LOCAL_ADDRESS);
+    printf("[ENV] TENET_TCP_NODELAY                      : %s\n",
+            (getenv("TENET_TCP_NODELAY") && atoi(getenv("TENET_TCP_NODELAY"))) ? "on" : "off");
+    printf("[ENV] TENET_TCP_CORK                         : %s\n", tcp_cork ? "on" : "off");
     printf("[ENV] TENET NEXT LOCAL TID                   : %d\n", tidlist_init());
 #if defined(LOG_INCOMING)
     printf("[ENV] LOG FILE INCOMING                      : %s\n", infilename);
@@ -612,62 +692,37 @@ void initialize_transport() {
     //    base_id_request(rt_fd);
 }
 
-void check_timer() {
-    /* Check/poll any piece of program which requires timer events */
-    polling_packettransport_timer();
-    polling_streamtransport_timer();
-    polling_rcrtransport_timer();
-    polling_trd_transport_timer();
-    polling_tcmp_timer();
+/* until TRD is ready to send tasks */
+void init_timer_fired(void *arg) {
+    struct timer_event *t = (struct timer_event *)arg;
+    check_init();
+    if (!ready_to_task)
+        timer_start(t, INIT_POLL_INTERVAL);
 }
 
 int main(int argc, char **argv)
 {
-    int timeout = 0;
+    struct timer_event init_timer;
 
     print_intro();          /* print anything that looks great */
 
     parse_argv(argc, argv); /* parse command-line arguments/options */
 
-    initialize_transport(); /* initialize transport (socket, etc) */
-
-    for (;;)
-    {
-        fd_set rfds;
-        int maxfd = -1;
-        int ret;
-        struct timeval tv;
-
-        FD_ZERO(&rfds);
-        fd_wait(&rfds, &maxfd, rt_fd);
-        fd_wait(&rfds, &maxfd, server_socket);
-        wait_clients(&rfds, &maxfd);
-
-        tv.tv_sec = 0;
-        tv.tv_usec = 49000; // poll for timer events every 49ms
+    ev_init();
 
-        ret = select(maxfd + 1, &rfds, NULL, NULL, &tv);   // block
-
-        if (ret > 0) {
-            if (FD_ISSET(rt_fd, &rfds))
-                check_router();     /* received a packet from router (or sf) */
+    initialize_transport(); /* initialize transport (socket, etc) */
 
-            if (FD_ISSET(server_socket, &rfds))
-                check_new_client(); /* received new connection request from a client */
+    shard_init();           /* start the protocol threads */
 
-            check_clients(&rfds);   /* received a packet from a client. */
+    ev_add(rt_fd, check_router, NULL);             /* received a packet from router (or sf) */
+    ev_add(server_socket, check_new_client, NULL); /* received new connection request from a client */
+                                                   /* clients are added as they connect */
+    /* TRD keeps its timers in 'main_timers', the other protocols on their shards */
+    timer_init(&init_timer, &main_timers, init_timer_fired, &init_timer);
+    timer_start(&init_timer, INIT_POLL_INTERVAL);
 
-            if (++timeout > 9) {   /* for at least every 10 pkts, check the timer. */
-                timeout = 0;
-                check_timer();    // if polling is used
-            }
-        } 
-        else  if (ret == 0) {
-            timeout = 0;
-            check_timer();    // if polling is used
-            check_init();
-        }
-    }
+    ev_loop();
+    return 0;
 }
 
 
@@ -689,6 +744,8 @@ void receive_trd_transport(uint16_t tid, uint16_t addr, int len, unsigned char *
     send_toApp(msg, len, TRANS_TYPE_BCAST, tid, addr);
 }
 void receive_packettransport(uint16_t tid, uint16_t addr, int len, unsigned char *msg) {
+    if (shard_event(SHARD_EV_RESPONSE, tid, addr, len, msg, 0))
+        return; // on its thread; we are called again on the main thread
     /* We have received a packet through packettransport protocol with 'tid' from 'addr'.
        - send this UP to the application */
     send_toApp(msg, len, TRANS_TYPE_RESPONSE, tid, addr);
@@ -696,7 +753,10 @@ void receive_packettransport(uint16_t tid, uint16_t addr, int len, unsigned char
 void senddone_packettransport(uint16_t tid, uint16_t addr, int len, unsigned char *msg, int success) {
     /* We have received a packet transport ACK for the packet that we've sent out.
        - notify this event UP to the application (send_done event) */
-    struct tid_list *t = tidlist_find_tid(tid);
+    struct tid_list *t;
+    if (shard_event(SHARD_EV_SENDDONE, tid, addr, len, msg, success))
+        return;
+    t = tidlist_find_tid(tid);
     if (t == NULL) return;
     if (t->type == TRANS_TYPE_CLOSE) { // close transaction done
         check_close_done(tid);
@@ -708,21 +768,29 @@ void senddone_packettransport(uint16_t tid, uint16_t addr, int len, unsigned cha
     }
 }
 void receive_streamtransport(uint16_t tid, uint16_t addr, int len, unsigned char *msg) {
+    if (shard_event(SHARD_EV_RESPONSE, tid, addr, len, msg, 0))
+        return;
     /* We have received a packet through streamtransport protocol with 'tid' from 'addr'.
        - send this UP to the application */
     send_toApp(msg, len, TRANS_TYPE_RESPONSE, tid, addr);
 }
 void receive_rcrtransport(uint16_t tid, uint16_t addr, int len, unsigned char *msg) {
+    if (shard_event(SHARD_EV_RESPONSE, tid, addr, len, msg, 0))
+        return;
     /* We have received a packet through rcrtransport protocol with 'tid' from 'addr'.
        - send this UP to the application */
     send_toApp(msg, len, TRANS_TYPE_RESPONSE, tid, addr);
 }
 void receive_TCMP_ping_ack(uint16_t tid, uint16_t addr, int len, unsigned char *msg) {
+    if (shard_event(SHARD_EV_PING_ACK, tid, addr, len, msg, 0))
+        return;
     /* We have received a TCMP ping ack
        - send this UP to the application */
     send_toApp(msg, len, TRANS_TYPE_PING, tid, addr);
 }
 void receive_TCMP_tracert_ack(uint16_t tid, uint16_t addr, int len, unsigned char *msg) {
+    if (shard_event(SHARD_EV_TRACERT_ACK, tid, addr, len, msg, 0))
+        return;
     /* We have received a TCMP trace route ack
        - send this UP to the application */
     send_toApp(msg, len, TRANS_TYPE_TRACERT, tid, addr);
@@ -735,12 +803,23 @@ void receive_service_response(uint16_t tid, uint16_t addr, int len, unsigned cha
     send_toApp(msg, len, TRANS_TYPE_SERVICE, tid, addr);
 }
 void packettransport_tid_delete_done(uint16_t tid) {
+    if (shard_event(SHARD_EV_DELETE_DONE, tid, 0, 0, NULL, 0))
+        return;
     check_close_done(tid);
 }
 void streamtransport_tid_delete_done(uint16_t tid) {
+    if (shard_event(SHARD_EV_DELETE_DONE, tid, 0, 0, NULL, 0))
+        return;
     check_close_done(tid);
 }
 void rcrtransport_tid_delete_done(uint16_t tid) {
+    if (shard_event(SHARD_EV_DELETE_DONE, tid, 0, 0, NULL, 0))
+        return;
     check_close_done(tid);
 }
-
+void TCMP_done(uint16_t tid) {
+    /* TCMP is done with the ping or trace route of 'tid' */
+    if (shard_event(SHARD_EV_TCMP_DONE, tid, 0, 0, NULL, 0))
+        return;
+    tidlist_remove_tid(tid);
+}
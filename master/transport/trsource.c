@@ -1,6 +1,8 @@
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <netdb.h>
 #include <unistd.h>
 #include <errno.h>
@@ -84,6 +86,8 @@ int open_tr_source(const char *host, int port)
       return -1;
     }
 
+  tr_tune_socket(fd);
+
   return fd;
 }
 
@@ -119,6 +123,168 @@ int init_tr_source(int fd)
   return 0;
 }
 
+/* A buffered reader of one fd: frames are parsed out of buf[start..end) */
+struct tr_reader
+{
+  int hdrlen;		/* 2: tr framing, 1: sf framing */
+  unsigned char *buf;
+  int start, end, size;
+};
+
+static struct tr_reader **readers;	/* indexed by fd */
+static int num_readers;
+
+static struct tr_reader *get_reader(int fd)
+{
+  if (fd < 0 || fd >= num_readers)
+    return NULL;
+  return readers[fd];
+}
+
+int tr_reader_open(int fd, int hdrlen)
+/* Effects: attaches a buffered reader to fd, for frames with a hdrlen
+     byte (1 or 2) big-endian length
+   Returns: 0 if it is attached, -1 otherwise
+*/
+{
+  struct tr_reader *r;
+
+  if (fd < 0 || (hdrlen != 1 && hdrlen != 2))
+    return -1;
+
+  if (fd >= num_readers)
+    {
+      int n = num_readers ? num_readers : 64;
+      struct tr_reader **t;
+
+      while (n <= fd)
+	n *= 2;
+      t = realloc(readers, n * sizeof *t);
+      if (!t)
+	return -1;
+      memset(t + num_readers, 0, (n - num_readers) * sizeof *t);
+      readers = t;
+      num_readers = n;
+    }
+
+  tr_reader_close(fd);
+
+  r = malloc(sizeof *r);
+  if (!r)
+    return -1;
+  r->hdrlen = hdrlen;
+  r->size = TR_READER_SIZE;
+  r->start = r->end = 0;
+  r->buf = malloc(r->size);
+  if (!r->buf)
+    {
+      free(r);
+      return -1;
+    }
+  readers[fd] = r;
+
+  return 0;
+}
+
+void tr_reader_close(int fd)
+/* Effects: drops the reader of fd, and whatever it has buffered
+*/
+{
+  struct tr_reader *r = get_reader(fd);
+
+  if (r)
+    {
+      readers[fd] = NULL;
+      free(r->buf);
+      free(r);
+    }
+}
+
+/* length of the frame at the start of r's buffer, -1 if the header is
+   not in yet */
+static int frame_length(struct tr_reader *r)
+{
+  unsigned char *p = r->buf + r->start;
+
+  if (r->end - r->start < r->hdrlen)
+    return -1;
+  if (r->hdrlen == 1)
+    return p[0];
+  return (p[0] << 8) + p[1];
+}
+
+int tr_reader_fill(int fd)
+/* Effects: reads once from fd into its reader, as much as there is room
+     for
+   Returns: the number of bytes read, 0 at end of file, -1 for failure
+*/
+{
+  struct tr_reader *r = get_reader(fd);
+  int l, n;
+
+  if (!r)
+    return -1;
+
+  /* move what is left of the last read to the front */
+  if (r->start > 0)
+    {
+      memmove(r->buf, r->buf + r->start, r->end - r->start);
+      r->end -= r->start;
+      r->start = 0;
+    }
+
+  /* and make room for a frame larger than the buffer */
+  l = frame_length(r);
+  if (l >= 0 && r->hdrlen + l > r->size)
+    {
+      unsigned char *buf = realloc(r->buf, r->hdrlen + l);
+      if (!buf)
+	return -1;
+      r->buf = buf;
+      r->size = r->hdrlen + l;
+    }
+
+  for (;;)
+    {
+      n = read(fd, r->buf + r->end, r->size - r->end);
+      if (n == -1 && errno == EINTR)
+	continue;
+      break;
+    }
+  if (n > 0)
+    r->end += n;
+
+  return n;
+}
+
+void *tr_reader_frame(int fd, int *len)
+/* Effects: takes the next complete frame out of the reader of fd,
+     without reading from fd
+   Returns: the frame, which stays valid until the next fill of fd,
+     and *len is set to its length; or NULL if no complete frame is
+     buffered
+*/
+{
+  struct tr_reader *r = get_reader(fd);
+  unsigned char *frame;
+  int l;
+
+  if (!r)
+    return NULL;
+
+  l = frame_length(r);
+  if (l < 0 || r->end - r->start < r->hdrlen + l)
+    return NULL;
+
+  frame = r->buf + r->start + r->hdrlen;
+  r->start += r->hdrlen + l;
+  if (r->start == r->end)
+    r->start = r->end = 0;
+  *len = l;
+
+  return frame;
+}
+
 void *read_tr_packet(int fd, int *len)
 /* Effects: reads packet from serial forwarder on file descriptor fd
    Returns: the packet read (in newly allocated memory), and *len is
@@ -126,18 +292,32 @@ void *read_tr_packet(int fd, int *len)
 */
 {
   int l2;
-  unsigned char l;
+  unsigned char l[2];
   void *packet;
 
-  if (saferead2(fd, &l, 1) != 1)
-    return NULL;
+  if (get_reader(fd))
+    {
+      void *frame;
+
+      while (!(frame = tr_reader_frame(fd, &l2)))
+	if (tr_reader_fill(fd) <= 0)
+	  return NULL;
 
-  l2 = (l<<8);
+      packet = malloc(l2 ? l2 : 1);
+      if (!packet)
+	return NULL;
+      memcpy(packet, frame, l2);
+      *len = l2;
 
-  if (saferead2(fd, &l, 1) != 1)
+      return packet;
+    }
+
+  /* no reader: read no further than this packet, for callers that
+     select() on fd between packets */
+  if (saferead2(fd, l, 2) != 2)
     return NULL;
 
-  l2 += l;
+  l2 = (l[0] << 8) + l[1];
 
   packet = malloc(l2);
   if (!packet)
@@ -153,20 +333,101 @@ void *read_tr_packet(int fd, int *len)
   return packet;
 }
 
+int write_tr_packetv(int fd, const struct iovec *iov, int iovcnt)
+/* Effects: writes the packet made of the iovcnt pieces in iov, behind
+     its length, to serial forwarder on file descriptor fd, in one
+     writev() unless it is cut short
+   Returns: 0 if packet successfully written, -1 otherwise
+*/
+{
+  struct iovec v[TR_MAX_IOV + 1];
+  struct iovec *next = v;
+  unsigned char l[2];
+  int len = 0, n = 1, i;
+
+  if (iovcnt > TR_MAX_IOV)
+    return -1;
+
+  for (i = 0; i < iovcnt; i++)
+    if (iov[i].iov_len > 0)
+      {
+	v[n++] = iov[i];
+	len += iov[i].iov_len;
+      }
+  l[0] = len >> 8;
+  l[1] = len;
+  v[0].iov_base = l;
+  v[0].iov_len = 2;
+
+  while (n > 0)
+    {
+      ssize_t actual = writev(fd, next, n);
+
+      if (actual == -1 && errno == EINTR)
+	continue;
+      if (actual == -1)
+	return -1;
+
+      /* skip what went out, and carry on with the rest */
+      while (n > 0 && (size_t)actual >= next->iov_len)
+	{
+	  actual -= next->iov_len;
+	  next++;
+	  n--;
+	}
+      if (n > 0)
+	{
+	  next->iov_base = (char *)next->iov_base + actual;
+	  next->iov_len -= actual;
+	}
+    }
+
+  return 0;
+}
+
 int write_tr_packet(int fd, const void *packet, int len)
 /* Effects: writes len byte packet to serial forwarder on file descriptor
      fd
    Returns: 0 if packet successfully written, -1 otherwise
 */
 {
-  unsigned char l = (len>>8);
-  unsigned char l2 = len;
+  struct iovec iov;
 
-  if (safewrite2(fd, &l, 1) != 1 ||
-      safewrite2(fd, &l2, 1) != 1 ||
-      safewrite2(fd, packet, len) != len)
-    return -1;
+  iov.iov_base = (void *)packet;
+  iov.iov_len = len;
 
-  return 0;
+  return write_tr_packetv(fd, &iov, 1);
 }
 
+int tr_set_nodelay(int fd, int on)
+/* Effects: turns Nagle's algorithm off (on != 0) or back on for fd
+   Returns: 0 if it is set, -1 otherwise
+*/
+{
+  return setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof on);
+}
+
+int tr_set_cork(int fd, int on)
+/* Effects: holds back partial segments of fd while on != 0, and sends
+     what is held back when it is turned off again
+   Returns: 0 if it is set, -1 otherwise (or if the system has no cork)
+*/
+{
+#if defined(TCP_CORK)
+  return setsockopt(fd, IPPROTO_TCP, TCP_CORK, &on, sizeof on);
+#elif defined(TCP_NOPUSH)
+  return setsockopt(fd, IPPROTO_TCP, TCP_NOPUSH, &on, sizeof on);
+#else
+  return -1;
+#endif
+}
+
+void tr_tune_socket(int fd)
+/* Effects: sets TCP_NODELAY on fd if TENET_TCP_NODELAY is set to non-zero
+*/
+{
+  char *tmp = getenv("TENET_TCP_NODELAY");
+
+  if (tmp && atoi(tmp))
+    tr_set_nodelay(fd, 1);
+}
@@ -1,6 +1,8 @@
 #ifndef TRSOURCE_H
 #define TRSOURCE_H
 
+#include <sys/uio.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -19,16 +21,75 @@ int init_tr_source(int fd);
 
 void *read_tr_packet(int fd, int *len);
 /* Effects: reads packet from serial forwarder on file descriptor fd
+     (through its reader, if it has one)
    Returns: the packet read (in newly allocated memory), and *len is
      set to the packet length
 */
 
+#define TR_READER_SIZE 16384	/* initial buffer of a reader */
+
+/* A reader buffers what one read() of fd returns, however many frames
+   that is, so that they can be taken one by one without another
+   system call or a malloc each. Once fd has a reader, read it only
+   through the reader (or read_tr_packet), and drop the reader before
+   closing fd. */
+
+int tr_reader_open(int fd, int hdrlen);
+/* Effects: attaches a buffered reader to fd, for frames with a hdrlen
+     byte (1 or 2) big-endian length; 2 is this protocol, 1 the
+     serial forwarder's
+   Returns: 0 if it is attached, -1 otherwise
+ */
+
+void tr_reader_close(int fd);
+/* Effects: drops the reader of fd, and whatever it has buffered
+ */
+
+int tr_reader_fill(int fd);
+/* Effects: reads once from fd into its reader, as much as there is room
+     for (a select()ed or epoll()ed fd won't block)
+   Returns: the number of bytes read, 0 at end of file, -1 for failure
+ */
+
+void *tr_reader_frame(int fd, int *len);
+/* Effects: takes the next complete frame out of the reader of fd,
+     without reading from fd
+   Returns: the frame, which stays valid until the next fill of fd,
+     and *len is set to its length; or NULL if no complete frame is
+     buffered
+ */
+
 int write_tr_packet(int fd, const void *packet, int len);
 /* Effects: writes len byte packet to serial forwarder on file descriptor
      fd
    Returns: 0 if packet successfully written, -1 otherwise
 */
 
+#define TR_MAX_IOV 8	/* pieces a packet can be written from */
+
+int write_tr_packetv(int fd, const struct iovec *iov, int iovcnt);
+/* Effects: writes the packet made of the iovcnt (up to TR_MAX_IOV)
+     pieces in iov to serial forwarder on file descriptor fd, length
+     included, with one writev() and no copy
+   Returns: 0 if packet successfully written, -1 otherwise
+*/
+
+int tr_set_nodelay(int fd, int on);
+/* Effects: sets (on != 0) or clears TCP_NODELAY on fd
+   Returns: 0 if it is set, -1 otherwise
+*/
+
+int tr_set_cork(int fd, int on);
+/* Effects: sets (on != 0) or clears TCP_CORK (TCP_NOPUSH on BSD) on fd;
+     clearing it sends what was held back
+   Returns: 0 if it is set, -1 otherwise
+*/
+
+void tr_tune_socket(int fd);
+/* Effects: sets TCP_NODELAY on fd if the environment variable
+     TENET_TCP_NODELAY is non-zero; open_tr_source does this already
+*/
+
 #ifdef __cplusplus
 }
 #endif
@@ -49,6 +49,7 @@
 #include "trd_checksum.h"
 #include "tosmsg.h"
 #include "timeval.h"
+#include "timerheap.h"
 #include "trd_interface.h"
 #include "trd_misc.h"
 
@@ -75,7 +76,7 @@ int is_trd_sendReady() {
 }
 
 void polling_trd_timer() {
-    polling_trd_state_timer();
+    timer_heap_fire(&main_timers);
 }
 
 int trd_send(int len, unsigned char *msg) {
@@ -59,11 +59,12 @@ void receive_trd(int sender, int len, unsigned char *msg);
 */
 void trd_init(int sf_fd, uint16_t local_adr);
 
-/* use polling to run and check the trd_timer (trickle timer + alpha)
-    - in the past, trd implemented it's own timing mechanism.
-    - but now, we rely on external polling/triggering to run trd_timer
-    - you must call this frequently enough (at least every 100ms) to run trd.
-    - if you don't trickle timer does not run. */
+/* use polling to run the trd timers (trickle timer + alpha)
+    - the timers are kept in 'main_timers' (timerheap.h); this fires
+      the ones that are due.
+    - if your main loop already runs 'main_timers', you need not call this.
+    - otherwise, you must call this frequently enough (at least every
+      100ms) to run trd. timer_heap_next_ms(&main_timers) says when. */
 void polling_trd_timer();
 
 
@@ -49,6 +49,7 @@
 #include "nx.h"
 #include "tosmsg.h"
 #include "timeval.h"
+#include "timerheap.h"
 #include "trd_state.h"
 #include "trd_seqno.h"
 #include "trd_interface.h"
@@ -65,9 +66,9 @@ unsigned char lastpacket[200];
 TRD_Metadata lastmeta;  // metadata of the last received trd packet
 int m_fast_retx_count;  // fast retransmission count
 
-struct timeval recover_alarm_time;
-struct timeval aging_alarm_time;
-struct timeval init_alarm_time;
+struct timer_event recover_timer;
+struct timer_event aging_timer;
+struct timer_event init_timer;
 struct timeval bootup_time;
 int init_loop_cnt;
 int init_done;
@@ -81,35 +82,30 @@ void read_memory();
 
 
 /********************************************************/
+void recovertimer_fired(void *arg) {
+    read_memory();
+}
 void recovertimer_init() {
-    recover_alarm_time.tv_sec = 0;
-    recover_alarm_time.tv_usec = 0;
+    timer_init(&recover_timer, &main_timers, recovertimer_fired, NULL);
 }
 void recovertimer_start(unsigned long int interval_ms) {
-    struct timeval curr;
-    gettimeofday(&curr, NULL);
-    add_ms_to_timeval(&curr, interval_ms, &recover_alarm_time);
+    timer_start(&recover_timer, interval_ms);
 }
 void recovertimer_stop() {
-    recovertimer_init();
-}
-void recovertimer_fired() {
-    read_memory();
+    timer_stop(&recover_timer);
 }
 /********************************************************/
+void inittimer_fired(void *arg);
 void inittimer_init() {
-    init_alarm_time.tv_sec = 0;
-    init_alarm_time.tv_usec = 0;
+    timer_init(&init_timer, &main_timers, inittimer_fired, NULL);
 }
 void inittimer_start(unsigned long int interval_ms) {
-    struct timeval curr;
-    gettimeofday(&curr, NULL);
-    add_ms_to_timeval(&curr, interval_ms, &init_alarm_time);
+    timer_start(&init_timer, interval_ms);
 }
 void inittimer_stop() {
-    inittimer_init();
+    timer_stop(&init_timer);
 }
-void inittimer_fired() {
+void inittimer_fired(void *arg) {
     inittimer_stop();
     if (m_state == TRD_S_DISCONNECTED) {
         #ifdef DEBUG_TRD_INIT
@@ -146,20 +142,25 @@ void inittimer_fired() {
     }
 }
 /********************************************************/
+void agingtimer_fired(void *arg);
 void agingtimer_init() {
-    aging_alarm_time.tv_sec = 0;
-    aging_alarm_time.tv_usec = 0;
+    timer_init(&aging_timer, &main_timers, agingtimer_fired, NULL);
 }
 void agingtimer_start(unsigned long int interval_ms) {
-    struct timeval curr;
-    gettimeofday(&curr, NULL);
-    add_ms_to_timeval(&curr, interval_ms, &aging_alarm_time);
+    timer_start(&aging_timer, interval_ms);
 }
 void agingtimer_stop() {
-    agingtimer_init();
+    timer_stop(&aging_timer);
 }
-void agingtimer_fired(unsigned long int time_late_ms) {
+void agingtimer_fired(void *arg) {
     unsigned long int age_unittime = TRD_AGE_UNITTIME*1000/1024;
+    unsigned long int time_late_ms = 0;
+    struct timeval curr, diff;
+
+    gettimeofday(&curr, NULL);
+    if (subtract_timeval(&curr, &aging_timer.alarm_time, &diff) == 0)
+        time_late_ms = tv2ms(&diff);
+
     agingtimer_start(age_unittime); // aging time
     do {
         trd_table_incrementAge(&m_table);
@@ -634,27 +635,4 @@ void trd_state_printTableEntry() {
     trd_table_printCacheEntry(&m_table);
 }
 
-void polling_trd_state_timer() {
-    struct timeval curr;
-    gettimeofday(&curr, NULL);
-
-    poll_trickle_timer();
-
-    if (((init_alarm_time.tv_sec > 0) || (init_alarm_time.tv_usec > 0))
-            && (compare_timeval(&init_alarm_time, &curr) <= 0)) {
-        inittimer_fired();
-    }
-    if (((recover_alarm_time.tv_sec > 0) || (recover_alarm_time.tv_usec > 0))
-            && (compare_timeval(&recover_alarm_time, &curr) <= 0)) {
-        recovertimer_fired();
-    }
-    if (((aging_alarm_time.tv_sec > 0) || (aging_alarm_time.tv_usec > 0))
-            && (compare_timeval(&aging_alarm_time, &curr) <= 0)) {
-        struct timeval diff;
-        unsigned long int diff_ms;
-        subtract_timeval(&curr, &aging_alarm_time, &diff);
-        diff_ms = tv2ms(&diff);
-        agingtimer_fired(diff_ms);
-    }
-}
 
@@ -78,7 +78,5 @@ int trd_state_sendReady();
 
 int trd_timer_fired();
 
-void polling_trd_state_timer();
-
 #endif
 
@@ -47,6 +47,7 @@
 #include "trd_timer.h"
 #include "trickle_timer.h"
 #include "timeval.h"
+#include "timerheap.h"
 
 //#define DEBUG_TRD_TIMER
 
@@ -56,17 +57,19 @@ uint8_t  trickleStage;
 uint8_t  trickleSuppress;
 uint8_t  trickleState;
 
-struct timeval trickle_alarm_time;
+struct timer_event trickle_timer;
 
 void trickleReset();
 void trickleSet();
 void trickleStart(unsigned long int interval_ms);
 void trickleStop();
-int trickleFired(int user_id);
+void trickleFired(void *arg);
 
 void trd_timer_init() {
     trickleReset();
-    if ((trickle_alarm_time.tv_sec == 0) && (trickle_alarm_time.tv_usec == 0)) {
+    if (trickle_timer.heap == NULL)
+        timer_init(&trickle_timer, &main_timers, trickleFired, NULL);
+    if (!timer_is_running(&trickle_timer)) {
         trickleStart(TRD_TIMER_PERIOD*1000/1024);
     }
 }
@@ -150,34 +153,20 @@ void trd_timer_printCacheEntry() {
 /* trd_timer_fired(int) function must be implemented by the
    user of this trd_timer algorithm.
 */
-int trickleFired(int user_id) {
+void trickleFired(void *arg) {
     updateCounters();
     if (trickleCountdown <= trickleAnnounce &&
         trickleState == TRD_PRE_PROCESS) {      
         trd_timer_fired();
     }
     trickleStart(TRD_TIMER_PERIOD + (lrand48() % (TRD_TIMER_PERIOD/2)));
-    return 1;
 }
 
 void trickleStart(unsigned long int interval_ms) {
-    struct timeval curr;
-    gettimeofday(&curr, NULL);
-    add_ms_to_timeval(&curr, interval_ms, &trickle_alarm_time);
-    return;
+    timer_start(&trickle_timer, interval_ms);
 }
 
 void trickleStop() {
-    trickle_alarm_time.tv_sec = 0;
-    trickle_alarm_time.tv_usec = 0;
-    return;
-}
-
-void poll_trickle_timer() {
-    struct timeval curr;
-    gettimeofday(&curr, NULL);
-    if (((trickle_alarm_time.tv_sec > 0) || (trickle_alarm_time.tv_usec > 0))
-                && (compare_timeval(&trickle_alarm_time, &curr) <= 0))
-        trickleFired((int)&trickleState);
+    timer_stop(&trickle_timer);
 }
 
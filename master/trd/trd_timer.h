@@ -53,7 +53,5 @@ void trd_timer_reset();
 void trd_timer_set(uint32_t interval);
 void trd_timer_printCacheEntry();
 
-void poll_trickle_timer();
-
 #endif
 
@@ -117,10 +117,6 @@ void receive_trd_fragment(uint16_t sender, int len, unsigned char *msg) {
     receive_trd_transport(nxs(tmsg->tid), sender, len, tmsg->data);
 }
 
-void polling_trd_transport_timer() {
-    polling_trd_timer();
-}
-
 void print_trd_transport_msg(int len, unsigned char *msg) {
     TRD_Msg *rmsg = (TRD_Msg *)msg;
     TRD_FragmentMsg *fmsg = (TRD_FragmentMsg *)rmsg->data;
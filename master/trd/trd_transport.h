@@ -74,12 +74,8 @@ void receive_trd_transport(uint16_t tid, uint16_t sender, int len, unsigned char
 */
 void trd_transport_init(int sf_fd, uint16_t local_addr);
 
-/* use polling to run and check the trd_timer (trickle timer + alpha)
-    - in the past, trd implemented it's own timing mechanism.
-    - but now, we rely on external polling/triggering to run trd_timer
-    - you must call this frequently enough (at least every 100ms) to run trd.
-    - if you don't trickle timer does not run. */
-void polling_trd_transport_timer();
+/* the trd timers (trickle timer + alpha) are kept in 'main_timers'
+   (timerheap.h), which the main loop of the user must run. */
 
 
 //////////////////////////////////////////////////////////////////////////////
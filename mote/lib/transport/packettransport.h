@@ -90,8 +90,6 @@ void packettransport_tid_delete_done(uint16_t tid);
    end-to-end ACK based packet transport */
 int packettransport_send(uint16_t tid, uint16_t addr, uint8_t len, unsigned char* packet);
 
-void polling_packettransport_timer();
-
 void packettransport_terminate();
 
 int packettransport_delete_tid(uint16_t tid);
@@ -125,8 +125,6 @@ void rcrtransport_tid_delete_done(uint16_t tid);
    pass it to this function. */
 void rcrtransport_receive(int len, unsigned char *packet, uint16_t srcAddr);
 
-void polling_rcrtransport_timer();
-
 void rcrt_configure(int setting);
 
 void rcrtransport_terminate();
@@ -102,8 +102,6 @@ void streamtransport_tid_delete_done(uint16_t tid);
    pass it to this function. */
 void streamtransport_receive(int len, unsigned char *packet, uint16_t srcAddr);
 
-void polling_streamtransport_timer();
-
 void streamtransport_terminate();
 
 int streamtransport_delete_tid(uint16_t tid);